@@ -7,64 +7,77 @@ static const R_CMethodDef CEntries[]  = {
 };
 
 static const R_CallMethodDef CallEntries[] = {
-  {"Cpp_BW", (DL_FUNC) &_collapse_BWCpp, 10},
-  {"Cpp_BWm", (DL_FUNC) &_collapse_BWmCpp, 10},
-  {"Cpp_BWl", (DL_FUNC) &_collapse_BWlCpp, 10},
+  {"Cpp_BW", (DL_FUNC) &_collapse_BWCpp, 12},
+  {"Cpp_BWm", (DL_FUNC) &_collapse_BWmCpp, 12},
+  {"Cpp_BWl", (DL_FUNC) &_collapse_BWlCpp, 12},
+  {"Cpp_HDW", (DL_FUNC) &_collapse_HDWCpp, 8},
   {"C_TRA", (DL_FUNC) &TRAC, 5},
   {"C_TRAm", (DL_FUNC) &TRAmC, 5},
   {"C_TRAl", (DL_FUNC) &TRAlC, 5},
   {"C_fndistinct", (DL_FUNC) &fndistinctC, 4},
   {"C_fndistinctl", (DL_FUNC) &fndistinctlC, 5},
   {"C_fndistinctm", (DL_FUNC) &fndistinctmC, 5},
+  {"C_fndistinct_hll", (DL_FUNC) &fndistinct_hllC, 6},
+  {"C_hll_sketch", (DL_FUNC) &hll_sketchC, 5},
+  {"C_hll_merge", (DL_FUNC) &hll_mergeC, 4},
+  {"C_hll_estimate", (DL_FUNC) &hll_estimateC, 1},
   {"Cpp_pwnobsm", (DL_FUNC) &_collapse_pwnobsmCpp, 1},
-  {"C_fnobs", (DL_FUNC) &fnobsC, 3},
-  {"C_fnobsm", (DL_FUNC) &fnobsmC, 4},
-  {"C_fnobsl", (DL_FUNC) &fnobslC, 4},
+  {"C_fnobs", (DL_FUNC) &fnobsC, 4},
+  {"C_fnobsm", (DL_FUNC) &fnobsmC, 5},
+  {"C_fnobsl", (DL_FUNC) &fnobslC, 5},
   {"Cpp_varying", (DL_FUNC) &_collapse_varyingCpp, 4},
   {"Cpp_varyingm", (DL_FUNC) &_collapse_varyingmCpp, 5},
   {"Cpp_varyingl", (DL_FUNC) &_collapse_varyinglCpp, 5},
   {"Cpp_fbstats", (DL_FUNC) &_collapse_fbstatsCpp, 11},
   {"Cpp_fbstatsm", (DL_FUNC) &_collapse_fbstatsmCpp, 10},
   {"Cpp_fbstatsl", (DL_FUNC) &_collapse_fbstatslCpp, 10},
-  {"C_ffirst", (DL_FUNC) &ffirstC, 5},
-  {"C_ffirstm", (DL_FUNC) &ffirstmC, 6},
-  {"C_ffirstl", (DL_FUNC) &ffirstlC, 5},
+  {"C_ffirst", (DL_FUNC) &ffirstC, 6},
+  {"C_ffirstm", (DL_FUNC) &ffirstmC, 7},
+  {"C_ffirstl", (DL_FUNC) &ffirstlC, 6},
   {"Cpp_fdiffgrowth", (DL_FUNC) &_collapse_fdiffgrowthCpp, 12},
   {"Cpp_fdiffgrowthm", (DL_FUNC) &_collapse_fdiffgrowthmCpp, 12},
   {"Cpp_fdiffgrowthl", (DL_FUNC) &_collapse_fdiffgrowthlCpp, 12},
   {"Cpp_flaglead", (DL_FUNC) &_collapse_flagleadCpp, 7},
   {"Cpp_flagleadm", (DL_FUNC) &_collapse_flagleadmCpp, 7},
   {"Cpp_flagleadl", (DL_FUNC) &_collapse_flagleadlCpp, 7},
-  {"C_flast", (DL_FUNC) &flastC, 4},
-  {"C_flastm", (DL_FUNC) &flastmC, 5},
-  {"C_flastl", (DL_FUNC) &flastlC, 4},
-  {"C_fmin", (DL_FUNC) &fminC, 4},
-  {"C_fminm", (DL_FUNC) &fminmC, 5},
-  {"C_fminl", (DL_FUNC) &fminlC, 5},
-  {"C_fmax", (DL_FUNC) &fmaxC, 4},
-  {"C_fmaxm", (DL_FUNC) &fmaxmC, 5},
-  {"C_fmaxl", (DL_FUNC) &fmaxlC, 5},
+  {"C_flast", (DL_FUNC) &flastC, 5},
+  {"C_flastm", (DL_FUNC) &flastmC, 6},
+  {"C_flastl", (DL_FUNC) &flastlC, 5},
+  {"C_fmin", (DL_FUNC) &fminC, 5},
+  {"C_fminm", (DL_FUNC) &fminmC, 6},
+  {"C_fminl", (DL_FUNC) &fminlC, 6},
+  {"C_fmax", (DL_FUNC) &fmaxC, 5},
+  {"C_fmaxm", (DL_FUNC) &fmaxmC, 6},
+  {"C_fmaxl", (DL_FUNC) &fmaxlC, 6},
   {"C_fmean", (DL_FUNC) &fmeanC, 7},
   {"C_fmeanm", (DL_FUNC) &fmeanmC, 8},
   {"C_fmeanl", (DL_FUNC) &fmeanlC, 8},
+  {"C_fmultistatl", (DL_FUNC) &fmultistatlC, 7},
   {"Cpp_fnth", (DL_FUNC) &_collapse_fnthCpp, 9},
   {"Cpp_fnthm", (DL_FUNC) &_collapse_fnthmCpp, 10},
   {"Cpp_fnthl", (DL_FUNC) &_collapse_fnthlCpp, 10},
+  {"Cpp_fnthtdigest", (DL_FUNC) &_collapse_fnthtdigestCpp, 8},
+  {"Cpp_tdigest", (DL_FUNC) &_collapse_tdigestCpp, 7},
+  {"Cpp_tdigestmerge", (DL_FUNC) &_collapse_tdigestmergeCpp, 5},
+  {"Cpp_tdigestquantile", (DL_FUNC) &_collapse_tdigestquantileCpp, 2},
   {"C_fmode", (DL_FUNC) &fmodeC, 6},
   {"C_fmodem", (DL_FUNC) &fmodemC, 7},
   {"C_fmodel", (DL_FUNC) &fmodelC, 6},
   {"C_fprod", (DL_FUNC) &fprodC, 5},
   {"C_fprodm", (DL_FUNC) &fprodmC, 6},
   {"C_fprodl", (DL_FUNC) &fprodlC, 6},
-  {"Cpp_fscale", (DL_FUNC) &_collapse_fscaleCpp, 7},
-  {"Cpp_fscalem", (DL_FUNC) &_collapse_fscalemCpp, 7},
-  {"Cpp_fscalel", (DL_FUNC) &_collapse_fscalelCpp, 7},
+  {"Cpp_fscale", (DL_FUNC) &_collapse_fscaleCpp, 9},
+  {"Cpp_fscalem", (DL_FUNC) &_collapse_fscalemCpp, 9},
+  {"Cpp_fscalel", (DL_FUNC) &_collapse_fscalelCpp, 9},
   {"C_fsum", (DL_FUNC) &fsumC, 6},
   {"C_fsumm", (DL_FUNC) &fsummC, 7},
   {"C_fsuml", (DL_FUNC) &fsumlC, 7},
-  {"Cpp_fvarsd", (DL_FUNC) &_collapse_fvarsdCpp, 8},
-  {"Cpp_fvarsdm", (DL_FUNC) &_collapse_fvarsdmCpp, 9},
-  {"Cpp_fvarsdl", (DL_FUNC) &_collapse_fvarsdlCpp, 9},
+  {"C_set_sum_accuracy", (DL_FUNC) &setsumaccC, 1},
+  {"C_set_deterministic", (DL_FUNC) &setdetC, 1},
+  {"C_set_gpart_mingroups", (DL_FUNC) &setgpartminC, 1},
+  {"Cpp_fvarsd", (DL_FUNC) &_collapse_fvarsdCpp, 9},
+  {"Cpp_fvarsdm", (DL_FUNC) &_collapse_fvarsdmCpp, 10},
+  {"Cpp_fvarsdl", (DL_FUNC) &_collapse_fvarsdlCpp, 10},
   {"Cpp_mrtl", (DL_FUNC) &_collapse_mrtl, 3},
   {"Cpp_mctl", (DL_FUNC) &_collapse_mctl, 3},
   {"Cpp_psmat", (DL_FUNC) &_collapse_psmatCpp, 4},
@@ -106,7 +119,9 @@ static const R_CallMethodDef CallEntries[] = {
   {"C_group", (DL_FUNC) &groupVec, 3},
   {"C_groupat", (DL_FUNC) &groupAtVec, 3},
   {"C_funique", (DL_FUNC) &funiqueC, 1},
+  {"C_set_group_cache", (DL_FUNC) &setgroupcacheC, 1},
   {"C_radixsort", (DL_FUNC) &Cradixsort, 6},
+  {"C_set_group_threads", (DL_FUNC) &setgroupthreadsC, 1},
   {"C_frankds", (DL_FUNC) &frankds, 4},
   {"C_pacf1", (DL_FUNC) &pacf1, 2},
   {"C_rbindlist", (DL_FUNC) &rbindlist, 4},
@@ -27,29 +27,18 @@
 #include "base_radixsort.h"
 
 
-// gs = groupsizes e.g.23, 12, 87, 2, 1, 34,...
-static int *gs[2] = { NULL };
-//two vectors flip flopped:flip and 1 - flip
-static int flip = 0;
-//allocated stack size
-static int gsalloc[2] = { 0 };
-static int gsngrp[2] = { 0 };
-//max grpn so far
-static int gsmax[2] = { 0 };
-//max size of stack, set by do_radixsort to nrows
-static int gsmaxalloc = 0;
-//switched off for last arg unless retGrp==TRUE
-static Rboolean stackgrps = TRUE;
+/* The state of the sort of integers and doubles (group sizes stack,
+ na.last and order, counts and working memory) is kept in a radix_ctx
+ (see base_radixsort.h), which is passed to all routines below. Several
+ threads can thus sort at the same time, each with its own context (see
+ radix_order_ctx() at the end of this file). do_radixsort uses a static
+ context. The sort of strings uses R's global CHARSXP cache (TRUELENGTH),
+ and its working memory below remains global. */
+
+// the context of do_radixsort: Cradixsort is only called from R
+static radix_ctx rctx = { .stackgrps = TRUE, .nalast = -1, .order = 1, .nthreads = 1 };
 // TRUE for setkey, FALSE for by=
 static Rboolean sortStr = TRUE;
-// used by do_radixsort and [i|d|c]sort to reorder order.
-// not needed if narg==1
-static int *newo = NULL;
-// =1, 0, -1 for TRUE, NA, FALSE respectively.
-// Value rewritten inside do_radixsort().
-static int nalast = -1;
-// =1, -1 for ascending and descending order respectively
-static int order = 1;
 
 //replaced n < 200 with n < N_SMALL.Easier to change later
 #define N_SMALL 200
@@ -124,62 +113,62 @@ static void savetl(SEXP s)
 /* use malloc/realloc (not Calloc/Realloc) so we can trap errors
  and call savetl_end() before the error(). */
 
-static void growstack(uint64_t newlen)
+static void growstack(radix_ctx *ctx, uint64_t newlen)
 {
   // no link to icount range restriction,
   // just 100,000 seems a good minimum at 0.4MB
   if (newlen == 0) newlen = 100000;
-  if (newlen > gsmaxalloc) newlen = gsmaxalloc;
-  gs[flip] = realloc(gs[flip], newlen * sizeof(int));
-  if (gs[flip] == NULL)
+  if (newlen > ctx->gsmaxalloc) newlen = ctx->gsmaxalloc;
+  ctx->gs[ctx->flip] = realloc(ctx->gs[ctx->flip], newlen * sizeof(int));
+  if (ctx->gs[ctx->flip] == NULL)
     Error("Failed to realloc working memory stack to %d*4bytes (flip=%d)",
-          (int)newlen /* no bigger than gsmaxalloc */, flip);
-  gsalloc[flip] = (int)newlen;
+          (int)newlen /* no bigger than gsmaxalloc */, ctx->flip);
+  ctx->gsalloc[ctx->flip] = (int)newlen;
 }
 
-static void push(int x)
+static void push(radix_ctx *ctx, int x)
 {
-  if (!stackgrps || x == 0)
+  if (!ctx->stackgrps || x == 0)
     return;
-  if (gsalloc[flip] == gsngrp[flip])
-    growstack((uint64_t)(gsngrp[flip]) * 2);
-  gs[flip][gsngrp[flip]++] = x;
-  if (x > gsmax[flip])
-    gsmax[flip] = x;
+  if (ctx->gsalloc[ctx->flip] == ctx->gsngrp[ctx->flip])
+    growstack(ctx, (uint64_t)(ctx->gsngrp[ctx->flip]) * 2);
+  ctx->gs[ctx->flip][ctx->gsngrp[ctx->flip]++] = x;
+  if (x > ctx->gsmax[ctx->flip])
+    ctx->gsmax[ctx->flip] = x;
 }
 
-static void mpush(int x, int n)
+static void mpush(radix_ctx *ctx, int x, int n)
 {
-  if (!stackgrps || x == 0)
+  if (!ctx->stackgrps || x == 0)
     return;
-  if (gsalloc[flip] < gsngrp[flip] + n)
-    growstack(((uint64_t)(gsngrp[flip]) + n) * 2);
+  if (ctx->gsalloc[ctx->flip] < ctx->gsngrp[ctx->flip] + n)
+    growstack(ctx, ((uint64_t)(ctx->gsngrp[ctx->flip]) + n) * 2);
   for (int i = 0; i != n; ++i)
-    gs[flip][gsngrp[flip]++] = x;
-  if (x > gsmax[flip])
-    gsmax[flip] = x;
+    ctx->gs[ctx->flip][ctx->gsngrp[ctx->flip]++] = x;
+  if (x > ctx->gsmax[ctx->flip])
+    ctx->gsmax[ctx->flip] = x;
 }
 
-static void flipflop()
+static void flipflop(radix_ctx *ctx)
 {
-  flip = 1 - flip;
-  gsngrp[flip] = 0;
-  gsmax[flip] = 0;
-  if (gsalloc[flip] < gsalloc[1 - flip])
-    growstack((uint64_t)(gsalloc[1 - flip]) * 2);
+  ctx->flip = 1 - ctx->flip;
+  ctx->gsngrp[ctx->flip] = 0;
+  ctx->gsmax[ctx->flip] = 0;
+  if (ctx->gsalloc[ctx->flip] < ctx->gsalloc[1 - ctx->flip])
+    growstack(ctx, (uint64_t)(ctx->gsalloc[1 - ctx->flip]) * 2);
 }
 
-static void gsfree()
+static void gsfree(radix_ctx *ctx)
 {
-  free(gs[0]);
-  free(gs[1]);
-  gs[0] = NULL;
-  gs[1] = NULL;
-  flip = 0;
-  gsalloc[0] = gsalloc[1] = 0;
-  gsngrp[0] = gsngrp[1] = 0;
-  gsmax[0] = gsmax[1] = 0;
-  gsmaxalloc = 0;
+  free(ctx->gs[0]);
+  free(ctx->gs[1]);
+  ctx->gs[0] = NULL;
+  ctx->gs[1] = NULL;
+  ctx->flip = 0;
+  ctx->gsalloc[0] = ctx->gsalloc[1] = 0;
+  ctx->gsngrp[0] = ctx->gsngrp[1] = 0;
+  ctx->gsmax[0] = ctx->gsmax[1] = 0;
+  ctx->gsmaxalloc = 0;
 }
 
 #ifdef TIMING_ON
@@ -196,69 +185,74 @@ static int nblock[NBLOCK];
 #define TEND(i)
 #endif
 
-static int range, xmin; // used by both icount and do_radixsort
-static void setRange(int *x, int n)
+static void setRange(radix_ctx *ctx, int *x, int n)
 {
-  xmin = NA_INTEGER;
+  ctx->xmin = NA_INTEGER;
   int xmax = NA_INTEGER;
   double overflow;
 
   int i = 0;
   while(i < n && x[i] == NA_INTEGER) i++;
-  if (i < n) xmax = xmin = x[i];
+  if (i < n) xmax = ctx->xmin = x[i];
   for (; i != n; ++i) {
     int tmp = x[i];
     if (tmp == NA_INTEGER)
       continue;
     if (tmp > xmax)
       xmax = tmp;
-    else if (tmp < xmin)
-      xmin = tmp;
+    else if (tmp < ctx->xmin)
+      ctx->xmin = tmp;
   }
   // all NAs, nothing to do
-  if (xmin == NA_INTEGER) {
-    range = NA_INTEGER;
+  if (ctx->xmin == NA_INTEGER) {
+    ctx->range = NA_INTEGER;
     return;
   }
   // ex: x=c(-2147483647L, NA_integer_, 1L) results in overflowing int range.
-  overflow = (double) xmax - (double) xmin + 1;
+  overflow = (double) xmax - (double) ctx->xmin + 1;
   // detect and force iradix here, since icount is out of the picture
   if (overflow > INT_MAX) {
-    range = INT_MAX;
+    ctx->range = INT_MAX;
     return;
   }
 
-  range = xmax - xmin + 1;
+  ctx->range = xmax - ctx->xmin + 1;
 
   return;
 }
 
 // x*order results in integer overflow when -1*NA,
 // so careful to avoid that here :
-static inline int icheck(int x)
+static inline int icheck(radix_ctx *ctx, int x)
 {
   // if nalast == 1, NAs must go last.
-  return ((nalast != 1) ? ((x != NA_INTEGER) ? x*order : x) :
-            ((x != NA_INTEGER) ? (x*order) - 1 : INT_MAX));
+  return ((ctx->nalast != 1) ? ((x != NA_INTEGER) ? x*ctx->order : x) :
+            ((x != NA_INTEGER) ? (x*ctx->order) - 1 : INT_MAX));
 }
 
 
-static void icount(int *x, int *o, int n)
+static void icount(radix_ctx *ctx, int *x, int *o, int n)
   /* Counting sort:
    1. Places the ordering into o directly, overwriting whatever was there
    2. Doesn't change x
    3. Pushes group sizes onto stack
    */
 {
-  int napos = range; // NA's always counted in last bin
-  // static is IMPORTANT, counting sort is called repetitively.
-  static unsigned int counts[N_RANGE + 1] = { 0 };
+  int napos = ctx->range; // NA's always counted in last bin
+  // kept in the context, counting sort is called repetitively.
+  if (ctx->icounts == NULL) {
+    ctx->icounts = (unsigned int *) calloc(N_RANGE + 1, sizeof(unsigned int));
+    if (ctx->icounts == NULL)
+      Error("Failed to allocate working memory for counting sort. Requested %d * %d bytes",
+            N_RANGE + 1, sizeof(unsigned int));
+  }
+  unsigned int *counts = ctx->icounts;
   /* counts are set back to 0 at the end efficiently. 1e5 = 0.4MB i.e
    tiny. We'll only use the front part of it, as large as range. So it's
    just reserving space, not using it. Have defined N_RANGE to be 100000.*/
-  if (range > N_RANGE)
+  if (ctx->range > N_RANGE)
     Error("Internal error: range = %d; isorted cannot handle range > %d",
-          range, N_RANGE);
+          ctx->range, N_RANGE);
   for (int i = 0; i != n; ++i) {
     // For nalast=NA case, we won't remove/skip NAs, rather set 'o' indices
     // to 0. subset will skip them. We can't know how many NAs to skip
@@ -266,39 +260,39 @@ static void icount(int *x, int *o, int n)
     if (x[i] == NA_INTEGER)
       counts[napos]++;
     else
-      counts[x[i] - xmin]++;
+      counts[x[i] - ctx->xmin]++;
   }
 
   int tmp = 0;
-  if (nalast != 1 && counts[napos]) {
-    push(counts[napos]);
+  if (ctx->nalast != 1 && counts[napos]) {
+    push(ctx, counts[napos]);
     tmp += counts[napos];
   }
-  int w = (order==1) ? 0 : range-1;
-  for (int i = 0; i != range; ++i)
+  int w = (ctx->order==1) ? 0 : ctx->range-1;
+  for (int i = 0; i != ctx->range; ++i)
     /* no point in adding tmp < n && i <= range, since range includes max,
      need to go to max, unlike 256 loops elsewhere in radixsort.c */
   {
     if (counts[w]) {
       // cumulate but not through 0's.
       // Helps resetting zeros when n < range, below.
-      push(counts[w]);
+      push(ctx, counts[w]);
       counts[w] = (tmp += counts[w]);
     }
-    w += order; // order is +1 or -1
+    w += ctx->order; // order is +1 or -1
   }
-  if (nalast == 1 && counts[napos]) {
-    push(counts[napos]);
+  if (ctx->nalast == 1 && counts[napos]) {
+    push(ctx, counts[napos]);
     counts[napos] = (tmp += counts[napos]);
   }
   for (int i = n - 1; i >= 0; i--) {
     // This way na.last=TRUE/FALSE cases will have just a
     // single if-check overhead.
     o[--counts[(x[i] == NA_INTEGER) ? napos :
-    x[i] - xmin]] = (int) (i + 1);
+    x[i] - ctx->xmin]] = (int) (i + 1);
   }
   // nalast = 1, -1 are both taken care already.
-  if (nalast == 0)
+  if (ctx->nalast == 0)
     // nalast = 0 is dealt with separately as it just sets o to 0
     for (int i = 0; i != n; ++i)
       o[i] = (x[o[i] - 1] == NA_INTEGER) ? 0 : o[i];
@@ -306,20 +300,20 @@ static void icount(int *x, int *o, int n)
 
   /* counts were cumulated above so leaves non zero.
    Faster to clear up now ready for next time. */
-  if (n < range) {
+  if (n < ctx->range) {
     /* Many zeros in counts already. Loop through n instead,
      doesn't matter if we set to 0 several times on any repeats */
     counts[napos] = 0;
     for (int i = 0; i != n; ++i) {
       if (x[i] != NA_INTEGER)
-        counts[x[i] - xmin] = 0;
+        counts[x[i] - ctx->xmin] = 0;
     }
   } else
-    memset(counts, 0, (range + 1) * sizeof(int));
+    memset(counts, 0, (ctx->range + 1) * sizeof(int));
   return;
 }
 
-static void iinsert(int *x, int *o, int n)
+static void iinsert(radix_ctx *ctx, int *x, int *o, int n)
   /*  orders both x and o by reference in-place. Fast for small vectors,
    low overhead.  don't be tempted to binsearch backwards here, have
    to shift anyway; many memmove would have overhead and do the same
@@ -345,11 +339,11 @@ static void iinsert(int *x, int *o, int n)
   for (int i = 1; i != n; ++i) {
     if (x[i] == x[i - 1]) tt++;
     else {
-      push(tt + 1);
+      push(ctx, tt + 1);
       tt = 0;
     }
   }
-  push(tt + 1); // INCLUDED ??
+  push(ctx, tt + 1); // INCLUDED ??
 }
 
 /*
@@ -383,79 +377,105 @@ static void iinsert(int *x, int *o, int n)
  there is wide random access in each LSD radix pass, though.
  */
 
-// 4 are used for iradix, 8 for dradix and i64radix
-static unsigned int radixcounts[8][257] = { {0} };
+/* radixcounts, skip and radix_xsub are in the context because iradix and
+ iradix_r interact and are called repetitively. counts are set back to 0
+ after each use, to benefit from skipped radix. */
 
-static int skip[8];
-/* global because iradix and iradix_r interact and are called repetitively.
- counts are set back to 0 after each use, to benefit from skipped radix. */
-static void *radix_xsub = NULL;
-static size_t radix_xsuballoc = 0;
-
-static int *otmp = NULL, otmp_alloc = 0;
-static void alloc_otmp(int n)
+static void alloc_otmp(radix_ctx *ctx, int n)
 {
-  if (otmp_alloc >= n)
+  if (ctx->otmp_alloc >= n)
     return;
-  otmp = (int *) realloc(otmp, n * sizeof(int));
-  if (otmp == NULL)
+  ctx->otmp = (int *) realloc(ctx->otmp, n * sizeof(int));
+  if (ctx->otmp == NULL)
     Error("Failed to allocate working memory for otmp. Requested %d * %d bytes",
           n, sizeof(int));
-  otmp_alloc = n;
+  ctx->otmp_alloc = n;
 }
 
 // TO DO: save xtmp if possible, see allocs in do_radixsort
-static void *xtmp = NULL;
-static int xtmp_alloc = 0;
 // TO DO: currently always the largest type (double) but
 //        could be int if that's all that's needed
-static void alloc_xtmp(int n)
+static void alloc_xtmp(radix_ctx *ctx, int n)
 {
-  if (xtmp_alloc >= n)
+  if (ctx->xtmp_alloc >= n)
     return;
-  xtmp = (double *) realloc(xtmp, n * sizeof(double));
-  if (xtmp == NULL)
+  ctx->xtmp = (double *) realloc(ctx->xtmp, n * sizeof(double));
+  if (ctx->xtmp == NULL)
     Error("Failed to allocate working memory for xtmp. Requested %d * %d bytes",
           n, sizeof(double));
-  xtmp_alloc = n;
+  ctx->xtmp_alloc = n;
 }
 
-static void iradix_r(int *xsub, int *osub, int n, int radix);
+/*
+ Multithreading: with set_group_threads(nthreads > 1), the passes of iradix
+ and dradix over the whole input (the parallel histogramming pass and the
+ scatter on the most significant non-skipped radix) are split into nth
+ contiguous chunks of x. Each thread counts its chunk into its own histograms,
+ and scatters its chunk starting at the bucket start plus the counts of the
+ preceding chunks, which gives exactly the (stable) order of the serial pass.
+ The recursion into the buckets is serial, as it uses the working memory of
+ the context. ctx->nthreads is set from group_nthreads by do_radixsort and
+ Cdoubleradixsort, and is 1 in radix_order_ctx(), which is typically called
+ from multiple threads already.
+ */
+int group_nthreads = 1; // also used by the hash grouping in kit_dup.c
+// minimum number of elements for a multithreaded pass
+#define N_PAR 100000
 
-static void iradix(int *x, int *o, int n)
+SEXP setgroupthreadsC(SEXP x)
+{
+  int old = group_nthreads, nth = asInteger(x);
+  if (nth == NA_INTEGER || nth < 1)
+    error("nthreads must be a positive integer");
+  group_nthreads = nth;
+  return ScalarInteger(old);
+}
+
+static unsigned int *radix_par_count(radix_ctx *ctx, void *x, int n, int nradix, int nth);
+static void radix_par_scatter(radix_ctx *ctx, void *x, int *o, int n, int radix, int nradix, int nth,
+                              unsigned int *thiscounts, unsigned int *tcounts);
+
+static void iradix_r(radix_ctx *ctx, int *xsub, int *osub, int n, int radix);
+
+static void iradix(radix_ctx *ctx, int *x, int *o, int n)
   /* As icount :
    Places the ordering into o directly, overwriting whatever was there
    Doesn't change x
    Pushes group sizes onto stack */
 {
   int nextradix, itmp, thisgrpn, maxgrpn;
-  unsigned int thisx = 0, shift, *thiscounts;
+  unsigned int thisx = 0, shift, *thiscounts, *tcounts = NULL;
+  const int nth = (n >= N_PAR) ? ctx->nthreads : 1;
 
-  for (int i = 0; i != n; ++i) {
+  if (nth > 1) {
+    tcounts = radix_par_count(ctx, x, n, 4, nth);
+    thisx = (unsigned int) (icheck(ctx, x[n - 1])) - INT_MIN;
+  } else for (int i = 0; i != n; ++i) {
     /* parallel histogramming pass; i.e. count occurrences of
      0:255 in each byte.  Sequential so almost negligible. */
     // relies on overflow behaviour. And shouldn't -INT_MIN be up in iradix?
-    thisx = (unsigned int) (icheck(x[i])) - INT_MIN;
+    thisx = (unsigned int) (icheck(ctx, x[i])) - INT_MIN;
     // unrolled since inside n-loop
-    radixcounts[0][thisx & 0xFF]++;
-    radixcounts[1][thisx >> 8 & 0xFF]++;
-    radixcounts[2][thisx >> 16 & 0xFF]++;
-    radixcounts[3][thisx >> 24 & 0xFF]++;
+    ctx->radixcounts[0][thisx & 0xFF]++;
+    ctx->radixcounts[1][thisx >> 8 & 0xFF]++;
+    ctx->radixcounts[2][thisx >> 16 & 0xFF]++;
+    ctx->radixcounts[3][thisx >> 24 & 0xFF]++;
   }
   for (int radix = 0; radix < 4; radix++) {
     /* any(count == n) => all radix must have been that value =>
      last x (still thisx) was that value */
     int i = thisx >> (radix*8) & 0xFF;
-    skip[radix] = radixcounts[radix][i] == n;
+    ctx->skip[radix] = ctx->radixcounts[radix][i] == n;
     // clear it now, the other counts must be 0 already
-    if (skip[radix])
-      radixcounts[radix][i] = 0;
+    if (ctx->skip[radix])
+      ctx->radixcounts[radix][i] = 0;
   }
 
   int radix = 3;  // MSD
-  while (radix >= 0 && skip[radix]) radix--;
+  while (radix >= 0 && ctx->skip[radix]) radix--;
   if (radix == -1) { // All radix are skipped; one number repeated n times.
-    if (nalast == 0 && x[0] == NA_INTEGER)
+    free(tcounts);
+    if (ctx->nalast == 0 && x[0] == NA_INTEGER)
       // all values are identical. return 0 if nalast=0 & all NA
       // because of 'return', have to take care of it here.
       for (int i = 0; i != n; ++i)
@@ -463,17 +483,17 @@ static void iradix(int *x, int *o, int n)
     else
       for (int i = 0; i != n; ++i)
         o[i] = (i + 1);
-    push(n);
+    push(ctx, n);
     return;
   }
   for (int i = radix - 1; i >= 0; i--) {
-    if (!skip[i])
-      memset(radixcounts[i], 0, 257 * sizeof(unsigned int));
+    if (!ctx->skip[i])
+      memset(ctx->radixcounts[i], 0, 257 * sizeof(unsigned int));
     /* clear the counts as we only needed the parallel pass for skip[]
      and we're going to use radixcounts again below. Can't use parallel
      lower counts in MSD radix, unlike LSD. */
   }
-  thiscounts = radixcounts[radix];
+  thiscounts = ctx->radixcounts[radix];
   shift = radix * 8;
 
   itmp = thiscounts[0];
@@ -487,32 +507,35 @@ static void iradix(int *x, int *o, int n)
       thiscounts[i] = (itmp += thisgrpn);
     }
   }
-  for (int i = n - 1; i >= 0; i--) {
-    thisx = ((unsigned int) (icheck(x[i])) - INT_MIN) >> shift & 0xFF;
+  if (nth > 1) {
+    radix_par_scatter(ctx, x, o, n, radix, 4, nth, thiscounts, tcounts);
+    free(tcounts);
+  } else for (int i = n - 1; i >= 0; i--) {
+    thisx = ((unsigned int) (icheck(ctx, x[i])) - INT_MIN) >> shift & 0xFF;
     o[--thiscounts[thisx]] = i + 1;
   }
 
-  if (radix_xsuballoc < maxgrpn) {
+  if (ctx->radix_xsuballoc < maxgrpn) {
     // The largest group according to the first non-skipped radix,
     // so could be big (if radix is needed on first arg)
     // TO DO: could include extra bits to divide the first radix
     // up more. Often the MSD has groups in just 0-4 out of 256.
     // free'd at the end of do_radixsort once we're done calling iradix
     // repetitively
-    radix_xsub = (int *) realloc(radix_xsub, maxgrpn * sizeof(double));
-    if (!radix_xsub)
+    ctx->radix_xsub = (int *) realloc(ctx->radix_xsub, maxgrpn * sizeof(double));
+    if (!ctx->radix_xsub)
       Error("Failed to realloc working memory %d*8bytes (xsub in iradix), radix=%d",
             maxgrpn, radix);
-    radix_xsuballoc = maxgrpn;
+    ctx->radix_xsuballoc = maxgrpn;
   }
 
   // TO DO: can we leave this to do_radixsort and remove these calls??
-  alloc_otmp(maxgrpn);
+  alloc_otmp(ctx, maxgrpn);
   // TO DO: doesn't need to be sizeof(double) always, see inside
-  alloc_xtmp(maxgrpn);
+  alloc_xtmp(ctx, maxgrpn);
 
   nextradix = radix - 1;
-  while (nextradix >= 0 && skip[nextradix]) nextradix--;
+  while (nextradix >= 0 && ctx->skip[nextradix]) nextradix--;
   if (thiscounts[0] != 0)
     Error("Internal error. thiscounts[0]=%d but should have been decremented to 0. dradix=%d",
           thiscounts[0], radix);
@@ -523,19 +546,19 @@ static void iradix(int *x, int *o, int n)
     // undo cumulate; i.e. diff
     thisgrpn = thiscounts[i] - itmp;
     if (thisgrpn == 1 || nextradix == -1) {
-      push(thisgrpn);
+      push(ctx, thisgrpn);
     } else {
       for (int j = 0; j != thisgrpn; ++j)
         // this is why this xsub here can't be the same memory as
         // xsub in do_radixsort.
-        ((int *)radix_xsub)[j] = icheck(x[o[itmp+j]-1]);
+        ((int *)ctx->radix_xsub)[j] = icheck(ctx, x[o[itmp+j]-1]);
       // changes xsub and o by reference recursively.
-      iradix_r(radix_xsub, o+itmp, thisgrpn, nextradix);
+      iradix_r(ctx, ctx->radix_xsub, o+itmp, thisgrpn, nextradix);
     }
     itmp = thiscounts[i];
     thiscounts[i] = 0;
   }
-  if (nalast == 0) // nalast = 1, -1 are both taken care already.
+  if (ctx->nalast == 0) // nalast = 1, -1 are both taken care already.
     // nalast = 0 is dealt with separately as it just sets o to 0
     for (int i = 0; i != n; ++i)
       o[i] = (x[o[i] - 1] == NA_INTEGER) ? 0 : o[i];
@@ -543,7 +566,7 @@ static void iradix(int *x, int *o, int n)
   // modified by reference unlike iinsert or iradix_r
 }
 
-static void iradix_r(int *xsub, int *osub, int n, int radix)
+static void iradix_r(radix_ctx *ctx, int *xsub, int *osub, int n, int radix)
   // xsub is a recursive offset into xsub working memory above in
   // iradix, reordered by reference.  osub is a an offset into the main
   // answer o, reordered by reference.  radix iterates 3,2,1,0
@@ -557,12 +580,12 @@ static void iradix_r(int *xsub, int *osub, int n, int radix)
   // unlikely.  when nalast==0, iinsert will be called only from
   // within iradix.
   if (n < N_SMALL) {
-    iinsert(xsub, osub, n);
+    iinsert(ctx, xsub, osub, n);
     return;
   }
 
   shift = radix * 8;
-  thiscounts = radixcounts[radix];
+  thiscounts = ctx->radixcounts[radix];
 
   for (int i = 0; i != n; ++i) {
     thisx = (unsigned int) xsub[i] - INT_MIN; // sequential in xsub
@@ -576,14 +599,14 @@ static void iradix_r(int *xsub, int *osub, int n, int radix)
   for (int i = n - 1; i >= 0; i--) {
     thisx = ((unsigned int) xsub[i] - INT_MIN) >> shift & 0xFF;
     j = --thiscounts[thisx];
-    otmp[j] = osub[i];
-    ((int *) xtmp)[j] = xsub[i];
+    ctx->otmp[j] = osub[i];
+    ((int *) ctx->xtmp)[j] = xsub[i];
   }
-  memcpy(osub, otmp, n * sizeof(int));
-  memcpy(xsub, xtmp, n * sizeof(int));
+  memcpy(osub, ctx->otmp, n * sizeof(int));
+  memcpy(xsub, ctx->xtmp, n * sizeof(int));
 
   nextradix = radix - 1;
-  while (nextradix >= 0 && skip[nextradix]) nextradix--;
+  while (nextradix >= 0 && ctx->skip[nextradix]) nextradix--;
   /* TO DO: If nextradix == -1 AND no further args from do_radixsort AND
    !retGrp, we're done. We have o. Remember to memset thiscounts
    before returning. */
@@ -598,9 +621,9 @@ static void iradix_r(int *xsub, int *osub, int n, int radix)
       continue;
     thisgrpn = thiscounts[i] - itmp;        // undo cummulate; i.e. diff
     if (thisgrpn == 1 || nextradix == -1) {
-      push(thisgrpn);
+      push(ctx, thisgrpn);
     } else {
-      iradix_r(xsub+itmp, osub+itmp, thisgrpn, nextradix);
+      iradix_r(ctx, xsub+itmp, osub+itmp, thisgrpn, nextradix);
     }
     itmp = thiscounts[i];
     thiscounts[i] = 0;
@@ -611,50 +634,48 @@ static void iradix_r(int *xsub, int *osub, int n, int radix)
 // + changed to MSD and hooked into do_radixsort framework here.
 // + replaced tolerance with rounding s.f.
 
-static unsigned long long dmask1;
-static unsigned long long dmask2;
-
-static void setNumericRounding(int dround)
+static void setNumericRounding(radix_ctx *ctx, int dround)
 {
-  dmask1 = dround ? 1 << (8 * dround - 1) : 0;
-  dmask2 = 0xffffffffffffffff << dround * 8;
+  ctx->dmask1 = dround ? 1 << (8 * dround - 1) : 0;
+  ctx->dmask2 = 0xffffffffffffffff << dround * 8;
 }
 
-static union {
+// local, not static: dtwiddle is called from multiple threads
+typedef union {
   double d;
   unsigned long long ull;
-} u;
+} dull;
 
 static
-  unsigned long long dtwiddle(void *p, int i, int order)
+  unsigned long long dtwiddle(radix_ctx *ctx, void *p, int i)
   {
-    u.d = order * ((double *)p)[i]; // take care of 'order' at the beginning
+    dull u;
+    u.d = ctx->order * ((double *)p)[i]; // take care of 'order' at the beginning
     if (R_FINITE(u.d)) {
-      u.ull = (u.d != 0.0) ? u.ull + ((u.ull & dmask1) << 1) : 0;
+      u.ull = (u.d != 0.0) ? u.ull + ((u.ull & ctx->dmask1) << 1) : 0;
     } else if (ISNAN(u.d)) {
       u.ull = 0;
-      return (nalast == 1 ? ~u.ull : u.ull);
+      return (ctx->nalast == 1 ? ~u.ull : u.ull);
     }
     unsigned long long mask = (u.ull & 0x8000000000000000) ?
     // always flip sign bit and if negative (sign bit was set)
     // flip other bits too
     0xffffffffffffffff : 0x8000000000000000;
-    return ((u.ull ^ mask) & dmask2);
+    return ((u.ull ^ mask) & ctx->dmask2);
   }
 
 static Rboolean dnan(void *p, int i)
 {
+  dull u;
   u.d = ((double *) p)[i];
   return (ISNAN(u.d));
 }
 
-static unsigned long long (*twiddle) (void *, int, int);
-static Rboolean(*is_nan) (void *, int);
 // the size of the arg type (4 or 8). Just 8 currently until iradix is
 // merged in.
 static size_t colSize = 8;
 
-static void dradix_r(unsigned char *xsub, int *osub, int n, int radix);
+static void dradix_r(radix_ctx *ctx, unsigned char *xsub, int *osub, int n, int radix);
 
 #ifdef WORDS_BIGENDIAN
 #define RADIX_BYTE colSize - radix - 1
@@ -662,34 +683,118 @@ static void dradix_r(unsigned char *xsub, int *osub, int n, int radix);
 #define RADIX_BYTE radix
 #endif
 
-static void dradix(unsigned char *x, int *o, int n)
+#define CHUNK_START(t) (int)((int64_t)n * (t) / nth)
+
+// per-thread histograms of the nradix bytes of all keys, summed into
+// radixcounts. Returns the histograms (nth * nradix * 256), needed by
+// radix_par_scatter(), which the caller frees.
+static unsigned int *radix_par_count(radix_ctx *ctx, void *x, int n, int nradix, int nth)
+{
+  unsigned int *tcounts = (unsigned int *) calloc((size_t)nth * nradix * 256, sizeof(unsigned int));
+  if (tcounts == NULL)
+    Error("Failed to allocate working memory for the radix counts of %d threads", nth);
+  #pragma omp parallel for num_threads(nth)
+  for (int t = 0; t < nth; ++t) {
+    unsigned int *tc = tcounts + (size_t)t * nradix * 256;
+    const int end = CHUNK_START(t + 1);
+    if (nradix == 4) {
+      for (int i = CHUNK_START(t); i < end; ++i) {
+        unsigned int thisx = (unsigned int) (icheck(ctx, ((int *)x)[i])) - INT_MIN;
+        tc[thisx & 0xFF]++;
+        tc[256 + (thisx >> 8 & 0xFF)]++;
+        tc[512 + (thisx >> 16 & 0xFF)]++;
+        tc[768 + (thisx >> 24 & 0xFF)]++;
+      }
+    } else {
+      for (int i = CHUNK_START(t); i < end; ++i) {
+        unsigned long long thisx = dtwiddle(ctx, x, i);
+        for (int radix = 0; radix != nradix; ++radix)
+          tc[radix * 256 + ((unsigned char *)&thisx)[RADIX_BYTE]]++;
+      }
+    }
+  }
+  for (int t = 0; t != nth; ++t) {
+    unsigned int *tc = tcounts + (size_t)t * nradix * 256;
+    for (int radix = 0; radix != nradix; ++radix)
+      for (int b = 0; b != 256; ++b)
+        ctx->radixcounts[radix][b] += tc[radix * 256 + b];
+  }
+  return tcounts;
+}
+
+// scatter on the given radix. thiscounts holds the cumulated counts (not
+// cumulated through 0s), and is left as after the serial scatter: the start
+// of each non-empty bucket.
+static void radix_par_scatter(radix_ctx *ctx, void *x, int *o, int n, int radix, int nradix, int nth,
+                              unsigned int *thiscounts, unsigned int *tcounts)
+{
+  int *pos = (int *) malloc((size_t)nth * 256 * sizeof(int));
+  if (pos == NULL) {
+    free(tcounts);
+    Error("Failed to allocate working memory for the radix offsets of %d threads", nth);
+  }
+  for (int b = 0; b != 256; ++b) {
+    unsigned int cnt = 0;
+    for (int t = 0; t != nth; ++t) cnt += tcounts[((size_t)t * nradix + radix) * 256 + b];
+    if (cnt == 0) continue;
+    int start = thiscounts[b] - cnt;
+    thiscounts[b] = start;
+    for (int t = 0; t != nth; ++t) {
+      pos[t * 256 + b] = start;
+      start += tcounts[((size_t)t * nradix + radix) * 256 + b];
+    }
+  }
+  #pragma omp parallel for num_threads(nth)
+  for (int t = 0; t < nth; ++t) {
+    int *tpos = pos + t * 256;
+    const int end = CHUNK_START(t + 1);
+    if (nradix == 4) {
+      const unsigned int shift = radix * 8;
+      for (int i = CHUNK_START(t); i < end; ++i)
+        o[tpos[((unsigned int) (icheck(ctx, ((int *)x)[i])) - INT_MIN) >> shift & 0xFF]++] = i + 1;
+    } else {
+      for (int i = CHUNK_START(t); i < end; ++i) {
+        unsigned long long thisx = dtwiddle(ctx, x, i);
+        o[tpos[((unsigned char *)&thisx)[RADIX_BYTE]]++] = i + 1;
+      }
+    }
+  }
+  free(pos);
+}
+
+static void dradix(radix_ctx *ctx, unsigned char *x, int *o, int n)
 {
   int radix, nextradix, itmp, thisgrpn, maxgrpn;
-  unsigned int *thiscounts;
+  unsigned int *thiscounts, *tcounts = NULL;
   unsigned long long thisx = 0;
+  const int nth = (n >= N_PAR) ? ctx->nthreads : 1;
   // see comments in iradix for structure.  This follows the same.
   // TO DO: merge iradix in here (almost ready)
-  for (int i = 0; i != n; ++i) {
-    thisx = twiddle(x, i, order);
+  if (nth > 1) {
+    tcounts = radix_par_count(ctx, x, n, (int) colSize, nth);
+    thisx = dtwiddle(ctx, x, n - 1);
+  } else for (int i = 0; i != n; ++i) {
+    thisx = dtwiddle(ctx, x, i);
     for (radix = 0; radix != colSize; ++radix)
       // if dround == 2 then radix 0 and 1 will be all 0 here and skipped.
       /* on little endian, 0 is the least significant bits (the right)
        and 7 is the most including sign (the left); i.e. reversed. */
-      radixcounts[radix][((unsigned char *)&thisx)[RADIX_BYTE]]++;
+      ctx->radixcounts[radix][((unsigned char *)&thisx)[RADIX_BYTE]]++;
   }
   for (radix = 0; radix != colSize; ++radix) {
     // thisx is the last x after loop above
     int i = ((unsigned char *) &thisx)[RADIX_BYTE];
-    skip[radix] = radixcounts[radix][i] == n;
+    ctx->skip[radix] = ctx->radixcounts[radix][i] == n;
     // clear it now, the other counts must be 0 already
-    if (skip[radix])
-      radixcounts[radix][i] = 0;
+    if (ctx->skip[radix])
+      ctx->radixcounts[radix][i] = 0;
   }
   radix = (int) colSize - 1;  // MSD
-  while (radix >= 0 && skip[radix]) radix--;
+  while (radix >= 0 && ctx->skip[radix]) radix--;
   if (radix == -1) {
     // All radix are skipped; i.e. one number repeated n times.
-    if (nalast == 0 && is_nan(x, 0))
+    free(tcounts);
+    if (ctx->nalast == 0 && dnan(x, 0))
       // all values are identical. return 0 if nalast=0 & all NA
       // because of 'return', have to take care of it here.
       for (int i = 0; i != n; ++i)
@@ -697,16 +802,16 @@ static void dradix(unsigned char *x, int *o, int n)
     else
       for (int i = 0; i != n; ++i)
         o[i] = (i + 1);
-    push(n);
+    push(ctx, n);
     return;
   }
   for (int i = radix - 1; i >= 0; i--) {
     // clear the lower radix counts, we only did them to know
     // skip. will be reused within each group
-    if (!skip[i])
-      memset(radixcounts[i], 0, 257 * sizeof(unsigned int));
+    if (!ctx->skip[i])
+      memset(ctx->radixcounts[i], 0, 257 * sizeof(unsigned int));
   }
-  thiscounts = radixcounts[radix];
+  thiscounts = ctx->radixcounts[radix];
   itmp = thiscounts[0];
   maxgrpn = itmp;
   for (int i = 1; itmp < n && i < 256; ++i) {
@@ -717,12 +822,15 @@ static void dradix(unsigned char *x, int *o, int n)
       thiscounts[i] = (itmp += thisgrpn);
     }
   }
-  for (int i = n - 1; i >= 0; i--) {
-    thisx = twiddle(x, i, order);
+  if (nth > 1) {
+    radix_par_scatter(ctx, x, o, n, radix, (int) colSize, nth, thiscounts, tcounts);
+    free(tcounts);
+  } else for (int i = n - 1; i >= 0; i--) {
+    thisx = dtwiddle(ctx, x, i);
     o[ --thiscounts[((unsigned char *)&thisx)[RADIX_BYTE]] ] = i + 1;
   }
 
-  if (radix_xsuballoc < maxgrpn) {
+  if (ctx->radix_xsuballoc < maxgrpn) {
     // TO DO: centralize this alloc
     // The largest group according to the first non-skipped radix,
     // so could be big (if radix is needed on first arg) TO DO:
@@ -730,18 +838,18 @@ static void dradix(unsigned char *x, int *o, int n)
     // more. Often the MSD has groups in just 0-4 out of 256.
     // free'd at the end of do_radixsort once we're done calling iradix
     // repetitively
-    radix_xsub = (double *) realloc(radix_xsub, maxgrpn * sizeof(double));
-    if (!radix_xsub)
+    ctx->radix_xsub = (double *) realloc(ctx->radix_xsub, maxgrpn * sizeof(double));
+    if (!ctx->radix_xsub)
       Error("Failed to realloc working memory %d*8bytes (xsub in dradix), radix=%d",
             maxgrpn, radix);
-    radix_xsuballoc = maxgrpn;
+    ctx->radix_xsuballoc = maxgrpn;
   }
 
-  alloc_otmp(maxgrpn);   // TO DO: leave to do_radixsort and remove these?
-  alloc_xtmp(maxgrpn);
+  alloc_otmp(ctx, maxgrpn);   // TO DO: leave to do_radixsort and remove these?
+  alloc_xtmp(ctx, maxgrpn);
 
   nextradix = radix - 1;
-  while (nextradix >= 0 && skip[nextradix])
+  while (nextradix >= 0 && ctx->skip[nextradix])
     nextradix--;
   if (thiscounts[0] != 0)
     Error("Logical error. thiscounts[0]=%d but should have been decremented to 0. dradix=%d",
@@ -753,34 +861,34 @@ static void dradix(unsigned char *x, int *o, int n)
       continue;
     thisgrpn = thiscounts[i] - itmp;  // undo cummulate; i.e. diff
     if (thisgrpn == 1 || nextradix == -1) {
-      push(thisgrpn);
+      push(ctx, thisgrpn);
     } else {
       if (colSize == 4) { // ready for merging in iradix ...
         error("Not yet used, still using iradix instead");
         for (int j = 0; j != thisgrpn; ++j)
-          ((int *)radix_xsub)[j] = (int)twiddle(x, o[itmp+j]-1, order);
+          ((int *)ctx->radix_xsub)[j] = (int)dtwiddle(ctx, x, o[itmp+j]-1);
         // this is why this xsub here can't be the same memory
         // as xsub in do_radixsort
       } else
         for (int j = 0; j != thisgrpn; ++j)
-          ((unsigned long long *)radix_xsub)[j] =
-            twiddle(x, o[itmp+j]-1, order);
+          ((unsigned long long *)ctx->radix_xsub)[j] =
+            dtwiddle(ctx, x, o[itmp+j]-1);
       // changes xsub and o by reference recursively.
-      dradix_r(radix_xsub, o+itmp, thisgrpn, nextradix);
+      dradix_r(ctx, ctx->radix_xsub, o+itmp, thisgrpn, nextradix);
     }
     itmp = thiscounts[i];
     thiscounts[i] = 0;
   }
-  if (nalast == 0) // nalast = 1, -1 are both taken care already.
+  if (ctx->nalast == 0) // nalast = 1, -1 are both taken care already.
     for (int i = 0; i != n; ++i)
-      o[i] = is_nan(x, o[i] - 1) ? 0 : o[i];
+      o[i] = dnan(x, o[i] - 1) ? 0 : o[i];
   // nalast = 0 is dealt with separately as it just sets o to 0
   // at those indices where x is NA. x[o[i]-1] because x is not
   // modified by reference unlike iinsert or iradix_r
 
 }
 
-static void dinsert(unsigned long long *x, int *o, int n)
+static void dinsert(radix_ctx *ctx, unsigned long long *x, int *o, int n)
   // orders both x and o by reference in-place. Fast for small vectors,
   // low overhead.  don't be tempted to binsearch backwards here, have
   // to shift anyway; many memmove would have overhead and do the same
@@ -806,14 +914,14 @@ static void dinsert(unsigned long long *x, int *o, int n)
   for (int i = 1; i != n; ++i) {
     if (x[i] == x[i - 1]) tt++;
     else {
-      push(tt + 1);
+      push(ctx, tt + 1);
       tt = 0;
     }
   } // INCLUDED ??
-  push(tt + 1);
+  push(ctx, tt + 1);
 }
 
-static void dradix_r(unsigned char *xsub, int *osub, int n, int radix)
+static void dradix_r(radix_ctx *ctx, unsigned char *xsub, int *osub, int n, int radix)
   /* xsub is a recursive offset into xsub working memory above in
    dradix, reordered by reference.  osub is a an offset into the main
    answer o, reordered by reference.  dradix iterates
@@ -827,11 +935,11 @@ static void dradix_r(unsigned char *xsub, int *osub, int n, int radix)
      based on sum(1:50)=1275 worst -vs- 256 cummulate + 256 memset +
      allowance since reverse order is unlikely */
     // order=1 here because it's already taken care of in iradix
-    dinsert((void *)xsub, osub, n);
+    dinsert(ctx, (void *)xsub, osub, n);
 
     return;
   }
-  thiscounts = radixcounts[radix];
+  thiscounts = ctx->radixcounts[radix];
   p = xsub + RADIX_BYTE;
   for (int i = 0; i != n; ++i) {
     thiscounts[*p]++;
@@ -847,23 +955,23 @@ static void dradix_r(unsigned char *xsub, int *osub, int n, int radix)
     error("Not yet used, still using iradix instead");
     for (int i = n - 1; i >= 0; i--) {
       int j = --thiscounts[*(p + RADIX_BYTE)];
-      otmp[j] = osub[i];
-      ((int *) xtmp)[j] = *(int *) p;
+      ctx->otmp[j] = osub[i];
+      ((int *) ctx->xtmp)[j] = *(int *) p;
       p -= colSize;
     }
   } else {
     for (int i = n - 1; i >= 0; i--) {
       int j = --thiscounts[*(p + RADIX_BYTE)];
-      otmp[j] = osub[i];
-      ((unsigned long long *) xtmp)[j] = *(unsigned long long *) p;
+      ctx->otmp[j] = osub[i];
+      ((unsigned long long *) ctx->xtmp)[j] = *(unsigned long long *) p;
       p -= colSize;
     }
   }
-  memcpy(osub, otmp, n * sizeof(int));
-  memcpy(xsub, xtmp, n * colSize);
+  memcpy(osub, ctx->otmp, n * sizeof(int));
+  memcpy(xsub, ctx->xtmp, n * colSize);
 
   nextradix = radix - 1;
-  while (nextradix >= 0 && skip[nextradix])
+  while (nextradix >= 0 && ctx->skip[nextradix])
     nextradix--;
   // TO DO: If nextradix==-1 and no further args from do_radixsort,
   // we're done. We have o. Remember to memset thiscounts before
@@ -879,9 +987,9 @@ static void dradix_r(unsigned char *xsub, int *osub, int n, int radix)
       continue;
     thisgrpn = thiscounts[i] - itmp;        // undo cummulate; i.e. diff
     if (thisgrpn == 1 || nextradix == -1)
-      push(thisgrpn);
+      push(ctx, thisgrpn);
     else
-      dradix_r(xsub + itmp * colSize, osub + itmp, thisgrpn,
+      dradix_r(ctx, xsub + itmp * colSize, osub + itmp, thisgrpn,
                nextradix);
     itmp = thiscounts[i];
     thiscounts[i] = 0;
@@ -900,15 +1008,15 @@ static SEXP *cradix_xtmp = NULL;
 static int cradix_xtmp_alloc = 0;
 
 // same as StrCmp but also takes into account 'decreasing' and 'na.last' args.
-static int StrCmp2(SEXP x, SEXP y)
+static int StrCmp2(radix_ctx *ctx, SEXP x, SEXP y)
 {
   // same cached pointer (including NA_STRING == NA_STRING)
   if (x == y) return 0;
   // if x=NA, nalast=1 ? then x > y else x < y (Note: nalast == 0 is
   // already taken care of in 'csorted', won't be 0 here)
-  if (x == NA_STRING) return nalast;
-  if (y == NA_STRING) return -nalast;     // if y=NA, nalast=1 ? then y > x
-  return order*strcmp(CHAR(x), CHAR(y));  // same as explanation in StrCmp
+  if (x == NA_STRING) return ctx->nalast;
+  if (y == NA_STRING) return -ctx->nalast;     // if y=NA, nalast=1 ? then y > x
+  return ctx->order*strcmp(CHAR(x), CHAR(y));  // same as explanation in StrCmp
 }
 
 static int StrCmp(SEXP x, SEXP y)            // also used by bmerge and chmatch
@@ -1042,7 +1150,7 @@ static void cradix_r(SEXP * xsub, int n, int radix)
 static SEXP *ustr = NULL;
 static int ustr_alloc = 0, ustr_n = 0;
 
-static void cgroup(SEXP * x, int *o, int n)
+static void cgroup(radix_ctx *ctx, SEXP * x, int *o, int n)
   // As icount :
   //   Places the ordering into o directly, overwriting whatever was there
   //   Doesn't change x
@@ -1094,10 +1202,10 @@ static void cgroup(SEXP * x, int *o, int n)
   // there are any marked encodings present)
   int cumsum = 0;
   for (int i = 0; i != ustr_n; ++i) {      // 0.000
-    push(-TRLEN(ustr[i]));
+    push(ctx, -TRLEN(ustr[i]));
     SET_TRLEN(ustr[i], cumsum += -TRLEN(ustr[i]));
   }
-  int *target = (o[0] != -1) ? newo : o;
+  int *target = (o[0] != -1) ? ctx->newo : o;
   for (int i = n - 1; i >= 0; i--) {
     SEXP s = x[i];           // 0.400 (page fetches on string cache)
     int k = TRLEN(s) - 1;
@@ -1124,7 +1232,7 @@ static void alloc_csort_otmp(int n)
   csort_otmp_alloc = n;
 }
 
-static void csort(SEXP * x, int *o, int n)
+static void csort(radix_ctx *ctx, SEXP * x, int *o, int n)
   /*
    As icount :
    Places the ordering into o directly, overwriting whatever was there
@@ -1138,7 +1246,7 @@ static void csort(SEXP * x, int *o, int n)
    either n=nrow if 1st arg, or n=maxgrpn if onwards args */
   for (int i = 0; i != n; ++i)
     csort_otmp[i] = (x[i] == NA_STRING) ? NA_INTEGER : -TRLEN(x[i]);
-  if (nalast == 0 && n == 2) {
+  if (ctx->nalast == 0 && n == 2) {
     // special case for nalast == 0. n == 1 is handled inside
     // do_radixsort. at least 1 will be NA here else use o from caller
     // directly (not 1st arg)
@@ -1148,29 +1256,29 @@ static void csort(SEXP * x, int *o, int n)
     for (int i = 0;  i != n; ++i) {
       if (csort_otmp[i] == NA_INTEGER) o[i] = 0;
     } // INCLUDED ??
-    push(1); push(1);
+    push(ctx, 1); push(ctx, 1);
     return;
   }
-  if (n < N_SMALL && nalast != 0) { // TO DO: calibrate() N_SMALL=200
+  if (n < N_SMALL && ctx->nalast != 0) { // TO DO: calibrate() N_SMALL=200
     if (o[0] == -1)
       for (int i = 0; i != n; ++i)
         o[i] = i + 1;
     // else use o from caller directly (not 1st arg)
     for (int i = 0; i != n; ++i)
-      csort_otmp[i] = icheck(csort_otmp[i]);
-    iinsert(csort_otmp, o, n);
+      csort_otmp[i] = icheck(ctx, csort_otmp[i]);
+    iinsert(ctx, csort_otmp, o, n);
   } else {
-    setRange(csort_otmp, n);
-    if (range == NA_INTEGER)
+    setRange(ctx, csort_otmp, n);
+    if (ctx->range == NA_INTEGER)
       Error("Internal error. csort's otmp contains all-NA");
-    int *target = (o[0] != -1) ? newo : o;
-    if (range <= N_RANGE)
+    int *target = (o[0] != -1) ? ctx->newo : o;
+    if (ctx->range <= N_RANGE)
       // TO DO: calibrate(). radix was faster (9.2s
       // "range<=10000" instead of 11.6s "range<=N_RANGE &&
       // range<n") for run(7) where range=N_RANGE n=10000000
-      icount(csort_otmp, target, n);
+      icount(ctx, csort_otmp, target, n);
     else
-      iradix(csort_otmp, target, n);
+      iradix(ctx, csort_otmp, target, n);
   }
   // all i* push onto stack. Using their counts may be faster here
   // than thrashing SEXP fetches over several passes as cgroup does
@@ -1270,7 +1378,7 @@ static void csort_pre(SEXP * x, int n)
 // order = 1 is ascending and order=-1 is descending; also takes care
 // of na.last argument with check through 'icheck' Relies on
 // NA_INTEGER == INT_MIN, checked in init.c
-static int isorted(int *x, int n)
+static int isorted(radix_ctx *ctx, int *x, int n)
 {
   int i = 1, j = 0;
   // when nalast = NA,
@@ -1278,47 +1386,47 @@ static int isorted(int *x, int n)
   // any NAs ? return 0 = unsorted and leave it
   //   to sort routines to replace o's with 0's
   // no NAs ? continue to check rest of isorted - the same routine as usual
-  if (nalast == 0) {
+  if (ctx->nalast == 0) {
     for (int k = 0; k != n; ++k) {
       if (x[k] != NA_INTEGER) j++;
     } // INCLUDED ??
     if (j == 0) {
-      push(n);
+      push(ctx, n);
       return (-2);
     }
     if (j != n)
       return (0);
   }
   if (n <= 1) {
-    push(n);
+    push(ctx, n);
     return (1);
   }
-  if (icheck(x[1]) < icheck(x[0])) {
+  if (icheck(ctx, x[1]) < icheck(ctx, x[0])) {
     i = 2;
-    while (i < n && icheck(x[i]) < icheck(x[i - 1]))
+    while (i < n && icheck(ctx, x[i]) < icheck(ctx, x[i - 1]))
       i++;
     // strictly opposite to expected 'order', no ties;
     if (i == n) {
-      mpush(1, n);
+      mpush(ctx, 1, n);
       return (-1);
     }
     // e.g. no more than one NA at the beginning/end (for order=-1/1)
     else return (0);
   }
-  int old = gsngrp[flip];
+  int old = ctx->gsngrp[ctx->flip];
   int tt = 1;
   for (int i = 1; i != n; ++i) {
-    if (icheck(x[i]) < icheck(x[i - 1])) {
-      gsngrp[flip] = old;
+    if (icheck(ctx, x[i]) < icheck(ctx, x[i - 1])) {
+      ctx->gsngrp[ctx->flip] = old;
       return (0);
     }
     if (x[i] == x[i - 1])
       tt++;
     else {
-      push(tt); tt = 1;
+      push(ctx, tt); tt = 1;
     }
   }
-  push(tt);
+  push(ctx, tt);
   // same as 'order', NAs at the beginning for order=1, at end for
   // order=-1, possibly with ties
   return(1);
@@ -1326,11 +1434,11 @@ static int isorted(int *x, int n)
 
 // order=1 is ascending and -1 is descending
 // also accounts for nalast=0 (=NA), =1 (TRUE), -1 (FALSE) (in twiddle)
-static int dsorted(double *x, int n)
+static int dsorted(radix_ctx *ctx, double *x, int n)
 {
   int i = 1, j = 0;
   unsigned long long prev, this;
-  if (nalast == 0) {
+  if (ctx->nalast == 0) {
     // when nalast = NA,
     // all NAs ? return special value to replace all o's values with '0'
     // any NAs ? return 0 = unsorted and leave it to sort routines to
@@ -1338,30 +1446,30 @@ static int dsorted(double *x, int n)
     // no NAs  ? continue to check the rest of isorted -
     //           the same routine as usual
     for (int k = 0; k != n; ++k) {
-      if (!is_nan(x, k)) j++;
+      if (!dnan(x, k)) j++;
     } // INCLUDED ??
     if (j == 0) {
-      push(n);
+      push(ctx, n);
       return (-2);
     }
     if (j != n)
       return (0);
   }
   if (n <= 1) {
-    push(n);
+    push(ctx, n);
     return (1);
   }
-  prev = twiddle(x, 0, order);
-  this = twiddle(x, 1, order);
+  prev = dtwiddle(ctx, x, 0);
+  this = dtwiddle(ctx, x, 1);
   if (this < prev) {
     i = 2;
     prev = this;
-    while (i < n && (this = twiddle(x, i, order)) < prev) {
+    while (i < n && (this = dtwiddle(ctx, x, i)) < prev) {
       i++;
       prev = this;
     }
     if (i == n) {
-      mpush(1, n);
+      mpush(ctx, 1, n);
       return (-1);
     }
     // strictly opposite of expected 'order', no ties; e.g. no
@@ -1370,26 +1478,26 @@ static int dsorted(double *x, int n)
     // TO DO: improve to be stable for ties in reverse
     else return(0);
   }
-  int old = gsngrp[flip];
+  int old = ctx->gsngrp[ctx->flip];
   int tt = 1;
   for (int i = 1; i != n; ++i) {
     // TO DO: once we get past -Inf, NA and NaN at the bottom, and
     //        +Inf at the top, the middle only need be twiddled
     //        for tolerance (worth it?)
-    this = twiddle(x, i, order);
+    this = dtwiddle(ctx, x, i);
     if (this < prev) {
-      gsngrp[flip] = old;
+      ctx->gsngrp[ctx->flip] = old;
       return (0);
     }
     if (this == prev)
       tt++;
     else {
-      push(tt);
+      push(ctx, tt);
       tt = 1;
     }
     prev = this;
   }
-  push(tt);
+  push(ctx, tt);
   // exactly as expected in 'order' (1=increasing, -1=decreasing),
   // possibly with ties
   return (1);
@@ -1397,10 +1505,10 @@ static int dsorted(double *x, int n)
 
 // order=1 is ascending and -1 is descending
 // also accounts for nalast=0 (=NA), =1 (TRUE), -1 (FALSE)
-static int csorted(SEXP *x, int n)
+static int csorted(radix_ctx *ctx, SEXP *x, int n)
 {
   int i = 1, j = 0, tmp;
-  if (nalast == 0) {
+  if (ctx->nalast == 0) {
     // when nalast = NA,
     // all NAs ? return special value to replace all o's values with '0'
     // any NAs ? return 0 = unsorted and leave it to sort routines
@@ -1411,22 +1519,22 @@ static int csorted(SEXP *x, int n)
       if (x[k] != NA_STRING) j++;
     } // INCLUDED ??
     if (j == 0) {
-      push(n);
+      push(ctx, n);
       return (-2);
     }
     if (j != n)
       return (0);
   }
   if (n <= 1) {
-    push(n);
+    push(ctx, n);
     return (1);
   }
-  if (StrCmp2(x[1], x[0]) < 0) {
+  if (StrCmp2(ctx, x[1], x[0]) < 0) {
     i = 2;
-    while (i < n && StrCmp2(x[i], x[i - 1]) < 0)
+    while (i < n && StrCmp2(ctx, x[i], x[i - 1]) < 0)
       i++;
     if (i == n) {
-      mpush(1, n);
+      mpush(ctx, 1, n);
       return (-1);
     }
     // strictly opposite of expected 'order', no ties;
@@ -1434,31 +1542,31 @@ static int csorted(SEXP *x, int n)
     else
       return (0);
   }
-  int old = gsngrp[flip];
+  int old = ctx->gsngrp[ctx->flip];
   int tt = 1;
   for (int i = 1; i != n; ++i) {
-    tmp = StrCmp2(x[i], x[i - 1]);
+    tmp = StrCmp2(ctx, x[i], x[i - 1]);
     if (tmp < 0) {
-      gsngrp[flip] = old;
+      ctx->gsngrp[ctx->flip] = old;
       return (0);
     }
     if (tmp == 0)
       tt++;
     else {
-      push(tt);
+      push(ctx, tt);
       tt = 1;
     }
   }
-  push(tt);
+  push(ctx, tt);
   // exactly as expected in 'order', possibly with ties
   return (1);
 }
 
-static void isort(int *x, int *o, int n)
+static void isort(radix_ctx *ctx, int *x, int *o, int n)
 {
   if (n <= 2) {
     // nalast = 0 and n == 2 (check bottom of this file for explanation)
-    if (nalast == 0 && n == 2) {
+    if (ctx->nalast == 0 && n == 2) {
       if (o[0] == -1) {
         o[0] = 1;
         o[1] = 2;
@@ -1466,50 +1574,50 @@ static void isort(int *x, int *o, int n)
       for (int i = 0; i != n; ++i) {
         if (x[i] == NA_INTEGER) o[i] = 0;
       } // INCLUDED ??
-      push(1); push(1);
+      push(ctx, 1); push(ctx, 1);
       return;
     } else Error("Internal error: isort received n=%d. isorted should have dealt with this (e.g. as a reverse sorted vector) already",n);
   }
-  if (n < N_SMALL && o[0] != -1 && nalast != 0) {
+  if (n < N_SMALL && o[0] != -1 && ctx->nalast != 0) {
     // see comment above in iradix_r on N_SMALL=200.
     /* if not o[0] then can't just populate with 1:n here, since x
      is changed by ref too (so would need to be copied). */
     /* pushes inside too. Changes x and o by reference, so not
      suitable in first arg when o hasn't been populated yet
      and x is an actual argument (hence check on o[0]). */
-    if (order != 1 || nalast != -1)
+    if (ctx->order != 1 || ctx->nalast != -1)
       // so that default case, i.e., order=1, nalast=FALSE will
       // not be affected (ex: `setkey`)
       for (int i = 0; i != n; ++i)
-        x[i] = icheck(x[i]);
-    iinsert(x, o, n);
+        x[i] = icheck(ctx, x[i]);
+    iinsert(ctx, x, o, n);
   } else {
     /* Tighter range (e.g. copes better with a few abormally large
      values in some groups), but also, when setRange was once at
      arg level that caused an extra scan of (long) x
      first. 10,000 calls to setRange takes just 0.04s
      i.e. negligible. */
-    setRange(x, n);
-    if (range == NA_INTEGER)
+    setRange(ctx, x, n);
+    if (ctx->range == NA_INTEGER)
       Error("Internal error: isort passed all-NA. isorted should have caught this before this point");
-    int *target = (o[0] != -1) ? newo : o;
+    int *target = (o[0] != -1) ? ctx->newo : o;
     // was range < 10000 for subgroups, but 1e5 for the first
     // arg, tried to generalise here.  1e4 rather than 1e5 here
     // because iterated was (thisgrpn < 200 || range > 20000) then
     // radix a short vector with large range can bite icount when
     // iterated (BLOCK 4 and 6)
-    if (range <= N_RANGE && range <= n) {
-      icount(x, target, n);
+    if (ctx->range <= N_RANGE && ctx->range <= n) {
+      icount(ctx, x, target, n);
     } else {
-      iradix(x, target, n);
+      iradix(ctx, x, target, n);
     }
   }
 }
 
-static void dsort(double *x, int *o, int n)
+static void dsort(radix_ctx *ctx, double *x, int *o, int n)
 {
   if (n <= 2) {
-    if (nalast == 0 && n == 2) {
+    if (ctx->nalast == 0 && n == 2) {
       // don't have to twiddle here.. at least one will be NA
       // and 'n' WILL BE 2.
       if (o[0] == -1) {
@@ -1517,22 +1625,22 @@ static void dsort(double *x, int *o, int n)
         o[1] = 2;
       }
       for (int i = 0; i != n; ++i) {
-        if (is_nan(x, i)) o[i] = 0;
+        if (dnan(x, i)) o[i] = 0;
       } // INCLUDED ??
-      push(1); push(1);
+      push(ctx, 1); push(ctx, 1);
       return;
     }
     Error("Internal error: dsort received n=%d. dsorted should have dealt with this (e.g. as a reverse sorted vector) already",n);
   }
-  if (n < N_SMALL && o[0] != -1 && nalast != 0) {
+  if (n < N_SMALL && o[0] != -1 && ctx->nalast != 0) {
     // see comment above in iradix_r re N_SMALL=200,  and isort for o[0]
     for (int i = 0; i != n; ++i)
-      ((unsigned long long *)x)[i] = twiddle(x, i, order);
+      ((unsigned long long *)x)[i] = dtwiddle(ctx, x, i);
     // have to twiddle here anyways, can't speed up default case
     // like in isort
-    dinsert((unsigned long long *)x, o, n);
+    dinsert(ctx, (unsigned long long *)x, o, n);
   } else {
-    dradix((unsigned char *) x, (o[0] != -1) ? newo : o, n);
+    dradix(ctx, (unsigned char *) x, (o[0] != -1) ? ctx->newo : o, n);
   }
 }
 
@@ -1580,6 +1688,7 @@ SEXP Cradixsort(SEXP NA_last, SEXP decreasing, SEXP RETstrt, SEXP RETgs, SEXP SO
   Rboolean isSorted = TRUE, retGrp, retStarts;
   void *xd;
   int *o = NULL;
+  radix_ctx *ctx = &rctx;
 
   // ML: FIXME: Here are just two of the dangerous assumptions here
   if (sizeof(int) != 4) {
@@ -1589,7 +1698,7 @@ SEXP Cradixsort(SEXP NA_last, SEXP decreasing, SEXP RETstrt, SEXP RETgs, SEXP SO
     error("radix sort assumes sizeof(double) == 8");
   }
 
-  nalast = (asLogical(NA_last) == NA_LOGICAL) ? 0 :
+  ctx->nalast = (asLogical(NA_last) == NA_LOGICAL) ? 0 :
     (asLogical(NA_last) == TRUE) ? 1 : -1; // 1=TRUE, -1=FALSE, 0=NA
   retStarts = asLogical(RETstrt);
   retGrp = retStarts || asLogical(RETgs);
@@ -1597,7 +1706,7 @@ SEXP Cradixsort(SEXP NA_last, SEXP decreasing, SEXP RETstrt, SEXP RETgs, SEXP SO
 
 
   /* When grouping, we round off doubles to account for imprecision */
-  setNumericRounding(0); // before: retGrp ? 2 : 0
+  setNumericRounding(ctx, 0); // before: retGrp ? 2 : 0
 
   if (args == R_NilValue)
     return R_NilValue;
@@ -1617,7 +1726,8 @@ SEXP Cradixsort(SEXP NA_last, SEXP decreasing, SEXP RETstrt, SEXP RETgs, SEXP SO
     if (LOGICAL(decreasing)[i] == NA_LOGICAL)
       error("'decreasing' elements must be TRUE or FALSE");
   }
-  order = asLogical(decreasing) ? -1 : 1;
+  ctx->order = asLogical(decreasing) ? -1 : 1;
+  ctx->nthreads = group_nthreads;
 
   SEXP x = CAR(args);
   args = CDR(args);
@@ -1631,7 +1741,7 @@ SEXP Cradixsort(SEXP NA_last, SEXP decreasing, SEXP RETstrt, SEXP RETgs, SEXP SO
   // upper limit for stack size (all size 1 groups). We'll detect
   // and avoid that limit, but if just one non-1 group (say 2), that
   // can't be avoided.
-  gsmaxalloc = n;
+  ctx->gsmaxalloc = n;
 
   // once for the result, needs to be length n.
 
@@ -1646,7 +1756,7 @@ SEXP Cradixsort(SEXP NA_last, SEXP decreasing, SEXP RETstrt, SEXP RETgs, SEXP SO
     o[0] = -1;
   xd = DATAPTR(x);
 
-  stackgrps = narg > 1 || retGrp;
+  ctx->stackgrps = narg > 1 || retGrp;
 
   if (TYPEOF(x) == STRSXP) {
     checkEncodings(x);
@@ -1657,15 +1767,13 @@ SEXP Cradixsort(SEXP NA_last, SEXP decreasing, SEXP RETstrt, SEXP RETgs, SEXP SO
   switch (TYPEOF(x)) {
   case INTSXP:
   case LGLSXP:
-    tmp = isorted(xd, n);
+    tmp = isorted(ctx, xd, n);
     break;
   case REALSXP :
-    twiddle = &dtwiddle;
-    is_nan  = &dnan;
-    tmp = dsorted(xd, n);
+    tmp = dsorted(ctx, xd, n);
     break;
   case STRSXP :
-    tmp = csorted(xd, n);
+    tmp = csorted(ctx, xd, n);
     break;
   default :
     Error("First arg is type '%s', not yet supported",
@@ -1684,7 +1792,7 @@ SEXP Cradixsort(SEXP NA_last, SEXP decreasing, SEXP RETstrt, SEXP RETgs, SEXP SO
       isSorted = FALSE;
       for (int i = 0; i != n; ++i)
         o[i] = n - i;
-    } else if (nalast == 0 && tmp == -2) {
+    } else if (ctx->nalast == 0 && tmp == -2) {
       // happens only when nalast=NA/0. Means all NAs, replace
       // with 0's therefore!
       isSorted = FALSE;
@@ -1696,18 +1804,18 @@ SEXP Cradixsort(SEXP NA_last, SEXP decreasing, SEXP RETstrt, SEXP RETgs, SEXP SO
     switch (TYPEOF(x)) {
     case INTSXP:
     case LGLSXP:
-      isort(xd, o, n);
+      isort(ctx, xd, o, n);
       break;
     case REALSXP :
-      dsort(xd, o, n);
+      dsort(ctx, xd, o, n);
       break;
     case STRSXP :
       if (sortStr) {
         csort_pre(xd, n);
         alloc_csort_otmp(n);
-        csort(xd, o, n);
+        csort(ctx, xd, o, n);
       } else
-        cgroup(xd, o, n);
+        cgroup(ctx, xd, o, n);
       break;
     default:
       Error
@@ -1715,20 +1823,20 @@ SEXP Cradixsort(SEXP NA_last, SEXP decreasing, SEXP RETstrt, SEXP RETgs, SEXP SO
     }
   }
 
-  int maxgrpn = gsmax[flip];   // biggest group in the first arg
+  int maxgrpn = ctx->gsmax[ctx->flip];   // biggest group in the first arg
   void *xsub = NULL;           // local
   int (*f) ();
   void (*g) ();
 
-  if (narg > 1 && gsngrp[flip] < n) {
+  if (narg > 1 && ctx->gsngrp[ctx->flip] < n) {
     // double is the largest type, 8
     xsub = (void *) malloc(maxgrpn * sizeof(double));
     if (xsub == NULL)
       Error("Couldn't allocate xsub in do_radixsort, requested %d * %d bytes.",
             maxgrpn, sizeof(double));
     // global variable, used by isort, dsort, sort and cgroup
-    newo = (int *) malloc(maxgrpn * sizeof(int));
-    if (newo == NULL)
+    ctx->newo = (int *) malloc(maxgrpn * sizeof(int));
+    if (ctx->newo == NULL)
       Error("Couldn't allocate newo in do_radixsort, requested %d * %d bytes.",
             maxgrpn, sizeof(int));
   }
@@ -1737,12 +1845,12 @@ SEXP Cradixsort(SEXP NA_last, SEXP decreasing, SEXP RETstrt, SEXP RETgs, SEXP SO
     x = CAR(args);
     args = CDR(args);
     xd = DATAPTR(x);
-    ngrp = gsngrp[flip];
-    if (ngrp == n && nalast != 0)
+    ngrp = ctx->gsngrp[ctx->flip];
+    if (ngrp == n && ctx->nalast != 0)
       break;
-    flipflop();
-    stackgrps = col != narg || retGrp;
-    order = LOGICAL(decreasing)[col - 1] ? -1 : 1;
+    flipflop(ctx);
+    ctx->stackgrps = col != narg || retGrp;
+    ctx->order = LOGICAL(decreasing)[col - 1] ? -1 : 1;
     switch (TYPEOF(x)) {
     case INTSXP:
     case LGLSXP:
@@ -1750,8 +1858,6 @@ SEXP Cradixsort(SEXP NA_last, SEXP decreasing, SEXP RETstrt, SEXP RETgs, SEXP SO
       g = &isort;
       break;
     case REALSXP:
-      twiddle = &dtwiddle;
-      is_nan = &dnan;
       f = &dsorted;
       g = &dsort;
       break;
@@ -1759,7 +1865,7 @@ SEXP Cradixsort(SEXP NA_last, SEXP decreasing, SEXP RETstrt, SEXP RETgs, SEXP SO
       f = &csorted;
       if (sortStr) {
         csort_pre(xd, n);
-        alloc_csort_otmp(gsmax[1 - flip]);
+        alloc_csort_otmp(ctx->gsmax[1 - ctx->flip]);
         g = &csort;
       }
       // no increasing/decreasing order required if sortStr = FALSE,
@@ -1773,9 +1879,9 @@ SEXP Cradixsort(SEXP NA_last, SEXP decreasing, SEXP RETstrt, SEXP RETgs, SEXP SO
     }
     int i = 0;
     for (int grp = 0; grp != ngrp; ++grp) {
-      thisgrpn = gs[1 - flip][grp];
+      thisgrpn = ctx->gs[1 - ctx->flip][grp];
       if (thisgrpn == 1) {
-        if (nalast == 0) {
+        if (ctx->nalast == 0) {
           // this edge case had to be taken care of
           // here.. (see the bottom of this file for
           // more explanation)
@@ -1808,7 +1914,7 @@ SEXP Cradixsort(SEXP NA_last, SEXP decreasing, SEXP RETstrt, SEXP RETgs, SEXP SO
           }
         }
         i++;
-        push(1);
+        push(ctx, 1);
         continue;
       }
       osub = o+i;
@@ -1830,7 +1936,7 @@ SEXP Cradixsort(SEXP NA_last, SEXP decreasing, SEXP RETstrt, SEXP RETgs, SEXP SO
       // continue; // BASELINE short circuit timing
       // point. Up to here is the cost of creating xsub.
       // [i|d|c]sorted(); very low cost, sequential
-      tmp = (*f)(xsub, thisgrpn);
+      tmp = (*f)(ctx, xsub, thisgrpn);
       if (tmp) {
         // *sorted will have already push()'d the groups
         if (tmp == -1) {
@@ -1845,7 +1951,7 @@ SEXP Cradixsort(SEXP NA_last, SEXP decreasing, SEXP RETstrt, SEXP RETgs, SEXP SO
             osub[k] = osub[thisgrpn - 1 - k];
             osub[thisgrpn - 1 - k] = tmp;
           }
-        } else if (nalast == 0 && tmp == -2) {
+        } else if (ctx->nalast == 0 && tmp == -2) {
           // all NAs, replace osub[.] with 0s.
           isSorted = FALSE;
           for (int k = 0; k != thisgrpn; ++k) osub[k] = 0;
@@ -1854,21 +1960,21 @@ SEXP Cradixsort(SEXP NA_last, SEXP decreasing, SEXP RETstrt, SEXP RETgs, SEXP SO
       }
       isSorted = FALSE;
       // nalast=NA will result in newo[0] = 0. So had to change to -1.
-      newo[0] = -1;
+      ctx->newo[0] = -1;
       // may update osub directly, or if not will put the
       // result in global newo
-      (*g)(xsub, osub, thisgrpn);
+      (*g)(ctx, xsub, osub, thisgrpn);
 
-      if (newo[0] != -1) {
-        if (nalast != 0)
+      if (ctx->newo[0] != -1) {
+        if (ctx->nalast != 0)
           for (int j = 0; j != thisgrpn; ++j)
             // reuse xsub to reorder osub
-            ((int *) xsub)[j] = osub[newo[j] - 1];
+            ((int *) xsub)[j] = osub[ctx->newo[j] - 1];
         else
           for (int j = 0; j != thisgrpn; ++j)
             // final nalast case to handle!
-            ((int *) xsub)[j] = (newo[j] == 0) ? 0 :
-            osub[newo[j] - 1];
+            ((int *) xsub)[j] = (ctx->newo[j] == 0) ? 0 :
+            osub[ctx->newo[j] - 1];
         memcpy(osub, xsub, thisgrpn * sizeof(int));
       }
     }
@@ -1888,7 +1994,7 @@ SEXP Cradixsort(SEXP NA_last, SEXP decreasing, SEXP RETstrt, SEXP RETgs, SEXP SO
 
   if (retGrp) {
     int maxgrpn = NA_INTEGER;
-    ngrp = gsngrp[flip];
+    ngrp = ctx->gsngrp[ctx->flip];
     SEXP s_starts = retStarts ? install("starts") : install("group.sizes");
     setAttrib(ans, s_starts, x = allocVector(INTSXP, ngrp));
     int *px = INTEGER(x); // pointer -> http://adv-r.had.co.nz/C-interface.html
@@ -1901,12 +2007,12 @@ SEXP Cradixsort(SEXP NA_last, SEXP decreasing, SEXP RETstrt, SEXP RETgs, SEXP SO
       if (ngrp > 0) {
         int ngm1 = ngrp-1;
         px[0] = 1;
-        py[ngm1] = gs[flip][ngm1];
+        py[ngm1] = ctx->gs[ctx->flip][ngm1];
         for (int i = 0; i != ngm1; ++i) {
-          py[i] = gs[flip][i];
+          py[i] = ctx->gs[ctx->flip][i];
           px[i + 1] = px[i] + py[i];
         }
-        maxgrpn = gsmax[flip];
+        maxgrpn = ctx->gsmax[ctx->flip];
       }
       UNPROTECT(1); // unprotects y !!
     } else if(retStarts) {
@@ -1914,16 +2020,16 @@ SEXP Cradixsort(SEXP NA_last, SEXP decreasing, SEXP RETstrt, SEXP RETgs, SEXP SO
         int ngm1 = ngrp-1;
         px[0] = 1;
         for (int i = 0; i != ngm1; ++i) {
-          px[i + 1] = px[i] + gs[flip][i];
+          px[i + 1] = px[i] + ctx->gs[ctx->flip][i];
         }
-        maxgrpn = gsmax[flip];
+        maxgrpn = ctx->gsmax[ctx->flip];
       }
     } else {
       if (ngrp > 0) {
         for (int i = 0; i != ngrp; ++i) {
-          px[i] = gs[flip][i];
+          px[i] = ctx->gs[ctx->flip][i];
         }
-        maxgrpn = gsmax[flip];
+        maxgrpn = ctx->gsmax[ctx->flip];
       }
     }
     SEXP s_maxgrpn = install("maxgrpn");
@@ -1945,7 +2051,7 @@ SEXP Cradixsort(SEXP NA_last, SEXP decreasing, SEXP RETstrt, SEXP RETgs, SEXP SO
   setAttrib(ans, s_sorted, ScalarLogical(isSorted));
 
 
-  Rboolean dropZeros = !retGrp && !isSorted && nalast == 0;
+  Rboolean dropZeros = !retGrp && !isSorted && ctx->nalast == 0;
   if (dropZeros) {
     int zeros = 0;
     for (int i = 0; i != n; ++i) {
@@ -1963,11 +2069,12 @@ SEXP Cradixsort(SEXP NA_last, SEXP decreasing, SEXP RETstrt, SEXP RETgs, SEXP SO
     }
   }
 
-  gsfree();
-  free(radix_xsub);          radix_xsub=NULL;    radix_xsuballoc=0;
-  free(xsub); free(newo);    xsub=newo=NULL;
-  free(xtmp);                xtmp=NULL;          xtmp_alloc=0;
-  free(otmp);                otmp=NULL;          otmp_alloc=0;
+  // ctx->icounts is kept for the next call (it was a static array before)
+  gsfree(ctx);
+  free(ctx->radix_xsub);     ctx->radix_xsub=NULL;    ctx->radix_xsuballoc=0;
+  free(xsub); free(ctx->newo); xsub=ctx->newo=NULL;
+  free(ctx->xtmp);           ctx->xtmp=NULL;          ctx->xtmp_alloc=0;
+  free(ctx->otmp);           ctx->otmp=NULL;          ctx->otmp_alloc=0;
   free(csort_otmp);          csort_otmp=NULL;    csort_otmp_alloc=0;
 
   free(cradix_counts);       cradix_counts=NULL; cradix_counts_alloc=0;
@@ -1979,64 +2086,73 @@ SEXP Cradixsort(SEXP NA_last, SEXP decreasing, SEXP RETstrt, SEXP RETgs, SEXP SO
 }
 
 
-void Cdoubleradixsort(int *o, Rboolean NA_last, Rboolean decreasing, SEXP x) {
-  int n = -1, tmp;
-  R_xlen_t nl = n;
-  void *xd;
-
-  nalast = (NA_last) ? 1 : -1; // 1=TRUE, -1=FALSE
-  /* When grouping, we round off doubles to account for imprecision */
-  setNumericRounding(0);
-  if(!isVector(x)) error("x is not a vector");
-  nl = XLENGTH(x);
-  order = (decreasing) ? -1 : 1;
-
-  // (ML) FIXME: need to support long vectors
-  if (nl > INT_MAX) error("long vectors not supported");
-
-  n = (int) nl;
-  // if (n != LENGTH(o)) error("lengths of all arguments must match"); Cannot get length from pointer to first element!!
-
-  // upper limit for stack size (all size 1 groups). We'll detect
-  // and avoid that limit, but if just one non-1 group (say 2), that
-  // can't be avoided.
-  gsmaxalloc = n;
-
-  // once for the result, needs to be length n.
-
-  // TO DO: save allocation if NULL is returned (isSorted = =TRUE) so
-  // [i|c|d]sort know they can populate o directly with no working
-  // memory needed to reorder existing order had to repace this from
-  // '0' to '-1' because 'nalast = 0' replace 'o[.]' with 0 values.
+/* Reentrant ordering of integer (tx = INTSXP or LGLSXP) or double (REALSXP)
+ vectors: o is set to the 1-based (stable) ordering of x, with missing values
+ last (nalast = TRUE) or first. No group sizes are computed and x is not
+ modified. Threads ordering concurrently each need their own context. A
+ context initialized by radix_ctx_init(ctx, n) (outside the parallel region,
+ as it may raise an error) does not allocate any further memory ordering
+ vectors of length n or less. With n = 0, memory is allocated when needed. */
+void radix_ctx_init(radix_ctx *ctx, int n)
+{
+  memset(ctx, 0, sizeof(radix_ctx));
+  ctx->nalast = 1;
+  ctx->order = 1;
+  ctx->nthreads = 1;
+  setNumericRounding(ctx, 0);
+  if (n <= 0)
+    return;
+  ctx->otmp = (int *) malloc(n * sizeof(int));
+  ctx->xtmp = malloc(n * sizeof(double));
+  ctx->radix_xsub = malloc(n * sizeof(double));
+  ctx->icounts = (unsigned int *) calloc(N_RANGE + 1, sizeof(unsigned int));
+  if (!ctx->otmp || !ctx->xtmp || !ctx->radix_xsub || !ctx->icounts) {
+    radix_ctx_free(ctx);
+    error("Failed to allocate working memory to order %d elements", n);
+  }
+  ctx->otmp_alloc = ctx->xtmp_alloc = n;
+  ctx->radix_xsuballoc = n;
+}
 
-  if (n > 0) o[0] = -1;
-  xd = DATAPTR(x);
+void radix_ctx_free(radix_ctx *ctx)
+{
+  gsfree(ctx);
+  free(ctx->newo);           ctx->newo=NULL;
+  free(ctx->radix_xsub);     ctx->radix_xsub=NULL;    ctx->radix_xsuballoc=0;
+  free(ctx->xtmp);           ctx->xtmp=NULL;          ctx->xtmp_alloc=0;
+  free(ctx->otmp);           ctx->otmp=NULL;          ctx->otmp_alloc=0;
+  free(ctx->icounts);        ctx->icounts=NULL;
+}
 
-  stackgrps = FALSE;
-  // savetl_init();   // from now on use Error not error.
-  twiddle = &dtwiddle;
-  is_nan  = &dnan;
-  tmp = dsorted(xd, n);
-  if (tmp) { // -1 or 1.
-    if (tmp == 1) { // same as expected in 'order' (1 = increasing, -1 = decreasing)
-      for (int i = 0; i != n; ++i) o[i] = i + 1;
-    } else if (tmp == -1) { // -1 (or -n for result of strcmp), strictly opposite to -expected 'order'
-      for (int i = 0; i != n; ++i) o[i] = n - i;
-    }
+void radix_order_ctx(radix_ctx *ctx, int *o, const void *x, int n, int tx, Rboolean NA_last, Rboolean decreasing)
+{
+  if (n < 1)
+    return;
+  void *xd = (void *) x; // only the ordering of subsequent keys modifies x
+  ctx->nalast = (NA_last) ? 1 : -1; // 1=TRUE, -1=FALSE
+  ctx->order = (decreasing) ? -1 : 1;
+  ctx->stackgrps = FALSE;
+  ctx->gsmaxalloc = n;
+  o[0] = -1;
+  int tmp = (tx == REALSXP) ? dsorted(ctx, xd, n) : isorted(ctx, xd, n);
+  if (tmp == 1) { // same as expected in 'order' (1 = increasing, -1 = decreasing)
+    for (int i = 0; i != n; ++i) o[i] = i + 1;
+  } else if (tmp == -1) { // strictly opposite to expected 'order'
+    for (int i = 0; i != n; ++i) o[i] = n - i;
+  } else if (tx == REALSXP) {
+    dsort(ctx, xd, o, n);
   } else {
-      dsort(xd, o, n);
+    isort(ctx, xd, o, n);
   }
-  // dsort(xd, o, n);
-
-
-  maxlen = 1;  // reset global. Minimum needed to count "" and NA
-  //savetl_end();
-
-  // gsfree(); // ok??
-  free(radix_xsub);          radix_xsub=NULL;    radix_xsuballoc=0; // needed in dradix !!
-  free(newo);    newo=NULL; // also needed !!
-  free(xtmp);                xtmp=NULL;          xtmp_alloc=0; // needed !!
-  free(otmp);                otmp=NULL;          otmp_alloc=0; // needed !!
-  // TO DO: use xtmp already got
+}
 
+void Cdoubleradixsort(int *o, Rboolean NA_last, Rboolean decreasing, SEXP x) {
+  radix_ctx ctx;
+  if(!isVector(x)) error("x is not a vector");
+  // (ML) FIXME: need to support long vectors
+  if (XLENGTH(x) > INT_MAX) error("long vectors not supported");
+  radix_ctx_init(&ctx, 0);
+  ctx.nthreads = group_nthreads;
+  radix_order_ctx(&ctx, o, DATAPTR(x), (int) XLENGTH(x), REALSXP, NA_last, decreasing);
+  radix_ctx_free(&ctx);
 }
@@ -16,6 +16,35 @@
 #define TRLEN(x) ((int) TRUELENGTH(x))
 #define SET_TRLEN(x, v) SET_TRUELENGTH(x, ((int) (v)))
 
+/* State of the radix sort of integers and doubles. Each thread sorting
+ concurrently needs its own (see radix_order_ctx() in base_radixsort.c) */
+typedef struct {
+  int *gs[2];             // group sizes stack, e.g. 23, 12, 87, 2, 1, 34,...
+  int flip;               // two stacks flip flopped: flip and 1 - flip
+  int gsalloc[2];         // allocated stack size
+  int gsngrp[2];
+  int gsmax[2];           // max grpn so far
+  int gsmaxalloc;         // max size of stack, set to nrows
+  Rboolean stackgrps;     // switched off for last arg unless retGrp == TRUE
+  int *newo;              // used by [i|d|c]sort to reorder order, not needed if narg == 1
+  int nalast;             // =1, 0, -1 for TRUE, NA, FALSE respectively
+  int order;              // =1, -1 for ascending and descending order respectively
+  int range, xmin;        // used by both icount and do_radixsort
+  unsigned int *icounts;  // counts of the counting sort (icount)
+  unsigned int radixcounts[8][257]; // 4 are used for iradix, 8 for dradix
+  int skip[8];
+  void *radix_xsub;
+  size_t radix_xsuballoc;
+  int *otmp, otmp_alloc;
+  void *xtmp;
+  int xtmp_alloc;
+  unsigned long long dmask1, dmask2;
+  int nthreads;           // threads for the passes over the whole input in iradix and dradix
+} radix_ctx;
 
 SEXP Cradixsort(SEXP NA_last, SEXP decreasing, SEXP RETstrt, SEXP RETgs, SEXP SORTStr, SEXP args);
 void Cdoubleradixsort(int *o, Rboolean NA_last, Rboolean decreasing, SEXP x);
+SEXP setgroupthreadsC(SEXP x);
+void radix_ctx_init(radix_ctx *ctx, int n);
+void radix_ctx_free(radix_ctx *ctx);
+void radix_order_ctx(radix_ctx *ctx, int *o, const void *x, int n, int tx, Rboolean NA_last, Rboolean decreasing);
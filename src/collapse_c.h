@@ -6,15 +6,92 @@
 // Faster than Rinternals version (which uses math library version)
 #undef ISNAN
 #define ISNAN(x) ((x) != (x))
+// Vectorised kernels: number of independent accumulators, and where GCC supports function multi-versioning (x86-64 with
+// glibc) versions for AVX-512, AVX2 and the baseline (SSE2) instruction set, of which one is chosen when loading the package.
+#define VLANES 8
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 6 && defined(__x86_64__) && defined(__linux__) && defined(__GLIBC__)
+#define SIMD_DISPATCH __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define SIMD_DISPATCH
+#endif
 
 void matCopyAttr(SEXP out, SEXP x, SEXP Rdrop, int ng);
 void DFcopyAttr(SEXP out, SEXP x, int ng);
+// Row-level multithreading of grouped computations (see gpar_plan() in small_helper.c)
+#define GPAR_SERIAL 0
+#define GPAR_SORTED 1
+#define GPAR_BUFFER 2
+int gpar_plan(int *cuts, const int *pg, const int ng, const int l, const int nth);
+void gpar_merge_sum(double *pout, const double *buf, const int ng, const int nth, const int narm);
+void gpar_merge_count(int *pout, const int *buf, const int ng, const int nth);
+void gpar_first_last(int *pgl, const void *px, const int tx, const int ng, const int *pg, const int narm, const int last, const int nth, const int mode, const int *cuts);
+// Segmented reductions over sorted groups (see gseg_starts() in small_helper.c)
+#define GSEG_MINSIZE 8
+#define GSEG_CHUNK 64 // Groups per dynamically scheduled chunk
+int *gseg_starts(const int *pg, const int ng, const int l);
+void fsum_double_seg_impl(double *restrict pout, const double *restrict px, const double *restrict pw, const int ng, const int *restrict starts, const int narm, const int nth);
+void fmean_double_seg_impl(double *restrict pout, const double *restrict px, const double *restrict pw, const int ng, const int *restrict starts, const int narm, const int nth);
+// Radix-partitioned aggregation over many groups (see gpart_init() in small_helper.c)
+#define GPART_MINGROUPS 33554432 // Default of gpart_mingroups: 256MB of doubles, see gpart_init()
+extern int gpart_mingroups;
+#define GPART_SHIFT 15 // At least 32768 groups per bucket
+#define GPART_MAXBUCKETS 64
+typedef struct {
+  int nb, shift, nth, l; // number of buckets, bits of the group id not used for bucketing, threads, rows
+  int *starts, *offs;    // starts of the buckets (nb + 1), and write offsets of the threads in the buckets (nth * nb)
+  int *g;                // group ids in bucket order
+} gpart;
+int gpart_init(gpart *gp, const int *pg, const int ng, const int l, int nth);
+void gpart_scatter(void *restrict out, const void *restrict px, const int tx, const int *restrict pg, const gpart *gp);
+void gpart_free(gpart *gp);
+// Grouped sum kernels, also used in other functions (e.g. fmean)
+void fsum_double_g_impl(double *restrict pout, const double *restrict px, const int ng, const int *restrict pg, const int narm, const int l);
+void fsum_double_g_omp_impl(double *restrict pout, const double *restrict px, const int ng, const int *restrict pg, const int narm, const int l, const int nth, const int mode, const int *restrict cuts);
+int fsum_g_part_impl(void *pout, const void *px, const double *pw, const int tx, const int ng, const int *pg, const int narm, const gpart *gp);
+extern const char *fsum_int_overflow_msg;
+// Vectorised ungrouped sums (see fsum.c)
+double vsum_double(const double *restrict px, const double *restrict pw, const int narm, const int l, int *restrict pn, double *restrict psumw);
+double vsum_int(const int *restrict px, const int narm, const int l, int *restrict pn);
+// Compensated and deterministic summation (see fsum.c)
+extern int fsum_accurate, fsum_deterministic;
+#define FSUM_STRICT (fsum_accurate || fsum_deterministic)
+int fsum_strict_impl(double *restrict pout, const double *restrict px, const double *restrict pw, const int narm, const int l, const int nth, const int mean);
+void fsum_strict_g_impl(double *restrict pout, int *restrict pn, double *restrict psw, const double *restrict px, const double *restrict pw,
+                        const int ng, const int *restrict pg, const int narm, const int l, const int nth, int mode, const int *restrict cuts);
+// Scratch memory for the hash tables of grouped fndistinct and fmode (see hash_arena_init() in small_helper.c)
+typedef struct {
+  int *h, *n;             // hash table (row of first occurrence + 1) and counts
+  double *sumw;           // sums of weights
+  unsigned int *gen, cur; // slot id is occupied iff gen[id] == cur
+  size_t M;               // size of h and gen
+} hash_arena;
+#define HA_COUNTS 1
+#define HA_WEIGHTS 2
+void hash_arena_init(hash_arena *a, const int maxl, const int nlev, const int what);
+size_t hash_arena_next(hash_arena *a, const int l, int *K);
+void hash_arena_free(hash_arena *a);
+// Parallel loop i = 0...n-1 where each thread reuses its own arena 'ha' sized for maxl elements or nlev levels
+#define HA_PRAGMA(x) _Pragma(#x)
+#define HA_PARALLEL_FOR(i, n, nth, maxl, nlev, what, ...) \
+  HA_PRAGMA(omp parallel num_threads(nth))                 \
+  {                                                        \
+    hash_arena ha;                                         \
+    hash_arena_init(&ha, maxl, nlev, what);                \
+    HA_PRAGMA(omp for)                                     \
+    for(int i = 0; i < n; ++i) { __VA_ARGS__ }             \
+    hash_arena_free(&ha);                                  \
+  }
+// Sort-based grouped fndistinct and fmode for large groups (see gsort_use() in small_helper.c)
+#define GSORT_MIN_GS 32768 // Minimum average group size
+int gsort_use(SEXP x, const SEXP *pg);
+SEXP gsort_order(SEXP x, SEXP gid);
 
 void multi_yw(void *, void *, void *, void *, void *, void *, void *, void *, void *, void *);
 SEXP collapse_init(SEXP);
 SEXP dt_na(SEXP, SEXP);
 SEXP allNAv(SEXP, SEXP);
 SEXP Cradixsort(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+SEXP setgroupthreadsC(SEXP);
 SEXP frankds(SEXP, SEXP, SEXP, SEXP);
 SEXP pacf1(SEXP, SEXP);
 SEXP rbindlist(SEXP, SEXP, SEXP, SEXP);
@@ -56,26 +133,34 @@ SEXP Cissorted(SEXP x, SEXP strictly);
 SEXP groupVec(SEXP X, SEXP starts, SEXP sizes);
 SEXP groupAtVec(SEXP X, SEXP starts, SEXP naincl);
 SEXP funiqueC(SEXP x);
+SEXP setgroupcacheC(SEXP x);
+// Per-group statistics cache (see gstats_get() in kit_dup.c)
+int gstats_active(void);
+SEXP gstats_get(SEXP g, const int ng);
+void gstats_put(SEXP g, const int ng, const double *pstat);
 SEXP createeptr(SEXP x);
 SEXP geteptr(SEXP x);
 SEXP fcrosscolon(SEXP x, SEXP ngp, SEXP y, SEXP ckna);
 SEXP fwtabulate(SEXP x, SEXP w, SEXP ngp, SEXP ckna);
 SEXP vecgcd(SEXP x);
 // fnobs rewritten in C:
-SEXP fnobsC(SEXP x, SEXP Rng, SEXP g);
-SEXP fnobsmC(SEXP x, SEXP Rng, SEXP g, SEXP Rdrop);
-SEXP fnobslC(SEXP x, SEXP Rng, SEXP g, SEXP Rdrop);
+SEXP fnobsC(SEXP x, SEXP Rng, SEXP g, SEXP Rnth);
+SEXP fnobsmC(SEXP x, SEXP Rng, SEXP g, SEXP Rdrop, SEXP Rnth);
+SEXP fnobslC(SEXP x, SEXP Rng, SEXP g, SEXP Rdrop, SEXP Rnth);
 // ffirst and flast rewritten in C:
-SEXP ffirstC(SEXP x, SEXP Rng, SEXP g, SEXP gst, SEXP Rnarm);
-SEXP ffirstmC(SEXP x, SEXP Rng, SEXP g, SEXP gst, SEXP Rnarm, SEXP Rdrop);
-SEXP ffirstlC(SEXP x, SEXP Rng, SEXP g, SEXP gst, SEXP Rnarm);
-SEXP flastC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm);
-SEXP flastmC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rdrop);
-SEXP flastlC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm);
+SEXP ffirstC(SEXP x, SEXP Rng, SEXP g, SEXP gst, SEXP Rnarm, SEXP Rnth);
+SEXP ffirstmC(SEXP x, SEXP Rng, SEXP g, SEXP gst, SEXP Rnarm, SEXP Rdrop, SEXP Rnth);
+SEXP ffirstlC(SEXP x, SEXP Rng, SEXP g, SEXP gst, SEXP Rnarm, SEXP Rnth);
+SEXP flastC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rnth);
+SEXP flastmC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rdrop, SEXP Rnth);
+SEXP flastlC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rnth);
 // fsum rewritten in C:
 SEXP fsumC(SEXP x, SEXP Rng, SEXP g, SEXP w, SEXP Rnarm, SEXP Rnth);
 SEXP fsummC(SEXP x, SEXP Rng, SEXP g, SEXP w, SEXP Rnarm, SEXP Rdrop, SEXP Rnth);
 SEXP fsumlC(SEXP x, SEXP Rng, SEXP g, SEXP w, SEXP Rnarm, SEXP Rdrop, SEXP Rnth);
+SEXP setsumaccC(SEXP x);
+SEXP setgpartminC(SEXP x);
+SEXP setdetC(SEXP x);
 // fprod rewritten in C:
 SEXP fprodC(SEXP x, SEXP Rng, SEXP g, SEXP w, SEXP Rnarm);
 SEXP fprodmC(SEXP x, SEXP Rng, SEXP g, SEXP w, SEXP Rnarm, SEXP Rdrop);
@@ -85,12 +170,14 @@ SEXP fmeanC(SEXP x, SEXP Rng, SEXP g, SEXP gs, SEXP w, SEXP Rnarm, SEXP Rnth);
 SEXP fmeanmC(SEXP x, SEXP Rng, SEXP g, SEXP gs, SEXP w, SEXP Rnarm, SEXP Rdrop, SEXP Rnth);
 SEXP fmeanlC(SEXP x, SEXP Rng, SEXP g, SEXP gs, SEXP w, SEXP Rnarm, SEXP Rdrop, SEXP Rnth);
 // fmin and fmax rewritten in C:
-SEXP fminC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm);
-SEXP fminmC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rdrop);
-SEXP fminlC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rdrop);
-SEXP fmaxC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm);
-SEXP fmaxmC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rdrop);
-SEXP fmaxlC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rdrop);
+SEXP fminC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rnth);
+SEXP fminmC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rdrop, SEXP Rnth);
+SEXP fminlC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rdrop, SEXP Rnth);
+SEXP fmaxC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rnth);
+SEXP fmaxmC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rdrop, SEXP Rnth);
+SEXP fmaxlC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rdrop, SEXP Rnth);
+// Fused computation of several statistics (collap, fsummarise):
+SEXP fmultistatlC(SEXP x, SEXP Rng, SEXP g, SEXP gs, SEXP w, SEXP Rstats, SEXP Rnarm);
 // Added fcumsum, written in C:
 SEXP fcumsumC(SEXP x, SEXP Rng, SEXP g, SEXP o, SEXP Rnarm, SEXP Rfill);
 SEXP fcumsummC(SEXP x, SEXP Rng, SEXP g, SEXP o, SEXP Rnarm, SEXP Rfill);
@@ -103,6 +190,10 @@ SEXP TRAlC(SEXP x, SEXP xAG, SEXP g, SEXP Rret, SEXP Rset);
 SEXP fndistinctC(SEXP x, SEXP g, SEXP Rnarm, SEXP Rnthreads);
 SEXP fndistinctlC(SEXP x, SEXP g, SEXP Rnarm, SEXP Rdrop, SEXP Rnthreads);
 SEXP fndistinctmC(SEXP x, SEXP g, SEXP Rnarm, SEXP Rdrop, SEXP Rnthreads);
+SEXP fndistinct_hllC(SEXP x, SEXP g, SEXP Rnarm, SEXP Rp, SEXP Rdrop, SEXP Rnthreads);
+SEXP hll_sketchC(SEXP x, SEXP g, SEXP Rnarm, SEXP Rp, SEXP Rnthreads);
+SEXP hll_mergeC(SEXP a, SEXP b, SEXP ia, SEXP ib);
+SEXP hll_estimateC(SEXP x);
 // fmode, rewritten in C:
 SEXP fmodeC(SEXP x, SEXP g, SEXP w, SEXP Rnarm, SEXP Rret, SEXP Rnthreads);
 SEXP fmodelC(SEXP x, SEXP g, SEXP w, SEXP Rnarm, SEXP Rret, SEXP Rnthreads);
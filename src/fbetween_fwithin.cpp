@@ -1,16 +1,178 @@
 #include <Rcpp.h>
 using namespace Rcpp;
+#include "par_cols.h"
 
 // NOTE: Special case is set_mean = -Inf, which is when on the R side mean = "overall.mean"
 // TODO: Best simply adding set_mean to the mean calculation, or better other solution ?
 
 
+// Multithreaded and in-place centering ----------------------------------------------------------------------------
+// With nthreads > 1, set = TRUE or set_sum_accuracy() / set_deterministic(TRUE), the (weighted) group sums, counts and
+// sums of weights are computed with the kernels of fsum.c (multithreaded over blocks of rows following a gpar_plan(), and
+// thread-count invariant under set_deterministic(TRUE)), and x is transformed in a second pass that is parallel over rows
+// (or over columns for matrices and lists with at least nthreads columns). With set = TRUE the result is written into x.
+// The means, theta and set_mean are applied as in the serial code below. This code is also used for unweighted grouped
+// computations with set_group_cache(size > 0): then the group sizes are taken from the per-group statistics cache (see
+// gstats_get() in kit_dup.c), where they are saved the first time they are obtained over the complete data. With cached
+// group sizes only the sums of x are accumulated, unless x has missing values and na.rm = TRUE.
+
+extern "C" int fsum_accurate, fsum_deterministic; // fsum.c
+extern "C" int gpar_plan(int *cuts, const int *pg, const int ng, const int l, const int nth); // small_helper.c
+extern "C" void fsum_strict_g_impl(double *pout, int *pn, double *psw, const double *px, const double *pw, const int ng,
+                                   const int *pg, const int narm, const int l, const int nth, int mode, const int *cuts); // fsum.c
+extern "C" void fmean_double_impl(double *pout, const double *px, const int narm, const int l); // fmean.c
+extern "C" void fmean_double_omp_impl(double *pout, const double *px, const int narm, const int l, const int nth);
+extern "C" void fmean_weights_impl(double *pout, const double *px, const double *pw, const int narm, const int l);
+extern "C" void fmean_weights_omp_impl(double *pout, const double *px, const double *pw, const int narm, const int l, const int nth);
+extern "C" int gstats_active(void); // kit_dup.c
+extern "C" SEXP gstats_get(SEXP g, const int ng);
+extern "C" void gstats_put(SEXP g, const int ng, const double *pstat);
+#define GPAR_SERIAL 0 // Modes returned by gpar_plan(), see collapse_c.h
+
+// Centers (or with B replaces by the means) px (length l) into pout, which may be px. pgs are the group sizes, only
+// used without weights and na.rm. mode and cuts are the gpar_plan() for nth threads. pcn are cached group sizes of the
+// complete data (only without weights), or NULL. Otherwise, if pstat is not NULL and the group sizes are obtained as
+// counts (na.rm = TRUE and no missing values), they are written to pstat and true is returned.
+static bool BW_par_impl(double *pout, const double *px, int ng, const int *pg, const int *pgs, const double *pw, bool narm,
+                        double theta, double set_mean, bool B, bool fill, int l, int nth, int mode, const int *cuts,
+                        const double *pcn, double *pstat) {
+  if(ng == 0) {
+    double mu;
+    if(pw == NULL) {
+      if(nth > 1) fmean_double_omp_impl(&mu, px, narm, l, nth);
+      else fmean_double_impl(&mu, px, narm, l);
+    } else {
+      if(nth > 1) fmean_weights_omp_impl(&mu, px, pw, narm, l, nth);
+      else fmean_weights_impl(&mu, px, pw, narm, l);
+    }
+    mu = theta * mu - set_mean;
+    if(!B) {
+      #pragma omp parallel for num_threads(nth) if(nth > 1)
+      for(int i = 0; i < l; ++i) pout[i] = px[i] - mu;
+    } else if(fill || !narm) {
+      std::fill(pout, pout + l, mu);
+    } else {
+      #pragma omp parallel for num_threads(nth) if(nth > 1)
+      for(int i = 0; i < l; ++i) pout[i] = std::isnan(px[i]) ? px[i] : mu;
+    }
+    return false;
+  }
+  bool saved = false;
+  std::vector<double> sum(ng), sumw(pw == NULL ? 0 : ng);
+  std::vector<int> n(pw == NULL && narm && pcn == NULL ? ng : 0);
+  if(pcn != NULL) { // Only without weights
+    fsum_strict_g_impl(sum.data(), NULL, NULL, px, NULL, ng, pg, 0, l, nth, mode, cuts);
+    if(narm) for(int i = ng; i--; ) {
+      if(!std::isnan(sum[i])) continue;
+      pcn = NULL; // Missing values: sums and counts of the non-missing values
+      n.assign(ng, 0);
+      fsum_strict_g_impl(sum.data(), n.data(), NULL, px, NULL, ng, pg, narm, l, nth, mode, cuts);
+      break;
+    }
+  } else {
+    fsum_strict_g_impl(sum.data(), n.empty() ? NULL : n.data(), sumw.empty() ? NULL : sumw.data(), px, pw, ng, pg, narm, l, nth, mode, cuts);
+    if(pstat != NULL && narm && pw == NULL) {
+      int64_t nobs = 0;
+      for(int i = ng; i--; ) nobs += n[i];
+      if((saved = nobs == l)) std::copy(n.begin(), n.end(), pstat);
+    }
+  }
+  #define BW_DENOM(i) (pcn != NULL ? pcn[i] : pw != NULL ? sumw[i] : narm ? (double)n[i] : (double)pgs[i])
+  double osum = 0;
+  if(B || (set_mean == 0 && theta == 1)) {
+    for(int i = ng; i--; ) sum[i] /= BW_DENOM(i);
+  } else if(set_mean != R_NegInf) {
+    for(int i = ng; i--; ) sum[i] = theta * sum[i] / BW_DENOM(i) - set_mean;
+  } else {
+    double on = 0;
+    for(int i = ng; i--; ) {
+      if(std::isnan(sum[i])) continue;
+      osum += sum[i];
+      on += BW_DENOM(i);
+      sum[i] /= BW_DENOM(i);
+    }
+    osum = theta * (osum / on);
+    if(theta != 1) for(int i = ng; i--; ) sum[i] *= theta;
+  }
+  #undef BW_DENOM
+  const double *pmean = sum.data()-1;
+  if(B) {
+    if(fill || !narm) {
+      #pragma omp parallel for num_threads(nth) if(nth > 1)
+      for(int i = 0; i < l; ++i) pout[i] = pmean[pg[i]];
+    } else {
+      #pragma omp parallel for num_threads(nth) if(nth > 1)
+      for(int i = 0; i < l; ++i) pout[i] = std::isnan(px[i]) ? px[i] : pmean[pg[i]];
+    }
+  } else if(set_mean != R_NegInf) {
+    #pragma omp parallel for num_threads(nth) if(nth > 1)
+    for(int i = 0; i < l; ++i) pout[i] = px[i] - pmean[pg[i]];
+  } else {
+    #pragma omp parallel for num_threads(nth) if(nth > 1)
+    for(int i = 0; i < l; ++i) pout[i] = px[i] - pmean[pg[i]] + osum;
+  }
+  return saved;
+}
+
+// Columns of a matrix or list with the same weights (pw) and groups g (see par_cols.h). With row-level parallelism the
+// gpar_plan() is shared by the columns. The group sizes obtained from the first column are saved to the cache.
+static void BW_par_cols(const par_cols& pc, int col, int ng, const IntegerVector& g, const SEXP& gs, const double *pw,
+                        bool narm, double theta, double set_mean, bool B, bool fill, int nth) {
+  const int *pl = pc.pl.data();
+  if(ng == 0 && !B && set_mean == R_NegInf) stop("For centering on the overall mean a grouping vector needs to be supplied");
+  if(nth < 1) nth = 1;
+  const int *pg = g.begin();
+  // The group sizes are cached if they would otherwise be counted: without weights, and with na.rm or if gs is not given
+  const bool cache = ng > 0 && col > 0 && pw == NULL && (narm || Rf_isNull(gs)) && gstats_active();
+  SEXP gst = cache ? gstats_get(g, ng) : R_NilValue; // Kept alive by the cache as long as g is
+  const double *pcn = Rf_isNull(gst) ? NULL : REAL(gst);
+  std::vector<double> stat(cache && pcn == NULL ? ng : 0);
+  std::vector<int> gsv, cuts(nth+1);
+  if(ng > 0 && pw == NULL && !narm && pcn == NULL) { // Group sizes
+    if(Rf_isNull(gs)) {
+      gsv.assign(ng, 0);
+      if(col > 0) for(int i = 0; i != pl[0]; ++i) ++gsv[pg[i]-1];
+    } else {
+      if(Rf_length(gs) != ng) stop("Vector of group-sizes must match number of groups");
+      gsv.assign(INTEGER(gs), INTEGER(gs) + ng);
+    }
+    if(stat.size()) {
+      std::copy(gsv.begin(), gsv.end(), stat.begin());
+      gstats_put(g, ng, stat.data());
+      stat.clear();
+    }
+  }
+  const int *pgs = gsv.empty() ? NULL : gsv.data();
+  double *pstat = stat.empty() ? NULL : stat.data();
+  bool saved = false;
+  const int mode = nth > 1 && col > 0 && col < nth && ng > 0 ? gpar_plan(cuts.data(), pg, ng, pl[0], nth) : GPAR_SERIAL;
+  par_cols_apply(col, nth, [&](int j, int nthj) {
+    bool sj = BW_par_impl(pc.pouts[j], pc.pxs[j], ng, pg, pgs, pw, narm, theta, set_mean, B, fill, pl[j], nthj,
+                          nthj > 1 ? mode : GPAR_SERIAL, cuts.data(), pcn, j == 0 ? pstat : NULL);
+    if(j == 0) saved = sj;
+  });
+  if(saved) gstats_put(g, ng, stat.data());
+}
+
 // [[Rcpp::export]]
 NumericVector BWCpp(const NumericVector& x, int ng = 0, const IntegerVector& g = 0,
                     const SEXP& gs = R_NilValue, const SEXP& w = R_NilValue,
-                    bool narm = true, double theta = 1, double set_mean = 0, bool B = false, bool fill = false) {
+                    bool narm = true, double theta = 1, double set_mean = 0, bool B = false, bool fill = false,
+                    int nthreads = 1, bool set = false) {
   int l = x.size();
   if(l < 1) return x; // Prevents segfault for numeric(0) #101
+
+  if(nthreads > 1 || set || fsum_accurate || fsum_deterministic || (ng > 0 && Rf_isNull(w) && gstats_active())) { // Multithreaded / in-place / cached, see above
+    if(ng > 0 && g.size() != l) stop("length(g) must match nrow(X)");
+    if(!Rf_isNull(w) && Rf_length(w) != l) stop("length(w) must match length(x)");
+    NumericVector wg = Rf_isNull(w) ? NumericVector(0) : NumericVector(w), res = set ? x : NumericVector(no_init_vector(l));
+    par_cols pc;
+    par_cols_matrix(pc, res.begin(), x.begin(), l, 1, l);
+    BW_par_cols(pc, 1, ng, g, gs, Rf_isNull(w) ? NULL : wg.begin(), narm, theta, set_mean, B, fill, nthreads);
+    if(!set) SHALLOW_DUPLICATE_ATTRIB(res, x);
+    return res;
+  }
+
   NumericVector out = no_init_vector(l);
 
   if (Rf_isNull(w)) { // No weights
@@ -314,8 +476,22 @@ NumericVector BWCpp(const NumericVector& x, int ng = 0, const IntegerVector& g =
 // [[Rcpp::export]]
 NumericMatrix BWmCpp(const NumericMatrix& x, int ng = 0, const IntegerVector& g = 0,
                      const SEXP& gs = R_NilValue, const SEXP& w = R_NilValue,
-                     bool narm = true, double theta = 1, double set_mean = 0, bool B = false, bool fill = false) {
+                     bool narm = true, double theta = 1, double set_mean = 0, bool B = false, bool fill = false,
+                     int nthreads = 1, bool set = false) {
   int l = x.nrow(), col = x.ncol();
+
+  if(nthreads > 1 || set || fsum_accurate || fsum_deterministic || (ng > 0 && Rf_isNull(w) && gstats_active())) { // Multithreaded / in-place / cached, see above
+    if(ng > 0 && g.size() != l) stop("length(g) must match nrow(X)");
+    if(!Rf_isNull(w) && Rf_length(w) != l) stop("length(w) must match nrow(X)");
+    NumericVector wg = Rf_isNull(w) ? NumericVector(0) : NumericVector(w);
+    NumericMatrix res = set ? x : NumericMatrix(no_init_matrix(l, col));
+    par_cols pc;
+    par_cols_matrix(pc, res.begin(), x.begin(), l, col, l);
+    BW_par_cols(pc, col, ng, g, gs, Rf_isNull(w) ? NULL : wg.begin(), narm, theta, set_mean, B, fill, nthreads);
+    if(!set) SHALLOW_DUPLICATE_ATTRIB(res, x);
+    return res;
+  }
+
   NumericMatrix out = no_init_matrix(l, col);
 
   if (Rf_isNull(w)) { // No weights !
@@ -684,9 +860,22 @@ NumericMatrix BWmCpp(const NumericMatrix& x, int ng = 0, const IntegerVector& g
 // [[Rcpp::export]]
 List BWlCpp(const List& x, int ng = 0, const IntegerVector& g = 0,
             const SEXP& gs = R_NilValue, const SEXP& w = R_NilValue,
-            bool narm = true, double theta = 1, double set_mean = 0, bool B = false, bool fill = false) {
+            bool narm = true, double theta = 1, double set_mean = 0, bool B = false, bool fill = false,
+            int nthreads = 1, bool set = false) {
 
   int l = x.size();
+
+  if(nthreads > 1 || set || fsum_accurate || fsum_deterministic || (ng > 0 && Rf_isNull(w) && gstats_active())) { // Multithreaded / in-place / cached, see above
+    par_cols pc;
+    par_cols_list(pc, x, ng, g.size(), w, 0, set);
+    NumericVector wg = Rf_isNull(w) ? NumericVector(0) : NumericVector(w);
+    BW_par_cols(pc, l, ng, g, gs, Rf_isNull(w) ? NULL : wg.begin(), narm, theta, set_mean, B, fill, nthreads);
+    if(set) return x;
+    if(ng > 0) for(int j = l; j--; ) SHALLOW_DUPLICATE_ATTRIB(VECTOR_ELT(pc.res, j), VECTOR_ELT(pc.columns, j)); // As the serial code
+    SHALLOW_DUPLICATE_ATTRIB(pc.res, x);
+    return pc.res;
+  }
+
   List out(l);
 
   if (Rf_isNull(w)) { // No weights
@@ -1080,3 +1269,251 @@ List BWlCpp(const List& x, int ng = 0, const IntegerVector& g = 0,
   SHALLOW_DUPLICATE_ATTRIB(out, x);
   return out;
 }
+
+
+// Higher-dimensional centering --------------------------------------------------------------------------------------
+// Method of alternating projections for fhdwithin() / fhdbetween() with several factors and / or varying slopes. Factor
+// f projects on p regressors within each of its groups: an intercept (unless slope.flag[f] < 0) and abs(slope.flag[f])
+// slope variables, following fixest::demean(). A sweep updates the coefficients factor after factor, where the (weighted)
+// cross-products of the residuals with the regressors are group sums computed with the kernels of fsum.c (row-parallel
+// following a gpar_plan(), as for the centering above), and the per-group systems are solved with Cholesky factors that
+// are computed once. Sweeps are accelerated with the Irons & Tuck (1969) extrapolation of the coefficients, and iteration
+// stops when no coefficient changes by more than tol (absolutely or relative to 0.1 + its magnitude). Columns are
+// centered in parallel if there are at least nthreads of them, otherwise one after the other with row-parallel sweeps.
+
+struct HDfactor {
+  int ng, p, mode;
+  const int *pg;
+  std::vector<const double *> z, wz; // Regressors and regressors times weights. NULL is a (unweighted) intercept.
+  std::vector<double> L; // Cholesky factors of the cross-product matrices (p x p for each group, rows of aliased regressors are 0)
+  std::vector<int> cuts;
+};
+
+// Factorizes the ng p x p cross-product matrices in L (lower triangles, row-major) in place. Regressors that are constant
+// 0 or collinear with the preceding ones within a group (e.g. unused factor levels) get a 0 row and column.
+static void HD_chol(double *L, int ng, int p) {
+  std::vector<double> d(p);
+  for(int g = 0; g != ng; ++g, L += p*p) {
+    for(int k = 0; k != p; ++k) d[k] = L[k*p+k];
+    for(int k = 0; k != p; ++k) {
+      double s = L[k*p+k];
+      for(int m = 0; m != k; ++m) s -= L[k*p+m] * L[k*p+m];
+      if(!(s > 1e-10 * d[k])) { // also catches NaN
+        for(int m = 0; m != p; ++m) L[k*p+m] = L[m*p+k] = 0;
+        continue;
+      }
+      L[k*p+k] = s = sqrt(s);
+      for(int i = k+1; i != p; ++i) {
+        double t = L[i*p+k];
+        for(int m = 0; m != k; ++m) t -= L[i*p+m] * L[k*p+m];
+        L[i*p+k] = t / s;
+      }
+    }
+  }
+}
+
+// One projection on factor F: the coefficients pa (ng x p) are updated, and the residuals pr (length l) with them.
+// pb and pd are workspaces of size ng * p.
+static void HD_project(double *pa, double *pr, const HDfactor& F, double *pb, double *pd, int l, int nth, bool par) {
+  const int ng = F.ng, p = F.p, *pg = F.pg;
+  const int mode = par ? F.mode : GPAR_SERIAL;
+  for(int a = 0; a != p; ++a) fsum_strict_g_impl(pb + (size_t)a*ng, NULL, NULL, pr, F.wz[a], ng, pg, 0, l, par ? nth : 1, mode, F.cuts.data());
+  const double *L = F.L.data();
+  for(int g = 0; g != ng; ++g, L += p*p) {
+    double *d = pd + (size_t)g*p;
+    for(int k = 0; k != p; ++k) { // Forward substitution
+      if(L[k*p+k] == 0) { d[k] = 0; continue; }
+      double t = pb[(size_t)k*ng+g];
+      for(int m = 0; m != k; ++m) t -= L[k*p+m] * d[m];
+      d[k] = t / L[k*p+k];
+    }
+    for(int k = p; k--; ) { // Back substitution
+      if(L[k*p+k] == 0) continue;
+      double t = d[k];
+      for(int m = k+1; m != p; ++m) t -= L[m*p+k] * d[m];
+      d[k] = t / L[k*p+k];
+    }
+    for(int k = 0; k != p; ++k) pa[(size_t)g*p+k] += d[k];
+  }
+  const double *pdm = pd - p; // 1-based group ids
+  if(p == 1 && F.z[0] == NULL) {
+    #pragma omp parallel for num_threads(nth) if(par && nth > 1)
+    for(int i = 0; i < l; ++i) pr[i] -= pdm[pg[i]];
+  } else {
+    #pragma omp parallel for num_threads(nth) if(par && nth > 1)
+    for(int i = 0; i < l; ++i) {
+      const double *di = pdm + (size_t)pg[i]*p;
+      double v = pr[i];
+      for(int k = 0; k != p; ++k) v -= di[k] * (F.z[k] == NULL ? 1 : F.z[k][i]);
+      pr[i] = v;
+    }
+  }
+}
+
+// Residuals of px given the coefficients pa (of all factors, stacked)
+static void HD_resid(double *pr, const double *px, const std::vector<HDfactor>& fe, const double *pa, int l, int nth, bool par) {
+  #pragma omp parallel for num_threads(nth) if(par && nth > 1)
+  for(int i = 0; i < l; ++i) {
+    double v = px[i];
+    const double *paf = pa;
+    for(const HDfactor& F : fe) {
+      const double *ai = paf + (size_t)(F.pg[i]-1)*F.p;
+      for(int k = 0; k != F.p; ++k) v -= ai[k] * (F.z[k] == NULL ? 1 : F.z[k][i]);
+      paf += (size_t)F.ng*F.p;
+    }
+    pr[i] = v;
+  }
+}
+
+static void HD_sweep(double *pa, double *pr, const std::vector<HDfactor>& fe, double *pb, double *pd, int l, int nth, bool par) {
+  for(const HDfactor& F : fe) {
+    HD_project(pa, pr, F, pb, pd, l, nth, par);
+    pa += (size_t)F.ng*F.p;
+  }
+}
+
+static bool HD_continue(const std::vector<double>& a, const std::vector<double>& b, double tol) {
+  for(size_t i = 0; i != a.size(); ++i) {
+    double diff = fabs(a[i] - b[i]);
+    if(diff > tol && diff / (0.1 + fabs(a[i])) > tol) return true;
+  }
+  return false;
+}
+
+// Writes the residuals of px into pr. Returns false if iter sweeps did not achieve convergence.
+static bool HD_center(double *pr, const double *px, const std::vector<HDfactor>& fe, int l, int iter, double tol, int nth, bool par) {
+  size_t P = 0, maxgp = 0;
+  for(const HDfactor& F : fe) {
+    P += (size_t)F.ng*F.p;
+    if((size_t)F.ng*F.p > maxgp) maxgp = (size_t)F.ng*F.p;
+  }
+  std::vector<double> X(P), GX(P), GGX(P), b(maxgp), d(maxgp);
+  std::copy(px, px + l, pr);
+  if(fe.size() == 1) { // Projection on a single factor (with slopes) is exact
+    HD_sweep(X.data(), pr, fe, b.data(), d.data(), l, nth, par);
+    return true;
+  }
+  for(int it = 0; it < iter; it += 2) {
+    GX = X;
+    HD_sweep(GX.data(), pr, fe, b.data(), d.data(), l, nth, par);
+    if(!HD_continue(X, GX, tol)) return true;
+    GGX = GX;
+    HD_sweep(GGX.data(), pr, fe, b.data(), d.data(), l, nth, par);
+    if(!HD_continue(GX, GGX, tol)) return true;
+    double vprod = 0, ssq = 0; // Irons-Tuck
+    for(size_t i = 0; i != P; ++i) {
+      double dGX = GGX[i] - GX[i], d2X = dGX - GX[i] + X[i];
+      vprod += dGX * d2X;
+      ssq += d2X * d2X;
+    }
+    if(ssq == 0) return true;
+    double coef = vprod / ssq;
+    for(size_t i = 0; i != P; ++i) X[i] = GGX[i] - coef * (GGX[i] - GX[i]);
+    HD_resid(pr, px, fe, X.data(), l, nth, par);
+  }
+  return false;
+}
+
+// [[Rcpp::export]]
+SEXP HDWCpp(const SEXP& x, const List& fl, const SEXP& slvars = R_NilValue, const SEXP& slflag = R_NilValue,
+            const SEXP& w = R_NilValue, int iter = 10000, double tol = 1e-8, int nthreads = 1) {
+  const bool islist = TYPEOF(x) == VECSXP;
+  int nfl = fl.size(), col, l, nsl = 0;
+  if(nfl < 1) stop("fl needs to contain at least one factor");
+  std::vector<NumericVector> xcols; // Numeric copies of non-double columns are kept here
+  NumericVector xv = islist ? NumericVector(0) : NumericVector(x);
+  if(islist) {
+    col = Rf_length(x);
+    l = col > 0 ? Rf_length(VECTOR_ELT(x, 0)) : Rf_length(VECTOR_ELT(fl, 0));
+    for(int j = 0; j != col; ++j) {
+      if(Rf_length(VECTOR_ELT(x, j)) != l) stop("All columns of x need to have the same length");
+      xcols.push_back(NumericVector(VECTOR_ELT(x, j)));
+    }
+  } else {
+    SEXP dim = Rf_getAttrib(x, R_DimSymbol);
+    l = Rf_isNull(dim) ? xv.size() : INTEGER(dim)[0];
+    col = l == 0 ? 0 : xv.size() / l;
+  }
+  IntegerVector flag = Rf_isNull(slflag) ? IntegerVector(nfl) : IntegerVector(slflag);
+  if(flag.size() != nfl) stop("length(slope.flag) must match length(fl)");
+  int nslv = Rf_isNull(slvars) ? 0 : Rf_length(slvars);
+  std::vector<NumericVector> slv;
+  NumericVector wv = Rf_isNull(w) ? NumericVector(0) : NumericVector(w);
+  const double *pw = Rf_isNull(w) ? NULL : wv.begin();
+  if(pw != NULL && wv.size() != l) stop("length(w) must match nrow(x)");
+  if(nthreads < 1) nthreads = 1;
+
+  std::vector<HDfactor> fe(nfl);
+  std::vector<std::vector<double> > wzs; // Products of weights and slopes
+  for(int f = 0; f != nfl; ++f) {
+    HDfactor& F = fe[f];
+    SEXP g = fl[f];
+    if(Rf_inherits(g, "GRP")) {
+      F.ng = Rf_asInteger(VECTOR_ELT(g, 0));
+      g = VECTOR_ELT(g, 1);
+    } else if(Rf_isFactor(g)) {
+      F.ng = Rf_nlevels(g);
+    } else stop("All elements of fl need to be factors or GRP objects");
+    if(TYPEOF(g) != INTSXP || Rf_length(g) != l) stop("All factors in fl need to have length nrow(x)");
+    F.pg = INTEGER(g);
+    int ns = abs(flag[f]);
+    if(flag[f] >= 0) {
+      F.z.push_back(NULL);
+      F.wz.push_back(pw);
+    }
+    for(int k = 0; k != ns; ++k, ++nsl) {
+      if(nsl >= nslv) stop("Fewer slope variables than indicated by slope.flag");
+      slv.push_back(NumericVector(VECTOR_ELT(slvars, nsl)));
+      if(slv.back().size() != l) stop("All slope variables need to have length nrow(x)");
+      const double *pz = slv.back().begin();
+      F.z.push_back(pz);
+      if(pw == NULL) F.wz.push_back(pz);
+      else {
+        wzs.push_back(std::vector<double>(l));
+        double *pwz = wzs.back().data();
+        for(int i = 0; i != l; ++i) pwz[i] = pw[i] * pz[i];
+        F.wz.push_back(pwz);
+      }
+    }
+    F.p = F.z.size();
+    if(F.p == 0) stop("slope.flag must not be 0 for factors without intercept");
+    // Cross-product matrices of the regressors within groups
+    const int p = F.p, ng = F.ng, *pg = F.pg;
+    F.L.assign((size_t)ng*p*p, 0.0);
+    double *pL = F.L.data() - p*p;
+    for(int i = 0; i != l; ++i) {
+      if(pg[i] < 1 || pg[i] > ng) stop("Factors in fl must not contain missing values");
+      double *Li = pL + (size_t)pg[i]*p*p, wi = pw == NULL ? 1 : pw[i];
+      for(int a = 0; a != p; ++a) {
+        double za = F.z[a] == NULL ? wi : F.z[a][i] * wi;
+        for(int b = 0; b <= a; ++b) Li[a*p+b] += za * (F.z[b] == NULL ? 1 : F.z[b][i]);
+      }
+    }
+    HD_chol(F.L.data(), ng, p);
+    F.cuts.assign(nthreads+1, 0);
+    F.mode = col < nthreads && l > 0 ? gpar_plan(F.cuts.data(), pg, ng, l, nthreads) : GPAR_SERIAL;
+  }
+
+  std::vector<double *> pouts(col);
+  std::vector<const double *> pxs(col);
+  RObject out = islist ? Rf_allocVector(VECSXP, col) : Rf_allocVector(REALSXP, xv.size());
+  for(int j = 0; j != col; ++j) {
+    if(islist) {
+      SET_VECTOR_ELT(out, j, Rf_allocVector(REALSXP, l));
+      pouts[j] = REAL(VECTOR_ELT(out, j));
+      pxs[j] = xcols[j].begin();
+    } else {
+      pouts[j] = REAL(out) + (size_t)j*l;
+      pxs[j] = xv.begin() + (size_t)j*l;
+    }
+  }
+  int nconv = 0;
+  if(col >= nthreads) {
+    #pragma omp parallel for num_threads(nthreads) schedule(dynamic) reduction(+:nconv) if(nthreads > 1)
+    for(int j = 0; j < col; ++j) nconv += HD_center(pouts[j], pxs[j], fe, l, iter, tol, 1, false);
+  } else {
+    for(int j = 0; j != col; ++j) nconv += HD_center(pouts[j], pxs[j], fe, l, iter, tol, nthreads, true);
+  }
+  if(nconv != col) warning("Higher-dimensional centering did not converge for %i column(s) in %i iterations. Consider increasing 'iter' or 'tol'.", col - nconv, iter);
+  return out;
+}
@@ -174,8 +174,25 @@ SEXP ffirst_impl(SEXP x, int ng, SEXP g, int narm, int *gl) {
   }
 }
 
-SEXP ffirstC(SEXP x, SEXP Rng, SEXP g, SEXP gst, SEXP Rnarm) {
-  int *pgl, ng = asInteger(Rng), narm = asLogical(Rnarm);
+// Row-level multithreading with groups: the indices of the first (non-missing) elements in each group are computed
+// in parallel, after which the values are fetched by ffirst_impl() as in the narm = FALSE case.
+static SEXP ffirst_gpar(SEXP x, int ng, SEXP g, int narm, int nth, int gmode, int *cuts) {
+  SEXP gl = PROTECT(allocVector(INTSXP, ng));
+  int *pgl = INTEGER(gl);
+  gpar_first_last(pgl, DATAPTR(x), TYPEOF(x), ng, INTEGER(g), narm, 0, nth, gmode, cuts);
+  for(int i = ng; i--; ) if(pgl[i] != NA_INTEGER) ++pgl[i]; // ffirst_impl() expects 1-based indices
+  SEXP res = ffirst_impl(x, ng, g, 0, pgl);
+  UNPROTECT(1);
+  return res;
+}
+
+SEXP ffirstC(SEXP x, SEXP Rng, SEXP g, SEXP gst, SEXP Rnarm, SEXP Rnth) {
+  int *pgl, ng = asInteger(Rng), narm = asLogical(Rnarm), nth = asInteger(Rnth), l = length(x);
+  if(ng > 0 && nth > 1 && l >= 100000 && (narm || length(gst) != ng)) {
+    if(length(g) != l) error("length(g) must match nrow(X)");
+    int *cuts = (int*)R_alloc(nth+1, sizeof(int)), gmode = gpar_plan(cuts, INTEGER(g), ng, l, nth);
+    if(gmode != GPAR_SERIAL) return ffirst_gpar(x, ng, g, narm, nth, gmode, cuts);
+  }
   if(ng == 0 || narm) {
     pgl = &ng; // TO avoid Wmaybe uninitialized
     return ffirst_impl(x, ng, g, narm, pgl);
@@ -209,34 +226,48 @@ SEXP ffirstC(SEXP x, SEXP Rng, SEXP g, SEXP gst, SEXP Rnarm) {
   } else return ffirst_impl(x, ng, g, narm, INTEGER(gst));
 }
 
-SEXP ffirstlC(SEXP x, SEXP Rng, SEXP g, SEXP gst, SEXP Rnarm) {
-  int l = length(x), *pgl, ng = asInteger(Rng), narm = asLogical(Rnarm), nprotect = 1;
+SEXP ffirstlC(SEXP x, SEXP Rng, SEXP g, SEXP gst, SEXP Rnarm, SEXP Rnth) {
+  int l = length(x), *pgl, ng = asInteger(Rng), narm = asLogical(Rnarm), nth = asInteger(Rnth), nprotect = 1,
+    gmode = GPAR_SERIAL, *cuts = NULL, lg = length(g);
+  if(ng > 0 && nth > 1 && lg >= 100000 && (narm || length(gst) != ng)) {
+    cuts = (int*)R_alloc(nth+1, sizeof(int));
+    gmode = gpar_plan(cuts, INTEGER(g), ng, lg, nth);
+  }
   if(ng > 0 && !narm) {
     if(length(gst) != ng) {
     // Cant use integer array here because apparently it is removed by the garbage collector when passed to a new function
     SEXP gl = PROTECT(allocVector(INTSXP, ng)); ++nprotect;
-    int *pg = INTEGER(g), lg = length(g); // gl[ng],
+    int *pg = INTEGER(g); // gl[ng],
     pgl = INTEGER(gl); // pgl = &gl[0];
+    if(gmode != GPAR_SERIAL) {
+      gpar_first_last(pgl, NULL, INTSXP, ng, pg, 0, 0, nth, gmode, cuts);
+      for(int i = ng; i--; ) if(pgl[i] != NA_INTEGER) ++pgl[i];
+    } else {
     for(int i = ng; i--; ) pgl[i] = NA_INTEGER;
     --pgl;
     for(int i = 0; i != lg; ++i) if(pgl[pg[i]] == NA_INTEGER) pgl[pg[i]] = i+1;
     ++pgl;
+    }
     } else pgl = INTEGER(gst);
   } else pgl = &l; // To avoid Wmaybe uninitialized..
   // return ffirst_impl(VECTOR_ELT(x, 0), ng, g, narm, pgl);
   SEXP out = PROTECT(allocVector(VECSXP, l));
   SEXP *px = SEXPPTR(x), *pout = SEXPPTR(out);
-  for(int j = 0; j != l; ++j) pout[j] = ffirst_impl(px[j], ng, g, narm, pgl);
+  if(narm && gmode != GPAR_SERIAL) {
+    for(int j = 0; j != l; ++j) pout[j] = ffirst_gpar(px[j], ng, g, narm, nth, gmode, cuts);
+  } else {
+    for(int j = 0; j != l; ++j) pout[j] = ffirst_impl(px[j], ng, g, narm, pgl);
+  }
   DFcopyAttr(out, x, ng);
   UNPROTECT(nprotect);
   return out;
 }
 
 // For matrix writing a separate function to increase efficiency.
-SEXP ffirstmC(SEXP x, SEXP Rng, SEXP g, SEXP gst, SEXP Rnarm, SEXP Rdrop) {
+SEXP ffirstmC(SEXP x, SEXP Rng, SEXP g, SEXP gst, SEXP Rnarm, SEXP Rdrop, SEXP Rnth) {
   SEXP dim = getAttrib(x, R_DimSymbol);
   if(isNull(dim)) error("x is not a matrix");
-  int tx = TYPEOF(x), ng = asInteger(Rng), narm = asLogical(Rnarm),
+  int tx = TYPEOF(x), ng = asInteger(Rng), narm = asLogical(Rnarm), nth = asInteger(Rnth),
     l = INTEGER(dim)[0], col = INTEGER(dim)[1], end = l-1;
   if (l < 2) return x;
   if (ng == 0) {
@@ -307,8 +338,48 @@ SEXP ffirstmC(SEXP x, SEXP Rng, SEXP g, SEXP gst, SEXP Rnarm, SEXP Rdrop) {
     int nprotect = 1;
     if(length(g) != l) error("length(g) must match nrow(X)");
     SEXP out = PROTECT(allocVector(tx, ng * col));
-    int *pg = INTEGER(g);
-    if(narm) {
+    int *pg = INTEGER(g), gmode = GPAR_SERIAL, *cuts = NULL;
+    if(nth > 1 && l >= 100000 && (narm || length(gst) != ng)) {
+      cuts = (int*)R_alloc(nth+1, sizeof(int));
+      gmode = gpar_plan(cuts, pg, ng, l, nth);
+    }
+    if(narm && gmode != GPAR_SERIAL) {
+      // Row-level multithreading: indices of the first non-missing elements of each column, then fetching the values
+      SEXP gl = PROTECT(allocVector(INTSXP, ng)); ++nprotect;
+      int *pgl = INTEGER(gl);
+      switch(tx) {
+      case REALSXP: {
+        double *px = REAL(x), *pout = REAL(out);
+        for(int j = 0; j != col; ++j) {
+          gpar_first_last(pgl, px, tx, ng, pg, narm, 0, nth, gmode, cuts);
+          for(int i = ng; i--; ) pout[i] = pgl[i] == NA_INTEGER ? NA_REAL : px[pgl[i]];
+          px += l; pout += ng;
+        }
+        break;
+      }
+      case INTSXP:
+      case LGLSXP: {
+        int *px = INTEGER(x), *pout = INTEGER(out);
+        for(int j = 0; j != col; ++j) {
+          gpar_first_last(pgl, px, tx, ng, pg, narm, 0, nth, gmode, cuts);
+          for(int i = ng; i--; ) pout[i] = pgl[i] == NA_INTEGER ? NA_INTEGER : px[pgl[i]];
+          px += l; pout += ng;
+        }
+        break;
+      }
+      case STRSXP:
+      case VECSXP: {
+        SEXP *px = SEXPPTR(x), *pout = SEXPPTR(out), na = tx == STRSXP ? NA_STRING : R_NilValue;
+        for(int j = 0; j != col; ++j) {
+          gpar_first_last(pgl, px, tx, ng, pg, narm, 0, nth, gmode, cuts);
+          for(int i = ng; i--; ) pout[i] = pgl[i] == NA_INTEGER ? na : px[pgl[i]];
+          px += l; pout += ng;
+        }
+        break;
+      }
+      default: error("Unsupported SEXP type!");
+      }
+    } else if(narm) {
       switch(tx) {
       case REALSXP: {
         double *px = REAL(x), *pout = REAL(out);
@@ -359,10 +430,15 @@ SEXP ffirstmC(SEXP x, SEXP Rng, SEXP g, SEXP gst, SEXP Rnarm, SEXP Rdrop) {
       SEXP gl = PROTECT(allocVector(INTSXP, ng)); ++nprotect;
       // int gl[ng], *pgl; pgl = &gl[0];
       pgl = INTEGER(gl);
+      if(gmode != GPAR_SERIAL) {
+        gpar_first_last(pgl, NULL, INTSXP, ng, pg, 0, 0, nth, gmode, cuts);
+        for(int i = ng; i--; ) if(pgl[i] != NA_INTEGER) ++pgl[i];
+      } else {
       for(int i = ng; i--; ) pgl[i] = NA_INTEGER;
       --pgl; // gcc11 issue with plain array
       for(int i = 0; i != l; ++i) if(pgl[pg[i]] == NA_INTEGER) pgl[pg[i]] = i+1;
       ++pgl;
+      }
       } else pgl = INTEGER(gst);
       switch(tx) {
       case REALSXP: {
@@ -155,8 +155,23 @@ SEXP flast_impl(SEXP x, int ng, SEXP g, int narm, int *gl) {
   }
 }
 
-SEXP flastC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm) {
-  int *pgl, ng = asInteger(Rng), narm = asLogical(Rnarm);
+// Row-level multithreading with groups: the indices of the last (non-missing) elements in each group are computed
+// in parallel, after which the values are fetched by flast_impl() as in the narm = FALSE case.
+static SEXP flast_gpar(SEXP x, int ng, SEXP g, int narm, int nth, int gmode, int *cuts) {
+  SEXP gl = PROTECT(allocVector(INTSXP, ng));
+  gpar_first_last(INTEGER(gl), DATAPTR(x), TYPEOF(x), ng, INTEGER(g), narm, 1, nth, gmode, cuts);
+  SEXP res = flast_impl(x, ng, g, 0, INTEGER(gl));
+  UNPROTECT(1);
+  return res;
+}
+
+SEXP flastC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rnth) {
+  int *pgl, ng = asInteger(Rng), narm = asLogical(Rnarm), nth = asInteger(Rnth), l = length(x);
+  if(ng > 0 && nth > 1 && l >= 100000) {
+    if(length(g) != l) error("length(g) must match nrow(X)");
+    int *cuts = (int*)R_alloc(nth+1, sizeof(int)), gmode = gpar_plan(cuts, INTEGER(g), ng, l, nth);
+    if(gmode != GPAR_SERIAL) return flast_gpar(x, ng, g, narm, nth, gmode, cuts);
+  }
   if(ng == 0 || narm) {
     pgl = &ng;
     return flast_impl(x, ng, g, narm, pgl);
@@ -172,30 +187,43 @@ SEXP flastC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm) {
   return res;
 }
 
-SEXP flastlC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm) {
-  int l = length(x), *pgl, ng = asInteger(Rng), narm = asLogical(Rnarm), nprotect = 1;
+SEXP flastlC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rnth) {
+  int l = length(x), *pgl, ng = asInteger(Rng), narm = asLogical(Rnarm), nth = asInteger(Rnth), nprotect = 1,
+    gmode = GPAR_SERIAL, *cuts = NULL, lg = length(g);
+  if(ng > 0 && nth > 1 && lg >= 100000) {
+    cuts = (int*)R_alloc(nth+1, sizeof(int));
+    gmode = gpar_plan(cuts, INTEGER(g), ng, lg, nth);
+  }
   if(ng > 0 && !narm) {
     SEXP gl = PROTECT(allocVector(INTSXP, ng)); ++nprotect;
     int *pg = INTEGER(g);
     pgl = INTEGER(gl);
+    if(gmode != GPAR_SERIAL) {
+      gpar_first_last(pgl, NULL, INTSXP, ng, pg, 0, 1, nth, gmode, cuts);
+    } else {
     for(int i = ng; i--; ) pgl[i] = NA_INTEGER;
     --pgl;
-    for(int i = length(g); i--; ) if(pgl[pg[i]] == NA_INTEGER) pgl[pg[i]] = i;
+    for(int i = lg; i--; ) if(pgl[pg[i]] == NA_INTEGER) pgl[pg[i]] = i;
     ++pgl;
+    }
   } else pgl = &l;
   SEXP out = PROTECT(allocVector(VECSXP, l));
   SEXP *px = SEXPPTR(x), *pout = SEXPPTR(out);
-  for(int j = 0; j != l; ++j) pout[j] = flast_impl(px[j], ng, g, narm, pgl);
+  if(narm && gmode != GPAR_SERIAL) {
+    for(int j = 0; j != l; ++j) pout[j] = flast_gpar(px[j], ng, g, narm, nth, gmode, cuts);
+  } else {
+    for(int j = 0; j != l; ++j) pout[j] = flast_impl(px[j], ng, g, narm, pgl);
+  }
   DFcopyAttr(out, x, ng);
   UNPROTECT(nprotect);
   return out;
 }
 
 // For matrix writing a separate function to increase efficiency.
-SEXP flastmC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rdrop) {
+SEXP flastmC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rdrop, SEXP Rnth) {
   SEXP dim = getAttrib(x, R_DimSymbol);
   if(isNull(dim)) error("x is not a matrix");
-  int tx = TYPEOF(x), ng = asInteger(Rng), narm = asLogical(Rnarm),
+  int tx = TYPEOF(x), ng = asInteger(Rng), narm = asLogical(Rnarm), nth = asInteger(Rnth),
     l = INTEGER(dim)[0], col = INTEGER(dim)[1];
   if (l < 2) return x;
   if (ng == 0) {
@@ -265,8 +293,49 @@ SEXP flastmC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rdrop) {
   } else { // with groups
     if(length(g) != l) error("length(g) must match nrow(X)");
     SEXP out = PROTECT(allocVector(tx, ng * col));
-    int *pg = INTEGER(g);
-    if(narm) {
+    int *pg = INTEGER(g), gmode = GPAR_SERIAL, *cuts = NULL;
+    if(nth > 1 && l >= 100000) {
+      cuts = (int*)R_alloc(nth+1, sizeof(int));
+      gmode = gpar_plan(cuts, pg, ng, l, nth);
+    }
+    if(narm && gmode != GPAR_SERIAL) {
+      // Row-level multithreading: indices of the last non-missing elements of each column, then fetching the values
+      SEXP gl = PROTECT(allocVector(INTSXP, ng));
+      int *pgl = INTEGER(gl);
+      switch(tx) {
+      case REALSXP: {
+        double *px = REAL(x), *pout = REAL(out);
+        for(int j = 0; j != col; ++j) {
+          gpar_first_last(pgl, px, tx, ng, pg, narm, 1, nth, gmode, cuts);
+          for(int i = ng; i--; ) pout[i] = pgl[i] == NA_INTEGER ? NA_REAL : px[pgl[i]];
+          px += l; pout += ng;
+        }
+        break;
+      }
+      case INTSXP:
+      case LGLSXP: {
+        int *px = INTEGER(x), *pout = INTEGER(out);
+        for(int j = 0; j != col; ++j) {
+          gpar_first_last(pgl, px, tx, ng, pg, narm, 1, nth, gmode, cuts);
+          for(int i = ng; i--; ) pout[i] = pgl[i] == NA_INTEGER ? NA_INTEGER : px[pgl[i]];
+          px += l; pout += ng;
+        }
+        break;
+      }
+      case STRSXP:
+      case VECSXP: {
+        SEXP *px = SEXPPTR(x), *pout = SEXPPTR(out), na = tx == STRSXP ? NA_STRING : R_NilValue;
+        for(int j = 0; j != col; ++j) {
+          gpar_first_last(pgl, px, tx, ng, pg, narm, 1, nth, gmode, cuts);
+          for(int i = ng; i--; ) pout[i] = pgl[i] == NA_INTEGER ? na : px[pgl[i]];
+          px += l; pout += ng;
+        }
+        break;
+      }
+      default: error("Unsupported SEXP type!");
+      }
+      UNPROTECT(1);
+    } else if(narm) {
       switch(tx) {
       case REALSXP: {
         double *px = REAL(x), *pout = REAL(out);
@@ -314,10 +383,14 @@ SEXP flastmC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rdrop) {
     } else {
       SEXP gl = PROTECT(allocVector(INTSXP, ng));
       int *pgl = INTEGER(gl);
+      if(gmode != GPAR_SERIAL) {
+        gpar_first_last(pgl, NULL, INTSXP, ng, pg, 0, 1, nth, gmode, cuts);
+      } else {
       for(int i = ng; i--; ) pgl[i] = NA_INTEGER;
       --pgl;
       for(int i = l; i--; ) if(pgl[pg[i]] == NA_INTEGER) pgl[pg[i]] = i;
       ++pgl;
+      }
       switch(tx) {
       case REALSXP: {
         double *px = REAL(x), *pout = REAL(out);
@@ -5,30 +5,14 @@
 // #include <R_ext/Altrep.h>
 
 void fmean_double_impl(double *restrict pout, const double *restrict px, const int narm, const int l) {
-  if(narm) {
-    int j = l-1, n = 1;
-    double mean = px[j];
-    while(ISNAN(mean) && j!=0) mean = px[--j];
-    if(j != 0) for(int i = j; i--; ) {
-      if(ISNAN(px[i])) continue;
-      mean += px[i];
-      ++n;
-    }
-    pout[0] = mean / n;
-  } else {
-    double mean = 0;
-    for(int i = 0; i != l; ++i) {
-      if(ISNAN(px[i])) {
-        mean = px[i];
-        break;
-      }
-      mean += px[i];
-    }
-    pout[0] = mean / l;
-  }
+  if(FSUM_STRICT && fsum_strict_impl(pout, px, NULL, narm, l, 1, 1)) return;
+  int n;
+  const double sum = vsum_double(px, NULL, narm, l, &n, NULL);
+  pout[0] = sum / (n ? n : 1);
 }
 
 void fmean_double_omp_impl(double *restrict pout, const double *restrict px, const int narm, const int l, const int nth) {
+  if(FSUM_STRICT && fsum_strict_impl(pout, px, NULL, narm, l, nth, 1)) return;
   double mean = 0;
   if(narm) {
     int n = 0;
@@ -47,61 +31,79 @@ void fmean_double_omp_impl(double *restrict pout, const double *restrict px, con
   }
 }
 
+// Grouped means are computed from sums and counts accumulated over rows start...end-1 (pout and n decremented by 1),
+// by the serial kernels over all rows, and by the multithreaded kernels over the row-ranges of a gpar_plan().
+// Without na.rm the sums are computed by the fsum kernels and divided by the group sizes.
+static void fmean_double_g_acc(double *restrict pout, int *restrict n, const double *restrict px, const int *restrict pg, const int start, const int end) {
+  for(int i = end; i-- != start; ) {
+    if(NISNAN(px[i])) { // faster way to code this ? -> Not Bad at all
+      if(ISNAN(pout[pg[i]])) {
+        pout[pg[i]] = px[i];
+        n[pg[i]] = 1;
+      } else {
+        pout[pg[i]] += px[i];
+        ++n[pg[i]];
+      }
+    }
+  }
+}
+
 void fmean_double_g_impl(double *restrict pout, const double *restrict px, const int ng, const int *restrict pg, const int *restrict pgs, const int narm, const int l) {
   if(narm) {
     int *restrict n = (int*)Calloc(ng, int);
-    for(int i = ng; i--; ) pout[i] = NA_REAL; // Other way ?
-    for(int i = l, gi; i--; ) {
-      if(NISNAN(px[i])) { // faster way to code this ? -> Not Bad at all
-        gi = pg[i]-1;
-        if(ISNAN(pout[gi])) {
-          pout[gi] = px[i];
-          n[gi] = 1;
-        } else {
-          pout[gi] += px[i];
-          ++n[gi];
-        }
-      }
+    if(FSUM_STRICT) fsum_strict_g_impl(pout, n, NULL, px, NULL, ng, pg, narm, l, 1, GPAR_SERIAL, NULL);
+    else {
+      for(int i = ng; i--; ) pout[i] = NA_REAL; // Other way ?
+      fmean_double_g_acc(pout-1, n-1, px, pg, 0, l);
     }
     for(int i = ng; i--; ) pout[i] /= n[i]; // could use R_alloc above, but what about this loop?
     Free(n);
   } else {
-    memset(pout, 0.0, sizeof(double) * ng);
-    --pout;
-    for(int i = l; i--; ) pout[pg[i]] += px[i]; // Used to stop loop when all groups passed with NA, but probably no speed gain since groups are mostly ordered.
-    ++pout;
+    fsum_double_g_impl(pout, px, ng, pg, 0, l);
     for(int i = ng; i--; ) pout[i] /= pgs[i];
   }
 }
 
-void fmean_weights_impl(double *restrict pout, const double *restrict px, const double *restrict pw, const int narm, const int l) {
-  double mean, sumw;
+void fmean_double_g_omp_impl(double *restrict pout, const double *restrict px, const int ng, const int *restrict pg, const int *restrict pgs, const int narm, const int l, const int nth, const int mode, const int *restrict cuts) {
   if(narm) {
-    int j = l-1;
-    while((ISNAN(px[j]) || ISNAN(pw[j])) && j!=0) --j;
-    sumw = pw[j];
-    mean = px[j] * sumw;
-    if(j != 0) for(int i = j; i--; ) {
-      if(ISNAN(px[i]) || ISNAN(pw[i])) continue;
-      mean += px[i] * pw[i];
-      sumw += pw[i];
-    }
-  } else {
-    mean = 0, sumw = 0;
-    for(int i = 0; i != l; ++i) {
-      if(ISNAN(px[i]) || ISNAN(pw[i])) {
-        mean = px[i] + pw[i];
-        break;
-      } else {
-        mean += px[i] * pw[i];
-        sumw += pw[i];
+    int *restrict n = (int*)Calloc(mode == GPAR_SORTED ? ng : (size_t)ng * nth, int);
+    if(FSUM_STRICT) fsum_strict_g_impl(pout, n, NULL, px, NULL, ng, pg, narm, l, nth, mode, cuts);
+    else if(mode == GPAR_SORTED) {
+      for(int i = ng; i--; ) pout[i] = NA_REAL;
+      #pragma omp parallel for num_threads(nth)
+      for(int t = 0; t < nth; ++t) fmean_double_g_acc(pout-1, n-1, px, pg, cuts[t], cuts[t+1]);
+    } else {
+      double *restrict buf = (double*)Calloc((size_t)ng * nth, double);
+      #pragma omp parallel for num_threads(nth)
+      for(int t = 0; t < nth; ++t) {
+        double *restrict pbt = buf + (size_t)t * ng;
+        for(int i = ng; i--; ) pbt[i] = NA_REAL;
+        fmean_double_g_acc(pbt-1, n + (size_t)t * ng - 1, px, pg, cuts[t], cuts[t+1]);
       }
+      gpar_merge_sum(pout, buf, ng, nth, narm);
+      gpar_merge_count(n, n, ng, nth);
+      Free(buf);
     }
+    #pragma omp parallel for num_threads(nth)
+    for(int i = 0; i < ng; ++i) pout[i] /= n[i];
+    Free(n);
+  } else {
+    fsum_double_g_omp_impl(pout, px, ng, pg, 0, l, nth, mode, cuts);
+    #pragma omp parallel for num_threads(nth)
+    for(int i = 0; i < ng; ++i) pout[i] /= pgs[i];
   }
-  pout[0] = mean / sumw;
+}
+
+void fmean_weights_impl(double *restrict pout, const double *restrict px, const double *restrict pw, const int narm, const int l) {
+  if(FSUM_STRICT && fsum_strict_impl(pout, px, pw, narm, l, 1, 1)) return;
+  int n;
+  double sumw;
+  const double sum = vsum_double(px, pw, narm, l, &n, &sumw);
+  pout[0] = n ? sum / sumw : sum;
 }
 
 void fmean_weights_omp_impl(double *restrict pout, const double *restrict px, const double *restrict pw, const int narm, const int l, const int nth) {
+  if(FSUM_STRICT && fsum_strict_impl(pout, px, pw, narm, l, nth, 1)) return;
   double mean = 0, sumw = 0;
   if(narm) {
     #pragma omp parallel for num_threads(nth) reduction(+:mean,sumw)
@@ -121,57 +123,78 @@ void fmean_weights_omp_impl(double *restrict pout, const double *restrict px, co
   pout[0] = mean / sumw;
 }
 
-void fmean_weights_g_impl(double *restrict pout, const double *restrict px, const int ng, const int *restrict pg, const double *restrict pw, const int narm, const int l) {
-  double *restrict sumw = (double*)Calloc(ng, double);
+static void fmean_weights_g_acc(double *restrict pout, double *restrict sumw, const double *restrict px, const int *restrict pg, const double *restrict pw, const int narm, const int start, const int end) {
   if(narm) {
-    for(int i = ng; i--; ) pout[i] = NA_REAL; // Other way ?
-    for(int i = l, gi; i--; ) {
+    for(int i = end; i-- != start; ) {
       if(ISNAN(px[i]) || ISNAN(pw[i])) continue;
-      gi = pg[i]-1;
-      if(ISNAN(pout[gi])) {
-        pout[gi] = px[i] * pw[i];
-        sumw[gi] = pw[i];
+      if(ISNAN(pout[pg[i]])) {
+        pout[pg[i]] = px[i] * pw[i];
+        sumw[pg[i]] = pw[i];
       } else {
-        pout[gi] += px[i] * pw[i];
-        sumw[gi] += pw[i];
+        pout[pg[i]] += px[i] * pw[i];
+        sumw[pg[i]] += pw[i];
       }
     }
   } else {
-    memset(pout, 0.0, sizeof(double) * ng);
-    for(int i = l, gi; i--; ) {
-      gi = pg[i]-1;
-      pout[gi] += px[i] * pw[i]; // Used to stop loop when all groups passed with NA, but probably no speed gain since groups are mostly ordered.
-      sumw[gi] += pw[i];
+    for(int i = end; i-- != start; ) {
+      pout[pg[i]] += px[i] * pw[i]; // Used to stop loop when all groups passed with NA, but probably no speed gain since groups are mostly ordered.
+      sumw[pg[i]] += pw[i];
     }
   }
+}
+
+void fmean_weights_g_impl(double *restrict pout, const double *restrict px, const int ng, const int *restrict pg, const double *restrict pw, const int narm, const int l) {
+  double *restrict sumw = (double*)Calloc(ng, double);
+  if(FSUM_STRICT) fsum_strict_g_impl(pout, NULL, sumw, px, pw, ng, pg, narm, l, 1, GPAR_SERIAL, NULL);
+  else {
+    if(narm) {
+      for(int i = ng; i--; ) pout[i] = NA_REAL; // Other way ?
+    } else memset(pout, 0.0, sizeof(double) * ng);
+    fmean_weights_g_acc(pout-1, sumw-1, px, pg, pw, narm, 0, l);
+  }
   for(int i = ng; i--; ) pout[i] /= sumw[i];
   Free(sumw);
 }
 
-double fmean_int_impl(const int *restrict px, const int narm, const int l) {
-  long long mean;
-  double dmean;
-  if(narm) {
-    int j = l-1, k = 1;
-    while(px[j] == NA_INTEGER && j!=0) --j;
-    mean = px[j];
-    if(j == 0 && (l > 1 || px[j] == NA_INTEGER)) return NA_REAL;
-    for(int i = j; i--; ) {
-      if(px[i] != NA_INTEGER) {
-        mean += px[i];
-        ++k;
-      }
-    }
-    dmean = (double)mean / k;
+void fmean_weights_g_omp_impl(double *restrict pout, const double *restrict px, const int ng, const int *restrict pg, const double *restrict pw, const int narm, const int l, const int nth, const int mode, const int *restrict cuts) {
+  if(FSUM_STRICT) {
+    double *restrict sumw = (double*)Calloc(ng, double);
+    fsum_strict_g_impl(pout, NULL, sumw, px, pw, ng, pg, narm, l, nth, mode, cuts);
+    #pragma omp parallel for num_threads(nth)
+    for(int i = 0; i < ng; ++i) pout[i] /= sumw[i];
+    Free(sumw);
+  } else if(mode == GPAR_SORTED) {
+    double *restrict sumw = (double*)Calloc(ng, double);
+    if(narm) {
+      for(int i = ng; i--; ) pout[i] = NA_REAL;
+    } else memset(pout, 0.0, sizeof(double) * ng);
+    #pragma omp parallel for num_threads(nth)
+    for(int t = 0; t < nth; ++t) fmean_weights_g_acc(pout-1, sumw-1, px, pg, pw, narm, cuts[t], cuts[t+1]);
+    #pragma omp parallel for num_threads(nth)
+    for(int i = 0; i < ng; ++i) pout[i] /= sumw[i];
+    Free(sumw);
   } else {
-    mean = 0;
-    for(int i = 0; i != l; ++i) {
-      if(px[i] == NA_INTEGER) return NA_REAL;
-      mean += px[i];
+    double *restrict buf = (double*)Calloc((size_t)ng * nth, double),
+           *restrict bufw = (double*)Calloc((size_t)ng * nth, double);
+    #pragma omp parallel for num_threads(nth)
+    for(int t = 0; t < nth; ++t) {
+      double *restrict pbt = buf + (size_t)t * ng;
+      if(narm) for(int i = ng; i--; ) pbt[i] = NA_REAL;
+      fmean_weights_g_acc(pbt-1, bufw + (size_t)t * ng - 1, px, pg, pw, narm, cuts[t], cuts[t+1]);
     }
-    dmean = (double)mean / l;
+    gpar_merge_sum(pout, buf, ng, nth, narm);
+    gpar_merge_sum(bufw, bufw, ng, nth, 0);
+    #pragma omp parallel for num_threads(nth)
+    for(int i = 0; i < ng; ++i) pout[i] /= bufw[i];
+    Free(buf);
+    Free(bufw);
   }
-  return dmean;
+}
+
+double fmean_int_impl(const int *restrict px, const int narm, const int l) {
+  int n;
+  const double sum = vsum_int(px, narm, l, &n);
+  return ISNAN(sum) ? NA_REAL : sum / n;
 }
 
 double fmean_int_omp_impl(const int *restrict px, const int narm, const int l, const int nth) {
@@ -188,40 +211,139 @@ double fmean_int_omp_impl(const int *restrict px, const int narm, const int l, c
     }
     dmean = n == 0 ? NA_REAL : (double)mean / n;
   } else {
-    #pragma omp parallel for num_threads(nth) reduction(+:mean)
-    for(int i = 0; i < l; ++i) mean += px[i];
-    dmean = (double)mean / l;
+    int nna = 0;
+    #pragma omp parallel for num_threads(nth) reduction(+:mean,nna)
+    for(int i = 0; i < l; ++i) {
+      if(px[i] == NA_INTEGER) ++nna;
+      else mean += px[i];
+    }
+    dmean = nna ? NA_REAL : (double)mean / l;
   }
   return dmean;
 }
 
-void fmean_int_g_impl(double *restrict pout, const int *restrict px, const int ng, const int *restrict pg, const int *restrict pgs, const int narm, const int l) {
+static void fmean_int_g_acc(double *restrict pout, int *restrict n, const int *restrict px, const int *restrict pg, const int narm, const int start, const int end) {
   if(narm) {
-    int *restrict n = (int*)Calloc(ng, int);
-    for(int i = ng; i--; ) pout[i] = NA_REAL;
-    for(int i = l, gi; i--; ) {
+    for(int i = end; i-- != start; ) {
       if(px[i] != NA_INTEGER) {
-        gi = pg[i]-1;
-        if(ISNAN(pout[gi])) {
-          pout[gi] = (double)px[i];
-          n[gi] = 1;
+        if(ISNAN(pout[pg[i]])) {
+          pout[pg[i]] = (double)px[i];
+          n[pg[i]] = 1;
         } else {
-          pout[gi] += px[i];
-          ++n[gi];
+          pout[pg[i]] += px[i];
+          ++n[pg[i]];
         }
       }
     }
+  } else {
+    for(int i = end; i-- != start; ) {
+      if(px[i] == NA_INTEGER) pout[pg[i]] = NA_REAL; // NA_INTEGER would otherwise be added as INT_MIN
+      else pout[pg[i]] += px[i];
+    }
+  }
+}
+
+void fmean_int_g_impl(double *restrict pout, const int *restrict px, const int ng, const int *restrict pg, const int *restrict pgs, const int narm, const int l) {
+  if(narm) {
+    int *restrict n = (int*)Calloc(ng, int);
+    for(int i = ng; i--; ) pout[i] = NA_REAL;
+    fmean_int_g_acc(pout-1, n-1, px, pg, narm, 0, l);
     for(int i = ng; i--; ) pout[i] /= n[i];
     Free(n);
   } else {
     memset(pout, 0.0, sizeof(double) * ng);
-    --pout;
-    for(int i = l; i--; ) pout[pg[i]] += px[i]; // Used to stop loop when all groups passed with NA, but probably no speed gain since groups are mostly ordered.
-    ++pout;
+    fmean_int_g_acc(pout-1, NULL, px, pg, narm, 0, l);
     for(int i = ng; i--; ) pout[i] /= pgs[i];
   }
 }
 
+void fmean_int_g_omp_impl(double *restrict pout, const int *restrict px, const int ng, const int *restrict pg, const int *restrict pgs, const int narm, const int l, const int nth, const int mode, const int *restrict cuts) {
+  int *restrict n = narm ? (int*)Calloc(mode == GPAR_SORTED ? ng : (size_t)ng * nth, int) : NULL;
+  if(mode == GPAR_SORTED) {
+    if(narm) {
+      for(int i = ng; i--; ) pout[i] = NA_REAL;
+    } else memset(pout, 0.0, sizeof(double) * ng);
+    #pragma omp parallel for num_threads(nth)
+    for(int t = 0; t < nth; ++t) fmean_int_g_acc(pout-1, narm ? n-1 : NULL, px, pg, narm, cuts[t], cuts[t+1]);
+  } else {
+    double *restrict buf = (double*)Calloc((size_t)ng * nth, double);
+    #pragma omp parallel for num_threads(nth)
+    for(int t = 0; t < nth; ++t) {
+      double *restrict pbt = buf + (size_t)t * ng;
+      if(narm) for(int i = ng; i--; ) pbt[i] = NA_REAL;
+      fmean_int_g_acc(pbt-1, narm ? n + (size_t)t * ng - 1 : NULL, px, pg, narm, cuts[t], cuts[t+1]);
+    }
+    gpar_merge_sum(pout, buf, ng, nth, narm);
+    if(narm) gpar_merge_count(n, n, ng, nth);
+    Free(buf);
+  }
+  if(narm) {
+    #pragma omp parallel for num_threads(nth)
+    for(int i = 0; i < ng; ++i) pout[i] /= n[i];
+    Free(n);
+  } else {
+    #pragma omp parallel for num_threads(nth)
+    for(int i = 0; i < ng; ++i) pout[i] /= pgs[i];
+  }
+}
+
+
+// Partitioned aggregation over many groups, see fsum_g_part_impl() in fsum.c: sums (and counts or sums of weights) of the
+// buckets are accumulated in parallel by the kernels above, and divided at the end.
+void fmean_g_part_impl(double *restrict pout, const void *px, const double *pw, const int tx, const int ng, const int *pg, const int *pgs, const int narm, const gpart *gp) {
+  if(!narm && !pw && tx == REALSXP) fsum_g_part_impl(pout, px, NULL, REALSXP, ng, pg, narm, gp);
+  else {
+    const int nb = gp->nb, nth = gp->nth < nb ? gp->nth : nb, *starts = gp->starts, *gs = gp->g;
+    int *restrict n = narm && !pw ? (int*)Calloc(ng, int) : NULL;
+    void *xs = tx == REALSXP ? (void*)Calloc(gp->l, double) : (void*)Calloc(gp->l, int);
+    double *ws = pw ? (double*)Calloc(gp->l, double) : NULL, *restrict sumw = pw ? (double*)Calloc(ng, double) : NULL;
+    gpart_scatter(xs, px, tx, pg, gp);
+    if(pw) gpart_scatter(ws, pw, REALSXP, pg, gp);
+    if(narm) {
+      for(int i = ng; i--; ) pout[i] = NA_REAL;
+    } else memset(pout, 0.0, sizeof(double) * ng);
+    #pragma omp parallel for num_threads(nth) schedule(dynamic)
+    for(int b = 0; b < nb; ++b) {
+      if(pw) fmean_weights_g_acc(pout-1, sumw-1, (const double *)xs, gs, ws, narm, starts[b], starts[b+1]);
+      else if(tx == REALSXP) fmean_double_g_acc(pout-1, n-1, (const double *)xs, gs, starts[b], starts[b+1]);
+      else fmean_int_g_acc(pout-1, narm ? n-1 : NULL, (const int *)xs, gs, narm, starts[b], starts[b+1]);
+    }
+    Free(xs);
+    if(pw) {
+      Free(ws);
+      for(int i = ng; i--; ) pout[i] /= sumw[i];
+      Free(sumw);
+      return;
+    }
+    if(narm) {
+      for(int i = ng; i--; ) pout[i] /= n[i];
+      Free(n);
+      return;
+    }
+  }
+  for(int i = ng; i--; ) pout[i] /= pgs[i];
+}
+
+// Segmented kernels for sorted groups (see gseg_starts()): means of contiguous runs of rows, computed with the vectorised
+// sum kernels in parallel over groups if nth > 1.
+void fmean_double_seg_impl(double *restrict pout, const double *restrict px, const double *restrict pw, const int ng, const int *restrict starts, const int narm, const int nth) {
+  #pragma omp parallel for num_threads(nth) schedule(dynamic, GSEG_CHUNK) if(nth > 1)
+  for(int gr = 0; gr < ng; ++gr) {
+    const int st = starts[gr];
+    int n;
+    double sumw = 1.0, sum = vsum_double(px + st, pw ? pw + st : NULL, narm, starts[gr+1] - st, &n, pw ? &sumw : NULL);
+    pout[gr] = n == 0 ? NA_REAL : sum / (pw ? sumw : n);
+  }
+}
+
+void fmean_int_seg_impl(double *restrict pout, const int *restrict px, const int ng, const int *restrict starts, const int narm, const int nth) {
+  #pragma omp parallel for num_threads(nth) schedule(dynamic, GSEG_CHUNK) if(nth > 1)
+  for(int gr = 0; gr < ng; ++gr) {
+    int n;
+    const double sum = vsum_int(px + starts[gr], narm, starts[gr+1] - starts[gr], &n);
+    pout[gr] = ISNAN(sum) ? NA_REAL : sum / n;
+  }
+}
 
 SEXP fmeanC(SEXP x, SEXP Rng, SEXP g, SEXP gs, SEXP w, SEXP Rnarm, SEXP Rnth) {
   const int l = length(x), ng = asInteger(Rng), narm = asLogical(Rnarm), nwl = isNull(w);
@@ -239,6 +361,12 @@ SEXP fmeanC(SEXP x, SEXP Rng, SEXP g, SEXP gs, SEXP w, SEXP Rnarm, SEXP Rnth) {
   if(ng && l != length(g)) error("length(g) must match length(x)");
   if(l < 100000) nth = 1; // No improvements from multithreading on small data.
   if(tx == LGLSXP) tx = INTSXP;
+  int gmode = GPAR_SERIAL, *cuts = NULL, *starts;
+  gpart gp;
+  if(ng && nth > 1) {
+    cuts = (int*)R_alloc(nth+1, sizeof(int));
+    gmode = gpar_plan(cuts, INTEGER(g), ng, l, nth);
+  }
   SEXP out = PROTECT(allocVector(REALSXP, ng == 0 ? 1 : ng));
   if(nwl) {
     if(ng && !narm) {
@@ -255,11 +383,26 @@ SEXP fmeanC(SEXP x, SEXP Rng, SEXP g, SEXP gs, SEXP w, SEXP Rnarm, SEXP Rnth) {
         if(ng == 0) {
           if(nth <= 1) fmean_double_impl(REAL(out), REAL(x), narm, l);
           else fmean_double_omp_impl(REAL(out), REAL(x), narm, l, nth);
-        } else fmean_double_g_impl(REAL(out), REAL(x), ng, INTEGER(g), pgs, narm, l);
+        } else if(!FSUM_STRICT && (starts = gseg_starts(INTEGER(g), ng, l))) { // Sorted groups: segmented kernels
+          fmean_double_seg_impl(REAL(out), REAL(x), NULL, ng, starts, narm, nth);
+          Free(starts);
+        } else if(!FSUM_STRICT && gpart_init(&gp, INTEGER(g), ng, l, nth)) { // Many groups: partitioned aggregation
+          fmean_g_part_impl(REAL(out), REAL(x), NULL, REALSXP, ng, INTEGER(g), pgs, narm, &gp);
+          gpart_free(&gp);
+        } else if(gmode == GPAR_SERIAL) fmean_double_g_impl(REAL(out), REAL(x), ng, INTEGER(g), pgs, narm, l);
+        else fmean_double_g_omp_impl(REAL(out), REAL(x), ng, INTEGER(g), pgs, narm, l, nth, gmode, cuts);
         break;
       case INTSXP: {
-        if(ng > 0) fmean_int_g_impl(REAL(out), INTEGER(x), ng, INTEGER(g), pgs, narm, l);
-        else REAL(out)[0] = nth <= 1 ? fmean_int_impl(INTEGER(x), narm, l) : fmean_int_omp_impl(INTEGER(x), narm, l, nth);
+        if(ng > 0) {
+          if((starts = gseg_starts(INTEGER(g), ng, l))) {
+            fmean_int_seg_impl(REAL(out), INTEGER(x), ng, starts, narm, nth);
+            Free(starts);
+          } else if(gpart_init(&gp, INTEGER(g), ng, l, nth)) {
+            fmean_g_part_impl(REAL(out), INTEGER(x), NULL, INTSXP, ng, INTEGER(g), pgs, narm, &gp);
+            gpart_free(&gp);
+          } else if(gmode == GPAR_SERIAL) fmean_int_g_impl(REAL(out), INTEGER(x), ng, INTEGER(g), pgs, narm, l);
+          else fmean_int_g_omp_impl(REAL(out), INTEGER(x), ng, INTEGER(g), pgs, narm, l, nth, gmode, cuts);
+        } else REAL(out)[0] = nth <= 1 ? fmean_int_impl(INTEGER(x), narm, l) : fmean_int_omp_impl(INTEGER(x), narm, l, nth);
         break;
       }
       default: error("Unsupported SEXP type");
@@ -284,7 +427,14 @@ SEXP fmeanC(SEXP x, SEXP Rng, SEXP g, SEXP gs, SEXP w, SEXP Rnarm, SEXP Rnth) {
     if(ng == 0) {
       if(nth <= 1) fmean_weights_impl(REAL(out), px, pw, narm, l);
       else fmean_weights_omp_impl(REAL(out), px, pw, narm, l, nth);
-    } else fmean_weights_g_impl(REAL(out), px, ng, INTEGER(g), pw, narm, l);
+    } else if(!FSUM_STRICT && (starts = gseg_starts(INTEGER(g), ng, l))) {
+      fmean_double_seg_impl(REAL(out), px, pw, ng, starts, narm, nth);
+      Free(starts);
+    } else if(!FSUM_STRICT && gpart_init(&gp, INTEGER(g), ng, l, nth)) {
+      fmean_g_part_impl(REAL(out), px, pw, REALSXP, ng, INTEGER(g), NULL, narm, &gp);
+      gpart_free(&gp);
+    } else if(gmode == GPAR_SERIAL) fmean_weights_g_impl(REAL(out), px, ng, INTEGER(g), pw, narm, l);
+    else fmean_weights_g_omp_impl(REAL(out), px, ng, INTEGER(g), pw, narm, l, nth, gmode, cuts);
   }
   if(ATTRIB(x) != R_NilValue && !(isObject(x) && inherits(x, "ts")))
      copyMostAttrib(x, out); // ATTRIB(x) != R_NilValue? // For example "Units" objects...
@@ -301,6 +451,12 @@ SEXP fmeanmC(SEXP x, SEXP Rng, SEXP g, SEXP gs, SEXP w, SEXP Rnarm, SEXP Rdrop,
   if(ng && l != length(g)) error("length(g) must match nrow(x)");
   if(l*col < 100000) nth = 1; // No gains from multithreading on small data
   if(tx == LGLSXP) tx = INTSXP;
+  int gmode = GPAR_SERIAL, *cuts = NULL, *starts;
+  gpart gp;
+  if(ng > 0 && nth > 1 && col < nth) { // Too few columns for column-level parallelism: parallelize over rows
+    cuts = (int*)R_alloc(nth+1, sizeof(int));
+    gmode = gpar_plan(cuts, pg, ng, l, nth);
+  }
   SEXP out = PROTECT(allocVector(REALSXP, ng == 0 ? col : col * ng));
   double *restrict pout = REAL(out);
   if(isNull(w)) {
@@ -326,7 +482,18 @@ SEXP fmeanmC(SEXP x, SEXP Rng, SEXP g, SEXP gs, SEXP w, SEXP Rnarm, SEXP Rdrop,
             for(int j = 0; j != col; ++j) fmean_double_omp_impl(pout + j, px + j*l, narm, l, nth);
           }
         } else {
-          if(nth <= 1 || col == 1) {
+          if(!FSUM_STRICT && (starts = gseg_starts(pg, ng, l))) { // Sorted groups: segmented kernels
+            if(nth > 1 && col >= nth) {
+              #pragma omp parallel for num_threads(nth)
+              for(int j = 0; j < col; ++j) fmean_double_seg_impl(pout + j*ng, px + j*l, NULL, ng, starts, narm, 1);
+            } else for(int j = 0; j != col; ++j) fmean_double_seg_impl(pout + j*ng, px + j*l, NULL, ng, starts, narm, nth);
+            Free(starts);
+          } else if(!FSUM_STRICT && gpart_init(&gp, pg, ng, l, nth)) { // Many groups: one partition for all columns
+            for(int j = 0; j != col; ++j) fmean_g_part_impl(pout + j*ng, px + j*l, NULL, REALSXP, ng, pg, pgs, narm, &gp);
+            gpart_free(&gp);
+          } else if(gmode != GPAR_SERIAL) {
+            for(int j = 0; j != col; ++j) fmean_double_g_omp_impl(pout + j*ng, px + j*l, ng, pg, pgs, narm, l, nth, gmode, cuts);
+          } else if(nth <= 1 || col == 1) {
             for(int j = 0; j != col; ++j) fmean_double_g_impl(pout + j*ng, px + j*l, ng, pg, pgs, narm, l);
           } else {
             if(nth > col) nth = col;
@@ -339,7 +506,18 @@ SEXP fmeanmC(SEXP x, SEXP Rng, SEXP g, SEXP gs, SEXP w, SEXP Rnarm, SEXP Rdrop,
       case INTSXP: {
         const int *px = INTEGER(x);
         if(ng > 0) {
-          if(nth <= 1 || col == 1) {
+          if((starts = gseg_starts(pg, ng, l))) {
+            if(nth > 1 && col >= nth) {
+              #pragma omp parallel for num_threads(nth)
+              for(int j = 0; j < col; ++j) fmean_int_seg_impl(pout + j*ng, px + j*l, ng, starts, narm, 1);
+            } else for(int j = 0; j != col; ++j) fmean_int_seg_impl(pout + j*ng, px + j*l, ng, starts, narm, nth);
+            Free(starts);
+          } else if(gpart_init(&gp, pg, ng, l, nth)) {
+            for(int j = 0; j != col; ++j) fmean_g_part_impl(pout + j*ng, px + j*l, NULL, INTSXP, ng, pg, pgs, narm, &gp);
+            gpart_free(&gp);
+          } else if(gmode != GPAR_SERIAL) {
+            for(int j = 0; j != col; ++j) fmean_int_g_omp_impl(pout + j*ng, px + j*l, ng, pg, pgs, narm, l, nth, gmode, cuts);
+          } else if(nth <= 1 || col == 1) {
             for(int j = 0; j != col; ++j) fmean_int_g_impl(pout + j*ng, px + j*l, ng, pg, pgs, narm, l);
           } else {
             if(nth > col) nth = col;
@@ -387,7 +565,18 @@ SEXP fmeanmC(SEXP x, SEXP Rng, SEXP g, SEXP gs, SEXP w, SEXP Rnarm, SEXP Rdrop,
         for(int j = 0; j != col; ++j) fmean_weights_omp_impl(pout + j, px + j*l, pw, narm, l, nth);
       }
     } else {
-      if(nth <= 1 || col == 1) {
+      if(!FSUM_STRICT && (starts = gseg_starts(pg, ng, l))) {
+        if(nth > 1 && col >= nth) {
+          #pragma omp parallel for num_threads(nth)
+          for(int j = 0; j < col; ++j) fmean_double_seg_impl(pout + j*ng, px + j*l, pw, ng, starts, narm, 1);
+        } else for(int j = 0; j != col; ++j) fmean_double_seg_impl(pout + j*ng, px + j*l, pw, ng, starts, narm, nth);
+        Free(starts);
+      } else if(!FSUM_STRICT && gpart_init(&gp, pg, ng, l, nth)) {
+        for(int j = 0; j != col; ++j) fmean_g_part_impl(pout + j*ng, px + j*l, pw, REALSXP, ng, pg, NULL, narm, &gp);
+        gpart_free(&gp);
+      } else if(gmode != GPAR_SERIAL) {
+        for(int j = 0; j != col; ++j) fmean_weights_g_omp_impl(pout + j*ng, px + j*l, ng, pg, pw, narm, l, nth, gmode, cuts);
+      } else if(nth <= 1 || col == 1) {
         for(int j = 0; j != col; ++j) fmean_weights_g_impl(pout + j*ng, px + j*l, ng, pg, pw, narm, l);
       } else {
         if(nth > col) nth = col;
@@ -420,9 +609,10 @@ SEXP fmeanlC(SEXP x, SEXP Rng, SEXP g, SEXP gs, SEXP w, SEXP Rnarm, SEXP Rdrop,
     return out;
   }
   SEXP out = PROTECT(allocVector(VECSXP, l)), *restrict pout = SEXPPTR(out), *restrict px = SEXPPTR(x);
-  if((ng > 0 && nth > 1 && l > 1) || (ng == 0 && nth > 1 && nth >= l)) {
+  // With groups and fewer columns than threads, fmeanC() parallelizes over the rows of long columns
+  if((ng > 0 && nth > 1 && l > 1 && (l >= nth || length(px[0]) < 100000)) || (ng == 0 && nth > 1 && nth >= l)) {
     if(nth > l) nth = l;
-    SEXP Rnth1 = PROTECT(ScalarInteger(1)); ++nprotect; // Needed if ng == 0, otherwise double multithreading
+    SEXP Rnth1 = PROTECT(ScalarInteger(1)); ++nprotect; // Needed to avoid double multithreading
     #pragma omp parallel for num_threads(nth)
     for(int j = 0; j < l; ++j) pout[j] = fmeanC(px[j], Rng, g, gs, w, Rnarm, Rnth1);
   } else {
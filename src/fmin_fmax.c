@@ -1,147 +1,330 @@
 #include "collapse_c.h"
 // #include <R_ext/Altrep.h>
 
-void fmin_double_impl(double *pout, double *px, int ng, int *pg, int narm, int l) {
-  if(ng == 0) {
-    double min;
-    if(narm) {
-      int j = l-1;
-      min = px[j];
-      while(ISNAN(min) && j!=0) min = px[--j];
-      if(j != 0) for(int i = j; i--; ) {
-        if(min > px[i]) min = px[i];
-      }
-    } else {
-      min = px[0];
-      for(int i = 0; i != l; ++i) {
-        if(ISNAN(px[i])) {
-          min = px[i];
-          break;
-        } else {
-          if(min > px[i]) min = px[i];
-        }
-      }
+// Grouped kernels: initialization of the result and accumulation of rows start...end-1 (pout decremented by 1).
+// These are shared by the serial code and the row-level multithreaded code further below.
+
+static void fmin_double_g_init(double *pout, const int ng, const int narm) {
+  if(narm) for(int i = ng; i--; ) pout[i] = NA_REAL; // Other way ?
+  else for(int i = ng; i--; ) pout[i] = R_PosInf;
+}
+
+static void fmin_double_g_acc(double *pout, const double *px, const int *pg, const int narm, const int start, const int end) {
+  if(narm) {
+    for(int i = end; i-- != start; ) if(pout[pg[i]] > px[i] || ISNAN(pout[pg[i]])) pout[pg[i]] = px[i];  // fastest
+  } else {
+    for(int i = end; i-- != start; ) if(pout[pg[i]] > px[i] || ISNAN(px[i])) pout[pg[i]] = px[i];  // Used to stop loop when all groups passed with NA, but probably no speed gain since groups are mostly ordered.
+  }
+}
+
+static void fmin_int_g_init(int *pout, const int ng, const int narm) {
+  if(narm) for(int i = ng; i--; ) pout[i] = NA_INTEGER;
+  else for(int i = ng; i--; ) pout[i] = INT_MAX;
+}
+
+static void fmin_int_g_acc(int *pout, const int *px, const int *pg, const int narm, const int start, const int end) {
+  if(narm) {
+    for(int i = end; i-- != start; ) if(px[i] != NA_INTEGER && (pout[pg[i]] > px[i] || pout[pg[i]] == NA_INTEGER)) pout[pg[i]] = px[i];  // fastest??
+  } else {
+    for(int i = end; i-- != start; ) if(pout[pg[i]] > px[i]) pout[pg[i]] = px[i];
+  }
+}
+
+static void fmax_double_g_init(double *pout, const int ng, const int narm) {
+  if(narm) for(int i = ng; i--; ) pout[i] = NA_REAL; // Other way ?
+  else for(int i = ng; i--; ) pout[i] = R_NegInf;
+}
+
+static void fmax_double_g_acc(double *pout, const double *px, const int *pg, const int narm, const int start, const int end) {
+  if(narm) {
+    for(int i = end; i-- != start; ) if(pout[pg[i]] < px[i] || ISNAN(pout[pg[i]])) pout[pg[i]] = px[i];  // fastest
+  } else {
+    for(int i = end; i-- != start; ) if(pout[pg[i]] < px[i] || ISNAN(px[i])) pout[pg[i]] = px[i];  // Used to stop loop when all groups passed with NA, but probably no speed gain since groups are mostly ordered.
+  }
+}
+
+static void fmax_int_g_init(int *pout, const int ng, const int narm) {
+  if(narm) for(int i = ng; i--; ) pout[i] = NA_INTEGER;
+  else for(int i = ng; i--; ) pout[i] = INT_MIN + 1; // best ??
+}
+
+static void fmax_int_g_acc(int *pout, const int *px, const int *pg, const int narm, const int start, const int end) {
+  if(narm) {
+    for(int i = end; i-- != start; ) if(pout[pg[i]] < px[i]) pout[pg[i]] = px[i];  // fastest??
+  } else {
+    for(int i = end; i-- != start; ) if(px[i] == NA_INTEGER || (pout[pg[i]] != NA_INTEGER && pout[pg[i]] < px[i])) pout[pg[i]] = px[i];
+  }
+}
+
+// Vectorised ungrouped kernels (see also fsum.c): VLANES independent minima/maxima of doubles, without branches on missing
+// values. With na.rm these are skipped (comparisons with NaN are false), otherwise a NaN is sticky in its lane and the lanes
+// are checked every VBLOCK elements, in which case the block is searched for the first missing value, which is returned.
+#define VBLOCK 2048
+
+#define VMINMAX_DOUBLE(NAME, OP, INIT)                                                              \
+SIMD_DISPATCH                                                                                        \
+static double NAME(const double *restrict px, const int narm, const int l) {                         \
+  double m[VLANES], res;                                                                             \
+  int i = 0;                                                                                         \
+  for(int k = 0; k != VLANES; ++k) m[k] = INIT;                                                      \
+  if(narm) {                                                                                         \
+    for(; i <= l - VLANES; i += VLANES) {                                                            \
+      _Pragma("omp simd")                                                                            \
+      for(int k = 0; k < VLANES; ++k) m[k] = px[i+k] OP m[k] ? px[i+k] : m[k];                       \
+    }                                                                                                \
+    for(; i < l; ++i) if(px[i] OP m[0]) m[0] = px[i];                                                \
+    res = m[0];                                                                                      \
+    for(int k = 1; k != VLANES; ++k) if(m[k] OP res) res = m[k];                                     \
+    if(res == INIT) { /* All values missing (the result is px[0]) or equal to INIT */                \
+      for(int j = 0; j != l; ++j) if(NISNAN(px[j])) return res;                                      \
+      return px[0];                                                                                  \
+    }                                                                                                \
+    return res;                                                                                      \
+  }                                                                                                  \
+  for(int b = 0, e; b < l; b = e) {                                                                  \
+    e = l - b > VBLOCK ? b + VBLOCK : l;                                                             \
+    for(; i <= e - VLANES; i += VLANES) {                                                            \
+      _Pragma("omp simd")                                                                            \
+      for(int k = 0; k < VLANES; ++k) m[k] = (px[i+k] OP m[k] || ISNAN(px[i+k])) ? px[i+k] : m[k];  \
+    }                                                                                                \
+    for(; i < e; ++i) if(px[i] OP m[0] || ISNAN(px[i])) m[0] = px[i];                                \
+    int anyna = 0;                                                                                   \
+    for(int k = 0; k != VLANES; ++k) anyna |= ISNAN(m[k]);                                           \
+    if(anyna) for(int j = b; j != e; ++j) if(ISNAN(px[j])) return px[j];                             \
+  }                                                                                                  \
+  res = m[0];                                                                                        \
+  for(int k = 1; k != VLANES; ++k) if(m[k] OP res) res = m[k];                                       \
+  return res;                                                                                        \
+}
+
+VMINMAX_DOUBLE(vmin_double, <, INFINITY)
+VMINMAX_DOUBLE(vmax_double, >, -INFINITY)
+
+// Integers: NA_INTEGER is the smallest integer, and the order of the reduction is irrelevant
+SIMD_DISPATCH
+static int vmin_int(const int *restrict px, const int narm, const int l) {
+  const int na = NA_INTEGER;
+  int min = INT_MAX;
+  if(narm) {
+    int n = 0;
+    #pragma omp simd reduction(min:min) reduction(+:n)
+    for(int i = 0; i < l; ++i) {
+      const int ok = px[i] != na;
+      min = (ok && px[i] < min) ? px[i] : min;
+      n += ok;
+    }
+    return n ? min : na;
+  }
+  for(int b = 0, e; b < l; b = e) {
+    e = l - b > VBLOCK ? b + VBLOCK : l;
+    #pragma omp simd reduction(min:min)
+    for(int i = b; i < e; ++i) min = px[i] < min ? px[i] : min;
+    if(min == na) return na;
+  }
+  return min;
+}
+
+SIMD_DISPATCH
+static int vmax_int(const int *restrict px, const int narm, const int l) {
+  const int na = NA_INTEGER;
+  int max = na;
+  if(narm) {
+    #pragma omp simd reduction(max:max)
+    for(int i = 0; i < l; ++i) max = px[i] > max ? px[i] : max;
+    return max;
+  }
+  for(int b = 0, e; b < l; b = e) {
+    e = l - b > VBLOCK ? b + VBLOCK : l;
+    int anyna = 0;
+    #pragma omp simd reduction(max:max) reduction(|:anyna)
+    for(int i = b; i < e; ++i) {
+      max = px[i] > max ? px[i] : max;
+      anyna |= px[i] == na;
+    }
+    if(anyna) return na;
+  }
+  return max;
+}
+
+// Sorted groups (see gseg_starts()): the vectorised kernels applied to the contiguous rows of each group
+static void fminmax_seg_impl(void *pout, const void *px, const int tx, const int max, const int ng, const int *restrict starts, const int narm, const int nth) {
+  if(tx == REALSXP) {
+    double *restrict po = (double *)pout;
+    const double *pxd = (const double *)px;
+    #pragma omp parallel for num_threads(nth) schedule(dynamic, GSEG_CHUNK) if(nth > 1)
+    for(int gr = 0; gr < ng; ++gr) {
+      const int s = starts[gr], n = starts[gr+1] - s;
+      po[gr] = max ? vmax_double(pxd + s, narm, n) : vmin_double(pxd + s, narm, n);
     }
-    pout[0] = min;
   } else {
-    if(narm) {
-      for(int i = ng; i--; ) pout[i] = NA_REAL; // Other way ?
-      --pout;
-      for(int i = l; i--; ) if(pout[pg[i]] > px[i] || ISNAN(pout[pg[i]])) pout[pg[i]] = px[i];  // fastest
-    } else {
-      for(int i = ng; i--; ) pout[i] = DBL_MAX;
-      --pout;
-      for(int i = l; i--; ) if(pout[pg[i]] > px[i] || ISNAN(px[i])) pout[pg[i]] = px[i];  // Used to stop loop when all groups passed with NA, but probably no speed gain since groups are mostly ordered.
+    int *restrict po = (int *)pout;
+    const int *pxi = (const int *)px;
+    #pragma omp parallel for num_threads(nth) schedule(dynamic, GSEG_CHUNK) if(nth > 1)
+    for(int gr = 0; gr < ng; ++gr) {
+      const int s = starts[gr], n = starts[gr+1] - s;
+      po[gr] = max ? vmax_int(pxi + s, narm, n) : vmin_int(pxi + s, narm, n);
     }
   }
 }
 
+// Matrix columns: parallel over columns if there are enough, otherwise over the groups of each column
+static void fminmax_seg_mat(void *pout, const void *px, const int tx, const int max, const int ng, const int *starts,
+                            const int narm, const int l, const int col, const int nth) {
+  const size_t sz = tx == REALSXP ? sizeof(double) : sizeof(int);
+  if(nth > 1 && col >= nth) {
+    #pragma omp parallel for num_threads(nth)
+    for(int j = 0; j < col; ++j) fminmax_seg_impl((char *)pout + (size_t)j*ng*sz, (const char *)px + (size_t)j*l*sz, tx, max, ng, starts, narm, 1);
+  } else {
+    for(int j = 0; j != col; ++j) fminmax_seg_impl((char *)pout + (size_t)j*ng*sz, (const char *)px + (size_t)j*l*sz, tx, max, ng, starts, narm, nth);
+  }
+}
+
+void fmin_double_impl(double *pout, double *px, int ng, int *pg, int narm, int l) {
+  if(ng == 0) {
+    pout[0] = vmin_double(px, narm, l);
+  } else {
+    fmin_double_g_init(pout, ng, narm);
+    fmin_double_g_acc(pout-1, px, pg, narm, 0, l);
+  }
+}
+
 void fmin_int_impl(int *pout, int *px, int ng, int *pg, int narm, int l) {
   if(ng == 0) {
-    int min;
-    if(narm) {
-      int j = l-1;
-      min = px[j];
-      while(min == NA_INTEGER && j!=0) min = px[--j];
-      if(j != 0) for(int i = j; i--; ) {
-        if(min > px[i] && px[i] != NA_INTEGER) min = px[i];
-      }
-    } else {
-      min = px[0];
-      for(int i = 0; i != l; ++i) {
-        if(px[i] == NA_INTEGER) {
-          min = NA_INTEGER;
-          break;
-        } else {
-          if(min > px[i]) min = px[i];
-        }
-      }
-    }
-    pout[0] = min;
+    pout[0] = vmin_int(px, narm, l);
   } else {
-    if(narm) {
-      for(int i = ng; i--; ) pout[i] = NA_INTEGER;
-      --pout;
-      for(int i = l; i--; ) if(px[i] != NA_INTEGER && (pout[pg[i]] > px[i] || pout[pg[i]] == NA_INTEGER)) pout[pg[i]] = px[i];  // fastest??
-    } else {
-      for(int i = ng; i--; ) pout[i] = INT_MAX;
-      --pout;
-      for(int i = l; i--; ) if(pout[pg[i]] > px[i]) pout[pg[i]] = px[i];
-    }
+    fmin_int_g_init(pout, ng, narm);
+    fmin_int_g_acc(pout-1, px, pg, narm, 0, l);
   }
 }
 
 void fmax_double_impl(double *pout, double *px, int ng, int *pg, int narm, int l) {
   if(ng == 0) {
-    double max;
-    if(narm) {
-      int j = l-1;
-      max = px[j];
-      while(ISNAN(max) && j!=0) max = px[--j];
-      if(j != 0) for(int i = j; i--; ) {
-        if(max < px[i]) max = px[i];
-      }
-    } else {
-      max = px[0];
-      for(int i = 0; i != l; ++i) {
-        if(ISNAN(px[i])) {
-          max = px[i];
-          break;
-        } else {
-          if(max < px[i]) max = px[i];
-        }
-      }
-    }
-    pout[0] = max;
+    pout[0] = vmax_double(px, narm, l);
   } else {
-    if(narm) {
-      for(int i = ng; i--; ) pout[i] = NA_REAL; // Other way ?
-      --pout;
-      for(int i = l; i--; ) if(pout[pg[i]] < px[i] || ISNAN(pout[pg[i]])) pout[pg[i]] = px[i];  // fastest
-    } else {
-      for(int i = ng; i--; ) pout[i] = DBL_MIN;
-      --pout;
-      for(int i = l; i--; ) if(pout[pg[i]] < px[i] || ISNAN(px[i])) pout[pg[i]] = px[i];  // Used to stop loop when all groups passed with NA, but probably no speed gain since groups are mostly ordered.
-    }
+    fmax_double_g_init(pout, ng, narm);
+    fmax_double_g_acc(pout-1, px, pg, narm, 0, l);
   }
 }
 
 void fmax_int_impl(int *pout, int *px, int ng, int *pg, int narm, int l) {
   if(ng == 0) {
-    int max;
-    if(narm) {
-      max = NA_INTEGER; // same as INT_MIN
-      for(int i = l; i--; ) if(max < px[i]) max = px[i];
-    } else {
-      max = px[0];
-      for(int i = 0; i != l; ++i) {
-        if(px[i] == NA_INTEGER) {
-          max = NA_INTEGER;
-          break;
-        } else {
-          if(max < px[i]) max = px[i];
-        }
-      }
-    }
-    pout[0] = max;
+    pout[0] = vmax_int(px, narm, l);
   } else {
-    if(narm) {
-      for(int i = ng; i--; ) pout[i] = NA_INTEGER;
-      --pout;
-      for(int i = l; i--; ) if(pout[pg[i]] < px[i]) pout[pg[i]] = px[i];  // fastest??
-    } else {
-      for(int i = ng; i--; ) pout[i] = INT_MIN + 1; // best ??
-      --pout;
-      for(int i = l; i--; ) if(px[i] == NA_INTEGER || (pout[pg[i]] != NA_INTEGER && pout[pg[i]] < px[i])) pout[pg[i]] = px[i];
+    fmax_int_g_init(pout, ng, narm);
+    fmax_int_g_acc(pout-1, px, pg, narm, 0, l);
+  }
+}
+
+// Row-level multithreading over groups using a gpar_plan(): with sorted groups threads accumulate directly into pout,
+// otherwise into thread-local buffers. Merging the buffers applies the same accumulation rules to the partial results
+// (a missing partial result is sticky without na.rm, and ignored with na.rm).
+
+void fmin_double_g_omp_impl(double *pout, const double *px, const int ng, const int *pg, const int narm, const int l, const int nth, const int mode, const int *cuts) {
+  if(mode == GPAR_SORTED) {
+    fmin_double_g_init(pout, ng, narm);
+    #pragma omp parallel for num_threads(nth)
+    for(int t = 0; t < nth; ++t) fmin_double_g_acc(pout-1, px, pg, narm, cuts[t], cuts[t+1]);
+    return;
+  }
+  double *buf = (double*)Calloc((size_t)ng * nth, double);
+  #pragma omp parallel for num_threads(nth)
+  for(int t = 0; t < nth; ++t) {
+    fmin_double_g_init(buf + (size_t)t * ng, ng, narm);
+    fmin_double_g_acc(buf + (size_t)t * ng - 1, px, pg, narm, cuts[t], cuts[t+1]);
+  }
+  #pragma omp parallel for num_threads(nth)
+  for(int i = 0; i < ng; ++i) {
+    double min = buf[i], bi;
+    for(int t = 1; t != nth; ++t) {
+      bi = buf[(size_t)t * ng + i];
+      if(narm ? (min > bi || ISNAN(min)) : (min > bi || ISNAN(bi))) min = bi;
     }
+    pout[i] = min;
   }
+  Free(buf);
 }
 
+void fmin_int_g_omp_impl(int *pout, const int *px, const int ng, const int *pg, const int narm, const int l, const int nth, const int mode, const int *cuts) {
+  if(mode == GPAR_SORTED) {
+    fmin_int_g_init(pout, ng, narm);
+    #pragma omp parallel for num_threads(nth)
+    for(int t = 0; t < nth; ++t) fmin_int_g_acc(pout-1, px, pg, narm, cuts[t], cuts[t+1]);
+    return;
+  }
+  int *buf = (int*)Calloc((size_t)ng * nth, int);
+  #pragma omp parallel for num_threads(nth)
+  for(int t = 0; t < nth; ++t) {
+    fmin_int_g_init(buf + (size_t)t * ng, ng, narm);
+    fmin_int_g_acc(buf + (size_t)t * ng - 1, px, pg, narm, cuts[t], cuts[t+1]);
+  }
+  #pragma omp parallel for num_threads(nth)
+  for(int i = 0; i < ng; ++i) {
+    int min = buf[i], bi;
+    for(int t = 1; t != nth; ++t) {
+      bi = buf[(size_t)t * ng + i];
+      if(narm ? (bi != NA_INTEGER && (min > bi || min == NA_INTEGER)) : min > bi) min = bi;
+    }
+    pout[i] = min;
+  }
+  Free(buf);
+}
 
-SEXP fminC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm) {
-  int l = length(x), tx = TYPEOF(x), ng = asInteger(Rng), narm = asLogical(Rnarm);
+void fmax_double_g_omp_impl(double *pout, const double *px, const int ng, const int *pg, const int narm, const int l, const int nth, const int mode, const int *cuts) {
+  if(mode == GPAR_SORTED) {
+    fmax_double_g_init(pout, ng, narm);
+    #pragma omp parallel for num_threads(nth)
+    for(int t = 0; t < nth; ++t) fmax_double_g_acc(pout-1, px, pg, narm, cuts[t], cuts[t+1]);
+    return;
+  }
+  double *buf = (double*)Calloc((size_t)ng * nth, double);
+  #pragma omp parallel for num_threads(nth)
+  for(int t = 0; t < nth; ++t) {
+    fmax_double_g_init(buf + (size_t)t * ng, ng, narm);
+    fmax_double_g_acc(buf + (size_t)t * ng - 1, px, pg, narm, cuts[t], cuts[t+1]);
+  }
+  #pragma omp parallel for num_threads(nth)
+  for(int i = 0; i < ng; ++i) {
+    double max = buf[i], bi;
+    for(int t = 1; t != nth; ++t) {
+      bi = buf[(size_t)t * ng + i];
+      if(narm ? (max < bi || ISNAN(max)) : (max < bi || ISNAN(bi))) max = bi;
+    }
+    pout[i] = max;
+  }
+  Free(buf);
+}
+
+void fmax_int_g_omp_impl(int *pout, const int *px, const int ng, const int *pg, const int narm, const int l, const int nth, const int mode, const int *cuts) {
+  if(mode == GPAR_SORTED) {
+    fmax_int_g_init(pout, ng, narm);
+    #pragma omp parallel for num_threads(nth)
+    for(int t = 0; t < nth; ++t) fmax_int_g_acc(pout-1, px, pg, narm, cuts[t], cuts[t+1]);
+    return;
+  }
+  int *buf = (int*)Calloc((size_t)ng * nth, int);
+  #pragma omp parallel for num_threads(nth)
+  for(int t = 0; t < nth; ++t) {
+    fmax_int_g_init(buf + (size_t)t * ng, ng, narm);
+    fmax_int_g_acc(buf + (size_t)t * ng - 1, px, pg, narm, cuts[t], cuts[t+1]);
+  }
+  #pragma omp parallel for num_threads(nth)
+  for(int i = 0; i < ng; ++i) {
+    int max = buf[i], bi;
+    for(int t = 1; t != nth; ++t) {
+      bi = buf[(size_t)t * ng + i];
+      if(narm ? max < bi : (bi == NA_INTEGER || (max != NA_INTEGER && max < bi))) max = bi;
+    }
+    pout[i] = max;
+  }
+  Free(buf);
+}
+
+
+SEXP fminC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rnth) {
+  int l = length(x), tx = TYPEOF(x), ng = asInteger(Rng), narm = asLogical(Rnarm), nth = asInteger(Rnth);
   if (l < 1) return x; // Prevents seqfault for numeric(0) #101
   if(ng && l != length(g)) error("length(g) must match length(x)");
+  if(l < 100000) nth = 1; // No improvements from multithreading on small data.
   if(tx == LGLSXP) tx = INTSXP;
   // ALTREP methods for compact sequences: not safe yet and not part of the API.
   // if(ALTREP(x) && ng == 0) {
@@ -149,11 +332,23 @@ SEXP fminC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm) {
   // if(tx == REALSXP) return ALTREAL_MIN(x, (Rboolean)narm);
   // error("ALTREP object must be integer or real typed");
   // }
+  int gmode = GPAR_SERIAL, *cuts = NULL, *starts;
+  if(ng && nth > 1) {
+    cuts = (int*)R_alloc(nth+1, sizeof(int));
+    gmode = gpar_plan(cuts, INTEGER(g), ng, l, nth);
+  }
   SEXP out = PROTECT(allocVector(tx, ng == 0 ? 1 : ng));
-  switch(tx) {
-  case REALSXP: fmin_double_impl(REAL(out), REAL(x), ng, INTEGER(g), narm, l);
+  if(ng && (tx == REALSXP || tx == INTSXP) && (starts = gseg_starts(INTEGER(g), ng, l))) { // Sorted groups: segmented kernels
+    fminmax_seg_impl(DATAPTR(out), DATAPTR(x), tx, 0, ng, starts, narm, nth);
+    Free(starts);
+  } else switch(tx) {
+  case REALSXP:
+    if(gmode == GPAR_SERIAL) fmin_double_impl(REAL(out), REAL(x), ng, INTEGER(g), narm, l);
+    else fmin_double_g_omp_impl(REAL(out), REAL(x), ng, INTEGER(g), narm, l, nth, gmode, cuts);
     break;
-  case INTSXP: fmin_int_impl(INTEGER(out), INTEGER(x), ng, INTEGER(g), narm, l);
+  case INTSXP:
+    if(gmode == GPAR_SERIAL) fmin_int_impl(INTEGER(out), INTEGER(x), ng, INTEGER(g), narm, l);
+    else fmin_int_g_omp_impl(INTEGER(out), INTEGER(x), ng, INTEGER(g), narm, l, nth, gmode, cuts);
     break;
   default: error("Unsupported SEXP type");
   }
@@ -163,24 +358,49 @@ SEXP fminC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm) {
   return out;
 }
 
-SEXP fminmC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rdrop) {
+SEXP fminmC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rdrop, SEXP Rnth) {
   SEXP dim = getAttrib(x, R_DimSymbol);
   if(isNull(dim)) error("x is not a matrix");
   int tx = TYPEOF(x), l = INTEGER(dim)[0], col = INTEGER(dim)[1], *pg = INTEGER(g),
-    ng = asInteger(Rng), ng1 = ng == 0 ? 1 : ng, narm = asLogical(Rnarm);
+    ng = asInteger(Rng), ng1 = ng == 0 ? 1 : ng, narm = asLogical(Rnarm), nth = asInteger(Rnth);
   if (l < 1) return x; // Prevents seqfault for numeric(0) #101
   if(ng && l != length(g)) error("length(g) must match nrow(x)");
+  if(l*col < 100000) nth = 1; // No gains from multithreading on small data
   if(tx == LGLSXP) tx = INTSXP;
+  int gmode = GPAR_SERIAL, *cuts = NULL, *starts;
+  if(ng > 0 && nth > 1 && col < nth) { // Too few columns for column-level parallelism: parallelize over rows
+    cuts = (int*)R_alloc(nth+1, sizeof(int));
+    gmode = gpar_plan(cuts, pg, ng, l, nth);
+  }
+  const int nthr = nth; // Row-level threads for the segmented kernels
+  if(gmode == GPAR_SERIAL && nth > col) nth = col;
   SEXP out = PROTECT(allocVector(tx, ng == 0 ? col : col * ng));
-  switch(tx) {
+  if(ng && (tx == REALSXP || tx == INTSXP) && (starts = gseg_starts(pg, ng, l))) { // Sorted groups: segmented kernels
+    fminmax_seg_mat(DATAPTR(out), DATAPTR(x), tx, 0, ng, starts, narm, l, col, nthr);
+    Free(starts);
+  } else switch(tx) {
   case REALSXP: {
     double *px = REAL(x), *pout = REAL(out);
-    for(int j = 0; j != col; ++j) fmin_double_impl(pout + j*ng1, px + j*l, ng, pg, narm, l);
+    if(gmode != GPAR_SERIAL) {
+      for(int j = 0; j != col; ++j) fmin_double_g_omp_impl(pout + j*ng1, px + j*l, ng, pg, narm, l, nth, gmode, cuts);
+    } else if(nth <= 1) {
+      for(int j = 0; j != col; ++j) fmin_double_impl(pout + j*ng1, px + j*l, ng, pg, narm, l);
+    } else {
+      #pragma omp parallel for num_threads(nth)
+      for(int j = 0; j < col; ++j) fmin_double_impl(pout + j*ng1, px + j*l, ng, pg, narm, l);
+    }
     break;
   }
   case INTSXP: {
     int *px = INTEGER(x), *pout = INTEGER(out);
-    for(int j = 0; j != col; ++j) fmin_int_impl(pout + j*ng1, px + j*l, ng, pg, narm, l);
+    if(gmode != GPAR_SERIAL) {
+      for(int j = 0; j != col; ++j) fmin_int_g_omp_impl(pout + j*ng1, px + j*l, ng, pg, narm, l, nth, gmode, cuts);
+    } else if(nth <= 1) {
+      for(int j = 0; j != col; ++j) fmin_int_impl(pout + j*ng1, px + j*l, ng, pg, narm, l);
+    } else {
+      #pragma omp parallel for num_threads(nth)
+      for(int j = 0; j < col; ++j) fmin_int_impl(pout + j*ng1, px + j*l, ng, pg, narm, l);
+    }
     break;
   }
   default: error("Unsupported SEXP type");
@@ -190,30 +410,39 @@ SEXP fminmC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rdrop) {
   return out;
 }
 
-SEXP fminlC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rdrop) {
-  int l = length(x), ng = asInteger(Rng);
+SEXP fminlC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rdrop, SEXP Rnth) {
+  int l = length(x), ng = asInteger(Rng), nth = asInteger(Rnth), nprotect = 1;
   if(l < 1) return x; // needed ??
   if(ng == 0 && asLogical(Rdrop)) {
     SEXP out = PROTECT(allocVector(REALSXP, l)), *px = SEXPPTR(x);
     double *pout = REAL(out);
-    for(int j = 0; j != l; ++j) pout[j] = asReal(fminC(px[j], Rng, g, Rnarm));
+    for(int j = 0; j != l; ++j) pout[j] = asReal(fminC(px[j], Rng, g, Rnarm, Rnth));
     setAttrib(out, R_NamesSymbol, getAttrib(x, R_NamesSymbol));
     UNPROTECT(1);
     return out;
   }
   SEXP out = PROTECT(allocVector(VECSXP, l)), *pout = SEXPPTR(out), *px = SEXPPTR(x);
-  for(int j = 0; j != l; ++j) pout[j] = fminC(px[j], Rng, g, Rnarm);
+  // With groups and fewer columns than threads, fminC() parallelizes over the rows of long columns
+  if(ng > 0 && nth > 1 && l > 1 && (l >= nth || length(px[0]) < 100000)) {
+    if(nth > l) nth = l;
+    SEXP Rnth1 = PROTECT(ScalarInteger(1)); ++nprotect;
+    #pragma omp parallel for num_threads(nth)
+    for(int j = 0; j < l; ++j) pout[j] = fminC(px[j], Rng, g, Rnarm, Rnth1);
+  } else {
+    for(int j = 0; j != l; ++j) pout[j] = fminC(px[j], Rng, g, Rnarm, Rnth);
+  }
   // if(ng == 0) for(int j = 0; j != l; ++j) copyMostAttrib(px[j], pout[j]);
   DFcopyAttr(out, x, ng);
-  UNPROTECT(1);
+  UNPROTECT(nprotect);
   return out;
 }
 
 
-SEXP fmaxC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm) {
-  int l = length(x), tx = TYPEOF(x), ng = asInteger(Rng), narm = asLogical(Rnarm);
+SEXP fmaxC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rnth) {
+  int l = length(x), tx = TYPEOF(x), ng = asInteger(Rng), narm = asLogical(Rnarm), nth = asInteger(Rnth);
   if (l < 1) return x; // Prevents seqfault for numeric(0) #101
   if(ng && l != length(g)) error("length(g) must match length(x)");
+  if(l < 100000) nth = 1; // No improvements from multithreading on small data.
   if(tx == LGLSXP) tx = INTSXP;
   // ALTREP methods for compact sequences: not safe yet and not part of the API.
   // if(ALTREP(x) && ng == 0) {
@@ -221,11 +450,23 @@ SEXP fmaxC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm) {
   // if(tx == REALSXP) return ALTREAL_MAX(x, (Rboolean)narm);
   // error("ALTREP object must be integer or real typed");
   // }
+  int gmode = GPAR_SERIAL, *cuts = NULL, *starts;
+  if(ng && nth > 1) {
+    cuts = (int*)R_alloc(nth+1, sizeof(int));
+    gmode = gpar_plan(cuts, INTEGER(g), ng, l, nth);
+  }
   SEXP out = PROTECT(allocVector(tx, ng == 0 ? 1 : ng));
-  switch(tx) {
-  case REALSXP: fmax_double_impl(REAL(out), REAL(x), ng, INTEGER(g), narm, l);
+  if(ng && (tx == REALSXP || tx == INTSXP) && (starts = gseg_starts(INTEGER(g), ng, l))) { // Sorted groups: segmented kernels
+    fminmax_seg_impl(DATAPTR(out), DATAPTR(x), tx, 1, ng, starts, narm, nth);
+    Free(starts);
+  } else switch(tx) {
+  case REALSXP:
+    if(gmode == GPAR_SERIAL) fmax_double_impl(REAL(out), REAL(x), ng, INTEGER(g), narm, l);
+    else fmax_double_g_omp_impl(REAL(out), REAL(x), ng, INTEGER(g), narm, l, nth, gmode, cuts);
     break;
-  case INTSXP: fmax_int_impl(INTEGER(out), INTEGER(x), ng, INTEGER(g), narm, l);
+  case INTSXP:
+    if(gmode == GPAR_SERIAL) fmax_int_impl(INTEGER(out), INTEGER(x), ng, INTEGER(g), narm, l);
+    else fmax_int_g_omp_impl(INTEGER(out), INTEGER(x), ng, INTEGER(g), narm, l, nth, gmode, cuts);
     break;
   default: error("Unsupported SEXP type");
   }
@@ -235,24 +476,49 @@ SEXP fmaxC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm) {
   return out;
 }
 
-SEXP fmaxmC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rdrop) {
+SEXP fmaxmC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rdrop, SEXP Rnth) {
   SEXP dim = getAttrib(x, R_DimSymbol);
   if(isNull(dim)) error("x is not a matrix");
   int tx = TYPEOF(x), l = INTEGER(dim)[0], col = INTEGER(dim)[1], *pg = INTEGER(g),
-    ng = asInteger(Rng), ng1 = ng == 0 ? 1 : ng, narm = asLogical(Rnarm);
+    ng = asInteger(Rng), ng1 = ng == 0 ? 1 : ng, narm = asLogical(Rnarm), nth = asInteger(Rnth);
   if (l < 1) return x; // Prevents seqfault for numeric(0) #101
   if(ng && l != length(g)) error("length(g) must match nrow(x)");
+  if(l*col < 100000) nth = 1; // No gains from multithreading on small data
   if(tx == LGLSXP) tx = INTSXP;
+  int gmode = GPAR_SERIAL, *cuts = NULL, *starts;
+  if(ng > 0 && nth > 1 && col < nth) { // Too few columns for column-level parallelism: parallelize over rows
+    cuts = (int*)R_alloc(nth+1, sizeof(int));
+    gmode = gpar_plan(cuts, pg, ng, l, nth);
+  }
+  const int nthr = nth; // Row-level threads for the segmented kernels
+  if(gmode == GPAR_SERIAL && nth > col) nth = col;
   SEXP out = PROTECT(allocVector(tx, ng == 0 ? col : col * ng));
-  switch(tx) {
+  if(ng && (tx == REALSXP || tx == INTSXP) && (starts = gseg_starts(pg, ng, l))) { // Sorted groups: segmented kernels
+    fminmax_seg_mat(DATAPTR(out), DATAPTR(x), tx, 1, ng, starts, narm, l, col, nthr);
+    Free(starts);
+  } else switch(tx) {
   case REALSXP: {
     double *px = REAL(x), *pout = REAL(out);
-    for(int j = 0; j != col; ++j) fmax_double_impl(pout + j*ng1, px + j*l, ng, pg, narm, l);
+    if(gmode != GPAR_SERIAL) {
+      for(int j = 0; j != col; ++j) fmax_double_g_omp_impl(pout + j*ng1, px + j*l, ng, pg, narm, l, nth, gmode, cuts);
+    } else if(nth <= 1) {
+      for(int j = 0; j != col; ++j) fmax_double_impl(pout + j*ng1, px + j*l, ng, pg, narm, l);
+    } else {
+      #pragma omp parallel for num_threads(nth)
+      for(int j = 0; j < col; ++j) fmax_double_impl(pout + j*ng1, px + j*l, ng, pg, narm, l);
+    }
     break;
   }
   case INTSXP: {
     int *px = INTEGER(x), *pout = INTEGER(out);
-    for(int j = 0; j != col; ++j) fmax_int_impl(pout + j*ng1, px + j*l, ng, pg, narm, l);
+    if(gmode != GPAR_SERIAL) {
+      for(int j = 0; j != col; ++j) fmax_int_g_omp_impl(pout + j*ng1, px + j*l, ng, pg, narm, l, nth, gmode, cuts);
+    } else if(nth <= 1) {
+      for(int j = 0; j != col; ++j) fmax_int_impl(pout + j*ng1, px + j*l, ng, pg, narm, l);
+    } else {
+      #pragma omp parallel for num_threads(nth)
+      for(int j = 0; j < col; ++j) fmax_int_impl(pout + j*ng1, px + j*l, ng, pg, narm, l);
+    }
     break;
   }
   default: error("Unsupported SEXP type");
@@ -262,21 +528,29 @@ SEXP fmaxmC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rdrop) {
   return out;
 }
 
-SEXP fmaxlC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rdrop) {
-  int l = length(x), ng = asInteger(Rng);
+SEXP fmaxlC(SEXP x, SEXP Rng, SEXP g, SEXP Rnarm, SEXP Rdrop, SEXP Rnth) {
+  int l = length(x), ng = asInteger(Rng), nth = asInteger(Rnth), nprotect = 1;
   if(l < 1) return x; // needed ??
   if(ng == 0 && asLogical(Rdrop)) {
     SEXP out = PROTECT(allocVector(REALSXP, l)), *px = SEXPPTR(x);
     double *pout = REAL(out);
-    for(int j = 0; j != l; ++j) pout[j] = asReal(fmaxC(px[j], Rng, g, Rnarm));
+    for(int j = 0; j != l; ++j) pout[j] = asReal(fmaxC(px[j], Rng, g, Rnarm, Rnth));
     setAttrib(out, R_NamesSymbol, getAttrib(x, R_NamesSymbol));
     UNPROTECT(1);
     return out;
   }
   SEXP out = PROTECT(allocVector(VECSXP, l)), *pout = SEXPPTR(out), *px = SEXPPTR(x);
-  for(int j = 0; j != l; ++j) pout[j] = fmaxC(px[j], Rng, g, Rnarm);
+  // With groups and fewer columns than threads, fmaxC() parallelizes over the rows of long columns
+  if(ng > 0 && nth > 1 && l > 1 && (l >= nth || length(px[0]) < 100000)) {
+    if(nth > l) nth = l;
+    SEXP Rnth1 = PROTECT(ScalarInteger(1)); ++nprotect;
+    #pragma omp parallel for num_threads(nth)
+    for(int j = 0; j < l; ++j) pout[j] = fmaxC(px[j], Rng, g, Rnarm, Rnth1);
+  } else {
+    for(int j = 0; j != l; ++j) pout[j] = fmaxC(px[j], Rng, g, Rnarm, Rnth);
+  }
   // if(ng == 0) for(int j = 0; j != l; ++j) copyMostAttrib(px[j], pout[j]);
   DFcopyAttr(out, x, ng);
-  UNPROTECT(1);
+  UNPROTECT(nprotect);
   return out;
 }
@@ -5,21 +5,20 @@
 #include "collapse_c.h"
 
 // C-implementations for different data types ----------------------------------
-// TODO: outsource and memset hash table and count vector?
-// Problem: does not work in parallel, each thread needs own intermediate vectors
-
-int mode_int(const int *restrict px, const int *restrict po, const int l, const int sorted, const int narm, const int ret) {
-  if(l == 1) return px[0];
-  const size_t l2 = 2U * (size_t) l;
-  size_t M = 256, id = 0;
-  int K = 8, index = 0, val, mode, max = 1, i = 0, end = l-1,
+// The hash table and count vector are taken from a hash_arena (see small_helper.c): grouped code passes a per-thread
+// arena sized for the largest group, ungrouped code (ha = NULL) allocates them just for the current vector.
+
+int mode_int(const int *restrict px, const int *restrict po, const int l, const int sorted, const int narm, const int ret, hash_arena *ha) {
+  if(l == 1) return sorted ? px[0] : px[po[0]-1];
+  hash_arena ha0, *a = ha ? ha : &ha0;
+  if(!ha) hash_arena_init(a, l, 0, HA_COUNTS);
+  size_t id = 0;
+  int K, index = 0, val, mode, max = 1, i = 0, end = l-1,
       minm = ret == 1, nfirstm = ret > 0, lastm = ret == 3;
-  while(M < l2) {
-    M *= 2;
-    K++;
-  }
-  int *restrict h = (int*)Calloc(M, int); // Table to save the hash values
-  int *restrict n = (int*)Calloc(l, int); // Table to count frequency of values
+  const size_t M = hash_arena_next(a, l, &K);
+  int *restrict h = a->h; // Table to save the hash values
+  int *restrict n = a->n; // Table to count frequency of values
+  unsigned int *restrict hg = a->gen, cur = a->cur; // Slot id is occupied iff hg[id] == cur
 
   if(sorted) {
     mode = px[0];
@@ -28,13 +27,15 @@ int mode_int(const int *restrict px, const int *restrict po, const int l, const
       val = px[i];
       if(val == NA_INTEGER && narm) continue;
       id = HASH(val, K);
-      while(h[id]) {
+      while(hg[id] == cur) {
         index = h[id]-1;
         if(px[index] == val) goto ibls;
         if(++id >= M) id %= M; // ++id; id %= M;
       }
+      hg[id] = cur;
       h[id] = i + 1;
-      index = i; // n[i] = 1;
+      index = i;
+      n[i] = 0;
       ibls:;
       if(++n[index] >= max) {
         if(lastm || n[index] > max) {
@@ -56,13 +57,15 @@ int mode_int(const int *restrict px, const int *restrict po, const int l, const
       val = px[po[i]-1];
       if(val == NA_INTEGER && narm) continue;
       id = HASH(val, K);
-      while(h[id]) {
+      while(hg[id] == cur) {
         index = h[id]-1;
         if(px[po[index]-1] == val) goto ibl;
         if(++id >= M) id %= M; // ++id; id %= M;
       }
+      hg[id] = cur;
       h[id] = i + 1;
-      index = i; // n[i] = 1;
+      index = i;
+      n[i] = 0;
       ibl:;
       if(++n[index] >= max) {
         if(lastm || n[index] > max) {
@@ -79,23 +82,24 @@ int mode_int(const int *restrict px, const int *restrict po, const int l, const
     }
   }
 
-  Free(h);
-  Free(n);
+  if(!ha) hash_arena_free(a);
   return mode;
 }
 
-int w_mode_int(const int *restrict px, const double *restrict pw, const int *restrict po, const int l, const int sorted, const int narm, const int ret) {
-  if(l == 1) return ISNAN(pw[0]) ? NA_INTEGER : px[0];
-  const size_t l2 = 2U * (size_t) l;
-  size_t M = 256, id = 0;
-  int K = 8, index = 0, val, mode, i = 0, end = l-1,
-    minm = ret == 1, nfirstm = ret > 0, lastm = ret == 3;
-  while(M < l2) {
-    M *= 2;
-    K++;
+int w_mode_int(const int *restrict px, const double *restrict pw, const int *restrict po, const int l, const int sorted, const int narm, const int ret, hash_arena *ha) {
+  if(l == 1) {
+    const int i0 = sorted ? 0 : po[0]-1;
+    return ISNAN(pw[i0]) ? NA_INTEGER : px[i0];
   }
-  int *restrict h = (int*)Calloc(M, int); // Table to save the hash values
-  double *restrict sumw = (double*)Calloc(l, double); // Table to save each values sum of weights
+  hash_arena ha0, *a = ha ? ha : &ha0;
+  if(!ha) hash_arena_init(a, l, 0, HA_WEIGHTS);
+  size_t id = 0;
+  int K, index = 0, val, mode, i = 0, end = l-1,
+    minm = ret == 1, nfirstm = ret > 0, lastm = ret == 3;
+  const size_t M = hash_arena_next(a, l, &K);
+  int *restrict h = a->h; // Table to save the hash values
+  double *restrict sumw = a->sumw; // Table to save each values sum of weights
+  unsigned int *restrict hg = a->gen, cur = a->cur; // Slot id is occupied iff hg[id] == cur
   double max = DBL_MIN;
 
   if(sorted) {
@@ -105,13 +109,15 @@ int w_mode_int(const int *restrict px, const double *restrict pw, const int *res
       val = px[i];
       if(ISNAN(pw[i]) || (val == NA_INTEGER && narm)) continue;
       id = HASH(val, K);
-      while(h[id]) {
+      while(hg[id] == cur) {
         index = h[id]-1;
         if(px[index] == val) goto ibls;
         if(++id >= M) id %= M; // ++id; id %= M;
       }
+      hg[id] = cur;
       h[id] = i + 1;
-      index = i; // n[i] = 1;
+      index = i;
+      sumw[i] = 0.0;
       ibls:;
       sumw[index] += pw[i];
       if(sumw[index] >= max) {
@@ -135,13 +141,15 @@ int w_mode_int(const int *restrict px, const double *restrict pw, const int *res
       val = px[oi];
       if(ISNAN(pw[oi]) || (val == NA_INTEGER && narm)) continue;
       id = HASH(val, K);
-      while(h[id]) {
+      while(hg[id] == cur) {
         index = h[id]-1;
         if(px[po[index]-1] == val) goto ibl;
         if(++id >= M) id %= M; // ++id; id %= M;
       }
+      hg[id] = cur;
       h[id] = i + 1;
-      index = i; // n[i] = 1;
+      index = i;
+      sumw[i] = 0.0;
       ibl:;
       sumw[index] += pw[oi];
       if(sumw[index] >= max) {
@@ -159,17 +167,20 @@ int w_mode_int(const int *restrict px, const double *restrict pw, const int *res
     }
   }
 
-  Free(h);
-  Free(sumw);
+  if(!ha) hash_arena_free(a);
   return mode;
 }
 
 
-int mode_fct_logi(const int *restrict px, const int *restrict po, const int l, const int nlev, const int sorted, const int narm, const int ret) {
-  if(l == 1) return px[0];
+int mode_fct_logi(const int *restrict px, const int *restrict po, const int l, const int nlev, const int sorted, const int narm, const int ret, hash_arena *ha) {
+  if(l == 1) return sorted ? px[0] : px[po[0]-1];
   int val, mode, max = 1, nlevp = nlev + 1, i = 0, end = l-1,
     minm = ret == 1, nfirstm = ret > 0, lastm = ret == 3;
-  int *restrict n = (int*)Calloc(nlevp+1, int); // Table to count frequency of values
+  hash_arena ha0, *a = ha ? ha : &ha0;
+  if(!ha) hash_arena_init(a, 0, nlev, HA_COUNTS);
+  hash_arena_next(a, 0, NULL);
+  int *restrict n = a->n; // Table to count frequency of values
+  unsigned int *restrict hg = a->gen, cur = a->cur; // n[val] is valid iff hg[val] == cur
 
   if(sorted) {
     mode = px[0];
@@ -180,6 +191,10 @@ int mode_fct_logi(const int *restrict px, const int *restrict po, const int l, c
         if(narm) continue;
         val = nlevp;
       }
+      if(hg[val] != cur) {
+        hg[val] = cur;
+        n[val] = 0;
+      }
       if(++n[val] >= max) {
         if(lastm || n[val] > max) {
           max = n[val];
@@ -202,6 +217,10 @@ int mode_fct_logi(const int *restrict px, const int *restrict po, const int l, c
         if(narm) continue;
         val = nlevp;
       }
+      if(hg[val] != cur) {
+        hg[val] = cur;
+        n[val] = 0;
+      }
       if(++n[val] >= max) {
         if(lastm || n[val] > max) {
           max = n[val];
@@ -217,15 +236,22 @@ int mode_fct_logi(const int *restrict px, const int *restrict po, const int l, c
     }
   }
 
-  Free(n);
+  if(!ha) hash_arena_free(a);
   return mode;
 }
 
-int w_mode_fct_logi(const int *restrict px, const double *restrict pw, const int *restrict po, const int l, const int nlev, const int sorted, const int narm, const int ret) {
-  if(l == 1) return ISNAN(pw[0]) ? NA_INTEGER : px[0];
+int w_mode_fct_logi(const int *restrict px, const double *restrict pw, const int *restrict po, const int l, const int nlev, const int sorted, const int narm, const int ret, hash_arena *ha) {
+  if(l == 1) {
+    const int i0 = sorted ? 0 : po[0]-1;
+    return ISNAN(pw[i0]) ? NA_INTEGER : px[i0];
+  }
   int val, mode, nlevp = nlev + 1, i = 0, end = l-1,
     minm = ret == 1, nfirstm = ret > 0, lastm = ret == 3;
-  double *restrict sumw = (double*)Calloc(nlevp+1, double); // Table to save each values sum of weights
+  hash_arena ha0, *a = ha ? ha : &ha0;
+  if(!ha) hash_arena_init(a, 0, nlev, HA_WEIGHTS);
+  hash_arena_next(a, 0, NULL);
+  double *restrict sumw = a->sumw; // Table to save each values sum of weights
+  unsigned int *restrict hg = a->gen, cur = a->cur; // sumw[val] is valid iff hg[val] == cur
   double max = DBL_MIN;
 
   if(sorted) {
@@ -238,6 +264,10 @@ int w_mode_fct_logi(const int *restrict px, const double *restrict pw, const int
         if(narm) continue;
         val = nlevp;
       }
+      if(hg[val] != cur) {
+        hg[val] = cur;
+        sumw[val] = 0.0;
+      }
       sumw[val] += pw[i];
       if(sumw[val] >= max) {
         if(lastm || sumw[val] > max) {
@@ -263,6 +293,10 @@ int w_mode_fct_logi(const int *restrict px, const double *restrict pw, const int
         if(narm) continue;
         val = nlevp;
       }
+      if(hg[val] != cur) {
+        hg[val] = cur;
+        sumw[val] = 0.0;
+      }
       sumw[val] += pw[oi];
       if(sumw[val] >= max) {
         if(lastm || sumw[val] > max) {
@@ -279,23 +313,22 @@ int w_mode_fct_logi(const int *restrict px, const double *restrict pw, const int
     }
   }
 
-  Free(sumw);
+  if(!ha) hash_arena_free(a);
   return mode;
 }
 
 
-double mode_double(const double *restrict px, const int *restrict po, const int l, const int sorted, const int narm, const int ret) {
-  if(l == 1) return px[0];
-  const size_t l2 = 2U * (size_t) l;
-  size_t M = 256, id = 0;
-  int K = 8, index = 0, max = 1, i = 0, end = l-1,
+double mode_double(const double *restrict px, const int *restrict po, const int l, const int sorted, const int narm, const int ret, hash_arena *ha) {
+  if(l == 1) return sorted ? px[0] : px[po[0]-1];
+  hash_arena ha0, *a = ha ? ha : &ha0;
+  if(!ha) hash_arena_init(a, l, 0, HA_COUNTS);
+  size_t id = 0;
+  int K, index = 0, max = 1, i = 0, end = l-1,
     minm = ret == 1, nfirstm = ret > 0, lastm = ret == 3;
-  while(M < l2) {
-    M *= 2;
-    K++;
-  }
-  int *restrict h = (int*)Calloc(M, int); // Table to save the hash values
-  int *restrict n = (int*)Calloc(l, int); // Table to count frequency of values
+  const size_t M = hash_arena_next(a, l, &K);
+  int *restrict h = a->h; // Table to save the hash values
+  int *restrict n = a->n; // Table to count frequency of values
+  unsigned int *restrict hg = a->gen, cur = a->cur; // Slot id is occupied iff hg[id] == cur
   double val, mode;
   union uno tpv;
 
@@ -305,15 +338,17 @@ double mode_double(const double *restrict px, const int *restrict po, const int
     for(; i < l; ++i) {
       val = px[i];
       if(ISNAN(val) && narm) continue;
-      tpv.d = val;
+      tpv.d = val == 0.0 ? 0.0 : val; // 0.0 and -0.0 are equal but hash differently
       id = HASH(tpv.u[0] + tpv.u[1], K);
-      while(h[id]) {
+      while(hg[id] == cur) {
         index = h[id]-1;
         if(REQUAL(px[index], val)) goto rbls;
         if(++id >= M) id %= M; // ++id; id %= M;
       }
+      hg[id] = cur;
       h[id] = i + 1;
-      index = i; // n[i] = 1;
+      index = i;
+      n[i] = 0;
       rbls:;
       if(++n[index] >= max) {
         if(lastm || n[index] > max) {
@@ -334,15 +369,17 @@ double mode_double(const double *restrict px, const int *restrict po, const int
     for(; i < l; ++i) {
       val = px[po[i]-1];
       if(ISNAN(val) && narm) continue;
-      tpv.d = val;
+      tpv.d = val == 0.0 ? 0.0 : val; // 0.0 and -0.0 are equal but hash differently
       id = HASH(tpv.u[0] + tpv.u[1], K);
-      while(h[id]) {
+      while(hg[id] == cur) {
         index = h[id]-1;
         if(REQUAL(px[po[index]-1], val)) goto rbl;
         if(++id >= M) id %= M; // ++id; id %= M;
       }
+      hg[id] = cur;
       h[id] = i + 1;
-      index = i; // n[i] = 1;
+      index = i;
+      n[i] = 0;
       rbl:;
       if(++n[index] >= max) {
         if(lastm || n[index] > max) {
@@ -359,22 +396,23 @@ double mode_double(const double *restrict px, const int *restrict po, const int
     }
   }
 
-  Free(h);
-  Free(n);
+  if(!ha) hash_arena_free(a);
   return mode;
 }
 
-double w_mode_double(const double *restrict px, const double *restrict pw, const int *restrict po, const int l, const int sorted, const int narm, const int ret) {
-  if(l == 1) return ISNAN(pw[0]) ? NA_REAL : px[0];
-  const size_t l2 = 2U * (size_t) l;
-  size_t M = 256, id = 0;
-  int K = 8, index = 0, i = 0, end = l-1, minm = ret == 1, nfirstm = ret > 0, lastm = ret == 3;
-  while(M < l2) {
-    M *= 2;
-    K++;
+double w_mode_double(const double *restrict px, const double *restrict pw, const int *restrict po, const int l, const int sorted, const int narm, const int ret, hash_arena *ha) {
+  if(l == 1) {
+    const int i0 = sorted ? 0 : po[0]-1;
+    return ISNAN(pw[i0]) ? NA_REAL : px[i0];
   }
-  int *restrict h = (int*)Calloc(M, int); // Table to save the hash values
-  double *restrict sumw = (double*)Calloc(l, double); // Table to save each values sum of weights
+  hash_arena ha0, *a = ha ? ha : &ha0;
+  if(!ha) hash_arena_init(a, l, 0, HA_WEIGHTS);
+  size_t id = 0;
+  int K, index = 0, i = 0, end = l-1, minm = ret == 1, nfirstm = ret > 0, lastm = ret == 3;
+  const size_t M = hash_arena_next(a, l, &K);
+  int *restrict h = a->h; // Table to save the hash values
+  double *restrict sumw = a->sumw; // Table to save each values sum of weights
+  unsigned int *restrict hg = a->gen, cur = a->cur; // Slot id is occupied iff hg[id] == cur
   double val, mode, max = DBL_MIN;
   union uno tpv;
 
@@ -384,15 +422,17 @@ double w_mode_double(const double *restrict px, const double *restrict pw, const
     for(; i < l; ++i) {
       val = px[i];
       if(ISNAN(pw[i]) || (ISNAN(val) && narm)) continue;
-      tpv.d = val;
+      tpv.d = val == 0.0 ? 0.0 : val; // 0.0 and -0.0 are equal but hash differently
       id = HASH(tpv.u[0] + tpv.u[1], K);
-      while(h[id]) {
+      while(hg[id] == cur) {
         index = h[id]-1;
         if(REQUAL(px[index], val)) goto rbls;
         if(++id >= M) id %= M; // ++id; id %= M;
       }
+      hg[id] = cur;
       h[id] = i + 1;
-      index = i; // n[i] = 1;
+      index = i;
+      sumw[i] = 0.0;
       rbls:;
       sumw[index] += pw[i];
       if(sumw[index] >= max) {
@@ -415,15 +455,17 @@ double w_mode_double(const double *restrict px, const double *restrict pw, const
       oi = po[i]-1;
       val = px[oi];
       if(ISNAN(pw[oi]) || (ISNAN(val) && narm)) continue;
-      tpv.d = val;
+      tpv.d = val == 0.0 ? 0.0 : val; // 0.0 and -0.0 are equal but hash differently
       id = HASH(tpv.u[0] + tpv.u[1], K);
-      while(h[id]) {
+      while(hg[id] == cur) {
         index = h[id]-1;
         if(REQUAL(px[po[index]-1], val)) goto rbl;
         if(++id >= M) id %= M; // ++id; id %= M;
       }
+      hg[id] = cur;
       h[id] = i + 1;
-      index = i; // n[i] = 1;
+      index = i;
+      sumw[i] = 0.0;
       rbl:;
       sumw[index] += pw[oi];
       if(sumw[index] >= max) {
@@ -441,24 +483,22 @@ double w_mode_double(const double *restrict px, const double *restrict pw, const
     }
   }
 
-  Free(h);
-  Free(sumw);
+  if(!ha) hash_arena_free(a);
   return mode;
 }
 
 
-SEXP mode_string(const SEXP *restrict px, const int *restrict po, const int l, const int sorted, const int narm, const int ret) {
-  if(l == 1) return px[0];
-  const size_t l2 = 2U * (size_t) l;
-  size_t M = 256, id = 0;
-  int K = 8, index = 0, max = 1, i = 0, end = l-1,
+SEXP mode_string(const SEXP *restrict px, const int *restrict po, const int l, const int sorted, const int narm, const int ret, hash_arena *ha) {
+  if(l == 1) return sorted ? px[0] : px[po[0]-1];
+  hash_arena ha0, *a = ha ? ha : &ha0;
+  if(!ha) hash_arena_init(a, l, 0, HA_COUNTS);
+  size_t id = 0;
+  int K, index = 0, max = 1, i = 0, end = l-1,
     minm = ret == 1, nfirstm = ret > 0, lastm = ret == 3;
-  while(M < l2) {
-    M *= 2;
-    K++;
-  }
-  int *restrict h = (int*)Calloc(M, int); // Table to save the hash values
-  int *restrict n = (int*)Calloc(l, int); // Table to count frequency of values
+  const size_t M = hash_arena_next(a, l, &K);
+  int *restrict h = a->h; // Table to save the hash values
+  int *restrict n = a->n; // Table to count frequency of values
+  unsigned int *restrict hg = a->gen, cur = a->cur; // Slot id is occupied iff hg[id] == cur
   SEXP val, mode;
 
   if(sorted) {
@@ -468,13 +508,15 @@ SEXP mode_string(const SEXP *restrict px, const int *restrict po, const int l, c
       val = px[i];
       if(val == NA_STRING && narm) continue;
       id = HASH(((intptr_t) val & 0xffffffff), K);
-      while(h[id]) {
+      while(hg[id] == cur) {
         index = h[id]-1;
         if(px[index] == val) goto sbls;
         if(++id >= M) id %= M; // ++id; id %= M;
       }
+      hg[id] = cur;
       h[id] = i + 1;
-      index = i; // n[i] = 1;
+      index = i;
+      n[i] = 0;
       sbls:;
       if(++n[index] >= max) {
         if(lastm || n[index] > max) {
@@ -496,13 +538,15 @@ SEXP mode_string(const SEXP *restrict px, const int *restrict po, const int l, c
       val = px[po[i]-1];
       if(val == NA_STRING && narm) continue;
       id = HASH(((intptr_t) val & 0xffffffff), K);
-      while(h[id]) {
+      while(hg[id] == cur) {
         index = h[id]-1;
         if(px[po[index]-1] == val) goto sbl;
         if(++id >= M) id %= M; // ++id; id %= M;
       }
+      hg[id] = cur;
       h[id] = i + 1;
-      index = i; // n[i] = 1;
+      index = i;
+      n[i] = 0;
       sbl:;
       if(++n[index] >= max) {
         if(lastm || n[index] > max) {
@@ -519,22 +563,23 @@ SEXP mode_string(const SEXP *restrict px, const int *restrict po, const int l, c
     }
   }
 
-  Free(h);
-  Free(n);
+  if(!ha) hash_arena_free(a);
   return mode;
 }
 
-SEXP w_mode_string(const SEXP *restrict px, const double *restrict pw, const int *restrict po, const int l, const int sorted, const int narm, const int ret) {
-  if(l == 1) return ISNAN(pw[0]) ? NA_STRING : px[0];
-  const size_t l2 = 2U * (size_t) l;
-  size_t M = 256, id = 0;
-  int K = 8, index = 0, i = 0, end = l-1, minm = ret == 1, nfirstm = ret > 0, lastm = ret == 3;
-  while(M < l2) {
-    M *= 2;
-    K++;
+SEXP w_mode_string(const SEXP *restrict px, const double *restrict pw, const int *restrict po, const int l, const int sorted, const int narm, const int ret, hash_arena *ha) {
+  if(l == 1) {
+    const int i0 = sorted ? 0 : po[0]-1;
+    return ISNAN(pw[i0]) ? NA_STRING : px[i0];
   }
-  int *restrict h = (int*)Calloc(M, int); // Table to save the hash values
-  double *restrict sumw = (double*)Calloc(l, double); // Table to save each values sum of weights
+  hash_arena ha0, *a = ha ? ha : &ha0;
+  if(!ha) hash_arena_init(a, l, 0, HA_WEIGHTS);
+  size_t id = 0;
+  int K, index = 0, i = 0, end = l-1, minm = ret == 1, nfirstm = ret > 0, lastm = ret == 3;
+  const size_t M = hash_arena_next(a, l, &K);
+  int *restrict h = a->h; // Table to save the hash values
+  double *restrict sumw = a->sumw; // Table to save each values sum of weights
+  unsigned int *restrict hg = a->gen, cur = a->cur; // Slot id is occupied iff hg[id] == cur
   double max = DBL_MIN;
   SEXP val, mode;
 
@@ -545,13 +590,15 @@ SEXP w_mode_string(const SEXP *restrict px, const double *restrict pw, const int
       val = px[i];
       if(ISNAN(pw[i]) || (val == NA_STRING && narm)) continue;
       id = HASH(((intptr_t) val & 0xffffffff), K);
-      while(h[id]) {
+      while(hg[id] == cur) {
         index = h[id]-1;
         if(px[index] == val) goto sbls;
         if(++id >= M) id %= M; // ++id; id %= M;
       }
+      hg[id] = cur;
       h[id] = i + 1;
-      index = i; // n[i] = 1;
+      index = i;
+      sumw[i] = 0.0;
       sbls:;
       sumw[index] += pw[i];
       if(sumw[index] >= max) {
@@ -575,13 +622,15 @@ SEXP w_mode_string(const SEXP *restrict px, const double *restrict pw, const int
       val = px[oi];
       if(ISNAN(pw[oi]) || (val == NA_STRING && narm)) continue;
       id = HASH(((intptr_t) val & 0xffffffff), K);
-      while(h[id]) {
+      while(hg[id] == cur) {
         index = h[id]-1;
         if(px[po[index]-1] == val) goto sbl;
         if(++id >= M) id %= M; // ++id; id %= M;
       }
+      hg[id] = cur;
       h[id] = i + 1;
-      index = i; // n[i] = 1;
+      index = i;
+      sumw[i] = 0.0;
       sbl:;
       sumw[index] += pw[oi];
       if(sumw[index] >= max) {
@@ -599,8 +648,7 @@ SEXP w_mode_string(const SEXP *restrict px, const double *restrict pw, const int
     }
   }
 
-  Free(h);
-  Free(sumw);
+  if(!ha) hash_arena_free(a);
   return mode;
 }
 
@@ -614,17 +662,17 @@ SEXP mode_impl(SEXP x, int narm, int ret) {
   SEXP res;
   switch(TYPEOF(x)) {
     case REALSXP:
-      PROTECT(res = ScalarReal(mode_double(REAL(x), &l, l, 1, narm, ret)));
+      PROTECT(res = ScalarReal(mode_double(REAL(x), &l, l, 1, narm, ret, NULL)));
       break;
     case INTSXP:
-      PROTECT(res = ScalarInteger(isFactor(x) ? mode_fct_logi(INTEGER(x), &l, l, nlevels(x), 1, narm, ret) :
-                              mode_int(INTEGER(x), &l, l, 1, narm, ret)));
+      PROTECT(res = ScalarInteger(isFactor(x) ? mode_fct_logi(INTEGER(x), &l, l, nlevels(x), 1, narm, ret, NULL) :
+                              mode_int(INTEGER(x), &l, l, 1, narm, ret, NULL)));
       break;
     case LGLSXP:
-      PROTECT(res = duplicate(ScalarLogical(mode_fct_logi(LOGICAL(x), &l, l, 1, 1, narm, ret))));
+      PROTECT(res = duplicate(ScalarLogical(mode_fct_logi(LOGICAL(x), &l, l, 1, 1, narm, ret, NULL))));
       break;
     case STRSXP:
-      PROTECT(res = ScalarString(mode_string(STRING_PTR(x), &l, l, 1, narm, ret)));
+      PROTECT(res = ScalarString(mode_string(STRING_PTR(x), &l, l, 1, narm, ret, NULL)));
       break;
     default: error("Not Supported SEXP Type!");
   }
@@ -641,17 +689,17 @@ SEXP w_mode_impl(SEXP x, double *pw, int narm, int ret) {
   SEXP res;
   switch(TYPEOF(x)) {
     case REALSXP:
-      PROTECT(res = ScalarReal(w_mode_double(REAL(x), pw, &l, l, 1, narm, ret)));
+      PROTECT(res = ScalarReal(w_mode_double(REAL(x), pw, &l, l, 1, narm, ret, NULL)));
       break;
     case INTSXP:
-      PROTECT(res = ScalarInteger(isFactor(x) ? w_mode_fct_logi(INTEGER(x), pw, &l, l, nlevels(x), 1, narm, ret) :
-                             w_mode_int(INTEGER(x), pw, &l, l, 1, narm, ret)));
+      PROTECT(res = ScalarInteger(isFactor(x) ? w_mode_fct_logi(INTEGER(x), pw, &l, l, nlevels(x), 1, narm, ret, NULL) :
+                             w_mode_int(INTEGER(x), pw, &l, l, 1, narm, ret, NULL)));
       break;
     case LGLSXP:
-      PROTECT(res = duplicate(ScalarLogical(w_mode_fct_logi(LOGICAL(x), pw, &l, l, 1, 1, narm, ret))));
+      PROTECT(res = duplicate(ScalarLogical(w_mode_fct_logi(LOGICAL(x), pw, &l, l, 1, 1, narm, ret, NULL))));
       break;
     case STRSXP:
-      PROTECT(res = ScalarString(w_mode_string(STRING_PTR(x), pw, &l, l, 1, narm, ret)));
+      PROTECT(res = ScalarString(w_mode_string(STRING_PTR(x), pw, &l, l, 1, narm, ret, NULL)));
       break;
     default: error("Not Supported SEXP Type!");
   }
@@ -664,6 +712,8 @@ SEXP w_mode_impl(SEXP x, double *pw, int narm, int ret) {
 SEXP mode_g_impl(SEXP x, int ng, int *pgs, int *po, int *pst, int sorted, int narm, int ret, int nthreads) {
 
   int l = length(x), tx = TYPEOF(x);
+  int maxgs = 0; // Each thread's hash table is sized for the largest group
+  for(int gr = 0; gr != ng; ++gr) if(pgs[gr] > maxgs) maxgs = pgs[gr];
   if(nthreads > ng) nthreads = ng;
 
   SEXP res = PROTECT(allocVector(tx, ng));
@@ -673,37 +723,37 @@ SEXP mode_g_impl(SEXP x, int ng, int *pgs, int *po, int *pst, int sorted, int na
     switch(tx) {
       case REALSXP: {
         double *px = REAL(x), *pres = REAL(res);
-        #pragma omp parallel for num_threads(nthreads)
-        for(int gr = 0; gr < ng; ++gr)
-          pres[gr] = pgs[gr] == 0 ? NA_REAL : mode_double(px + pst[gr]-1, po, pgs[gr], 1, narm, ret);
+        HA_PARALLEL_FOR(gr, ng, nthreads, maxgs, 0, HA_COUNTS,
+          pres[gr] = pgs[gr] == 0 ? NA_REAL : mode_double(px + pst[gr]-1, po, pgs[gr], 1, narm, ret, &ha);
+        )
         break;
       }
       case INTSXP: {
         int *px = INTEGER(x), *pres = INTEGER(res);
         if(isFactor(x) && nlevels(x) < l / ng * 3) {
           int M = nlevels(x);
-          #pragma omp parallel for num_threads(nthreads)
-          for(int gr = 0; gr < ng; ++gr)
-            pres[gr] = pgs[gr] == 0 ? NA_INTEGER : mode_fct_logi(px + pst[gr]-1, po, pgs[gr], M, 1, narm, ret);
+          HA_PARALLEL_FOR(gr, ng, nthreads, 0, M, HA_COUNTS,
+            pres[gr] = pgs[gr] == 0 ? NA_INTEGER : mode_fct_logi(px + pst[gr]-1, po, pgs[gr], M, 1, narm, ret, &ha);
+          )
         } else {
-          #pragma omp parallel for num_threads(nthreads)
-          for(int gr = 0; gr < ng; ++gr)
-            pres[gr] = pgs[gr] == 0 ? NA_INTEGER : mode_int(px + pst[gr]-1, po, pgs[gr], 1, narm, ret);
+          HA_PARALLEL_FOR(gr, ng, nthreads, maxgs, 0, HA_COUNTS,
+            pres[gr] = pgs[gr] == 0 ? NA_INTEGER : mode_int(px + pst[gr]-1, po, pgs[gr], 1, narm, ret, &ha);
+          )
         }
         break;
       }
       case LGLSXP: {
         int *px = LOGICAL(x), *pres = LOGICAL(res);
-        #pragma omp parallel for num_threads(nthreads)
-        for(int gr = 0; gr < ng; ++gr)
-            pres[gr] = pgs[gr] == 0 ? NA_LOGICAL : mode_fct_logi(px + pst[gr]-1, po, pgs[gr], 1, 1, narm, ret);
+        HA_PARALLEL_FOR(gr, ng, nthreads, 0, 1, HA_COUNTS,
+            pres[gr] = pgs[gr] == 0 ? NA_LOGICAL : mode_fct_logi(px + pst[gr]-1, po, pgs[gr], 1, 1, narm, ret, &ha);
+        )
         break;
       }
       case STRSXP: {
         SEXP *px = STRING_PTR(x), *pres = STRING_PTR(res);
-        #pragma omp parallel for num_threads(nthreads)
-        for(int gr = 0; gr < ng; ++gr)
-          pres[gr] = pgs[gr] == 0 ? NA_STRING : mode_string(px + pst[gr]-1, po, pgs[gr], 1, narm, ret);
+        HA_PARALLEL_FOR(gr, ng, nthreads, maxgs, 0, HA_COUNTS,
+          pres[gr] = pgs[gr] == 0 ? NA_STRING : mode_string(px + pst[gr]-1, po, pgs[gr], 1, narm, ret, &ha);
+        )
         break;
       }
       default: error("Not Supported SEXP Type!");
@@ -712,37 +762,37 @@ SEXP mode_g_impl(SEXP x, int ng, int *pgs, int *po, int *pst, int sorted, int na
     switch(tx) {
       case REALSXP: {
         double *px = REAL(x), *pres = REAL(res);
-        #pragma omp parallel for num_threads(nthreads)
-        for(int gr = 0; gr < ng; ++gr)
-          pres[gr] = pgs[gr] == 0 ? NA_REAL : mode_double(px, po + pst[gr]-1, pgs[gr], 0, narm, ret);
+        HA_PARALLEL_FOR(gr, ng, nthreads, maxgs, 0, HA_COUNTS,
+          pres[gr] = pgs[gr] == 0 ? NA_REAL : mode_double(px, po + pst[gr]-1, pgs[gr], 0, narm, ret, &ha);
+        )
         break;
       }
       case INTSXP: {
         int *px = INTEGER(x), *pres = INTEGER(res);
         if(isFactor(x) && nlevels(x) < l / ng * 3) {
           int M = nlevels(x);
-          #pragma omp parallel for num_threads(nthreads)
-          for(int gr = 0; gr < ng; ++gr)
-            pres[gr] = pgs[gr] == 0 ? NA_INTEGER : mode_fct_logi(px, po + pst[gr]-1, pgs[gr], M, 0, narm, ret);
+          HA_PARALLEL_FOR(gr, ng, nthreads, 0, M, HA_COUNTS,
+            pres[gr] = pgs[gr] == 0 ? NA_INTEGER : mode_fct_logi(px, po + pst[gr]-1, pgs[gr], M, 0, narm, ret, &ha);
+          )
         } else {
-          #pragma omp parallel for num_threads(nthreads)
-          for(int gr = 0; gr < ng; ++gr)
-            pres[gr] = pgs[gr] == 0 ? NA_INTEGER : mode_int(px, po + pst[gr]-1, pgs[gr], 0, narm, ret);
+          HA_PARALLEL_FOR(gr, ng, nthreads, maxgs, 0, HA_COUNTS,
+            pres[gr] = pgs[gr] == 0 ? NA_INTEGER : mode_int(px, po + pst[gr]-1, pgs[gr], 0, narm, ret, &ha);
+          )
         }
         break;
       }
       case LGLSXP: {
         int *px = LOGICAL(x), *pres = LOGICAL(res);
-        #pragma omp parallel for num_threads(nthreads)
-        for(int gr = 0; gr < ng; ++gr)
-          pres[gr] = pgs[gr] == 0 ? NA_LOGICAL : mode_fct_logi(px, po + pst[gr]-1, pgs[gr], 1, 0, narm, ret);
+        HA_PARALLEL_FOR(gr, ng, nthreads, 0, 1, HA_COUNTS,
+          pres[gr] = pgs[gr] == 0 ? NA_LOGICAL : mode_fct_logi(px, po + pst[gr]-1, pgs[gr], 1, 0, narm, ret, &ha);
+        )
         break;
       }
       case STRSXP: {
         SEXP *px = STRING_PTR(x), *pres = STRING_PTR(res);
-        #pragma omp parallel for num_threads(nthreads)
-        for(int gr = 0; gr < ng; ++gr)
-          pres[gr] = pgs[gr] == 0 ? NA_STRING : mode_string(px, po + pst[gr]-1, pgs[gr], 0, narm, ret);
+        HA_PARALLEL_FOR(gr, ng, nthreads, maxgs, 0, HA_COUNTS,
+          pres[gr] = pgs[gr] == 0 ? NA_STRING : mode_string(px, po + pst[gr]-1, pgs[gr], 0, narm, ret, &ha);
+        )
         break;
       }
       default: error("Not Supported SEXP Type!");
@@ -757,6 +807,8 @@ SEXP mode_g_impl(SEXP x, int ng, int *pgs, int *po, int *pst, int sorted, int na
 SEXP w_mode_g_impl(SEXP x, double *pw, int ng, int *pgs, int *po, int *pst, int sorted, int narm, int ret, int nthreads) {
 
   int l = length(x), tx = TYPEOF(x);
+  int maxgs = 0; // Each thread's hash table is sized for the largest group
+  for(int gr = 0; gr != ng; ++gr) if(pgs[gr] > maxgs) maxgs = pgs[gr];
   if(nthreads > ng) nthreads = ng;
 
   SEXP res = PROTECT(allocVector(tx, ng));
@@ -766,37 +818,37 @@ SEXP w_mode_g_impl(SEXP x, double *pw, int ng, int *pgs, int *po, int *pst, int
     switch(tx) {
       case REALSXP: {
         double *px = REAL(x), *pres = REAL(res);
-        #pragma omp parallel for num_threads(nthreads)
-        for(int gr = 0; gr < ng; ++gr)
-          pres[gr] = pgs[gr] == 0 ? NA_REAL : w_mode_double(px + pst[gr]-1, pw + pst[gr]-1, po, pgs[gr], 1, narm, ret);
+        HA_PARALLEL_FOR(gr, ng, nthreads, maxgs, 0, HA_WEIGHTS,
+          pres[gr] = pgs[gr] == 0 ? NA_REAL : w_mode_double(px + pst[gr]-1, pw + pst[gr]-1, po, pgs[gr], 1, narm, ret, &ha);
+        )
         break;
       }
       case INTSXP: {
         int *px = INTEGER(x), *pres = INTEGER(res);
         if(isFactor(x) && nlevels(x) < l / ng * 3) {
           int M = nlevels(x);
-          #pragma omp parallel for num_threads(nthreads)
-          for(int gr = 0; gr < ng; ++gr)
-            pres[gr] = pgs[gr] == 0 ? NA_INTEGER : w_mode_fct_logi(px + pst[gr]-1, pw + pst[gr]-1, po, pgs[gr], M, 1, narm, ret);
+          HA_PARALLEL_FOR(gr, ng, nthreads, 0, M, HA_WEIGHTS,
+            pres[gr] = pgs[gr] == 0 ? NA_INTEGER : w_mode_fct_logi(px + pst[gr]-1, pw + pst[gr]-1, po, pgs[gr], M, 1, narm, ret, &ha);
+          )
         } else {
-          #pragma omp parallel for num_threads(nthreads)
-          for(int gr = 0; gr < ng; ++gr)
-            pres[gr] = pgs[gr] == 0 ? NA_INTEGER : w_mode_int(px + pst[gr]-1, pw + pst[gr]-1, po, pgs[gr], 1, narm, ret);
+          HA_PARALLEL_FOR(gr, ng, nthreads, maxgs, 0, HA_WEIGHTS,
+            pres[gr] = pgs[gr] == 0 ? NA_INTEGER : w_mode_int(px + pst[gr]-1, pw + pst[gr]-1, po, pgs[gr], 1, narm, ret, &ha);
+          )
         }
         break;
       }
       case LGLSXP: {
         int *px = LOGICAL(x), *pres = LOGICAL(res);
-        #pragma omp parallel for num_threads(nthreads)
-        for(int gr = 0; gr < ng; ++gr)
-          pres[gr] = pgs[gr] == 0 ? NA_LOGICAL : w_mode_fct_logi(px + pst[gr]-1, pw + pst[gr]-1, po, pgs[gr], 1, 1, narm, ret);
+        HA_PARALLEL_FOR(gr, ng, nthreads, 0, 1, HA_WEIGHTS,
+          pres[gr] = pgs[gr] == 0 ? NA_LOGICAL : w_mode_fct_logi(px + pst[gr]-1, pw + pst[gr]-1, po, pgs[gr], 1, 1, narm, ret, &ha);
+        )
         break;
       }
       case STRSXP: {
         SEXP *px = STRING_PTR(x), *pres = STRING_PTR(res);
-        #pragma omp parallel for num_threads(nthreads)
-        for(int gr = 0; gr < ng; ++gr)
-          pres[gr] = pgs[gr] == 0 ? NA_STRING : w_mode_string(px + pst[gr]-1, pw + pst[gr]-1, po, pgs[gr], 1, narm, ret);
+        HA_PARALLEL_FOR(gr, ng, nthreads, maxgs, 0, HA_WEIGHTS,
+          pres[gr] = pgs[gr] == 0 ? NA_STRING : w_mode_string(px + pst[gr]-1, pw + pst[gr]-1, po, pgs[gr], 1, narm, ret, &ha);
+        )
         break;
       }
       default: error("Not Supported SEXP Type!");
@@ -805,37 +857,37 @@ SEXP w_mode_g_impl(SEXP x, double *pw, int ng, int *pgs, int *po, int *pst, int
     switch(tx) {
       case REALSXP: {
         double *px = REAL(x), *pres = REAL(res);
-        #pragma omp parallel for num_threads(nthreads)
-        for(int gr = 0; gr < ng; ++gr)
-          pres[gr] = pgs[gr] == 0 ? NA_REAL : w_mode_double(px, pw, po + pst[gr]-1, pgs[gr], 0, narm, ret);
+        HA_PARALLEL_FOR(gr, ng, nthreads, maxgs, 0, HA_WEIGHTS,
+          pres[gr] = pgs[gr] == 0 ? NA_REAL : w_mode_double(px, pw, po + pst[gr]-1, pgs[gr], 0, narm, ret, &ha);
+        )
         break;
       }
       case INTSXP: {
         int *px = INTEGER(x), *pres = INTEGER(res);
         if(isFactor(x) && nlevels(x) < l / ng * 3) {
           int M = nlevels(x);
-          #pragma omp parallel for num_threads(nthreads)
-          for(int gr = 0; gr < ng; ++gr)
-            pres[gr] = pgs[gr] == 0 ? NA_INTEGER : w_mode_fct_logi(px, pw, po + pst[gr]-1, pgs[gr], M, 0, narm, ret);
+          HA_PARALLEL_FOR(gr, ng, nthreads, 0, M, HA_WEIGHTS,
+            pres[gr] = pgs[gr] == 0 ? NA_INTEGER : w_mode_fct_logi(px, pw, po + pst[gr]-1, pgs[gr], M, 0, narm, ret, &ha);
+          )
         } else {
-          #pragma omp parallel for num_threads(nthreads)
-          for(int gr = 0; gr < ng; ++gr)
-            pres[gr] = pgs[gr] == 0 ? NA_INTEGER : w_mode_int(px, pw, po + pst[gr]-1, pgs[gr], 0, narm, ret);
+          HA_PARALLEL_FOR(gr, ng, nthreads, maxgs, 0, HA_WEIGHTS,
+            pres[gr] = pgs[gr] == 0 ? NA_INTEGER : w_mode_int(px, pw, po + pst[gr]-1, pgs[gr], 0, narm, ret, &ha);
+          )
         }
         break;
       }
       case LGLSXP: {
         int *px = LOGICAL(x), *pres = LOGICAL(res);
-        #pragma omp parallel for num_threads(nthreads)
-        for(int gr = 0; gr < ng; ++gr)
-          pres[gr] = pgs[gr] == 0 ? NA_LOGICAL : w_mode_fct_logi(px, pw, po + pst[gr]-1, pgs[gr], 1, 0, narm, ret);
+        HA_PARALLEL_FOR(gr, ng, nthreads, 0, 1, HA_WEIGHTS,
+          pres[gr] = pgs[gr] == 0 ? NA_LOGICAL : w_mode_fct_logi(px, pw, po + pst[gr]-1, pgs[gr], 1, 0, narm, ret, &ha);
+        )
         break;
       }
       case STRSXP: {
         SEXP *px = STRING_PTR(x), *pres = STRING_PTR(res);
-        #pragma omp parallel for num_threads(nthreads)
-        for(int gr = 0; gr < ng; ++gr)
-          pres[gr] = pgs[gr] == 0 ? NA_STRING : w_mode_string(px, pw, po + pst[gr]-1, pgs[gr], 0, narm, ret);
+        HA_PARALLEL_FOR(gr, ng, nthreads, maxgs, 0, HA_WEIGHTS,
+          pres[gr] = pgs[gr] == 0 ? NA_STRING : w_mode_string(px, pw, po + pst[gr]-1, pgs[gr], 0, narm, ret, &ha);
+        )
         break;
       }
       default: error("Not Supported SEXP Type!");
@@ -848,6 +900,254 @@ SEXP w_mode_g_impl(SEXP x, double *pw, int ng, int *pgs, int *po, int *pst, int
 }
 
 
+// Sort-based versions for large groups (see gsort_use() in small_helper.c): pog orders the rows of a group by value (stably, with
+// missing values last), so that each distinct value forms a run whose last element is the row of its last occurrence. The hashing
+// algorithms above update the mode when the count of a value reaches the maximum count, thus with ties = "first" ("last") the mode
+// is the value with the maximum count whose last occurrence comes first (last). With ties = "min" or "max" the mode is compared to
+// the other values with the maximum count. These functions process the runs and reproduce the results exactly.
+#define MODE_RUN(val, cnt, row)                     \
+  if(cnt > max) {                                   \
+    max = cnt;                                      \
+    frow = lrow = row;                              \
+    fmode = lmode = best = val;                     \
+  } else if(cnt == max) {                           \
+    if(row < frow) {                                \
+      frow = row;                                   \
+      fmode = val;                                  \
+    }                                               \
+    if(row > lrow) {                                \
+      lrow = row;                                   \
+      lmode = val;                                  \
+    }                                               \
+    if(minm ? best > val : best < val) best = val;  \
+  }
+
+static int mode_int_runs(const int *restrict px, const int *restrict pog, const int l, const int narm, const int ret) {
+  if(l == 1) return px[pog[0]-1];
+  int i = 0, cnt, max = 0, frow = 0, lrow = 0, val, fmode = NA_INTEGER, lmode = NA_INTEGER, best = NA_INTEGER, minm = ret == 1;
+  while(i < l) {
+    val = px[pog[i]-1];
+    if(val == NA_INTEGER && narm) break; // NA's are sorted last
+    cnt = 0;
+    do {
+      ++cnt;
+    } while(++i < l && px[pog[i]-1] == val);
+    MODE_RUN(val, cnt, pog[i-1]);
+  }
+  return ret == 0 ? fmode : ret == 3 ? lmode : best;
+}
+
+static double mode_double_runs(const double *restrict px, const int *restrict pog, const int l, const int narm, const int ret) {
+  if(l == 1) return px[pog[0]-1];
+  int i = 0, cnt, max = 0, frow = 0, lrow = 0, minm = ret == 1;
+  double val, fmode = NA_REAL, lmode = NA_REAL, best = NA_REAL;
+  while(i < l) {
+    val = px[pog[i]-1];
+    if(ISNAN(val)) break; // NA/NaN's are sorted last
+    cnt = 0;
+    do {
+      ++cnt;
+    } while(++i < l && px[pog[i]-1] == val);
+    MODE_RUN(px[pog[i-1]-1], cnt, pog[i-1]); // Value of the last occurrence (0.0 or -0.0)
+  }
+  if(i < l) {
+    if(narm) {
+      if(max == 0) return px[pog[l-1]-1];
+    } else { // NA and NaN are distinct values for the hashing algorithm, but are sorted together
+      int nna = 0, nnan = 0, rna = 0, rnan = 0;
+      for( ; i < l; ++i) {
+        if(R_IsNA(px[pog[i]-1])) {
+          ++nna;
+          rna = pog[i];
+        } else {
+          ++nnan;
+          rnan = pog[i];
+        }
+      }
+      if(nna) {
+        MODE_RUN(px[rna-1], nna, rna);
+      }
+      if(nnan) {
+        MODE_RUN(px[rnan-1], nnan, rnan);
+      }
+    }
+  }
+  // With ties = "min" or "max", comparisons to a missing mode are always FALSE, and missing values are processed last
+  return ret == 0 ? fmode : ret == 3 ? lmode : ISNAN(fmode) ? fmode : best;
+}
+
+static SEXP mode_string_runs(const SEXP *restrict px, const int *restrict pog, const int l, const int narm, const int ret) {
+  if(l == 1) return px[pog[0]-1];
+  int i = 0, cnt, max = 0, frow = 0, lrow = 0, minm = ret == 1;
+  SEXP val, fmode = NA_STRING, lmode = NA_STRING, best = NA_STRING;
+  while(i < l) { // Strings are grouped but not sorted: NA's can be anywhere
+    val = px[pog[i]-1];
+    cnt = 0;
+    do {
+      ++cnt;
+    } while(++i < l && px[pog[i]-1] == val);
+    if(val == NA_STRING && narm) continue;
+    MODE_RUN(val, cnt, pog[i-1]);
+  }
+  return ret == 0 ? fmode : ret == 3 ? lmode : best;
+}
+
+SEXP mode_g_sort_impl(SEXP x, const SEXP *pg, const int narm, const int ret, int nthreads) {
+
+  const int ng = INTEGER(pg[0])[0], tx = TYPEOF(x), *restrict pgs = INTEGER(pg[2]);
+  SEXP o = PROTECT(gsort_order(x, pg[1])), res = PROTECT(allocVector(tx, ng));
+  const int *restrict po = INTEGER(o);
+  int *restrict pst = (int *) R_alloc(ng, sizeof(int));
+  pst[0] = 0; // Groups appear in the order of the group id
+  for(int gr = 1; gr < ng; ++gr) pst[gr] = pst[gr-1] + pgs[gr-1];
+  if(nthreads > ng) nthreads = ng;
+
+  switch(tx) {
+    case REALSXP: {
+      double *px = REAL(x), *pres = REAL(res);
+      #pragma omp parallel for num_threads(nthreads)
+      for(int gr = 0; gr < ng; ++gr)
+        pres[gr] = pgs[gr] == 0 ? NA_REAL : mode_double_runs(px, po + pst[gr], pgs[gr], narm, ret);
+      break;
+    }
+    case INTSXP: {
+      int *px = INTEGER(x), *pres = INTEGER(res);
+      #pragma omp parallel for num_threads(nthreads)
+      for(int gr = 0; gr < ng; ++gr)
+        pres[gr] = pgs[gr] == 0 ? NA_INTEGER : mode_int_runs(px, po + pst[gr], pgs[gr], narm, ret);
+      break;
+    }
+    case STRSXP: {
+      SEXP *px = STRING_PTR(x), *pres = STRING_PTR(res);
+      #pragma omp parallel for num_threads(nthreads)
+      for(int gr = 0; gr < ng; ++gr)
+        pres[gr] = pgs[gr] == 0 ? NA_STRING : mode_string_runs(px, po + pst[gr], pgs[gr], narm, ret);
+      break;
+    }
+    default: error("Not Supported SEXP Type!");
+  }
+
+  copyMostAttrib(x, res);
+  UNPROTECT(2);
+  return res;
+}
+
+// Grouped mode of a factor or logical vector from a dense (group x level) table of counts or sums of weights, filled in a single
+// pass over the data in row order, thus without the ordering of the groups. For unweighted data each thread fills a table for a
+// block of rows, and the tables are summed. As with the sort-based versions above, the mode with ties = "first" ("last") is the
+// value with the maximum count whose count reached the maximum first (last), i.e. at its last occurrence, so a second table keeps
+// the last row of each value (for weighted data the last row with a positive (non-missing) weight). Yields the same results as
+// mode_fct_logi() and w_mode_fct_logi(), but returns R_NilValue if the table exceeds MODE_DENSE_MAXCELLS(l) cells or if there are
+// negative weights (where the maximum running sum can exceed the final sum), in which case the per-group versions are used.
+#define MODE_DENSE_MAXCELLS(l) (2.0 * (l) + 1e6)
+#define MODE_DENSE_IDX(v) ((v) == NA_INTEGER ? nlevp : (v))
+
+static SEXP mode_fct_g_dense(SEXP x, const int *restrict pgv, const int *restrict pgs, const int ng, const double *restrict pw,
+                             const int narm, const int ret, int nthreads) {
+  const int l = length(x), nlev = isFactor(x) ? nlevels(x) : 1, W = nlev + 2, nlevp = nlev + 1,
+    minm = ret == 1, lastm = ret == 3, rowm = ret == 0 || lastm;
+  const double cells = (double)ng * W;
+  if(cells > MODE_DENSE_MAXCELLS(l)) return R_NilValue;
+  if(pw) for(int i = 0; i != l; ++i) if(pw[i] < 0) return R_NilValue;
+
+  const size_t nc = (size_t)ng * W;
+  const int *restrict px = INTEGER(x);
+  SEXP res = PROTECT(allocVector(TYPEOF(x), ng));
+  int *restrict pres = INTEGER(res), *restrict lr = rowm ? (int *) Calloc(nc, int) : NULL; // Last row + 1
+
+  if(pw == NULL) {
+    if(l < 100000) nthreads = 1;
+    else if(cells * (1 + rowm) * nthreads > 4 * MODE_DENSE_MAXCELLS(l)) nthreads = 4 * MODE_DENSE_MAXCELLS(l) / (cells * (1 + rowm));
+    if(nthreads < 1) nthreads = 1;
+    int *restrict cnt = (int *) Calloc(nc * nthreads, int), *restrict tlr = nthreads > 1 && rowm ? (int *) Calloc(nc * (nthreads-1), int) : NULL;
+    #pragma omp parallel for num_threads(nthreads)
+    for(int t = 0; t < nthreads; ++t) {
+      int *restrict ct = cnt + t * nc, *restrict lt = t == 0 ? lr : tlr + (t-1) * nc;
+      const int end = (int)((int64_t)l * (t+1) / nthreads);
+      for(int i = (int)((int64_t)l * t / nthreads), xi; i < end; ++i) {
+        xi = px[i];
+        if(xi == NA_INTEGER && narm) continue;
+        const size_t id = (size_t)(pgv[i]-1) * W + MODE_DENSE_IDX(xi);
+        ++ct[id];
+        if(rowm) lt[id] = i + 1;
+      }
+    }
+    if(nthreads > 1) { // Later blocks contain later rows
+      #pragma omp parallel for num_threads(nthreads)
+      for(size_t id = 0; id < nc; ++id) {
+        for(int t = 1; t != nthreads; ++t) {
+          cnt[id] += cnt[t * nc + id];
+          if(rowm && tlr[(t-1) * nc + id]) lr[id] = tlr[(t-1) * nc + id];
+        }
+      }
+    }
+    #pragma omp parallel for num_threads(nthreads)
+    for(int gr = 0; gr < ng; ++gr) {
+      const int *restrict cg = cnt + (size_t)gr * W, *restrict lg = rowm ? lr + (size_t)gr * W : NULL;
+      int max = 0, mode = NA_INTEGER, row = 0;
+      for(int v = 0, val; v != W; ++v) {
+        if(cg[v] == 0 || cg[v] < max) continue;
+        val = v == nlevp ? NA_INTEGER : v;
+        if(cg[v] > max || (rowm ? (lastm ? lg[v] > row : lg[v] < row) : (minm ? mode > val : mode < val))) {
+          max = cg[v];
+          mode = val;
+          if(rowm) row = lg[v];
+        }
+      }
+      pres[gr] = mode;
+    }
+    Free(cnt);
+    if(tlr) Free(tlr);
+  } else { // Sums of weights are accumulated serially in row order, as in w_mode_fct_logi()
+    double *restrict sw = (double *) Calloc(nc, double);
+    int *restrict first = (int *) R_alloc(ng, sizeof(int)), *restrict last = (int *) R_alloc(ng, sizeof(int));
+    char *restrict seen = (char *) R_alloc(ng, sizeof(char)); // 1: first value found, 2: non-missing weight
+    memset(seen, 0, ng);
+    for(int i = 0, gi, xi; i != l; ++i) {
+      gi = pgv[i]-1;
+      xi = last[gi] = px[i];
+      // Value returned if no value has a positive sum of weights: the first (non-missing) value
+      if(!(seen[gi] & 1) && (!narm || (xi != NA_INTEGER && NISNAN(pw[i])))) {
+        seen[gi] |= 1;
+        first[gi] = xi;
+      }
+      if(ISNAN(pw[i])) continue;
+      seen[gi] |= 2;
+      if(xi == NA_INTEGER && narm) continue;
+      const size_t id = (size_t)gi * W + MODE_DENSE_IDX(xi);
+      sw[id] += pw[i];
+      if(rowm && (lastm || pw[i] > 0)) lr[id] = i + 1;
+    }
+    if(nthreads > ng) nthreads = ng;
+    #pragma omp parallel for num_threads(nthreads)
+    for(int gr = 0; gr < ng; ++gr) {
+      const double *restrict sg = sw + (size_t)gr * W;
+      const int *restrict lg = rowm ? lr + (size_t)gr * W : NULL;
+      double max = DBL_MIN;
+      int mode = NA_INTEGER, row = 0, found = 0;
+      for(int v = 0, val; v != W; ++v) {
+        if(sg[v] < max) continue;
+        val = v == nlevp ? NA_INTEGER : v;
+        if(sg[v] > max || !found || (rowm ? (lastm ? lg[v] > row : lg[v] < row) : (minm ? mode > val : mode < val))) {
+          max = sg[v];
+          mode = val;
+          found = 1;
+          if(rowm) row = lg[v];
+        }
+      }
+      if(found) pres[gr] = mode;
+      else if(pgs[gr] == 0 || (pgs[gr] == 1 && !(seen[gr] & 2))) pres[gr] = NA_INTEGER;
+      else pres[gr] = seen[gr] & 1 ? first[gr] : last[gr];
+    }
+    Free(sw);
+  }
+  if(lr) Free(lr);
+
+  copyMostAttrib(x, res);
+  UNPROTECT(1);
+  return res;
+}
+
 // Functions for Export --------------------------------------------------------
 
 SEXP fmodeC(SEXP x, SEXP g, SEXP w, SEXP Rnarm, SEXP Rret, SEXP Rnthreads) {
@@ -871,6 +1171,13 @@ SEXP fmodeC(SEXP x, SEXP g, SEXP w, SEXP Rnarm, SEXP Rret, SEXP Rnthreads) {
   const SEXP *restrict pg = SEXPPTR(g), o = pg[6];
   int sorted = LOGICAL(pg[5])[1] == 1, ng = INTEGER(pg[0])[0], *restrict pgs = INTEGER(pg[2]), *restrict po, *restrict pst;
   if(l != length(pg[1])) error("length(g) must match length(x)");
+  if(isFactor(x) || TYPEOF(x) == LGLSXP) {
+    SEXP res = mode_fct_g_dense(x, INTEGER(pg[1]), pgs, ng, nullw ? NULL : pw, asLogical(Rnarm), asInteger(Rret), asInteger(Rnthreads));
+    if(res != R_NilValue) {
+      UNPROTECT(nprotect);
+      return res;
+    }
+  }
   if(isNull(o)) {
     int *cgs = (int *) R_alloc(ng+2, sizeof(int)), *restrict pgv = INTEGER(pg[1]); cgs[1] = 1;
     for(int i = 0; i != ng; ++i) cgs[i+2] = cgs[i+1] + pgs[i];
@@ -886,7 +1193,8 @@ SEXP fmodeC(SEXP x, SEXP g, SEXP w, SEXP Rnarm, SEXP Rret, SEXP Rnthreads) {
     po = INTEGER(o);
     pst = INTEGER(getAttrib(o, install("starts")));
   }
-  if(nullw) return mode_g_impl(x, ng, pgs, po, pst, sorted, asLogical(Rnarm), asInteger(Rret), asInteger(Rnthreads));
+  if(nullw) return gsort_use(x, pg) ? mode_g_sort_impl(x, pg, asLogical(Rnarm), asInteger(Rret), asInteger(Rnthreads)) :
+                   mode_g_impl(x, ng, pgs, po, pst, sorted, asLogical(Rnarm), asInteger(Rret), asInteger(Rnthreads));
   if(TYPEOF(w) != REALSXP) UNPROTECT(nprotect);
   return w_mode_g_impl(x, pw, ng, pgs, po, pst, sorted, asLogical(Rnarm), asInteger(Rret), asInteger(Rnthreads));
 }
@@ -919,10 +1227,10 @@ SEXP fmodelC(SEXP x, SEXP g, SEXP w, SEXP Rnarm, SEXP Rret, SEXP Rnthreads) {
       if(TYPEOF(g) != VECSXP || !inherits(g, "GRP")) error("g needs to be an object of class 'GRP', see ?GRP");
       const SEXP *restrict pg = SEXPPTR(g), o = pg[6];
       ng = INTEGER(pg[0])[0];
-      int sorted = LOGICAL(pg[5])[1] == 1, *restrict pgs = INTEGER(pg[2]), *restrict po, *restrict pst;
+      int sorted = LOGICAL(pg[5])[1] == 1, *restrict pgs = INTEGER(pg[2]), *restrict pgv = INTEGER(pg[1]), *restrict po, *restrict pst;
       if(nrx != length(pg[1])) error("length(g) must match nrow(x)");
       if(isNull(o)) {
-        int *cgs = (int *) R_alloc(ng+2, sizeof(int)), *restrict pgv = INTEGER(pg[1]); cgs[1] = 1;
+        int *cgs = (int *) R_alloc(ng+2, sizeof(int)); cgs[1] = 1;
         for(int i = 0; i != ng; ++i) cgs[i+2] = cgs[i+1] + pgs[i];
         pst = cgs + 1;
         if(sorted) po = &l;
@@ -936,10 +1244,14 @@ SEXP fmodelC(SEXP x, SEXP g, SEXP w, SEXP Rnarm, SEXP Rret, SEXP Rnthreads) {
         po = INTEGER(o);
         pst = INTEGER(getAttrib(o, install("starts")));
       }
+      // Factors and logical vectors use a dense table if possible
+      for(int j = 0; j < l; ++j) pout[j] = isFactor(px[j]) || TYPEOF(px[j]) == LGLSXP ?
+                                             mode_fct_g_dense(px[j], pgv, pgs, ng, nullw ? NULL : pw, narm, ret, nthreads) : R_NilValue;
       if(nullw) { // Parallelism at sub-column level
-        for(int j = 0; j < l; ++j) pout[j] = mode_g_impl(px[j], ng, pgs, po, pst, sorted, narm, ret, nthreads);
+        for(int j = 0; j < l; ++j) if(pout[j] == R_NilValue) pout[j] = gsort_use(px[j], pg) ? mode_g_sort_impl(px[j], pg, narm, ret, nthreads) :
+                                                                mode_g_impl(px[j], ng, pgs, po, pst, sorted, narm, ret, nthreads);
       } else { // Parallelism at sub-column level
-        for(int j = 0; j < l; ++j) pout[j] = w_mode_g_impl(px[j], pw, ng, pgs, po, pst, sorted, narm, ret, nthreads);
+        for(int j = 0; j < l; ++j) if(pout[j] == R_NilValue) pout[j] = w_mode_g_impl(px[j], pw, ng, pgs, po, pst, sorted, narm, ret, nthreads);
       }
     }
   }
@@ -975,10 +1287,10 @@ SEXP fmodemC(SEXP x, SEXP g, SEXP w, SEXP Rnarm, SEXP Rdrop, SEXP Rret, SEXP Rnt
         double *px = REAL(x), *restrict pres = REAL(res);
         if(nullw) {
           #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) pres[j] = mode_double(px + j*l, &l, l, 1, narm, ret);
+          for(int j = 0; j < col; ++j) pres[j] = mode_double(px + j*l, &l, l, 1, narm, ret, NULL);
         } else {
           #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) pres[j] = w_mode_double(px + j*l, pw, &l, l, 1, narm, ret);
+          for(int j = 0; j < col; ++j) pres[j] = w_mode_double(px + j*l, pw, &l, l, 1, narm, ret, NULL);
         }
         break;
       }
@@ -986,10 +1298,10 @@ SEXP fmodemC(SEXP x, SEXP g, SEXP w, SEXP Rnarm, SEXP Rdrop, SEXP Rret, SEXP Rnt
         int *px = INTEGER(x), *restrict pres = INTEGER(res);
         if(nullw) {
           #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) pres[j] = mode_int(px + j*l, &l, l, 1, narm, ret);
+          for(int j = 0; j < col; ++j) pres[j] = mode_int(px + j*l, &l, l, 1, narm, ret, NULL);
         } else {
           #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) pres[j] = w_mode_int(px + j*l, pw, &l, l, 1, narm, ret);
+          for(int j = 0; j < col; ++j) pres[j] = w_mode_int(px + j*l, pw, &l, l, 1, narm, ret, NULL);
         }
         break;
       }
@@ -997,10 +1309,10 @@ SEXP fmodemC(SEXP x, SEXP g, SEXP w, SEXP Rnarm, SEXP Rdrop, SEXP Rret, SEXP Rnt
         int *px = LOGICAL(x), *restrict pres = LOGICAL(res);
         if(nullw) {
           #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) pres[j] = mode_fct_logi(px + j*l, &l, l, 1, 1, narm, ret);
+          for(int j = 0; j < col; ++j) pres[j] = mode_fct_logi(px + j*l, &l, l, 1, 1, narm, ret, NULL);
         } else {
           #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) pres[j] = w_mode_fct_logi(px + j*l, pw, &l, l, 1, 1, narm, ret);
+          for(int j = 0; j < col; ++j) pres[j] = w_mode_fct_logi(px + j*l, pw, &l, l, 1, 1, narm, ret, NULL);
         }
         break;
       }
@@ -1008,10 +1320,10 @@ SEXP fmodemC(SEXP x, SEXP g, SEXP w, SEXP Rnarm, SEXP Rdrop, SEXP Rret, SEXP Rnt
         SEXP *px = STRING_PTR(x), *restrict pres = STRING_PTR(res);
         if(nullw) {
           #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) pres[j] = mode_string(px + j*l, &l, l, 1, narm, ret);
+          for(int j = 0; j < col; ++j) pres[j] = mode_string(px + j*l, &l, l, 1, narm, ret, NULL);
         } else {
           #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) pres[j] = w_mode_string(px + j*l, pw, &l, l, 1, narm, ret);
+          for(int j = 0; j < col; ++j) pres[j] = w_mode_string(px + j*l, pw, &l, l, 1, narm, ret, NULL);
         }
         break;
       }
@@ -1046,77 +1358,72 @@ SEXP fmodemC(SEXP x, SEXP g, SEXP w, SEXP Rnarm, SEXP Rdrop, SEXP Rret, SEXP Rnt
     pst = INTEGER(getAttrib(o, install("starts")));
   }
 
+  int maxgs = 0; // Each thread's hash table is sized for the largest group and reused across columns and groups
+  for(int gr = 0; gr != ng; ++gr) if(pgs[gr] > maxgs) maxgs = pgs[gr];
+
   if(sorted) { // Sorted
     switch(tx) {
       case REALSXP: {
         double *px = REAL(x), *restrict pres = REAL(res);
         if(nullw) {
-          #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) {
+          HA_PARALLEL_FOR(j, col, nthreads, maxgs, 0, HA_COUNTS,
             int jng = j * ng;
             double *pxj = px + j * l;
-            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_REAL : mode_double(pxj + pst[gr]-1, po, pgs[gr], 1, narm, ret);
-          }
+            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_REAL : mode_double(pxj + pst[gr]-1, po, pgs[gr], 1, narm, ret, &ha);
+          )
         } else {
-          #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) {
+          HA_PARALLEL_FOR(j, col, nthreads, maxgs, 0, HA_WEIGHTS,
             int jng = j * ng;
             double *pxj = px + j * l;
-            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_REAL : w_mode_double(pxj + pst[gr]-1, pw + pst[gr]-1, po, pgs[gr], 1, narm, ret);
-          }
+            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_REAL : w_mode_double(pxj + pst[gr]-1, pw + pst[gr]-1, po, pgs[gr], 1, narm, ret, &ha);
+          )
         }
         break;
       }
       case INTSXP: { // Factor matrix not well defined object...
         int *px = INTEGER(x), *restrict pres = INTEGER(res);
         if(nullw) {
-          #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) {
+          HA_PARALLEL_FOR(j, col, nthreads, maxgs, 0, HA_COUNTS,
             int *pxj = px + j * l, jng = j * ng;
-            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_INTEGER : mode_int(pxj + pst[gr]-1, po, pgs[gr], 1, narm, ret);
-          }
+            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_INTEGER : mode_int(pxj + pst[gr]-1, po, pgs[gr], 1, narm, ret, &ha);
+          )
         } else {
-          #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) {
+          HA_PARALLEL_FOR(j, col, nthreads, maxgs, 0, HA_WEIGHTS,
             int *pxj = px + j * l, jng = j * ng;
-            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_INTEGER : w_mode_int(pxj + pst[gr]-1, pw + pst[gr]-1, po, pgs[gr], 1, narm, ret);
-          }
+            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_INTEGER : w_mode_int(pxj + pst[gr]-1, pw + pst[gr]-1, po, pgs[gr], 1, narm, ret, &ha);
+          )
         }
         break;
       }
       case LGLSXP: {
         int *px = LOGICAL(x), *restrict pres = LOGICAL(res);
         if(nullw) {
-          #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) {
+          HA_PARALLEL_FOR(j, col, nthreads, 0, 1, HA_COUNTS,
             int *pxj = px + j * l, jng = j * ng;
-            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_LOGICAL : mode_fct_logi(pxj + pst[gr]-1, po, pgs[gr], 1, 1, narm, ret);
-          }
+            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_LOGICAL : mode_fct_logi(pxj + pst[gr]-1, po, pgs[gr], 1, 1, narm, ret, &ha);
+          )
         } else {
-          #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) {
+          HA_PARALLEL_FOR(j, col, nthreads, 0, 1, HA_WEIGHTS,
             int *pxj = px + j * l, jng = j * ng;
-            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_LOGICAL : w_mode_fct_logi(pxj + pst[gr]-1, pw + pst[gr]-1, po, pgs[gr], 1, 1, narm, ret);
-          }
+            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_LOGICAL : w_mode_fct_logi(pxj + pst[gr]-1, pw + pst[gr]-1, po, pgs[gr], 1, 1, narm, ret, &ha);
+          )
         }
         break;
       }
       case STRSXP: {
         SEXP *px = STRING_PTR(x), *restrict pres = STRING_PTR(res);
         if(nullw) {
-          #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) {
+          HA_PARALLEL_FOR(j, col, nthreads, maxgs, 0, HA_COUNTS,
             int jng = j * ng;
             SEXP *pxj = px + j * l;
-            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_STRING : mode_string(pxj + pst[gr]-1, po, pgs[gr], 1, narm, ret);
-          }
+            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_STRING : mode_string(pxj + pst[gr]-1, po, pgs[gr], 1, narm, ret, &ha);
+          )
         } else {
-          #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) {
+          HA_PARALLEL_FOR(j, col, nthreads, maxgs, 0, HA_WEIGHTS,
             int jng = j * ng;
             SEXP *pxj = px + j * l;
-            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_STRING : w_mode_string(pxj + pst[gr]-1, pw + pst[gr]-1, po, pgs[gr], 1, narm, ret);
-          }
+            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_STRING : w_mode_string(pxj + pst[gr]-1, pw + pst[gr]-1, po, pgs[gr], 1, narm, ret, &ha);
+          )
         }
         break;
       }
@@ -1127,72 +1434,64 @@ SEXP fmodemC(SEXP x, SEXP g, SEXP w, SEXP Rnarm, SEXP Rdrop, SEXP Rret, SEXP Rnt
       case REALSXP: {
         double *px = REAL(x), *restrict pres = REAL(res);
         if(nullw) {
-          #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) {
+          HA_PARALLEL_FOR(j, col, nthreads, maxgs, 0, HA_COUNTS,
             int jng = j * ng;
             double *pxj = px + j * l;
-            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_REAL : mode_double(pxj, po + pst[gr]-1, pgs[gr], 0, narm, ret);
-          }
+            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_REAL : mode_double(pxj, po + pst[gr]-1, pgs[gr], 0, narm, ret, &ha);
+          )
         } else {
-          #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) {
+          HA_PARALLEL_FOR(j, col, nthreads, maxgs, 0, HA_WEIGHTS,
             int jng = j * ng;
             double *pxj = px + j * l;
-            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_REAL : w_mode_double(pxj, pw, po + pst[gr]-1, pgs[gr], 0, narm, ret);
-          }
+            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_REAL : w_mode_double(pxj, pw, po + pst[gr]-1, pgs[gr], 0, narm, ret, &ha);
+          )
         }
         break;
       }
       case INTSXP: {
         int *px = INTEGER(x), *restrict pres = INTEGER(res);
         if(nullw) {
-          #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) {
+          HA_PARALLEL_FOR(j, col, nthreads, maxgs, 0, HA_COUNTS,
             int jng = j * ng, *pxj = px + j * l;
-            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_INTEGER : mode_int(pxj, po + pst[gr]-1, pgs[gr], 0, narm, ret);
-          }
+            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_INTEGER : mode_int(pxj, po + pst[gr]-1, pgs[gr], 0, narm, ret, &ha);
+          )
         } else {
-          #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) {
+          HA_PARALLEL_FOR(j, col, nthreads, maxgs, 0, HA_WEIGHTS,
             int jng = j * ng, *pxj = px + j * l;
-            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_INTEGER : w_mode_int(pxj, pw, po + pst[gr]-1, pgs[gr], 0, narm, ret);
-          }
+            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_INTEGER : w_mode_int(pxj, pw, po + pst[gr]-1, pgs[gr], 0, narm, ret, &ha);
+          )
         }
         break;
       }
       case LGLSXP: {
         int *px = LOGICAL(x), *restrict pres = LOGICAL(res);
         if(nullw) {
-          #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) {
+          HA_PARALLEL_FOR(j, col, nthreads, 0, 1, HA_COUNTS,
             int jng = j * ng, *pxj = px + j * l;
-            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_LOGICAL : mode_fct_logi(pxj, po + pst[gr]-1, pgs[gr], 1, 0, narm, ret);
-          }
+            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_LOGICAL : mode_fct_logi(pxj, po + pst[gr]-1, pgs[gr], 1, 0, narm, ret, &ha);
+          )
         } else {
-          #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) {
+          HA_PARALLEL_FOR(j, col, nthreads, 0, 1, HA_WEIGHTS,
             int jng = j * ng, *pxj = px + j * l;
-            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_LOGICAL : w_mode_fct_logi(pxj, pw, po + pst[gr]-1, pgs[gr], 1, 0, narm, ret);
-          }
+            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_LOGICAL : w_mode_fct_logi(pxj, pw, po + pst[gr]-1, pgs[gr], 1, 0, narm, ret, &ha);
+          )
         }
         break;
       }
       case STRSXP: {
         SEXP *px = STRING_PTR(x), *restrict pres = STRING_PTR(res);
         if(nullw) {
-          #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) {
+          HA_PARALLEL_FOR(j, col, nthreads, maxgs, 0, HA_COUNTS,
             int jng = j * ng;
             SEXP *pxj = px + j * l;
-            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_STRING : mode_string(pxj, po + pst[gr]-1, pgs[gr], 0, narm, ret);
-          }
+            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_STRING : mode_string(pxj, po + pst[gr]-1, pgs[gr], 0, narm, ret, &ha);
+          )
         } else {
-          #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) {
+          HA_PARALLEL_FOR(j, col, nthreads, maxgs, 0, HA_WEIGHTS,
             int jng = j * ng;
             SEXP *pxj = px + j * l;
-            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_STRING : w_mode_string(pxj, pw, po + pst[gr]-1, pgs[gr], 0, narm, ret);
-          }
+            for(int gr = 0; gr < ng; ++gr) pres[jng + gr] = pgs[gr] == 0 ? NA_STRING : w_mode_string(pxj, pw, po + pst[gr]-1, pgs[gr], 0, narm, ret, &ha);
+          )
         }
         break;
       }
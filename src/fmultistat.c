@@ -0,0 +1,408 @@
+#include <math.h>
+#include "collapse_c.h"
+
+// Fused grouped aggregation: computes several of fsum, fmean, fvar, fsd, fmin, fmax, ffirst, flast and fnobs with
+// one pass through each column. The loops replicate the serial loops of the individual functions (fsumC, fmeanC,
+// fvarsdCpp etc.), which also give the results of their partitioned kernels for very many groups (gpart_init()). To keep
+// the results identical in other cases, sums and means of doubles over sorted groups are taken from the segmented
+// kernels of fsum and fmean (see gseg_starts()), and with compensated or deterministic summation fmultistatlC() returns
+// NULL, so that the functions are applied separately.
+// Used by collap() and fsummarise() if all functions are supported (see R/collap.R).
+// The codes must match the order of functions in fmultistat_codes() in R/collap.R.
+#define MS_SUM 1
+#define MS_MEAN 2
+#define MS_VAR 3
+#define MS_SD 4
+#define MS_MIN 5
+#define MS_MAX 6
+#define MS_FIRST 7
+#define MS_LAST 8
+#define MS_NOBS 9
+
+// Grouped workspace, each vector has length ng and is decremented by 1 (indexed by the 1-based group id).
+typedef struct {
+  double *sum, *cnt, *mean, *M2, *n, *min, *max;
+  int *isum, *imin, *imax, *first, *last, *nobs;
+} ms_ws;
+
+// Initializes the workspace for a column of type tx. Welford's algorithm starts with n = 1 (or the first weight) when na.rm = TRUE,
+// and with n = 0 going forward through the data otherwise (same as fvarsdCpp).
+static void ms_ws_init(const ms_ws *w, const int *ds, const int tx, const int narm, const int ng) {
+  for(int i = ng+1; --i; ) {
+    if(ds[MS_SUM] || ds[MS_MEAN]) {
+      w->sum[i] = narm ? NA_REAL : 0.0;
+      w->cnt[i] = 0.0;
+    }
+    if(ds[MS_SUM] && tx == INTSXP) w->isum[i] = narm ? NA_INTEGER : 0;
+    if(ds[MS_VAR] || ds[MS_SD]) {
+      w->M2[i] = narm ? NA_REAL : 0.0;
+      w->mean[i] = 0.0;
+      w->n[i] = narm ? 1.0 : 0.0;
+    }
+    if(tx == REALSXP) {
+      if(ds[MS_MIN]) w->min[i] = narm ? NA_REAL : R_PosInf;
+      if(ds[MS_MAX]) w->max[i] = narm ? NA_REAL : R_NegInf;
+    } else {
+      if(ds[MS_MIN]) w->imin[i] = narm ? NA_INTEGER : INT_MAX;
+      if(ds[MS_MAX]) w->imax[i] = narm ? NA_INTEGER : INT_MIN + 1;
+    }
+    if(ds[MS_FIRST]) w->first[i] = NA_INTEGER;
+    if(ds[MS_LAST]) w->last[i] = NA_INTEGER;
+    if(ds[MS_NOBS]) w->nobs[i] = 0;
+  }
+}
+
+static void ms_double(const ms_ws *w, const int *ds, const double *restrict px, const int *restrict pg, const int narm, const int l) {
+  const int dsum = ds[MS_SUM] || ds[MS_MEAN], dvar = ds[MS_VAR] || ds[MS_SD];
+  double *restrict sum = w->sum, *restrict cnt = w->cnt, *restrict mean = w->mean, *restrict M2 = w->M2,
+         *restrict n = w->n, *restrict min = w->min, *restrict max = w->max, d1;
+  int *restrict first = w->first, *restrict last = w->last, *restrict nobs = w->nobs;
+  if(narm) {
+    for(int i = l, gi; i--; ) {
+      if(ISNAN(px[i])) continue;
+      gi = pg[i];
+      if(dsum) {
+        if(ISNAN(sum[gi])) {
+          sum[gi] = px[i];
+          cnt[gi] = 1.0;
+        } else {
+          sum[gi] += px[i];
+          ++cnt[gi];
+        }
+      }
+      if(dvar) {
+        if(ISNAN(M2[gi])) {
+          mean[gi] = px[i];
+          M2[gi] = 0;
+        } else {
+          d1 = px[i]-mean[gi];
+          mean[gi] += d1 * (1 / ++n[gi]);
+          M2[gi] += d1*(px[i]-mean[gi]);
+        }
+      }
+      if(ds[MS_MIN] && (min[gi] > px[i] || ISNAN(min[gi]))) min[gi] = px[i];
+      if(ds[MS_MAX] && (max[gi] < px[i] || ISNAN(max[gi]))) max[gi] = px[i];
+      if(ds[MS_FIRST]) first[gi] = i;
+      if(ds[MS_LAST] && last[gi] == NA_INTEGER) last[gi] = i;
+      if(ds[MS_NOBS]) ++nobs[gi];
+    }
+  } else { // Variance is computed in a separate forward pass, see ms_var_forward()
+    for(int i = l, gi; i--; ) {
+      gi = pg[i];
+      if(dsum) sum[gi] += px[i];
+      if(ds[MS_MIN] && (min[gi] > px[i] || ISNAN(px[i]))) min[gi] = px[i];
+      if(ds[MS_MAX] && (max[gi] < px[i] || ISNAN(px[i]))) max[gi] = px[i];
+      if(ds[MS_FIRST]) first[gi] = i;
+      if(ds[MS_LAST] && last[gi] == NA_INTEGER) last[gi] = i;
+      if(ds[MS_NOBS] && NISNAN(px[i])) ++nobs[gi];
+    }
+  }
+}
+
+// Returns 1 if the integer sum overflowed (as in fsum_int_g_acc)
+static int ms_int(const ms_ws *w, const int *ds, const int *restrict px, const int *restrict pg, const int narm, const int l) {
+  const int dvar = ds[MS_VAR] || ds[MS_SD];
+  double *restrict sum = w->sum, *restrict cnt = w->cnt, *restrict mean = w->mean, *restrict M2 = w->M2,
+         *restrict n = w->n, d1, xi;
+  int *restrict isum = w->isum, *restrict min = w->imin, *restrict max = w->imax,
+      *restrict first = w->first, *restrict last = w->last, *restrict nobs = w->nobs;
+  long long ckof;
+  if(narm) {
+    for(int i = l, gi; i--; ) {
+      if(px[i] == NA_INTEGER) continue;
+      gi = pg[i];
+      if(ds[MS_SUM]) {
+        if(isum[gi] == NA_INTEGER) isum[gi] = px[i];
+        else {
+          ckof = (long long)isum[gi] + px[i];
+          if(ckof > INT_MAX || ckof <= INT_MIN) return 1;
+          isum[gi] = (int)ckof;
+        }
+      }
+      if(ds[MS_MEAN]) {
+        if(ISNAN(sum[gi])) {
+          sum[gi] = (double)px[i];
+          cnt[gi] = 1.0;
+        } else {
+          sum[gi] += px[i];
+          ++cnt[gi];
+        }
+      }
+      if(dvar) {
+        xi = (double)px[i];
+        if(ISNAN(M2[gi])) {
+          mean[gi] = xi;
+          M2[gi] = 0;
+        } else {
+          d1 = xi-mean[gi];
+          mean[gi] += d1 * (1 / ++n[gi]);
+          M2[gi] += d1*(xi-mean[gi]);
+        }
+      }
+      if(ds[MS_MIN] && (min[gi] > px[i] || min[gi] == NA_INTEGER)) min[gi] = px[i];
+      if(ds[MS_MAX] && max[gi] < px[i]) max[gi] = px[i];
+      if(ds[MS_FIRST]) first[gi] = i;
+      if(ds[MS_LAST] && last[gi] == NA_INTEGER) last[gi] = i;
+      if(ds[MS_NOBS]) ++nobs[gi];
+    }
+  } else {
+    for(int i = l, gi; i--; ) {
+      gi = pg[i];
+      if(ds[MS_SUM]) {
+        if(px[i] == NA_INTEGER) isum[gi] = NA_INTEGER;
+        else if(isum[gi] != NA_INTEGER) {
+          ckof = (long long)isum[gi] + px[i];
+          if(ckof > INT_MAX || ckof <= INT_MIN) return 1;
+          isum[gi] = (int)ckof;
+        }
+      }
+      if(ds[MS_MEAN]) {
+        if(px[i] == NA_INTEGER) sum[gi] = NA_REAL;
+        else sum[gi] += px[i];
+      }
+      if(ds[MS_MIN] && min[gi] > px[i]) min[gi] = px[i];
+      if(ds[MS_MAX] && (px[i] == NA_INTEGER || (max[gi] != NA_INTEGER && max[gi] < px[i]))) max[gi] = px[i];
+      if(ds[MS_FIRST]) first[gi] = i;
+      if(ds[MS_LAST] && last[gi] == NA_INTEGER) last[gi] = i;
+      if(ds[MS_NOBS] && px[i] != NA_INTEGER) ++nobs[gi];
+    }
+  }
+  return 0;
+}
+
+// Weighted sums, means and variances (the other statistics do not take weights). cnt holds the sum of weights for the mean,
+// n the sum of weights for the variance (which excludes zero weights as in fvarsdCpp).
+static void ms_weights(const ms_ws *w, const int *ds, const double *restrict px, const double *restrict pw, const int *restrict pg, const int narm, const int l) {
+  const int dsum = ds[MS_SUM] || ds[MS_MEAN], dvar = ds[MS_VAR] || ds[MS_SD];
+  double *restrict sum = w->sum, *restrict sumw = w->cnt, *restrict mean = w->mean, *restrict M2 = w->M2, *restrict n = w->n, d1;
+  if(narm) {
+    for(int i = l, gi; i--; ) {
+      if(ISNAN(px[i]) || ISNAN(pw[i])) continue;
+      gi = pg[i];
+      if(dsum) {
+        if(ISNAN(sum[gi])) {
+          sum[gi] = px[i] * pw[i];
+          sumw[gi] = pw[i];
+        } else {
+          sum[gi] += px[i] * pw[i];
+          sumw[gi] += pw[i];
+        }
+      }
+      if(dvar && pw[i] != 0) {
+        if(ISNAN(M2[gi])) {
+          n[gi] = pw[i];
+          mean[gi] = px[i];
+          M2[gi] = 0;
+        } else {
+          n[gi] += pw[i];
+          d1 = px[i] - mean[gi];
+          mean[gi] += d1 * (pw[i] / n[gi]);
+          M2[gi] += pw[i] * d1 * (px[i] - mean[gi]);
+        }
+      }
+    }
+  } else if(dsum) {
+    for(int i = l; i--; ) {
+      sum[pg[i]] += px[i] * pw[i];
+      sumw[pg[i]] += pw[i];
+    }
+  }
+}
+
+// Without na.rm, fvarsdCpp() runs Welford's algorithm forward through the data and stops updating a group once it encounters
+// a missing value. Replicating this requires a second pass. Integer data is passed in pxi (px = NULL).
+static void ms_var_forward(const ms_ws *w, const double *restrict px, const int *restrict pxi, const double *restrict pw, const int *restrict pg, const int ng, const int l) {
+  double *restrict mean = w->mean, *restrict M2 = w->M2, *restrict n = w->n, d1, xi;
+  for(int i = 0, ngs = 0, gi; i != l; ++i) {
+    gi = pg[i];
+    if(ISNAN(M2[gi])) continue;
+    xi = px ? px[i] : pxi[i] == NA_INTEGER ? NA_REAL : (double)pxi[i];
+    if(ISNAN(xi) || (pw && ISNAN(pw[i]))) {
+      M2[gi] = NA_REAL;
+      if(++ngs == ng) break;
+    } else if(pw) {
+      if(pw[i] == 0) continue;
+      n[gi] += pw[i];
+      d1 = xi - mean[gi];
+      mean[gi] += d1 * (pw[i] / n[gi]);
+      M2[gi] += pw[i] * d1 * (xi - mean[gi]);
+    } else {
+      d1 = xi-mean[gi];
+      mean[gi] += d1 * (1 / ++n[gi]);
+      M2[gi] += d1*(xi-mean[gi]);
+    }
+  }
+}
+
+// Attributes are copied as by the individual functions: fvarsdlCpp() duplicates all attributes of the column
+static void ms_attrib(SEXP res, const int s, SEXP x) {
+  if(s == MS_VAR || s == MS_SD) SHALLOW_DUPLICATE_ATTRIB(res, x);
+  else if(ATTRIB(x) != R_NilValue && !(isObject(x) && inherits(x, "ts"))) copyMostAttrib(x, res);
+}
+
+// Fills the result column for statistic s from the workspace (not decremented here)
+static void ms_result(SEXP res, const int s, const ms_ws *w, SEXP x, const int *pgs, const int wtd, const int ng) {
+  const int tx = TYPEOF(x);
+  switch(s) {
+  case MS_SUM:
+    if(tx == INTSXP && !wtd) memcpy(INTEGER(res), w->isum + 1, sizeof(int) * ng);
+    else memcpy(REAL(res), w->sum + 1, sizeof(double) * ng);
+    break;
+  case MS_MEAN: {
+    double *pres = REAL(res), *sum = w->sum + 1, *cnt = w->cnt + 1;
+    if(pgs) for(int i = ng; i--; ) pres[i] = sum[i] / pgs[i];
+    else for(int i = ng; i--; ) pres[i] = sum[i] / cnt[i];
+    break;
+  }
+  case MS_VAR:
+  case MS_SD: {
+    double *pres = REAL(res), *M2 = w->M2 + 1, *n = w->n + 1;
+    for(int i = ng; i--; ) {
+      if(ISNAN(M2[i])) pres[i] = NA_REAL;
+      else {
+        pres[i] = s == MS_SD ? sqrt(M2[i]/(n[i]-1)) : M2[i]/(n[i]-1);
+        if(ISNAN(pres[i])) pres[i] = NA_REAL;
+      }
+    }
+    break;
+  }
+  case MS_MIN:
+  case MS_MAX:
+    if(tx == REALSXP) memcpy(REAL(res), (s == MS_MIN ? w->min : w->max) + 1, sizeof(double) * ng);
+    else memcpy(INTEGER(res), (s == MS_MIN ? w->imin : w->imax) + 1, sizeof(int) * ng);
+    break;
+  case MS_FIRST:
+  case MS_LAST: {
+    const int *pi = (s == MS_FIRST ? w->first : w->last) + 1;
+    if(tx == REALSXP) {
+      double *pres = REAL(res), *px = REAL(x);
+      for(int i = ng; i--; ) pres[i] = pi[i] == NA_INTEGER ? NA_REAL : px[pi[i]];
+    } else {
+      int *pres = INTEGER(res), *px = INTEGER(x);
+      for(int i = ng; i--; ) pres[i] = pi[i] == NA_INTEGER ? NA_INTEGER : px[pi[i]];
+    }
+    break;
+  }
+  case MS_NOBS:
+    memcpy(INTEGER(res), w->nobs + 1, sizeof(int) * ng);
+    break;
+  }
+  ms_attrib(res, s, x);
+}
+
+SEXP fmultistatlC(SEXP x, SEXP Rng, SEXP g, SEXP gs, SEXP w, SEXP Rstats, SEXP Rnarm) {
+  const int l = length(x), ng = asInteger(Rng), ns = length(Rstats), narm = asLogical(Rnarm), wtd = !isNull(w);
+  if(l < 1 || ng < 1) error("fmultistatl requires a non-empty list and at least one group");
+  if(TYPEOF(Rstats) != INTSXP) error("stats must be integer");
+  const int *pst = INTEGER(Rstats), *restrict pg = INTEGER(g), nr = length(g);
+  int ds[10] = {0}, *pgs = NULL, nprotect = 1;
+  for(int k = 0; k != ns; ++k) {
+    if(pst[k] < MS_SUM || pst[k] > MS_NOBS) error("Unsupported statistic code: %d", pst[k]);
+    if(wtd && pst[k] > MS_SD) error("Weights are only supported for fsum, fmean, fvar and fsd");
+    ds[pst[k]] = 1;
+  }
+  const int dvar = ds[MS_VAR] || ds[MS_SD], dsum = ds[MS_SUM] || ds[MS_MEAN];
+  // Compensated and deterministic summation (set_sum_accuracy(), set_deterministic(), which also applies to fvar / fsd)
+  // are not replicated here: the functions are applied separately
+  if(FSUM_STRICT && (dsum || (fsum_deterministic && dvar))) return R_NilValue;
+
+  // Checks and weights
+  SEXP *restrict px = SEXPPTR(x);
+  for(int j = 0; j != l; ++j) {
+    if(length(px[j]) != nr) error("length(g) must match nrow(X)");
+    if(TYPEOF(px[j]) != REALSXP && TYPEOF(px[j]) != INTSXP) error("Unsupported SEXP type");
+  }
+  const double *pw = NULL;
+  if(wtd) {
+    if(length(w) != nr) error("length(w) must match nrow(X)");
+    int tw = TYPEOF(w);
+    if(tw != REALSXP) {
+      if(tw != INTSXP && tw != LGLSXP) error("weigths must be double or integer");
+      w = PROTECT(coerceVector(w, REALSXP)); ++nprotect;
+    }
+    pw = REAL(w);
+  }
+  // Without na.rm, unweighted means divide the sums by the group sizes
+  if(ds[MS_MEAN] && !narm && !wtd) {
+    if(length(gs) == ng) pgs = INTEGER(gs);
+    else {
+      pgs = (int*)R_alloc(ng, sizeof(int));
+      memset(pgs, 0, sizeof(int) * ng);
+      for(int i = 0; i != nr; ++i) ++pgs[pg[i]-1];
+    }
+  }
+
+  // Sorted groups: sums and means of doubles by the segmented kernels, the workspace computes the other statistics
+  int dss[10], *starts = NULL;
+  memcpy(dss, ds, sizeof(ds));
+  dss[MS_SUM] = dss[MS_MEAN] = 0;
+  if(dsum) {
+    int *st = gseg_starts(pg, ng, nr);
+    if(st) {
+      starts = (int*)R_alloc(ng+1, sizeof(int));
+      memcpy(starts, st, sizeof(int) * (ng+1));
+      Free(st);
+    }
+  }
+
+  // Workspace
+  ms_ws ws;
+  memset(&ws, 0, sizeof(ms_ws));
+  if(ds[MS_SUM] || ds[MS_MEAN]) {
+    ws.sum = (double*)R_alloc(ng, sizeof(double)) - 1;
+    ws.cnt = (double*)R_alloc(ng, sizeof(double)) - 1;
+    if(ds[MS_SUM]) ws.isum = (int*)R_alloc(ng, sizeof(int)) - 1;
+  }
+  if(dvar) {
+    ws.mean = (double*)R_alloc(ng, sizeof(double)) - 1;
+    ws.M2 = (double*)R_alloc(ng, sizeof(double)) - 1;
+    ws.n = (double*)R_alloc(ng, sizeof(double)) - 1;
+  }
+  if(ds[MS_MIN]) {
+    ws.min = (double*)R_alloc(ng, sizeof(double)) - 1;
+    ws.imin = (int*)R_alloc(ng, sizeof(int)) - 1;
+  }
+  if(ds[MS_MAX]) {
+    ws.max = (double*)R_alloc(ng, sizeof(double)) - 1;
+    ws.imax = (int*)R_alloc(ng, sizeof(int)) - 1;
+  }
+  if(ds[MS_FIRST]) ws.first = (int*)R_alloc(ng, sizeof(int)) - 1;
+  if(ds[MS_LAST]) ws.last = (int*)R_alloc(ng, sizeof(int)) - 1;
+  if(ds[MS_NOBS]) ws.nobs = (int*)R_alloc(ng, sizeof(int)) - 1;
+
+  // Result: a list of data frames, one for each statistic
+  SEXP out = PROTECT(allocVector(VECSXP, ns));
+  for(int k = 0; k != ns; ++k) SET_VECTOR_ELT(out, k, allocVector(VECSXP, l));
+
+  for(int j = 0; j != l; ++j) {
+    SEXP xj = px[j];
+    int tx = TYPEOF(xj), cx = wtd && tx != REALSXP;
+    const int seg = starts != NULL && (wtd || tx == REALSXP), *dsj = seg ? dss : ds;
+    if(cx) xj = PROTECT(coerceVector(xj, REALSXP));
+    if(wtd) {
+      ms_ws_init(&ws, dsj, REALSXP, narm, ng);
+      ms_weights(&ws, dsj, REAL(xj), pw, pg, narm, nr);
+      if(dvar && !narm) ms_var_forward(&ws, REAL(xj), NULL, pw, pg, ng, nr);
+    } else {
+      ms_ws_init(&ws, dsj, tx, narm, ng);
+      if(tx == REALSXP) ms_double(&ws, dsj, REAL(xj), pg, narm, nr);
+      else if(ms_int(&ws, dsj, INTEGER(xj), pg, narm, nr)) error(fsum_int_overflow_msg);
+      if(dvar && !narm) ms_var_forward(&ws, tx == REALSXP ? REAL(xj) : NULL, tx == REALSXP ? NULL : INTEGER(xj), NULL, pg, ng, nr);
+    }
+    for(int k = 0, s; k != ns; ++k) {
+      s = pst[k];
+      SEXP res = allocVector(s == MS_NOBS ? INTSXP : s == MS_SUM ? (wtd ? REALSXP : tx) :
+                            (s == MS_MEAN || s == MS_VAR || s == MS_SD) ? REALSXP : tx, ng);
+      SET_VECTOR_ELT(VECTOR_ELT(out, k), j, res);
+      if(seg && (s == MS_SUM || s == MS_MEAN)) {
+        if(s == MS_SUM) fsum_double_seg_impl(REAL(res), REAL(xj), pw, ng, starts, narm, 1);
+        else fmean_double_seg_impl(REAL(res), REAL(xj), pw, ng, starts, narm, 1);
+        ms_attrib(res, s, px[j]);
+      } else ms_result(res, s, &ws, px[j], narm || wtd ? NULL : pgs, wtd, ng);
+    }
+    if(cx) UNPROTECT(1);
+  }
+  for(int k = 0; k != ns; ++k) DFcopyAttr(VECTOR_ELT(out, k), x, ng);
+  UNPROTECT(nprotect);
+  return out;
+}
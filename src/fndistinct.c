@@ -5,19 +5,18 @@
 #include "collapse_c.h"
 
 // C-implementations for different data types ----------------------------------
-// TODO: outsource and memset hash table?
-// Problem: does not work in parallel, each thread needs own hash table...
-
-int ndistinct_int(const int *restrict px, const int *restrict po, const int l, const int sorted, const int narm) {
-  if(l == 1) return !(narm && px[0] == NA_INTEGER);
-  const size_t l2 = 2U * (size_t) l;
-  size_t M = 256, id = 0;
-  int K = 8, ndist = 0, anyNA = 0;
-  while(M < l2) {
-    M *= 2;
-    K++;
-  }
-  int *restrict h = (int*)Calloc(M, int); // Table to save the hash values, table has size M
+// The hash table is taken from a hash_arena (see small_helper.c): grouped code passes a per-thread arena
+// sized for the largest group, ungrouped code (ha = NULL) allocates a table just for the current vector.
+
+int ndistinct_int(const int *restrict px, const int *restrict po, const int l, const int sorted, const int narm, hash_arena *ha) {
+  if(l == 1) return !(narm && px[sorted ? 0 : po[0]-1] == NA_INTEGER);
+  hash_arena ha0, *a = ha ? ha : &ha0;
+  if(!ha) hash_arena_init(a, l, 0, 0);
+  size_t id = 0;
+  int K, ndist = 0, anyNA = 0;
+  const size_t M = hash_arena_next(a, l, &K);
+  int *restrict h = a->h; // Table to save the hash values, table has size M
+  unsigned int *restrict hg = a->gen, cur = a->cur; // Slot id is occupied iff hg[id] == cur
 
   if(sorted) {
     for (int i = 0; i != l; ++i) {
@@ -26,10 +25,11 @@ int ndistinct_int(const int *restrict px, const int *restrict po, const int l, c
         continue;
       }
       id = HASH(px[i], K);
-      while(h[id]) {
+      while(hg[id] == cur) {
         if(px[h[id]-1] == px[i]) goto ibls;
         if(++id >= M) id %= M; // ++id; id %= M;
       }
+      hg[id] = cur;
       h[id] = i + 1;
       ++ndist;
       ibls:;
@@ -42,24 +42,28 @@ int ndistinct_int(const int *restrict px, const int *restrict po, const int l, c
         continue;
       }
       id = HASH(xi, K);
-      while(h[id]) {
+      while(hg[id] == cur) {
         if(px[po[h[id]-1]-1] == xi) goto ibl;
         if(++id >= M) id %= M; // ++id; id %= M;
       }
+      hg[id] = cur;
       h[id] = i + 1;
       ++ndist;
       ibl:;
     }
   }
 
-  Free(h);
+  if(!ha) hash_arena_free(a);
   if(narm == 0) ndist += anyNA;
   return ndist;
 }
 
-int ndistinct_fct(const int *restrict px, const int *restrict po, const int l, const int nlev, const int sorted, const int narm) {
-  if(l == 1) return !(narm && px[0] == NA_INTEGER);
-  int *restrict h = (int*)Calloc(nlev+1, int);
+int ndistinct_fct(const int *restrict px, const int *restrict po, const int l, const int nlev, const int sorted, const int narm, hash_arena *ha) {
+  if(l == 1) return !(narm && px[sorted ? 0 : po[0]-1] == NA_INTEGER);
+  hash_arena ha0, *a = ha ? ha : &ha0;
+  if(!ha) hash_arena_init(a, 0, nlev, 0);
+  hash_arena_next(a, 0, NULL);
+  unsigned int *restrict h = a->gen, cur = a->cur; // Level xi was seen iff h[xi] == cur
   int ndist = 0, anyNA = narm; // Ensures breaking works if narm = TRUE or FALSE
   if(sorted) {
     for (int i = 0, xi; i != l; ++i) {
@@ -68,10 +72,10 @@ int ndistinct_fct(const int *restrict px, const int *restrict po, const int l, c
         anyNA = 1;
         continue;
       }
-      if(h[xi]) continue;
+      if(h[xi] == cur) continue;
       ++ndist;
       if(anyNA && ndist == nlev) break;
-      h[xi] = 1;
+      h[xi] = cur;
     }
   } else {
     for (int i = 0, xi; i != l; ++i) {
@@ -80,19 +84,19 @@ int ndistinct_fct(const int *restrict px, const int *restrict po, const int l, c
         anyNA = 1;
         continue;
       }
-      if(h[xi]) continue;
+      if(h[xi] == cur) continue;
       ++ndist;
       if(anyNA && ndist == nlev) break;
-      h[xi] = 1;
+      h[xi] = cur;
     }
   }
   if(narm == 0) ndist += anyNA;
-  Free(h);
+  if(!ha) hash_arena_free(a);
   return ndist;
 }
 
 int ndistinct_logi(const int *restrict px, const int *restrict po, const int l, const int sorted, const int narm) {
-  if(l == 1) return !(narm && px[0] == NA_LOGICAL);
+  if(l == 1) return !(narm && px[sorted ? 0 : po[0]-1] == NA_LOGICAL);
   int seenT = 0, seenF = 0, anyNA = narm; // Ensures breaking works if narm = TRUE or FALSE
   if(sorted) {
     for (int i = 0, xi; i != l; ++i) {
@@ -130,16 +134,15 @@ int ndistinct_logi(const int *restrict px, const int *restrict po, const int l,
   return seenT + seenF;
 }
 
-int ndistinct_double(const double *restrict px, const int *restrict po, const int l, const int sorted, const int narm) {
-  if(l == 1) return !(narm && ISNAN(px[0]));
-  const size_t l2 = 2U * (size_t) l;
-  size_t M = 256, id = 0;
-  int K = 8, ndist = 0, anyNA = 0;
-  while(M < l2) {
-    M *= 2;
-    K++;
-  }
-  int *restrict h = (int*)Calloc(M, int); // Table to save the hash values, table has size M
+int ndistinct_double(const double *restrict px, const int *restrict po, const int l, const int sorted, const int narm, hash_arena *ha) {
+  if(l == 1) return !(narm && ISNAN(px[sorted ? 0 : po[0]-1]));
+  hash_arena ha0, *a = ha ? ha : &ha0;
+  if(!ha) hash_arena_init(a, l, 0, 0);
+  size_t id = 0;
+  int K, ndist = 0, anyNA = 0;
+  const size_t M = hash_arena_next(a, l, &K);
+  int *restrict h = a->h; // Table to save the hash values, table has size M
+  unsigned int *restrict hg = a->gen, cur = a->cur; // Slot id is occupied iff hg[id] == cur
   union uno tpv;
   double xi;
 
@@ -149,12 +152,13 @@ int ndistinct_double(const double *restrict px, const int *restrict po, const in
         anyNA = 1;
         continue;
       }
-      tpv.d = px[i];
+      tpv.d = px[i] == 0.0 ? 0.0 : px[i]; // 0.0 and -0.0 are equal but hash differently
       id = HASH(tpv.u[0] + tpv.u[1], K);
-      while(h[id]) {
+      while(hg[id] == cur) {
         if(REQUAL(px[h[id]-1], px[i])) goto rbls;
         if(++id >= M) id %= M; // ++id; id %= M;
       }
+      hg[id] = cur;
       h[id] = i + 1;
       ++ndist;
       rbls:;
@@ -166,12 +170,13 @@ int ndistinct_double(const double *restrict px, const int *restrict po, const in
         anyNA = 1;
         continue;
       }
-      tpv.d = xi;
+      tpv.d = xi == 0.0 ? 0.0 : xi; // 0.0 and -0.0 are equal but hash differently
       id = HASH(tpv.u[0] + tpv.u[1], K);
-      while(h[id]) {
+      while(hg[id] == cur) {
         if(REQUAL(px[po[h[id]-1]-1], xi)) goto rbl;
         if(++id >= M) id %= M; // ++id; id %= M;
       }
+      hg[id] = cur;
       h[id] = i + 1;
       ++ndist;
       rbl:;
@@ -179,21 +184,20 @@ int ndistinct_double(const double *restrict px, const int *restrict po, const in
   }
 
 
-  Free(h);
+  if(!ha) hash_arena_free(a);
   if(narm == 0) ndist += anyNA;
   return ndist;
 }
 
-int ndistinct_string(const SEXP *restrict px, const int *restrict po, const int l, const int sorted, const int narm) {
-  if(l == 1) return !(narm && px[0] == NA_STRING);
-  const size_t l2 = 2U * (size_t) l;
-  size_t M = 256, id = 0;
-  int K = 8, ndist = 0, anyNA = 0;
-  while(M < l2) {
-    M *= 2;
-    K++;
-  }
-  int *restrict h = (int*)Calloc(M, int); // Table to save the hash values, table has size M
+int ndistinct_string(const SEXP *restrict px, const int *restrict po, const int l, const int sorted, const int narm, hash_arena *ha) {
+  if(l == 1) return !(narm && px[sorted ? 0 : po[0]-1] == NA_STRING);
+  hash_arena ha0, *a = ha ? ha : &ha0;
+  if(!ha) hash_arena_init(a, l, 0, 0);
+  size_t id = 0;
+  int K, ndist = 0, anyNA = 0;
+  const size_t M = hash_arena_next(a, l, &K);
+  int *restrict h = a->h; // Table to save the hash values, table has size M
+  unsigned int *restrict hg = a->gen, cur = a->cur; // Slot id is occupied iff hg[id] == cur
   SEXP xi;
 
   if(sorted) {
@@ -203,10 +207,11 @@ int ndistinct_string(const SEXP *restrict px, const int *restrict po, const int
         continue;
       }
       id = HASH(((intptr_t) px[i] & 0xffffffff), K);
-      while(h[id]) {
+      while(hg[id] == cur) {
         if(px[h[id]-1] == px[i]) goto sbls;
         if(++id >= M) id %= M; //++id; id %= M;
       }
+      hg[id] = cur;
       h[id] = i + 1;
       ++ndist;
       sbls:;
@@ -219,17 +224,18 @@ int ndistinct_string(const SEXP *restrict px, const int *restrict po, const int
         continue;
       }
       id = HASH(((intptr_t) xi & 0xffffffff), K);
-      while(h[id]) {
+      while(hg[id] == cur) {
         if(px[po[h[id]-1]-1] == xi) goto sbl;
         if(++id >= M) id %= M; //++id; id %= M;
       }
+      hg[id] = cur;
       h[id] = i + 1;
       ++ndist;
       sbl:;
     }
   }
 
-  Free(h);
+  if(!ha) hash_arena_free(a);
   if(narm == 0) ndist += anyNA;
   return ndist;
 }
@@ -241,17 +247,17 @@ SEXP ndistinct_impl(SEXP x, int narm) {
   if(l < 1) return ScalarInteger(0);
   switch(TYPEOF(x)) {
     case REALSXP:
-      res = ndistinct_double(REAL(x), &l, l, 1, narm);
+      res = ndistinct_double(REAL(x), &l, l, 1, narm, NULL);
       break;
   case INTSXP:  // TODO: optimize for plain integer??
-      res = isFactor(x) ? ndistinct_fct(INTEGER(x), &l, l, nlevels(x), 1, narm) :
-               ndistinct_int(INTEGER(x), &l, l, 1, narm);
+      res = isFactor(x) ? ndistinct_fct(INTEGER(x), &l, l, nlevels(x), 1, narm, NULL) :
+               ndistinct_int(INTEGER(x), &l, l, 1, narm, NULL);
       break;
     case LGLSXP:
       res = ndistinct_logi(INTEGER(x), &l, l, 1, narm);
       break;
     case STRSXP:
-      res = ndistinct_string(STRING_PTR(x), &l, l, 1, narm);
+      res = ndistinct_string(STRING_PTR(x), &l, l, 1, narm, NULL);
       break;
     default: error("Not Supported SEXP Type!");
   }
@@ -263,8 +269,9 @@ SEXP ndistinct_impl(SEXP x, int narm) {
 SEXP ndistinct_g_impl(SEXP x, const int ng, const int *restrict pgs, const int *restrict po, const int *restrict pst, const int sorted, const int narm, int nthreads) {
 
   SEXP res = PROTECT(allocVector(INTSXP, ng));
-  int l = length(x), *restrict pres = INTEGER(res);
+  int l = length(x), *restrict pres = INTEGER(res), maxgs = 0;
   if(nthreads > ng) nthreads = ng;
+  for(int gr = 0; gr != ng; ++gr) if(pgs[gr] > maxgs) maxgs = pgs[gr]; // Each thread's hash table is sized for the largest group
 
   if(sorted) { // Sorted: could compute cumulative group size (= starts) on the fly... but doesn't work multithreaded...
     po = &l;
@@ -272,22 +279,22 @@ SEXP ndistinct_g_impl(SEXP x, const int ng, const int *restrict pgs, const int *
     switch(TYPEOF(x)) {
       case REALSXP: {
         const double *px = REAL(x);
-        #pragma omp parallel for num_threads(nthreads)
-        for(int gr = 0; gr < ng; ++gr)
-          pres[gr] = pgs[gr] == 0 ? 0 : ndistinct_double(px + pst[gr]-1, po, pgs[gr], 1, narm);
+        HA_PARALLEL_FOR(gr, ng, nthreads, maxgs, 0, 0,
+          pres[gr] = pgs[gr] == 0 ? 0 : ndistinct_double(px + pst[gr]-1, po, pgs[gr], 1, narm, &ha);
+        )
         break;
       }
       case INTSXP: {
         const int *px = INTEGER(x);
         if(isFactor(x) && nlevels(x) < l / ng * 3) {
           int M = nlevels(x);
-          #pragma omp parallel for num_threads(nthreads)
-          for(int gr = 0; gr < ng; ++gr)
-            pres[gr] = pgs[gr] == 0 ? 0 : ndistinct_fct(px + pst[gr]-1, po, pgs[gr], M, 1, narm);
+          HA_PARALLEL_FOR(gr, ng, nthreads, 0, M, 0,
+            pres[gr] = pgs[gr] == 0 ? 0 : ndistinct_fct(px + pst[gr]-1, po, pgs[gr], M, 1, narm, &ha);
+          )
         } else {
-          #pragma omp parallel for num_threads(nthreads)
-          for(int gr = 0; gr < ng; ++gr)
-            pres[gr] = pgs[gr] == 0 ? 0 : ndistinct_int(px + pst[gr]-1, po, pgs[gr], 1, narm);
+          HA_PARALLEL_FOR(gr, ng, nthreads, maxgs, 0, 0,
+            pres[gr] = pgs[gr] == 0 ? 0 : ndistinct_int(px + pst[gr]-1, po, pgs[gr], 1, narm, &ha);
+          )
         }
         break;
       }
@@ -300,9 +307,9 @@ SEXP ndistinct_g_impl(SEXP x, const int ng, const int *restrict pgs, const int *
       }
       case STRSXP: {
         const SEXP *px = STRING_PTR(x);
-        #pragma omp parallel for num_threads(nthreads)
-        for(int gr = 0; gr < ng; ++gr)
-          pres[gr] = pgs[gr] == 0 ? 0 : ndistinct_string(px + pst[gr]-1, po, pgs[gr], 1, narm);
+        HA_PARALLEL_FOR(gr, ng, nthreads, maxgs, 0, 0,
+          pres[gr] = pgs[gr] == 0 ? 0 : ndistinct_string(px + pst[gr]-1, po, pgs[gr], 1, narm, &ha);
+        )
         break;
       }
       default: error("Not Supported SEXP Type!");
@@ -311,22 +318,22 @@ SEXP ndistinct_g_impl(SEXP x, const int ng, const int *restrict pgs, const int *
     switch(TYPEOF(x)) {
       case REALSXP: {
         const double *px = REAL(x);
-        #pragma omp parallel for num_threads(nthreads)
-        for(int gr = 0; gr < ng; ++gr)
-          pres[gr] = pgs[gr] == 0 ? 0 : ndistinct_double(px, po + pst[gr]-1, pgs[gr], 0, narm);
+        HA_PARALLEL_FOR(gr, ng, nthreads, maxgs, 0, 0,
+          pres[gr] = pgs[gr] == 0 ? 0 : ndistinct_double(px, po + pst[gr]-1, pgs[gr], 0, narm, &ha);
+        )
         break;
       }
       case INTSXP: {
         const int *px = INTEGER(x);
         if(isFactor(x) && nlevels(x) < l / ng * 3) {
           int M = nlevels(x);
-          #pragma omp parallel for num_threads(nthreads)
-          for(int gr = 0; gr < ng; ++gr)
-            pres[gr] = pgs[gr] == 0 ? 0 : ndistinct_fct(px, po + pst[gr]-1, pgs[gr], M, 0, narm);
+          HA_PARALLEL_FOR(gr, ng, nthreads, 0, M, 0,
+            pres[gr] = pgs[gr] == 0 ? 0 : ndistinct_fct(px, po + pst[gr]-1, pgs[gr], M, 0, narm, &ha);
+          )
         } else {
-          #pragma omp parallel for num_threads(nthreads)
-          for(int gr = 0; gr < ng; ++gr)
-            pres[gr] = pgs[gr] == 0 ? 0 : ndistinct_int(px, po + pst[gr]-1, pgs[gr], 0, narm);
+          HA_PARALLEL_FOR(gr, ng, nthreads, maxgs, 0, 0,
+            pres[gr] = pgs[gr] == 0 ? 0 : ndistinct_int(px, po + pst[gr]-1, pgs[gr], 0, narm, &ha);
+          )
         }
         break;
       }
@@ -339,9 +346,9 @@ SEXP ndistinct_g_impl(SEXP x, const int ng, const int *restrict pgs, const int *
       }
       case STRSXP: {
         const SEXP *px = STRING_PTR(x);
-        #pragma omp parallel for num_threads(nthreads)
-        for(int gr = 0; gr < ng; ++gr)
-          pres[gr] = pgs[gr] == 0 ? 0 : ndistinct_string(px, po + pst[gr]-1, pgs[gr], 0, narm);
+        HA_PARALLEL_FOR(gr, ng, nthreads, maxgs, 0, 0,
+          pres[gr] = pgs[gr] == 0 ? 0 : ndistinct_string(px, po + pst[gr]-1, pgs[gr], 0, narm, &ha);
+        )
         break;
       }
       default: error("Not Supported SEXP Type!");
@@ -352,6 +359,74 @@ SEXP ndistinct_g_impl(SEXP x, const int ng, const int *restrict pgs, const int *
   return res;
 }
 
+// Sort-based version for large groups (see gsort_use() in small_helper.c): o orders x by group and value, such that
+// the distinct values of each group form runs and counting them amounts to counting runs (using the same comparisons)
+SEXP ndistinct_g_sort_impl(SEXP x, const SEXP *pg, const int narm, int nthreads) {
+
+  const int ng = INTEGER(pg[0])[0], *restrict pgs = INTEGER(pg[2]);
+  SEXP o = PROTECT(gsort_order(x, pg[1])), res = PROTECT(allocVector(INTSXP, ng));
+  const int *restrict po = INTEGER(o);
+  int *restrict pres = INTEGER(res), *restrict pst = (int *) R_alloc(ng, sizeof(int));
+  pst[0] = 0; // Groups appear in the order of the group id
+  for(int gr = 1; gr < ng; ++gr) pst[gr] = pst[gr-1] + pgs[gr-1];
+  if(nthreads > ng) nthreads = ng;
+
+  switch(TYPEOF(x)) {
+    case REALSXP: {
+      const double *px = REAL(x);
+      #pragma omp parallel for num_threads(nthreads)
+      for(int gr = 0; gr < ng; ++gr) {
+        const int *pog = po + pst[gr];
+        int ndist = 0, anyNA = 0;
+        for(int i = 0, end = pgs[gr]; i != end; ++i) {
+          if(ISNAN(px[pog[i]-1])) { // NA/NaN's are sorted last
+            anyNA = 1;
+            break;
+          }
+          if(i == 0 || px[pog[i]-1] != px[pog[i-1]-1]) ++ndist;
+        }
+        pres[gr] = narm ? ndist : ndist + anyNA;
+      }
+      break;
+    }
+    case INTSXP: {
+      const int *px = INTEGER(x);
+      #pragma omp parallel for num_threads(nthreads)
+      for(int gr = 0; gr < ng; ++gr) {
+        const int *pog = po + pst[gr];
+        int ndist = 0, anyNA = 0;
+        for(int i = 0, end = pgs[gr]; i != end; ++i) {
+          if(px[pog[i]-1] == NA_INTEGER) { // NA's are sorted last
+            anyNA = 1;
+            break;
+          }
+          if(i == 0 || px[pog[i]-1] != px[pog[i-1]-1]) ++ndist;
+        }
+        pres[gr] = narm ? ndist : ndist + anyNA;
+      }
+      break;
+    }
+    case STRSXP: {
+      const SEXP *px = STRING_PTR(x);
+      #pragma omp parallel for num_threads(nthreads)
+      for(int gr = 0; gr < ng; ++gr) {
+        const int *pog = po + pst[gr];
+        int ndist = 0, anyNA = 0;
+        for(int i = 0, end = pgs[gr]; i != end; ++i) { // Strings are grouped but not sorted: NA's can be anywhere
+          if(px[pog[i]-1] == NA_STRING) anyNA = 1;
+          else if(i == 0 || px[pog[i]-1] != px[pog[i-1]-1]) ++ndist;
+        }
+        pres[gr] = narm ? ndist : ndist + anyNA;
+      }
+      break;
+    }
+    default: error("Not Supported SEXP Type!");
+  }
+
+  UNPROTECT(2);
+  return res;
+}
+
 // Functions for Export --------------------------------------------------------
 
 SEXP fndistinctC(SEXP x, SEXP g, SEXP Rnarm, SEXP Rnthreads) {
@@ -376,7 +451,8 @@ SEXP fndistinctC(SEXP x, SEXP g, SEXP Rnarm, SEXP Rnthreads) {
     po = INTEGER(o);
     pst = INTEGER(getAttrib(o, install("starts")));
   }
-  PROTECT(res = ndistinct_g_impl(x, ng, pgs, po, pst, sorted, asLogical(Rnarm), asInteger(Rnthreads)));
+  PROTECT(res = gsort_use(x, pg) ? ndistinct_g_sort_impl(x, pg, asLogical(Rnarm), asInteger(Rnthreads)) :
+                ndistinct_g_impl(x, ng, pgs, po, pst, sorted, asLogical(Rnarm), asInteger(Rnthreads)));
   if(OBJECT(x) == 0) copyMostAttrib(x, res);
   else {
     SEXP sym_label = install("label");
@@ -433,7 +509,8 @@ SEXP fndistinctlC(SEXP x, SEXP g, SEXP Rnarm, SEXP Rdrop, SEXP Rnthreads) {
       for(int j = 0; j != l; ++j) {
         SEXP xj = px[j];
         if(length(xj) != gl) error("length(g) must match nrow(x)");
-        pout[j] = ndistinct_g_impl(xj, ng, pgs, po, pst, sorted, narm, nthreads);
+        pout[j] = gsort_use(xj, pg) ? ndistinct_g_sort_impl(xj, pg, narm, nthreads) :
+                  ndistinct_g_impl(xj, ng, pgs, po, pst, sorted, narm, nthreads);
         if(OBJECT(xj) == 0) copyMostAttrib(xj, pout[j]);
         else setAttrib(pout[j], sym_label, getAttrib(xj, sym_label));
       }
@@ -461,14 +538,14 @@ SEXP fndistinctmC(SEXP x, SEXP g, SEXP Rnarm, SEXP Rdrop, SEXP Rnthreads) {
         double *px = REAL(x);
         #pragma omp parallel for num_threads(nthreads)
         for(int j = 0; j < col; ++j)
-          pres[j] = ndistinct_double(px + j*l, &l, l, 1, narm);
+          pres[j] = ndistinct_double(px + j*l, &l, l, 1, narm, NULL);
         break;
       }
       case INTSXP: {  // Factor matrix not well defined object...
         int *px = INTEGER(x);
         #pragma omp parallel for num_threads(nthreads)
         for(int j = 0; j < col; ++j)
-          pres[j] = ndistinct_int(px + j*l, &l, l, 1, narm);
+          pres[j] = ndistinct_int(px + j*l, &l, l, 1, narm, NULL);
         break;
       }
       case LGLSXP: {
@@ -482,7 +559,7 @@ SEXP fndistinctmC(SEXP x, SEXP g, SEXP Rnarm, SEXP Rdrop, SEXP Rnthreads) {
         SEXP *px = STRING_PTR(x);
         #pragma omp parallel for num_threads(nthreads)
         for(int j = 0; j < col; ++j)
-          pres[j] = ndistinct_string(px + j*l, &l, l, 1, narm);
+          pres[j] = ndistinct_string(px + j*l, &l, l, 1, narm, NULL);
         break;
       }
       default: error("Not Supported SEXP Type!");
@@ -516,27 +593,28 @@ SEXP fndistinctmC(SEXP x, SEXP g, SEXP Rnarm, SEXP Rdrop, SEXP Rnthreads) {
       pst = INTEGER(getAttrib(o, install("starts")));
     }
 
+    int maxgs = 0; // Each thread's hash table is sized for the largest group and reused across columns and groups
+    for(int gr = 0; gr != ng; ++gr) if(pgs[gr] > maxgs) maxgs = pgs[gr];
+
     if(sorted) { // Sorted
       switch(TYPEOF(x)) {
         case REALSXP: {
           double *px = REAL(x);
-          #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) {
+          HA_PARALLEL_FOR(j, col, nthreads, maxgs, 0, 0,
             int jng = j * ng;
             double *pxj = px + j * l;
             for(int gr = 0; gr < ng; ++gr)
-              pres[jng + gr] = pgs[gr] == 0 ? 0 : ndistinct_double(pxj + pst[gr]-1, po, pgs[gr], 1, narm);
-          }
+              pres[jng + gr] = pgs[gr] == 0 ? 0 : ndistinct_double(pxj + pst[gr]-1, po, pgs[gr], 1, narm, &ha);
+          )
           break;
         }
         case INTSXP: { // Factor matrix not well defined object...
           int *px = INTEGER(x);
-          #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) {
+          HA_PARALLEL_FOR(j, col, nthreads, maxgs, 0, 0,
             int *pxj = px + j * l, jng = j * ng;
             for(int gr = 0; gr < ng; ++gr)
-              pres[jng + gr] = pgs[gr] == 0 ? 0 : ndistinct_int(pxj + pst[gr]-1, po, pgs[gr], 1, narm);
-          }
+              pres[jng + gr] = pgs[gr] == 0 ? 0 : ndistinct_int(pxj + pst[gr]-1, po, pgs[gr], 1, narm, &ha);
+          )
           break;
         }
         case LGLSXP: {
@@ -551,13 +629,12 @@ SEXP fndistinctmC(SEXP x, SEXP g, SEXP Rnarm, SEXP Rdrop, SEXP Rnthreads) {
         }
         case STRSXP: {
           SEXP *px = STRING_PTR(x);
-          #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) {
+          HA_PARALLEL_FOR(j, col, nthreads, maxgs, 0, 0,
             int jng = j * ng;
             SEXP *pxj = px + j * l;
             for(int gr = 0; gr < ng; ++gr)
-              pres[jng + gr] = pgs[gr] == 0 ? 0 : ndistinct_string(pxj + pst[gr]-1, po, pgs[gr], 1, narm);
-          }
+              pres[jng + gr] = pgs[gr] == 0 ? 0 : ndistinct_string(pxj + pst[gr]-1, po, pgs[gr], 1, narm, &ha);
+          )
           break;
         }
         default: error("Not Supported SEXP Type!");
@@ -567,23 +644,21 @@ SEXP fndistinctmC(SEXP x, SEXP g, SEXP Rnarm, SEXP Rdrop, SEXP Rnthreads) {
       switch(TYPEOF(x)) {
         case REALSXP: {
           double *px = REAL(x);
-          #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) {
+          HA_PARALLEL_FOR(j, col, nthreads, maxgs, 0, 0,
             int jng = j * ng;
             double *pxj = px + j * l;
             for(int gr = 0; gr < ng; ++gr)
-              pres[jng + gr] = pgs[gr] == 0 ? 0 : ndistinct_double(pxj, po + pst[gr]-1, pgs[gr], 0, narm);
-          }
+              pres[jng + gr] = pgs[gr] == 0 ? 0 : ndistinct_double(pxj, po + pst[gr]-1, pgs[gr], 0, narm, &ha);
+          )
           break;
         }
         case INTSXP: { // Factor matrix not well defined object...
           int *px = INTEGER(x);
-          #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) {
+          HA_PARALLEL_FOR(j, col, nthreads, maxgs, 0, 0,
             int jng = j * ng, *pxj = px + j * l;
             for(int gr = 0; gr < ng; ++gr)
-              pres[jng + gr] = pgs[gr] == 0 ? 0 : ndistinct_int(pxj, po + pst[gr]-1, pgs[gr], 0, narm);
-          }
+              pres[jng + gr] = pgs[gr] == 0 ? 0 : ndistinct_int(pxj, po + pst[gr]-1, pgs[gr], 0, narm, &ha);
+          )
           break;
         }
         case LGLSXP: {
@@ -598,13 +673,12 @@ SEXP fndistinctmC(SEXP x, SEXP g, SEXP Rnarm, SEXP Rdrop, SEXP Rnthreads) {
         }
         case STRSXP: {
           SEXP *px = STRING_PTR(x);
-          #pragma omp parallel for num_threads(nthreads)
-          for(int j = 0; j < col; ++j) {
+          HA_PARALLEL_FOR(j, col, nthreads, maxgs, 0, 0,
             int jng = j * ng;
             SEXP *pxj = px + j * l;
             for(int gr = 0; gr < ng; ++gr)
-              pres[jng + gr] = pgs[gr] == 0 ? 0 : ndistinct_string(pxj, po + pst[gr]-1, pgs[gr], 0, narm);
-          }
+              pres[jng + gr] = pgs[gr] == 0 ? 0 : ndistinct_string(pxj, po + pst[gr]-1, pgs[gr], 0, narm, &ha);
+          )
           break;
         }
         default: error("Not Supported SEXP Type!");
@@ -616,3 +690,291 @@ SEXP fndistinctmC(SEXP x, SEXP g, SEXP Rnarm, SEXP Rdrop, SEXP Rnthreads) {
   }
 }
 
+
+// Approximate distinct value count (HyperLogLog) ------------------------------
+// A sketch consists of m = 2^p one-byte registers. The first p bits of a 64-bit hash of each value select a register, which keeps the
+// maximum rank (position of the first 1-bit) of the remaining bits. The relative standard error of the estimate is about 1.04/sqrt(m).
+// Values are hashed by content (integers as doubles, strings and factor levels by their bytes), so that sketches of different vectors
+// or sessions can be merged by taking the register-wise maximum.
+
+#define HLL_NA_HASH 0x5bd1e9955bd1e995ULL // All NA's and NaN's are one value, as in ndistinct_double()
+
+static inline uint64_t hll_mix(uint64_t h) { // splitmix64 finalizer
+  h ^= h >> 30; h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27; h *= 0x94d049bb133111ebULL;
+  return h ^ (h >> 31);
+}
+
+static inline uint64_t hll_hash_double(const double x) {
+  union { double d; uint64_t u; } tpv;
+  tpv.d = x == 0.0 ? 0.0 : x; // 0.0 and -0.0 are equal
+  return hll_mix(tpv.u);
+}
+
+static inline uint64_t hll_hash_string(const SEXP x) {
+  uint64_t h = 0xcbf29ce484222325ULL; // FNV-1a
+  for(const unsigned char *s = (const unsigned char *) CHAR(x); *s; ++s) {
+    h ^= *s;
+    h *= 0x100000001b3ULL;
+  }
+  return hll_mix(h);
+}
+
+static inline void hll_add(uint8_t *restrict reg, const uint64_t h, const int p) {
+  const uint64_t w = (h << p) | ((uint64_t)1 << (p-1)); // guard bit: rank is at most 64-p+1
+  const uint8_t rank = (uint8_t)(__builtin_clzll(w) + 1);
+  const uint64_t j = h >> (64-p);
+  if(rank > reg[j]) reg[j] = rank;
+}
+
+// Adds elements from...to-1 (or rows po[from...to-1]) of px to the sketch. lh holds the hashes of the levels of a factor
+static void hll_add_range(uint8_t *restrict reg, const void *px, const int tx, const uint64_t *restrict lh, const int *restrict po,
+                          const int from, const int to, const int p, const int narm) {
+  switch(tx) {
+    case REALSXP: {
+      const double *restrict pd = (const double *) px;
+      for(int k = from; k < to; ++k) {
+        const double xi = pd[po ? po[k]-1 : k];
+        if(NISNAN(xi)) hll_add(reg, hll_hash_double(xi), p);
+        else if(!narm) hll_add(reg, HLL_NA_HASH, p);
+      }
+      break;
+    }
+    case INTSXP:
+    case LGLSXP: {
+      const int *restrict pi = (const int *) px;
+      for(int k = from; k < to; ++k) {
+        const int xi = pi[po ? po[k]-1 : k];
+        if(xi != NA_INTEGER) hll_add(reg, lh ? lh[xi-1] : hll_hash_double((double)xi), p);
+        else if(!narm) hll_add(reg, HLL_NA_HASH, p);
+      }
+      break;
+    }
+    case STRSXP: {
+      const SEXP *restrict ps = (const SEXP *) px;
+      for(int k = from; k < to; ++k) {
+        const SEXP xi = ps[po ? po[k]-1 : k];
+        if(xi != NA_STRING) hll_add(reg, hll_hash_string(xi), p);
+        else if(!narm) hll_add(reg, HLL_NA_HASH, p);
+      }
+      break;
+    }
+  }
+}
+
+// Fills the sketches reg (max(ng, 1) x m registers) of a vector px of length l. Ungrouped: each thread sketches a chunk of the vector
+// and the sketches are merged. Grouped: groups are distributed across threads.
+static void hll_sketch_impl(uint8_t *restrict reg, const void *px, const int tx, const uint64_t *restrict lh, const int l, const int p,
+                            const int ng, const int *restrict pgs, const int *restrict po, const int *restrict pst, const int sorted,
+                            const int narm, int nthreads) {
+  const size_t m = (size_t)1 << p;
+  if(ng == 0) {
+    if(nthreads > 1 && l >= 100000) {
+      uint8_t *restrict treg = (uint8_t *) Calloc(m * nthreads, uint8_t);
+      #pragma omp parallel for num_threads(nthreads)
+      for(int t = 0; t < nthreads; ++t)
+        hll_add_range(treg + t * m, px, tx, lh, NULL, (int)((int64_t)l * t / nthreads), (int)((int64_t)l * (t+1) / nthreads), p, narm);
+      for(int t = 0; t != nthreads; ++t) {
+        const uint8_t *restrict tr = treg + t * m;
+        for(size_t j = 0; j != m; ++j) if(tr[j] > reg[j]) reg[j] = tr[j];
+      }
+      Free(treg);
+    } else hll_add_range(reg, px, tx, lh, NULL, 0, l, p, narm);
+  } else {
+    if(nthreads > ng) nthreads = ng;
+    #pragma omp parallel for num_threads(nthreads)
+    for(int gr = 0; gr < ng; ++gr)
+      hll_add_range(reg + gr * m, px, tx, lh, sorted ? NULL : po, pst[gr]-1, pst[gr]-1+pgs[gr], p, narm);
+  }
+}
+
+static double hll_estimate_impl(const uint8_t *restrict reg, const int p) {
+  const int m = 1 << p;
+  const double alpha = m == 16 ? 0.673 : m == 32 ? 0.697 : m == 64 ? 0.709 : 0.7213 / (1.0 + 1.079 / m);
+  double sum = 0.0;
+  int zeros = 0;
+  for(int j = 0; j != m; ++j) {
+    sum += ldexp(1.0, -reg[j]);
+    zeros += reg[j] == 0;
+  }
+  double est = alpha * m * m / sum;
+  if(est <= 2.5 * m && zeros) est = m * log((double)m / zeros); // Linear counting for small cardinalities
+  return est;
+}
+
+static int hll_precision(SEXP Rp) {
+  int p = asInteger(Rp);
+  if(p == NA_INTEGER || p < 4 || p > 18) error("precision needs to be an integer between 4 and 18");
+  return p;
+}
+
+// Checks the type of x and returns the level hashes if x is a factor
+static uint64_t *hll_level_hashes(SEXP x) {
+  int tx = TYPEOF(x);
+  if(tx != REALSXP && tx != INTSXP && tx != LGLSXP && tx != STRSXP) error("Not Supported SEXP Type!");
+  if(!isFactor(x)) return NULL;
+  SEXP lev = getAttrib(x, R_LevelsSymbol);
+  const SEXP *restrict pl = STRING_PTR(lev);
+  int nlev = length(lev);
+  uint64_t *lh = (uint64_t *) R_alloc(nlev + 1, sizeof(uint64_t));
+  for(int j = 0; j != nlev; ++j) lh[j] = hll_hash_string(pl[j]);
+  return lh;
+}
+
+// Groups as in fndistinctC(): sets ng, pgs, po and pst and returns sorted
+static int hll_groups(SEXP g, const int l, int *ng, int **pgs, int **po, int **pst) {
+  if(isNull(g)) {
+    *ng = 0;
+    return 1;
+  }
+  if(TYPEOF(g) != VECSXP || !inherits(g, "GRP")) error("g needs to be an object of class 'GRP', see ?GRP");
+  const SEXP *restrict pg = SEXPPTR(g), o = pg[6];
+  int sorted = LOGICAL(pg[5])[1] == 1;
+  *ng = INTEGER(pg[0])[0];
+  *pgs = INTEGER(pg[2]);
+  if(l != length(pg[1])) error("length(g) must match length(x)");
+  if(isNull(o)) {
+    int *cgs = (int *) R_alloc(*ng+2, sizeof(int)), *restrict pgv = INTEGER(pg[1]); cgs[1] = 1;
+    for(int i = 0; i != *ng; ++i) cgs[i+2] = cgs[i+1] + (*pgs)[i];
+    *pst = cgs + 1;
+    if(!sorted) {
+      int *restrict count = (int *) Calloc(*ng+1, int), *pop = (int *) R_alloc(l, sizeof(int)); --pop;
+      for(int i = 0; i != l; ++i) pop[cgs[pgv[i]] + count[pgv[i]]++] = i+1;
+      *po = pop + 1; Free(count);
+    }
+  } else {
+    *po = INTEGER(o);
+    *pst = INTEGER(getAttrib(o, install("starts")));
+  }
+  return sorted;
+}
+
+// Estimates for a vector of length l (offset off into x), written to pres (max(ng, 1) values)
+static void hll_ndistinct_vec(double *restrict pres, SEXP x, const size_t off, const uint64_t *lh, const int l, const int p, const int ng,
+                              const int *pgs, const int *po, const int *pst, const int sorted, const int narm, const int nthreads) {
+  const int nc = ng == 0 ? 1 : ng, tx = TYPEOF(x);
+  const size_t m = (size_t)1 << p;
+  const void *px = tx == REALSXP ? (const void *)(REAL(x) + off) : tx == STRSXP ? (const void *)(STRING_PTR(x) + off) : (const void *)(INTEGER(x) + off);
+  uint8_t *restrict reg = (uint8_t *) Calloc(m * nc, uint8_t);
+  hll_sketch_impl(reg, px, tx, lh, l, p, ng, pgs, po, pst, sorted, narm, nthreads);
+  for(int gr = 0; gr != nc; ++gr) pres[gr] = nearbyint(hll_estimate_impl(reg + gr * m, p));
+  Free(reg);
+}
+
+SEXP fndistinct_hllC(SEXP x, SEXP g, SEXP Rnarm, SEXP Rp, SEXP Rdrop, SEXP Rnthreads) {
+  const int p = hll_precision(Rp), narm = asLogical(Rnarm), nthreads = asInteger(Rnthreads);
+  int ng = 0, *pgs = NULL, *po = NULL, *pst = NULL, sorted = 1;
+  SEXP res, sym_label = install("label");
+
+  if(TYPEOF(x) == VECSXP) { // List / data frame
+    int l = length(x), nrx = l ? length(VECTOR_ELT(x, 0)) : 0;
+    if(l < 1) return ScalarReal(0);
+    sorted = hll_groups(g, nrx, &ng, &pgs, &po, &pst);
+    const SEXP *restrict px = SEXPPTR(x);
+    if(ng == 0 && asLogical(Rdrop)) {
+      res = PROTECT(allocVector(REALSXP, l));
+      double *restrict pres = REAL(res);
+      for(int j = 0; j != l; ++j)
+        hll_ndistinct_vec(pres + j, px[j], 0, hll_level_hashes(px[j]), length(px[j]), p, 0, pgs, po, pst, sorted, narm, nthreads);
+      setAttrib(res, R_NamesSymbol, getAttrib(x, R_NamesSymbol));
+    } else {
+      res = PROTECT(allocVector(VECSXP, l));
+      for(int j = 0; j != l; ++j) {
+        SEXP xj = px[j], resj;
+        if(length(xj) != nrx) error("length(g) must match nrow(x)");
+        SET_VECTOR_ELT(res, j, resj = allocVector(REALSXP, ng == 0 ? 1 : ng));
+        hll_ndistinct_vec(REAL(resj), xj, 0, hll_level_hashes(xj), nrx, p, ng, pgs, po, pst, sorted, narm, nthreads);
+        if(OBJECT(xj) == 0) copyMostAttrib(xj, resj);
+        else setAttrib(resj, sym_label, getAttrib(xj, sym_label));
+      }
+      DFcopyAttr(res, x, ng);
+    }
+    UNPROTECT(1);
+    return res;
+  }
+
+  SEXP dim = getAttrib(x, R_DimSymbol);
+  uint64_t *lh = hll_level_hashes(x);
+  if(isNull(dim)) { // Vector
+    int l = length(x);
+    sorted = hll_groups(g, l, &ng, &pgs, &po, &pst);
+    res = PROTECT(allocVector(REALSXP, ng == 0 ? 1 : ng));
+    hll_ndistinct_vec(REAL(res), x, 0, lh, l, p, ng, pgs, po, pst, sorted, narm, nthreads);
+    if(ng > 0) {
+      if(OBJECT(x) == 0) copyMostAttrib(x, res);
+      else setAttrib(res, sym_label, getAttrib(x, sym_label));
+    }
+  } else { // Matrix
+    int l = INTEGER(dim)[0], col = INTEGER(dim)[1];
+    sorted = hll_groups(g, l, &ng, &pgs, &po, &pst);
+    int nc = ng == 0 ? 1 : ng;
+    res = PROTECT(allocVector(REALSXP, (size_t)col * nc));
+    double *restrict pres = REAL(res);
+    for(int j = 0; j != col; ++j)
+      hll_ndistinct_vec(pres + (size_t)j * nc, x, (size_t)j * l, lh, l, p, ng, pgs, po, pst, sorted, narm, nthreads);
+    matCopyAttr(res, x, Rdrop, ng);
+  }
+  UNPROTECT(1);
+  return res;
+}
+
+// Sketches of a vector: a raw matrix with 2^p rows and one column per group
+SEXP hll_sketchC(SEXP x, SEXP g, SEXP Rnarm, SEXP Rp, SEXP Rnthreads) {
+  const int p = hll_precision(Rp), l = length(x), tx = TYPEOF(x);
+  int ng = 0, *pgs = NULL, *po = NULL, *pst = NULL;
+  uint64_t *lh = hll_level_hashes(x);
+  int sorted = hll_groups(g, l, &ng, &pgs, &po, &pst);
+  SEXP res = PROTECT(allocMatrix(RAWSXP, 1 << p, ng == 0 ? 1 : ng));
+  memset(RAW(res), 0, (size_t)length(res));
+  const void *px = tx == REALSXP ? (const void *)REAL(x) : tx == STRSXP ? (const void *)STRING_PTR(x) : (const void *)INTEGER(x);
+  hll_sketch_impl((uint8_t *) RAW(res), px, tx, lh, l, p, ng, pgs, po, pst, sorted, asLogical(Rnarm), asInteger(Rnthreads));
+  UNPROTECT(1);
+  return res;
+}
+
+static int hll_check_sketch(SEXP x) {
+  SEXP dim = getAttrib(x, R_DimSymbol);
+  int m = isNull(dim) ? length(x) : INTEGER(dim)[0], p = 4;
+  if(TYPEOF(x) != RAWSXP) error("sketch needs to be a raw vector or matrix, see ?hll_sketch");
+  while(p < 18 && (1 << p) < m) ++p;
+  if(m != (1 << p)) error("number of sketch registers (rows) needs to be a power of 2 between 2^4 and 2^18");
+  return p;
+}
+
+// Register-wise maximum of columns ia of sketch a and ib of sketch b (NA = no column)
+SEXP hll_mergeC(SEXP a, SEXP b, SEXP ia, SEXP ib) {
+  const int p = hll_check_sketch(a), n = length(ia);
+  if(hll_check_sketch(b) != p) error("can only merge sketches with the same precision");
+  if(length(ib) != n) error("length(ia) must match length(ib)");
+  const size_t m = (size_t)1 << p, nca = length(a) / m, ncb = length(b) / m;
+  const int *restrict pia = INTEGER(ia), *restrict pib = INTEGER(ib);
+  const uint8_t *restrict pa = (const uint8_t *) RAW(a), *restrict pb = (const uint8_t *) RAW(b);
+  SEXP res = PROTECT(allocMatrix(RAWSXP, m, n));
+  uint8_t *restrict pres = (uint8_t *) RAW(res);
+  memset(pres, 0, m * n);
+  for(int j = 0; j != n; ++j) {
+    uint8_t *restrict pr = pres + j * m;
+    if(pia[j] != NA_INTEGER) {
+      if(pia[j] < 1 || pia[j] > (int)nca) error("ia out of range");
+      memcpy(pr, pa + (pia[j]-1) * m, m);
+    }
+    if(pib[j] != NA_INTEGER) {
+      if(pib[j] < 1 || pib[j] > (int)ncb) error("ib out of range");
+      const uint8_t *restrict pbj = pb + (pib[j]-1) * m;
+      for(size_t k = 0; k != m; ++k) if(pbj[k] > pr[k]) pr[k] = pbj[k];
+    }
+  }
+  UNPROTECT(1);
+  return res;
+}
+
+SEXP hll_estimateC(SEXP x) {
+  const int p = hll_check_sketch(x);
+  const size_t m = (size_t)1 << p, nc = length(x) / m;
+  const uint8_t *restrict px = (const uint8_t *) RAW(x);
+  SEXP res = PROTECT(allocVector(REALSXP, nc));
+  double *restrict pres = REAL(res);
+  for(size_t j = 0; j != nc; ++j) pres[j] = nearbyint(hll_estimate_impl(px + j * m, p));
+  UNPROTECT(1);
+  return res;
+}
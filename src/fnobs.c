@@ -1,20 +1,103 @@
 #include "collapse_c.h"
 
-SEXP fnobsC(SEXP x, SEXP Rng, SEXP g) {
-  int l = length(x), ng = asInteger(Rng);
+// Grouped counting of non-missing values in rows start...end-1, pn must be decremented by 1 (pn[pg[i]])
+static void fnobs_g_acc(int *restrict pn, const void *restrict px, const int tx, const int *restrict pg, const int start, const int end) {
+  switch(tx) {
+    case REALSXP: {
+      const double *pxd = (const double *)px;
+      for(int i = start; i != end; ++i) if(NISNAN(pxd[i])) ++pn[pg[i]];
+      break;
+    }
+    case INTSXP:
+    case LGLSXP: {
+      const int *pxi = (const int *)px;
+      for(int i = start; i != end; ++i) if(pxi[i] != NA_INTEGER) ++pn[pg[i]];
+      break;
+    }
+    case STRSXP: {
+      const SEXP *pxs = (const SEXP *)px;
+      for(int i = start; i != end; ++i) if(pxs[i] != NA_STRING) ++pn[pg[i]];
+      break;
+    }
+    case VECSXP: {
+      const SEXP *pxs = (const SEXP *)px;
+      for(int i = start; i != end; ++i) if(length(pxs[i])) ++pn[pg[i]];
+      break;
+    }
+  }
+}
+
+// Vectorised ungrouped counts, see SIMD_DISPATCH in collapse_c.h
+SIMD_DISPATCH
+static int vnobs_double(const double *restrict px, const int l) {
+  int n = 0;
+  #pragma omp simd reduction(+:n)
+  for(int i = 0; i < l; ++i) n += NISNAN(px[i]);
+  return n;
+}
+
+SIMD_DISPATCH
+static int vnobs_int(const int *restrict px, const int l) {
+  const int na = NA_INTEGER;
+  int n = 0;
+  #pragma omp simd reduction(+:n)
+  for(int i = 0; i < l; ++i) n += px[i] != na;
+  return n;
+}
+
+// Sorted groups (see gseg_starts()): counts over the contiguous rows of each group
+static void fnobs_seg_impl(int *restrict pn, const void *restrict px, const int tx, const int ng, const int *restrict starts, const int nth) {
+  #pragma omp parallel for num_threads(nth) schedule(dynamic, GSEG_CHUNK) if(nth > 1)
+  for(int gr = 0; gr < ng; ++gr) {
+    const int s = starts[gr], e = starts[gr+1];
+    int n = 0;
+    switch(tx) {
+      case REALSXP: n = vnobs_double((const double *)px + s, e - s); break;
+      case INTSXP:
+      case LGLSXP: n = vnobs_int((const int *)px + s, e - s); break;
+      case STRSXP: {
+        const SEXP *pxs = (const SEXP *)px;
+        for(int i = s; i != e; ++i) if(pxs[i] != NA_STRING) ++n;
+        break;
+      }
+      case VECSXP: {
+        const SEXP *pxs = (const SEXP *)px;
+        for(int i = s; i != e; ++i) if(length(pxs[i])) ++n;
+        break;
+      }
+    }
+    pn[gr] = n;
+  }
+}
+
+// Row-level multithreaded version, see gpar_plan(). pn is initialized here.
+static void fnobs_g_omp_impl(int *restrict pn, const void *restrict px, const int tx, const int ng, const int *restrict pg, const int nth, const int mode, const int *restrict cuts) {
+  if(mode == GPAR_SORTED) {
+    memset(pn, 0, sizeof(int) * ng);
+    #pragma omp parallel for num_threads(nth)
+    for(int t = 0; t < nth; ++t) fnobs_g_acc(pn-1, px, tx, pg, cuts[t], cuts[t+1]);
+  } else {
+    int *buf = (int*)Calloc((size_t)ng * nth, int);
+    #pragma omp parallel for num_threads(nth)
+    for(int t = 0; t < nth; ++t) fnobs_g_acc(buf + (size_t)t * ng - 1, px, tx, pg, cuts[t], cuts[t+1]);
+    gpar_merge_count(pn, buf, ng, nth);
+    Free(buf);
+  }
+}
+
+SEXP fnobsC(SEXP x, SEXP Rng, SEXP g, SEXP Rnth) {
+  int l = length(x), ng = asInteger(Rng), nth = asInteger(Rnth);
 
   if (ng == 0) {
     int n = 0;
     switch(TYPEOF(x)) {
       case REALSXP: {
-        double *px = REAL(x);
-        for(int i = 0; i != l; ++i) if(px[i] == px[i]) ++n;
+        n = vnobs_double(REAL(x), l);
         break;
       }
       case INTSXP:
       case LGLSXP: {
-        int *px = INTEGER(x);
-        for(int i = 0; i != l; ++i) if(px[i] != NA_INTEGER) ++n;
+        n = vnobs_int(INTEGER(x), l);
         break;
       }
       case STRSXP: {
@@ -33,31 +116,43 @@ SEXP fnobsC(SEXP x, SEXP Rng, SEXP g) {
   } else { // with groups
     if(length(g) != l) error("length(g) must match NROW(X)");
     SEXP n = PROTECT(allocVector(INTSXP, ng));
-    int *pn = INTEGER(n), *pg = INTEGER(g);
-    memset(pn, 0, sizeof(int) * ng); --pn;
-    switch(TYPEOF(x)) {
-      case REALSXP: {
-        double *px = REAL(x);
-        for(int i = 0; i != l; ++i) if(px[i] == px[i]) ++pn[pg[i]];
-        break;
-      }
-      case INTSXP:
-      case LGLSXP: {
-        int *px = INTEGER(x);
-        for(int i = 0; i != l; ++i) if(px[i] != NA_INTEGER) ++pn[pg[i]];
-        break;
-      }
-      case STRSXP: {
-        SEXP *px = STRING_PTR(x);
-        for(int i = 0; i != l; ++i) if(px[i] != NA_STRING) ++pn[pg[i]];
-        break;
-      }
-      case VECSXP: {
-        SEXP *px = SEXPPTR(x);
-        for(int i = 0; i != l; ++i) if(length(px[i])) ++pn[pg[i]];
-        break;
+    int *pn = INTEGER(n), *pg = INTEGER(g), tx = TYPEOF(x), gmode = GPAR_SERIAL, *starts;
+    if(tx != REALSXP && tx != INTSXP && tx != LGLSXP && tx != STRSXP && tx != VECSXP) error("Unsupported SEXP type");
+    if((starts = gseg_starts(pg, ng, l))) { // Sorted groups: segmented counts
+      fnobs_seg_impl(pn, DATAPTR(x), tx, ng, starts, l >= 100000 ? nth : 1);
+      Free(starts);
+      gmode = GPAR_SORTED; // i.e. not serial: done
+    } else if(nth > 1 && l >= 100000) {
+      int *cuts = (int*)R_alloc(nth+1, sizeof(int));
+      gmode = gpar_plan(cuts, pg, ng, l, nth);
+      if(gmode != GPAR_SERIAL) fnobs_g_omp_impl(pn, DATAPTR(x), tx, ng, pg, nth, gmode, cuts);
+    }
+    if(gmode == GPAR_SERIAL) {
+      memset(pn, 0, sizeof(int) * ng); --pn;
+      switch(tx) {
+        case REALSXP: {
+          double *px = REAL(x);
+          for(int i = 0; i != l; ++i) if(px[i] == px[i]) ++pn[pg[i]];
+          break;
+        }
+        case INTSXP:
+        case LGLSXP: {
+          int *px = INTEGER(x);
+          for(int i = 0; i != l; ++i) if(px[i] != NA_INTEGER) ++pn[pg[i]];
+          break;
+        }
+        case STRSXP: {
+          SEXP *px = STRING_PTR(x);
+          for(int i = 0; i != l; ++i) if(px[i] != NA_STRING) ++pn[pg[i]];
+          break;
+        }
+        case VECSXP: {
+          SEXP *px = SEXPPTR(x);
+          for(int i = 0; i != l; ++i) if(length(px[i])) ++pn[pg[i]];
+          break;
+        }
+        default: error("Unsupported SEXP type");
       }
-      default: error("Unsupported SEXP type");
     }
     if(!isObject(x)) {
       copyMostAttrib(x, n); // SHALLOW_DUPLICATE_ATTRIB(n, x);
@@ -72,10 +167,10 @@ SEXP fnobsC(SEXP x, SEXP Rng, SEXP g) {
 }
 
 
-SEXP fnobsmC(SEXP x, SEXP Rng, SEXP g, SEXP Rdrop) {
+SEXP fnobsmC(SEXP x, SEXP Rng, SEXP g, SEXP Rdrop, SEXP Rnth) {
   SEXP dim = getAttrib(x, R_DimSymbol); // protect ??
   if(isNull(dim)) error("x is not a matrix");
-  int ng = asInteger(Rng), l = INTEGER(dim)[0], col = INTEGER(dim)[1];
+  int ng = asInteger(Rng), nth = asInteger(Rnth), l = INTEGER(dim)[0], col = INTEGER(dim)[1];
 
   SEXP n = PROTECT(allocVector(INTSXP, ng == 0 ? col : ng * col));
   int *pn = INTEGER(n);
@@ -84,21 +179,13 @@ SEXP fnobsmC(SEXP x, SEXP Rng, SEXP g, SEXP Rdrop) {
     switch(TYPEOF(x)) {
       case REALSXP: {
         double *px = REAL(x);
-        for(int j = 0; j != col; ++j) {
-           int nj = 0, end = l * j + l;
-           for(int i = l * j; i != end; ++i) if(NISNAN(px[i])) ++nj;
-           pn[j] = nj;
-        }
+        for(int j = 0; j != col; ++j) pn[j] = vnobs_double(px + (size_t)l * j, l);
         break;
       }
       case INTSXP:
       case LGLSXP: {
         int *px = INTEGER(x);
-        for(int j = 0; j != col; ++j) {
-          int nj = 0, end = l * j + l;
-          for(int i = l * j; i != end; ++i) if(px[i] != NA_INTEGER) ++nj;
-          pn[j] = nj;
-        }
+        for(int j = 0; j != col; ++j) pn[j] = vnobs_int(px + (size_t)l * j, l);
         break;
       }
       case STRSXP: {
@@ -123,10 +210,45 @@ SEXP fnobsmC(SEXP x, SEXP Rng, SEXP g, SEXP Rdrop) {
     }
   } else { // with groups
     if(length(g) != l) error("length(g) must match NROW(X)");
+    int *pg = INTEGER(g), tx = TYPEOF(x), gmode = GPAR_SERIAL, *cuts = NULL, *starts;
+    if(tx != REALSXP && tx != INTSXP && tx != LGLSXP && tx != STRSXP && tx != VECSXP) error("Unsupported SEXP type");
+    if((starts = gseg_starts(pg, ng, l))) { // Sorted groups: segmented counts, parallel over columns if there are enough
+      size_t size = tx == REALSXP ? sizeof(double) : tx == STRSXP || tx == VECSXP ? sizeof(SEXP) : sizeof(int);
+      char *px = (char *)DATAPTR(x);
+      if((double)l * col < 100000) nth = 1;
+      if(nth > 1 && col >= nth) {
+        #pragma omp parallel for num_threads(nth)
+        for(int j = 0; j < col; ++j) fnobs_seg_impl(pn + j * ng, px + (size_t)j * l * size, tx, ng, starts, 1);
+      } else {
+        for(int j = 0; j != col; ++j) fnobs_seg_impl(pn + j * ng, px + (size_t)j * l * size, tx, ng, starts, nth);
+      }
+      Free(starts);
+      matCopyAttr(n, x, Rdrop, ng);
+      UNPROTECT(1);
+      return n;
+    }
+    if(nth > 1 && (double)l * col >= 100000) {
+      size_t size = tx == REALSXP ? sizeof(double) : tx == STRSXP || tx == VECSXP ? sizeof(SEXP) : sizeof(int);
+      char *px = (char *)DATAPTR(x);
+      if(col < nth) { // Long and narrow matrix: row-level parallelism
+        cuts = (int*)R_alloc(nth+1, sizeof(int));
+        gmode = gpar_plan(cuts, pg, ng, l, nth);
+      }
+      if(gmode != GPAR_SERIAL) {
+        for(int j = 0; j != col; ++j) fnobs_g_omp_impl(pn + j * ng, px + (size_t)j * l * size, tx, ng, pg, nth, gmode, cuts);
+      } else {
+        if(nth > col) nth = col;
+        memset(pn, 0, sizeof(int) * ng * col);
+        #pragma omp parallel for num_threads(nth)
+        for(int j = 0; j < col; ++j) fnobs_g_acc(pn + j * ng - 1, px + (size_t)j * l * size, tx, pg, 0, l);
+      }
+      matCopyAttr(n, x, Rdrop, ng);
+      UNPROTECT(1);
+      return n;
+    }
     memset(pn, 0, sizeof(int) * ng * col);
     pn -= ng + 1;
-    int *pg = INTEGER(g);
-    switch(TYPEOF(x)) {
+    switch(tx) {
       case REALSXP: {
         double *px = REAL(x)-l;
         for(int j = 0; j != col; ++j) {
@@ -169,19 +291,19 @@ SEXP fnobsmC(SEXP x, SEXP Rng, SEXP g, SEXP Rdrop) {
 }
 
 
-SEXP fnobslC(SEXP x, SEXP Rng, SEXP g, SEXP Rdrop) {
+SEXP fnobslC(SEXP x, SEXP Rng, SEXP g, SEXP Rdrop, SEXP Rnth) {
   int l = length(x), ng = asInteger(Rng);
   if(l < 1) return x;
   if(asLogical(Rdrop) && ng == 0) {
     SEXP out = PROTECT(allocVector(INTSXP, l)), *px = SEXPPTR(x);
     int *pout = INTEGER(out);
-    for(int j = 0; j != l; ++j) pout[j] = INTEGER(fnobsC(px[j], Rng, g))[0];
+    for(int j = 0; j != l; ++j) pout[j] = INTEGER(fnobsC(px[j], Rng, g, Rnth))[0];
     setAttrib(out, R_NamesSymbol, getAttrib(x, R_NamesSymbol));
     UNPROTECT(1);
     return out;
   } else {
     SEXP out = PROTECT(allocVector(VECSXP, l)), *pout = SEXPPTR(out), *px = SEXPPTR(x);
-    for(int j = 0; j != l; ++j) pout[j] = fnobsC(px[j], Rng, g);
+    for(int j = 0; j != l; ++j) pout[j] = fnobsC(px[j], Rng, g, Rnth);
     DFcopyAttr(out, x, ng);
     UNPROTECT(1);
     return out;
@@ -1,5 +1,7 @@
 #ifdef _OPENMP
 #include <omp.h>
+#else
+#define omp_get_thread_num() 0
 #endif
 #include <numeric>
 // #define STRICT_R_HEADERS // Now defined globally in Makevars
@@ -14,6 +16,114 @@ extern "C" {
 auto isnan2 = [](double x) { return x != x; };
 auto nisnan = [](double x) { return x == x; };
 
+// Grouped order statistics use one buffer of length l, in which group i (1...ng) occupies the segment starting at
+// gst[i] (gst[ng+1] = l). This avoids allocating a separate vector for each group.
+static std::vector<int> group_starts(int ng, const IntegerVector& g, const SEXP& gs, int l) {
+  std::vector<int> gst(ng+2);
+  if(Rf_isNull(gs)) {
+    for(int i = 0; i != l; ++i) ++gst[g[i]+1];
+  } else {
+    IntegerVector gsv = gs;
+    if(ng != gsv.size()) stop("ng must match length(gs)");
+    for(int i = 0; i != ng; ++i) gst[i+2] = gsv[i];
+  }
+  for(int i = 2; i < ng+2; ++i) gst[i] += gst[i-1];
+  return gst;
+}
+
+// Weighted order statistics: the n'th element is found by scanning the values in ascending order, accumulating weights until
+// the target partial sum wsumQ = Q * sum(w) is reached.
+
+// Weighted n'th element of a column px given its ordering o (1-based, missing values last). The target wsumQ is only passed
+// if narm = false (otherwise computed here), and nawg is set if there are missing weights for non-missing values.
+static double wnth_ordered(const double *px, const double *pw, const int *o, int l, double wsumQ, double Q,
+                           bool narm, bool tiesmean, bool lower, bool& nawg) {
+  if(narm) {
+    wsumQ = 0;
+    for(int i = 0; i != l; ++i) if(nisnan(px[i])) wsumQ += pw[i];
+    if(wsumQ == 0) return NA_REAL;
+    wsumQ *= Q;
+  } else if(isnan2(px[o[l-1]-1])) return NA_REAL;
+  if(isnan2(wsumQ)) {
+    nawg = true;
+    return NA_REAL;
+  }
+  double wsum = pw[o[0]-1];
+  int k = 1;
+  if(lower) {
+    while(wsum < wsumQ) wsum += pw[o[k++]-1];
+    if(tiesmean && wsum == wsumQ) {
+      double outtmp = px[o[k-1]-1], n = 2;
+      while(pw[o[k]-1] == 0) {
+        outtmp += px[o[k++]-1];
+        ++n;
+      }
+      return (outtmp + px[o[k]-1]) / n;
+    }
+  } else {
+    while(wsum <= wsumQ) wsum += pw[o[k++]-1];
+  }
+  return px[o[k-1]-1];
+}
+
+// Grouped weighted n'th element: instead of scanning a global ordering of x, the (value, weight) pairs of each group are copied
+// to the group's segment of one buffer (see group_starts()) and stably sorted by value within groups, in parallel across
+// groups. Each group is thus scanned in the same order as in the global ordering, giving identical results.
+typedef std::pair<double, double> vwpair;
+
+static void wnth_grouped(double *pout, const double *px, const double *pw, const int *pg, int l, int ng, const std::vector<int>& gst,
+                         std::vector<vwpair>& buf, double Q, bool narm, bool tiesmean, bool lower, int nthreads) {
+  std::vector<int> gcount(ng+1);
+  std::vector<double> wsumQ(ng+1);
+  std::vector<char> gna(ng+1);
+  for(int i = 0; i != l; ++i) {
+    if(isnan2(px[i])) gna[pg[i]] = 1;
+    else {
+      buf[gst[pg[i]] + gcount[pg[i]]++] = vwpair(px[i], pw[i]);
+      wsumQ[pg[i]] += pw[i];
+    }
+  }
+  for(int i = 1; i <= ng; ++i) {
+    if(!narm && gna[i]) continue;
+    if(isnan2(wsumQ[i])) stop("Missing weights in order statistics are currently only supported if x is also missing");
+    wsumQ[i] *= Q;
+  }
+  if(nthreads > ng) nthreads = ng;
+  #pragma omp parallel for num_threads(nthreads)
+  for(int i = 1; i <= ng; ++i) {
+    if(!narm && gna[i]) {
+      pout[i-1] = NA_REAL;
+      continue;
+    }
+    vwpair *v = buf.data() + gst[i];
+    int n = gcount[i];
+    double wsum = 0.0, res = NA_REAL, wQ = wsumQ[i];
+    std::stable_sort(v, v + n, [](const vwpair& a, const vwpair& b) { return a.first < b.first; });
+    if(tiesmean) {
+      for(int k = 0, nt = 1; k != n; ++k) {
+        if(wsum < wQ) res = v[k].first;
+        else {
+          if(wsum > wQ) break;
+          res += (v[k].first - res) / ++nt;
+        }
+        wsum += v[k].second;
+      }
+    } else if(lower) {
+      for(int k = 0; k != n && wsum < wQ; ++k) {
+        wsum += v[k].second;
+        res = v[k].first;
+      }
+    } else {
+      for(int k = 0; k != n && wsum <= wQ; ++k) {
+        wsum += v[k].second;
+        res = v[k].first;
+      }
+      if(gna[i] && wsum <= wQ) res = NA_REAL; // Zero total weight: scanning continues into the missing values
+    }
+    pout[i-1] = res;
+  }
+}
+
 
 //[[Rcpp::export]]
 NumericVector fnthCpp(const NumericVector& x, double Q = 0.5, int ng = 0, const IntegerVector& g = 0,
@@ -70,36 +180,17 @@ NumericVector fnthCpp(const NumericVector& x, double Q = 0.5, int ng = 0, const
       if(l != g.size()) stop("length(g) must match length(x)");
       if(nthreads > ng) nthreads = ng;
       int ngp = ng+1;
-      std::vector<std::vector<double> > gmap(ngp);
-      std::vector<int> gcount(ngp);
-      if(Rf_isNull(gs)) {
-        for(int i = 0; i != l; ++i) ++gcount[g[i]];
-        #pragma omp parallel for num_threads(nthreads)
-        for(int i = 1; i < ngp; ++i) {
-          // if(gcount[i] == 0) stop("Group size of 0 encountered. This is probably because of unused factor levels. Use fdroplevels(f) to drop them.");
-          if(gcount[i] > 0) {
-            gmap[i] = std::vector<double> (gcount[i]);
-            gcount[i] = 0;
-          }
-        }
-      } else {
-        IntegerVector gsv = gs;
-        if(ng != gsv.size()) stop("ng must match length(gs)");
-        #pragma omp parallel for num_threads(nthreads)
-        for(int i = 0; i < ng; ++i) {
-          // if(gsv[i] == 0) stop("Group size of 0 encountered. This is probably because of unused factor levels. Use fdroplevels(f) to drop them.");
-          if(gsv[i] > 0) gmap[i+1] = std::vector<double> (gsv[i]);
-        }
-      }
+      std::vector<int> gst = group_starts(ng, g, gs, l), gcount(ngp);
+      NumericVector gbuf = no_init_vector(gst[ngp]); // Non-missing values of each group, stored contiguously in group order
 
       if(narm) {
         NumericVector out(ng, NA_REAL);
-        for(int i = 0; i != l; ++i) if(nisnan(x[i])) gmap[g[i]][gcount[g[i]]++] = x[i];
+        for(int i = 0; i != l; ++i) if(nisnan(x[i])) gbuf[gst[g[i]] + gcount[g[i]]++] = x[i];
         #pragma omp parallel for num_threads(nthreads)
         for(int i = 1; i < ngp; ++i) {
           if(gcount[i] != 0) {
             int n = gcount[i], nth = lower ? (n-1)*Q : n*Q;
-            auto begin = gmap[i].begin(), mid = begin + nth, end = begin + n;
+            double *begin = gbuf.begin() + gst[i], *mid = begin + nth, *end = begin + n;
             std::nth_element(begin, mid, end);
             out[i-1] = (tiesmean && n%2 == 0) ? (*(mid) + *(std::min_element(mid+1, end)))*0.5 : *(mid);
           }
@@ -118,14 +209,14 @@ NumericVector fnthCpp(const NumericVector& x, double Q = 0.5, int ng = 0, const
               if(ngs == ng) break;
             }
           } else {
-            gmap[g[i]][gcount[g[i]]++] = x[i];
+            gbuf[gst[g[i]] + gcount[g[i]]++] = x[i];
           }
         }
         #pragma omp parallel for num_threads(nthreads)
         for(int i = 0; i < ng; ++i) {
           if(isnan2(out[i]) || gcount[i+1] == 0) continue;
           int n = gcount[i+1], nth = lower ? (n-1)*Q : n*Q;
-          auto begin = gmap[i+1].begin(), mid = begin + nth, end = begin + n;
+          double *begin = gbuf.begin() + gst[i+1], *mid = begin + nth, *end = begin + n;
           std::nth_element(begin, mid, end);
           out[i] = (tiesmean && n%2 == 0) ? (*(mid) + *(std::min_element(mid+1, end)))*0.5 : *(mid);
         }
@@ -137,11 +228,11 @@ NumericVector fnthCpp(const NumericVector& x, double Q = 0.5, int ng = 0, const
   } else { // with weights
     NumericVector wg = w;
     if(l != wg.size()) stop("length(w) must match length(x)");
-    IntegerVector o = no_init_vector(l);
-    int *ord = INTEGER(o);
-    Cdoubleradixsort(ord, TRUE, FALSE, wrap(x)); // starts from 1
 
     if(ng == 0) {
+      IntegerVector o = no_init_vector(l);
+      int *ord = INTEGER(o);
+      Cdoubleradixsort(ord, TRUE, FALSE, wrap(x)); // starts from 1
       double wsumQ = 0, wsum = wg[o[0]-1], res = DBL_MIN;
       int k = 1;
       if(narm) {
@@ -179,66 +270,12 @@ NumericVector fnthCpp(const NumericVector& x, double Q = 0.5, int ng = 0, const
         Rf_copyMostAttrib(x, out);
         return out;
       } else return Rf_ScalarReal(res);
-    } else { // with groups and weights: no efficient parallelism possible...
+    } else { // with groups and weights: sorting within groups, parallel across groups
       if(l != g.size()) stop("length(g) must match length(x)");
-      NumericVector wsumQ(ng), wsum(ng), out(ng, NA_REAL);
-      if(narm) {
-        for(int i = 0; i != l; ++i) if(nisnan(x[i])) wsumQ[g[i]-1] += wg[i]; //  && nisnan(wg[i])
-        for(int i = ng; i--; ) {
-          if(isnan2(wsumQ[i])) stop("Missing weights in order statistics are currently only supported if x is also missing");
-          wsumQ[i] *= Q;
-        }
-      } else {
-        for(int i = 0; i != l; ++i) {
-          if(nisnan(x[i])) {
-            wsumQ[g[i]-1] += wg[i];
-          } else {
-            wsum[g[i]-1] = DBL_MAX; // OK ? // needed ? // = wsumQ[g[i]-1]
-          }
-        }
-        for(int i = ng; i--; ) {
-          if(isnan2(wsumQ[i]) && wsum[i] != DBL_MAX) stop("Missing weights in order statistics are currently only supported if x is also missing");
-          wsumQ[i] *= Q;
-        }
-      }
-      // wsumQ = wsumQ * Q;
-      int gi, oi;
-      if(tiesmean) {
-        std::vector<bool> seen(ng);
-        std::vector<int> n(ng, 1); // only needed for 0 weights. Could check above if there are any.
-        for(int i = 0; i != l; ++i) {
-          oi = o[i]-1;
-          gi = g[oi]-1;
-          if(seen[gi]) continue;
-          if(wsum[gi] < wsumQ[gi]) out[gi] = x[oi];
-          else {
-            if(wsum[gi] > wsumQ[gi]) {
-              seen[gi] = true;
-              continue;
-            }
-            out[gi] += (x[oi]-out[gi])/++n[gi]; // https://stackoverflow.com/questions/28820904/how-to-efficiently-compute-average-on-the-fly-moving-average
-          }
-          wsum[gi] += wg[oi];
-        }
-      } else if(lower) {
-        for(int i = 0; i != l; ++i) {
-          oi = o[i]-1;
-          gi = g[oi]-1;
-          if(wsum[gi] < wsumQ[gi]) {
-            wsum[gi] += wg[oi];
-            out[gi] = x[oi];
-          }
-        }
-      } else {
-        for(int i = 0; i != l; ++i) {
-          oi = o[i]-1;
-          gi = g[oi]-1;
-          if(wsum[gi] <= wsumQ[gi]) {
-            wsum[gi] += wg[oi];
-            out[gi] = x[oi];
-          }
-        }
-      }
+      std::vector<int> gst = group_starts(ng, g, gs, l);
+      std::vector<vwpair> buf(gst[ng+1]);
+      NumericVector out = no_init_vector(ng);
+      wnth_grouped(REAL(out), x.begin(), wg.begin(), g.begin(), l, ng, gst, buf, Q, narm, tiesmean, lower, nthreads);
       if(ATTRIB(x) != R_NilValue && !(Rf_isObject(x) && Rf_inherits(x, "ts")))
         Rf_copyMostAttrib(x, out);
       return out;
@@ -321,24 +358,8 @@ SEXP fnthmCpp(const NumericMatrix& x, double Q = 0.5, int ng = 0, const IntegerV
       if(l != g.size()) stop("length(g) must match nrow(x)");
       if(nthreads > ng) nthreads = ng;
       int ngp = ng+1;
-      std::vector<std::vector<double> > gmap(ngp);
-      std::vector<int> gcount(ngp);
-      if(Rf_isNull(gs)) {
-        for(int i = 0; i != l; ++i) ++gcount[g[i]];
-        #pragma omp parallel for num_threads(nthreads)
-        for(int i = 1; i < ngp; ++i) {
-          // if(gcount[i] == 0) stop("Group size of 0 encountered. This is probably because of unused factor levels. Use fdroplevels(f) to drop them.");
-          if(gcount[i] > 0) gmap[i] = std::vector<double> (gcount[i]);
-        }
-      } else {
-        IntegerVector gsv = gs;
-        if(ng != gsv.size()) stop("ng must match length(gs)");
-        #pragma omp parallel for num_threads(nthreads)
-        for(int i = 0; i < ng; ++i) {
-          // if(gsv[i] == 0) stop("Group size of 0 encountered. This is probably because of unused factor levels. Use fdroplevels(f) to drop them.");
-          if(gsv[i] > 0) gmap[i+1] = std::vector<double> (gsv[i]);
-        }
-      }
+      std::vector<int> gst = group_starts(ng, g, gs, l), gcount(ngp);
+      NumericVector gbuf = no_init_vector(gst[ngp]); // Non-missing values of each group, stored contiguously in group order
 
       if(narm) {
         NumericMatrix out = no_init_matrix(ng, col);
@@ -347,12 +368,12 @@ SEXP fnthmCpp(const NumericMatrix& x, double Q = 0.5, int ng = 0, const IntegerV
           NumericMatrix::ConstColumn column = x( _ , j);
           NumericMatrix::Column nthj = out( _ , j);
           gcount.assign(ngp, 0);
-          for(int i = 0; i != l; ++i) if(nisnan(column[i])) gmap[g[i]][gcount[g[i]]++] = column[i];
+          for(int i = 0; i != l; ++i) if(nisnan(column[i])) gbuf[gst[g[i]] + gcount[g[i]]++] = column[i];
           #pragma omp parallel for num_threads(nthreads)
           for(int i = 1; i < ngp; ++i) {
             if(gcount[i] != 0) {
               int n = gcount[i], nth = lower ? (n-1)*Q : n*Q;
-              auto begin = gmap[i].begin(), mid = begin + nth, end = begin + n;
+              double *begin = gbuf.begin() + gst[i], *mid = begin + nth, *end = begin + n;
               std::nth_element(begin, mid, end);
               nthj[i-1] = (tiesmean && n%2 == 0) ? (*(mid) + *(std::min_element(mid+1, end)))*0.5 : *(mid);
             }
@@ -376,14 +397,14 @@ SEXP fnthmCpp(const NumericMatrix& x, double Q = 0.5, int ng = 0, const IntegerV
                 if(ngs == ng) break;
               }
             } else {
-              gmap[g[i]][gcount[g[i]]++] = column[i];
+              gbuf[gst[g[i]] + gcount[g[i]]++] = column[i];
             }
           }
           #pragma omp parallel for num_threads(nthreads)
           for(int i = 0; i < ng; ++i) {
             if(isnan2(nthj[i]) || gcount[i+1] == 0) continue;
             int n = gcount[i+1], nth = lower ? (n-1)*Q : n*Q;
-            auto begin = gmap[i+1].begin(), mid = begin + nth, end = begin + n;
+            double *begin = gbuf.begin() + gst[i+1], *mid = begin + nth, *end = begin + n;
             std::nth_element(begin, mid, end);
             nthj[i] = (tiesmean && n%2 == 0) ? (*(mid) + *(std::min_element(mid+1, end)))*0.5 : *(mid);
           }
@@ -396,57 +417,37 @@ SEXP fnthmCpp(const NumericMatrix& x, double Q = 0.5, int ng = 0, const IntegerV
   } else { // with weights
     NumericVector wg = w;
     if(l != wg.size()) stop("length(w) must match nrow(x)");
-    IntegerVector o = no_init_vector(l);
-    int *ord = INTEGER(o);
 
     if(ng == 0) {
       NumericVector out = no_init_vector(col);
-      double wsumQ = 0;
+      double wsumQ = 0, *pout = REAL(out);
+      const double *px = x.begin(), *pw = wg.begin();
+      bool nawg = false;
       if(!narm) {
         wsumQ = std::accumulate(wg.begin(), wg.end(), 0.0) * Q;
-        if(isnan2(wsumQ)) {
-          stop("Missing weights in order statistics are currently only supported if x is also missing");
-          // std::fill(out.begin(), out.end(), NA_REAL);
-          // goto outnth;
-        }
+        if(isnan2(wsumQ)) stop("Missing weights in order statistics are currently only supported if x is also missing");
       }
-      for(int j = col; j--; ) {
-        NumericMatrix::ConstColumn column = x( _ , j);
-        Cdoubleradixsort(ord, TRUE, FALSE, wrap(column)); // starts from 1....
-        if(narm) {
-          wsumQ = 0;
-          for(int i = 0; i != l; ++i) if(nisnan(column[i])) wsumQ += wg[i]; //  && nisnan(wg[i])
-          if(wsumQ == 0) {
-            out[j] = NA_REAL;
-            continue;
-          }
-          if(isnan2(wsumQ)) stop("Missing weights in order statistics are currently only supported if x is also missing");
-          wsumQ *= Q;
-        } else {
-          if(isnan2(column[o[l-1]-1])) {
-            out[j] = NA_REAL;
-            continue;
-          }
+      if(nthreads > 1 && col > 1) { // Each thread orders columns with its own radix sort context and ordering buffer, allocated up front
+        if(nthreads > col) nthreads = col;
+        std::vector<radix_ctx> ctx(nthreads);
+        std::vector<int> o((size_t)nthreads * l);
+        for(int t = 0; t != nthreads; ++t) radix_ctx_init(&ctx[t], l);
+        #pragma omp parallel for num_threads(nthreads) reduction(||:nawg)
+        for(int j = 0; j < col; ++j) {
+          int t = omp_get_thread_num(), *ot = o.data() + (size_t)t*l;
+          radix_order_ctx(&ctx[t], ot, px + (size_t)j*l, l, REALSXP, TRUE, FALSE);
+          pout[j] = wnth_ordered(px + (size_t)j*l, pw, ot, l, wsumQ, Q, narm, tiesmean, lower, nawg);
         }
-        double wsum = wg[o[0]-1];
-        int k = 1; // what about all missing ? -> gives dsort error...
-
-        if(lower) {
-          while(wsum < wsumQ) wsum += wg[o[k++]-1];
-          if(tiesmean && wsum == wsumQ) {
-            double outtmp = column[o[k-1]-1], n = 2;
-            while(wg[o[k]-1] == 0) {
-              outtmp += column[o[k++]-1];
-              ++n;
-            }
-            out[j] = (outtmp + column[o[k]-1]) / n;
-            continue;
-          }
-        } else {
-          while(wsum <= wsumQ) wsum += wg[o[k++]-1];
+        for(int t = 0; t != nthreads; ++t) radix_ctx_free(&ctx[t]);
+      } else {
+        IntegerVector o = no_init_vector(l);
+        int *ord = INTEGER(o);
+        for(int j = col; j--; ) {
+          Cdoubleradixsort(ord, TRUE, FALSE, wrap(x( _ , j))); // starts from 1....
+          pout[j] = wnth_ordered(px + (size_t)j*l, pw, ord, l, wsumQ, Q, narm, tiesmean, lower, nawg);
         }
-        out[j] = column[o[k-1]-1];
       }
+      if(nawg) stop("Missing weights in order statistics are currently only supported if x is also missing");
       // outnth:
       if(drop) Rf_setAttrib(out, R_NamesSymbol, colnames(x));
       else {
@@ -455,70 +456,13 @@ SEXP fnthmCpp(const NumericMatrix& x, double Q = 0.5, int ng = 0, const IntegerV
         if(!Rf_isObject(x)) Rf_copyMostAttrib(x, out);
       }
       return out;
-    } else { // with groups and weights
+    } else { // with groups and weights: sorting within groups, parallel across groups
       if(l != g.size()) stop("length(g) must match nrow(x)");
-      int gi, oi;
+      std::vector<int> gst = group_starts(ng, g, gs, l);
+      std::vector<vwpair> buf(gst[ng+1]);
       NumericMatrix out = no_init_matrix(ng, col);
-      std::fill(out.begin(), out.end(), NA_REAL);
-      NumericVector wsumQ(ng);
-      if(!narm) {
-        for(int i = 0; i != l; ++i) wsumQ[g[i]-1] += wg[i];
-        wsumQ = wsumQ * Q;
-      }
-      for(int j = col; j--; ) {
-        NumericMatrix::ConstColumn column = x( _ , j);
-        NumericMatrix::Column nthj = out( _ , j);
-        Cdoubleradixsort(ord, TRUE, FALSE, wrap(column));
-        NumericVector wsum(ng);
-        if(narm) {
-          std::fill(wsumQ.begin(), wsumQ.end(), 0.0);
-          for(int i = 0; i != l; ++i) if(nisnan(column[i])) wsumQ[g[i]-1] += wg[i]; //  && nisnan(wg[i])
-          for(int i = ng; i--; ) {
-            if(isnan2(wsumQ[i])) stop("Missing weights in order statistics are currently only supported if x is also missing");
-            wsumQ[i] *= Q;
-          }
-        } else {
-          for(int i = 0; i != l; ++i) if(isnan2(column[i])) wsum[g[i]-1] = DBL_MAX; // OK ?? // needed??
-          for(int i = ng; i--; ) if(isnan2(wsumQ[i]) && wsum[i] != DBL_MAX) stop("Missing weights in order statistics are currently only supported if x is also missing");
-        }
-
-        if(tiesmean) {
-          std::vector<bool> seen(ng);
-          std::vector<int> n(ng, 1); // only needed for 0 weights. Could check above if there are any.
-          for(int i = 0; i != l; ++i) {
-            oi = o[i]-1;
-            gi = g[oi]-1;
-            if(seen[gi]) continue;
-            if(wsum[gi] < wsumQ[gi]) nthj[gi] = column[oi];
-            else {
-              if(wsum[gi] > wsumQ[gi]) {
-                seen[gi] = true;
-                continue;
-              }
-              nthj[gi] += (column[oi]-nthj[gi])/++n[gi];
-            }
-            wsum[gi] += wg[oi];
-          }
-        } else if(lower) {
-          for(int i = 0; i != l; ++i) {
-            oi = o[i]-1;
-            gi = g[oi]-1;
-            if(wsum[gi] < wsumQ[gi]) {
-              wsum[gi] += wg[oi];
-              nthj[gi] = column[oi];
-            }
-          }
-        } else {
-          for(int i = 0; i != l; ++i) {
-            oi = o[i]-1;
-            gi = g[oi]-1;
-            if(wsum[gi] <= wsumQ[gi]) {
-              wsum[gi] += wg[oi];
-              nthj[gi] = column[oi];
-            }
-          }
-        }
-      }
+      for(int j = 0; j != col; ++j)
+        wnth_grouped(out.begin() + (size_t)j*ng, x.begin() + (size_t)j*l, wg.begin(), g.begin(), l, ng, gst, buf, Q, narm, tiesmean, lower, nthreads);
       colnames(out) = colnames(x);
       if(!Rf_isObject(x)) Rf_copyMostAttrib(x, out);
       return out;
@@ -629,36 +573,20 @@ SEXP fnthlCpp(const List& x, double Q = 0.5, int ng = 0, const IntegerVector& g
       if(nthreads > ng) nthreads = ng;
       List out(l);
       int ngp = ng+1;
-      std::vector<std::vector<double> > gmap(ngp);
-      std::vector<int> gcount(ngp);
-      if(Rf_isNull(gs)) {
-        for(int i = 0; i != lx1; ++i) ++gcount[g[i]];
-        #pragma omp parallel for num_threads(nthreads)
-        for(int i = 1; i < ngp; ++i) {
-          // if(gcount[i] == 0) stop("Group size of 0 encountered. This is probably because of unused factor levels. Use fdroplevels(f) to drop them.");
-          if(gcount[i] > 0) gmap[i] = std::vector<double> (gcount[i]);
-        }
-      } else {
-        IntegerVector gsv = gs;
-        if(ng != gsv.size()) stop("ng must match length(gs)");
-        #pragma omp parallel for num_threads(nthreads)
-        for(int i = 0; i < ng; ++i) {
-          // if(gsv[i] == 0) stop("Group size of 0 encountered. This is probably because of unused factor levels. Use fdroplevels(f) to drop them.");
-          if(gsv[i] > 0) gmap[i+1] = std::vector<double> (gsv[i]);
-        }
-      }
+      std::vector<int> gst = group_starts(ng, g, gs, lx1), gcount(ngp);
+      NumericVector gbuf = no_init_vector(gst[ngp]); // Non-missing values of each group, stored contiguously in group order
       if(narm) {
         for(int j = l; j--; ) {
           NumericVector column = x[j];
           NumericVector nthj(ng, NA_REAL);
           if(lx1 != column.size()) stop("length(g) must match nrow(x)");
           gcount.assign(ngp, 0);
-          for(int i = 0; i != lx1; ++i) if(nisnan(column[i])) gmap[g[i]][gcount[g[i]]++] = column[i];
+          for(int i = 0; i != lx1; ++i) if(nisnan(column[i])) gbuf[gst[g[i]] + gcount[g[i]]++] = column[i];
           #pragma omp parallel for num_threads(nthreads)
           for(int i = 1; i < ngp; ++i) {
             if(gcount[i] != 0) {
               int n = gcount[i], nth = lower ? (n-1)*Q : n*Q;
-              auto begin = gmap[i].begin(), mid = begin + nth, end = begin + n;
+              double *begin = gbuf.begin() + gst[i], *mid = begin + nth, *end = begin + n;
               std::nth_element(begin, mid, end);
               nthj[i-1] = (tiesmean && n%2 == 0) ? (*(mid) + *(std::min_element(mid+1, end)))*0.5 : *(mid);
             }
@@ -681,14 +609,14 @@ SEXP fnthlCpp(const List& x, double Q = 0.5, int ng = 0, const IntegerVector& g
                 if(ngs == ng) break;
               }
             } else {
-              gmap[g[i]][gcount[g[i]]++] = column[i];
+              gbuf[gst[g[i]] + gcount[g[i]]++] = column[i];
             }
           }
           #pragma omp parallel for num_threads(nthreads)
           for(int i = 0; i < ng; ++i) {
             if(isnan2(nthj[i]) || gcount[i+1] == 0) continue;
             int n = gcount[i+1], nth = lower ? (n-1)*Q : n*Q;
-            auto begin = gmap[i+1].begin(), mid = begin + nth, end = begin + n;
+            double *begin = gbuf.begin() + gst[i+1], *mid = begin + nth, *end = begin + n;
             std::nth_element(begin, mid, end);
             nthj[i] = (tiesmean && n%2 == 0) ? (*(mid) + *(std::min_element(mid+1, end)))*0.5 : *(mid);
           }
@@ -703,58 +631,43 @@ SEXP fnthlCpp(const List& x, double Q = 0.5, int ng = 0, const IntegerVector& g
   } else { // with weights
     NumericVector wg = w;
     if(lx1 != wg.size()) stop("length(w) must match nrow(x)");
-    IntegerVector o = no_init_vector(lx1);
-    int *ord = INTEGER(o);
+    List xd(l); // Columns coerced to double beforehand, needed with multithreading
+    for(int j = 0; j != l; ++j) {
+      xd[j] = Rf_coerceVector(x[j], REALSXP);
+      if(lx1 != Rf_length(xd[j])) stop("length(w) must match nrow(x)");
+    }
+    const double *pw = wg.begin();
 
     if(ng == 0) {
       NumericVector out = no_init_vector(l);
-      double wsumQ = 0;
+      double wsumQ = 0, *pout = REAL(out);
+      bool nawg = false;
       if(!narm) {
         wsumQ = std::accumulate(wg.begin(), wg.end(), 0.0) * Q;
-        if(isnan2(wsumQ)) {
-          stop("Missing weights in order statistics are currently only supported if x is also missing");
-          // std::fill(out.begin(), out.end(), NA_REAL);
-          // goto outnth;
-        }
+        if(isnan2(wsumQ)) stop("Missing weights in order statistics are currently only supported if x is also missing");
       }
-      for(int j = l; j--; ) {
-        NumericVector column = x[j];
-        if(lx1 != column.size()) stop("length(w) must match nrow(x)");
-        Cdoubleradixsort(ord, TRUE, FALSE, wrap(column)); // starts from 1
-        if(narm) {
-          wsumQ = 0;
-          for(int i = 0; i != lx1; ++i) if(nisnan(column[i])) wsumQ += wg[i]; //  && nisnan(wg[i])
-          if(wsumQ == 0) {
-            out[j] = NA_REAL;
-            continue;
-          }
-          if(isnan2(wsumQ)) stop("Missing weights in order statistics are currently only supported if x is also missing");
-          wsumQ *= Q;
-        } else {
-          if(isnan2(column[o[lx1-1]-1])) {
-            out[j] = NA_REAL;
-            continue;
-          }
-        }
-        double wsum = wg[o[0]-1];
-        int k = 1; // what about all missing ? -> gives dsort error...
-
-        if(lower) {
-          while(wsum < wsumQ) wsum += wg[o[k++]-1];
-          if(tiesmean && wsum == wsumQ) {
-            double outtmp = column[o[k-1]-1], n = 2;
-            while(wg[o[k]-1] == 0) {
-              outtmp += column[o[k++]-1];
-              ++n;
-            }
-            out[j] = (outtmp + column[o[k]-1]) / n;
-            continue;
-          }
-        } else {
-          while(wsum <= wsumQ) wsum += wg[o[k++]-1];
+      if(nthreads > 1 && l > 1) { // Each thread orders columns with its own radix sort context and ordering buffer, allocated up front
+        if(nthreads > l) nthreads = l;
+        std::vector<radix_ctx> ctx(nthreads);
+        std::vector<int> o((size_t)nthreads * lx1);
+        for(int t = 0; t != nthreads; ++t) radix_ctx_init(&ctx[t], lx1);
+        #pragma omp parallel for num_threads(nthreads) reduction(||:nawg)
+        for(int j = 0; j < l; ++j) {
+          const double *px = REAL(VECTOR_ELT(xd, j));
+          int t = omp_get_thread_num(), *ot = o.data() + (size_t)t*lx1;
+          radix_order_ctx(&ctx[t], ot, px, lx1, REALSXP, TRUE, FALSE);
+          pout[j] = wnth_ordered(px, pw, ot, lx1, wsumQ, Q, narm, tiesmean, lower, nawg);
+        }
+        for(int t = 0; t != nthreads; ++t) radix_ctx_free(&ctx[t]);
+      } else {
+        IntegerVector o = no_init_vector(lx1);
+        int *ord = INTEGER(o);
+        for(int j = l; j--; ) {
+          Cdoubleradixsort(ord, TRUE, FALSE, xd[j]); // starts from 1
+          pout[j] = wnth_ordered(REAL(xd[j]), pw, ord, lx1, wsumQ, Q, narm, tiesmean, lower, nawg);
         }
-        out[j] = column[o[k-1]-1];
       }
+      if(nawg) stop("Missing weights in order statistics are currently only supported if x is also missing");
       // outnth:
       if(drop) {
         Rf_setAttrib(out, R_NamesSymbol, Rf_getAttrib(x, R_NamesSymbol));
@@ -769,68 +682,15 @@ SEXP fnthlCpp(const List& x, double Q = 0.5, int ng = 0, const IntegerVector& g
         Rf_setAttrib(outl, R_RowNamesSymbol, Rf_ScalarInteger(1));
         return outl;
       }
-    } else { // with groups and weights
+    } else { // with groups and weights: sorting within groups, parallel across groups
       if(lx1 != g.size()) stop("length(w) must match length(g)");
-      int gi, oi;
+      std::vector<int> gst = group_starts(ng, g, gs, lx1);
+      std::vector<vwpair> buf(gst[ng+1]);
       List out(l);
-      NumericVector wsumQ(ng);
-      if(!narm) {
-        for(int i = 0; i != lx1; ++i) wsumQ[g[i]-1] += wg[i];
-        wsumQ = wsumQ * Q;
-      }
-      for(int j = l; j--; ) {
-        NumericVector column = x[j];
-        if(lx1 != column.size()) stop("length(w) must match nrow(x)");
-        Cdoubleradixsort(ord, TRUE, FALSE, wrap(column));
-        NumericVector wsum(ng), nthj(ng, NA_REAL);
-        if(narm) {
-          std::fill(wsumQ.begin(), wsumQ.end(), 0.0);
-          for(int i = 0; i != lx1; ++i) if(nisnan(column[i])) wsumQ[g[i]-1] += wg[i]; //  && nisnan(wg[i])
-          for(int i = ng; i--; ) {
-            if(isnan2(wsumQ[i])) stop("Missing weights in order statistics are currently only supported if x is also missing");
-            wsumQ[i] *= Q;
-          }
-        } else {
-          for(int i = 0; i != lx1; ++i) if(isnan2(column[i])) wsum[g[i]-1] = DBL_MAX; // OK ?? // needed??
-          for(int i = ng; i--; ) if(isnan2(wsumQ[i]) && wsum[i] != DBL_MAX) stop("Missing weights in order statistics are currently only supported if x is also missing");
-        }
-
-        if(tiesmean) {
-          std::vector<bool> seen(ng);
-          std::vector<int> n(ng, 1); // only needed for 0 weights. Could check above if there are any.
-          for(int i = 0; i != lx1; ++i) {
-            oi = o[i]-1;
-            gi = g[oi]-1;
-            if(seen[gi]) continue;
-            if(wsum[gi] < wsumQ[gi]) nthj[gi] = column[oi];
-            else {
-              if(wsum[gi] > wsumQ[gi]) {
-                seen[gi] = true;
-                continue;
-              }
-              nthj[gi] += (column[oi]-nthj[gi])/++n[gi];
-            }
-            wsum[gi] += wg[oi];
-          }
-        } else if(lower) {
-          for(int i = 0; i != lx1; ++i) {
-            oi = o[i]-1;
-            gi = g[oi]-1;
-            if(wsum[gi] < wsumQ[gi]) {
-              wsum[gi] += wg[oi];
-              nthj[gi] = column[oi];
-            }
-          }
-        } else {
-          for(int i = 0; i != lx1; ++i) {
-            oi = o[i]-1;
-            gi = g[oi]-1;
-            if(wsum[gi] <= wsumQ[gi]) {
-              wsum[gi] += wg[oi];
-              nthj[gi] = column[oi];
-            }
-          }
-        }
+      for(int j = 0; j != l; ++j) {
+        SEXP column = x[j];
+        NumericVector nthj = no_init_vector(ng);
+        wnth_grouped(REAL(nthj), REAL(xd[j]), pw, g.begin(), lx1, ng, gst, buf, Q, narm, tiesmean, lower, nthreads);
         SHALLOW_DUPLICATE_ATTRIB(nthj, column);
         out[j] = nthj;
       }
@@ -840,3 +700,230 @@ SEXP fnthlCpp(const List& x, double Q = 0.5, int ng = 0, const IntegerVector& g
     }
   }
 }
+
+
+// Approximate quantiles using t-digests ---------------------------------------
+// A t-digest (Dunning & Ertl, 2019) summarises a distribution by weighted centroids which are small in the tails and larger
+// in the middle (scale function k1, compression delta), so memory per group is bounded by about 7*delta centroids
+// (including a buffer of 5*delta unmerged values) irrespective of the group size. Groups with fewer than about delta/2
+// values are stored exactly. Digests of different chunks of the data can be merged.
+
+struct centroid { double mean, weight; };
+
+struct tdigest {
+  std::vector<centroid> c; // Compressed centroids (first nc), followed by buffered values
+  int nc = 0;
+  double min = R_PosInf, max = R_NegInf;
+
+  void add(double x, double w, double delta) {
+    if(x < min) min = x;
+    if(x > max) max = x;
+    c.push_back({x, w});
+    if(c.size() >= nc + 5*delta) compress(delta);
+  }
+
+  void compress(double delta) {
+    if((int)c.size() == nc) return;
+    std::sort(c.begin(), c.end(), [](const centroid& a, const centroid& b) { return a.mean < b.mean; });
+    double total = 0.0, wsofar = 0.0, qlimit;
+    for(const centroid& ci : c) total += ci.weight;
+    const double step = 2 * M_PI / delta; // k1(q) = delta/(2*pi) * asin(2q-1): a centroid may span one unit of k
+    auto limit = [step](double q0) { double k = asin(2*q0-1) + step; return k >= M_PI_2 ? 1.0 : (sin(k) + 1) * 0.5; };
+    qlimit = limit(0.0);
+    size_t k = 0;
+    for(size_t i = 1; i < c.size(); ++i) {
+      if((wsofar + c[k].weight + c[i].weight) / total <= qlimit) {
+        c[k].weight += c[i].weight;
+        c[k].mean += (c[i].mean - c[k].mean) * c[i].weight / c[k].weight;
+      } else {
+        wsofar += c[k].weight;
+        qlimit = limit(wsofar / total);
+        c[++k] = c[i];
+      }
+    }
+    c.resize(k+1);
+    c.shrink_to_fit();
+    nc = k+1;
+  }
+
+  void merge(const tdigest& d, double delta) {
+    if(ISNAN(d.min) || ISNAN(min)) {
+      setNA();
+      return;
+    }
+    if(d.min < min) min = d.min;
+    if(d.max > max) max = d.max;
+    c.insert(c.end(), d.c.begin(), d.c.end());
+    compress(delta);
+  }
+
+  void setNA() {
+    min = max = NA_REAL;
+    c.clear();
+    c.shrink_to_fit();
+    nc = 0;
+  }
+
+  // Interpolates between centroid centers (and min / max in the tails). With unit weight centroids this gives
+  // exact medians (averaging the two middle values for even sizes, as fmedian).
+  double quantile(double q) const { // digest must be compressed
+    int n = c.size();
+    if(ISNAN(min) || n == 0) return NA_REAL;
+    if(n == 1) return c[0].mean;
+    double total = 0.0;
+    for(const centroid& ci : c) total += ci.weight;
+    double t = q * total, cum = 0.0;
+    if(t < c[0].weight * 0.5) return min + (c[0].mean - min) * t / (c[0].weight * 0.5);
+    for(int i = 0; i != n-1; ++i) {
+      double ci = cum + c[i].weight * 0.5, cn = cum + c[i].weight + c[i+1].weight * 0.5;
+      if(t <= cn) return c[i].mean + (c[i+1].mean - c[i].mean) * (t - ci) / (cn - ci);
+      cum += c[i].weight;
+    }
+    double cl = total - c[n-1].weight * 0.5;
+    return c[n-1].mean + (max - c[n-1].mean) * (t - cl) / (c[n-1].weight * 0.5);
+  }
+};
+
+// Builds compressed digests for ng groups (or one digest if ng = 0). Threads work on chunks of rows with their own digests
+// which are subsequently merged, so multithreading is only used if there are enough rows per group.
+static std::vector<tdigest> tdigest_build(const NumericVector& x, int ng, const IntegerVector& g, const SEXP& w, bool narm, double delta, int nthreads) {
+  int l = x.size(), ngr = ng == 0 ? 1 : ng;
+  if(ng > 0 && l != g.size()) stop("length(g) must match length(x)");
+  if(!Rf_isNull(w) && Rf_length(w) != l) stop("length(w) must match length(x)");
+  if(delta < 10 || delta > 1e6) stop("compression needs to be between 10 and 1e6");
+  if((double)ngr * nthreads * 100 > l) nthreads = std::max(1, (int)(l / ((double)ngr * 100))); // At least 100 rows per group and thread
+  std::vector<tdigest> d((size_t)ngr * nthreads);
+  NumericVector wv = Rf_isNull(w) ? NumericVector(0) : NumericVector(w);
+  const double *pw = Rf_isNull(w) ? NULL : wv.begin();
+  const int *pg = ng == 0 ? NULL : INTEGER(g);
+  bool nawg = false;
+
+  #pragma omp parallel for num_threads(nthreads) reduction(||:nawg)
+  for(int t = 0; t < nthreads; ++t) {
+    tdigest *dt = &d[(size_t)t * ngr];
+    int end = (int)((double)l * (t+1) / nthreads);
+    for(int i = (int)((double)l * t / nthreads); i < end; ++i) {
+      tdigest& di = dt[pg ? pg[i]-1 : 0];
+      if(isnan2(x[i])) {
+        if(!narm && nisnan(di.min)) di.setNA();
+        continue;
+      }
+      if(ISNAN(di.min)) continue;
+      if(pw) {
+        if(isnan2(pw[i])) {
+          nawg = true;
+          continue;
+        }
+        if(pw[i] <= 0) continue;
+        di.add(x[i], pw[i], delta);
+      } else di.add(x[i], 1.0, delta);
+    }
+  }
+  if(nawg) stop("Missing weights in order statistics are currently only supported if x is also missing");
+
+  #pragma omp parallel for num_threads(nthreads)
+  for(int i = 0; i < ngr; ++i) {
+    d[i].compress(delta);
+    for(int t = 1; t < nthreads; ++t) d[i].merge(d[(size_t)t * ngr + i], delta);
+  }
+  d.resize(ngr);
+  return d;
+}
+
+// Sketch object: centroid means and weights of all groups, the number of centroids per group, and group minima and maxima (NA if
+// the group contains missing values and na.rm = FALSE)
+static List tdigest_list(const std::vector<tdigest>& d, double delta) {
+  int ng = d.size();
+  R_xlen_t nc = 0;
+  for(const tdigest& di : d) nc += di.c.size();
+  NumericVector mean = no_init_vector(nc), weight = no_init_vector(nc), mi = no_init_vector(ng), ma = no_init_vector(ng);
+  IntegerVector size = no_init_vector(ng);
+  R_xlen_t k = 0;
+  for(int i = 0; i != ng; ++i) {
+    for(const centroid& ci : d[i].c) {
+      mean[k] = ci.mean;
+      weight[k++] = ci.weight;
+    }
+    size[i] = d[i].c.size();
+    mi[i] = d[i].min;
+    ma[i] = d[i].max;
+  }
+  List res = List::create(_["mean"] = mean, _["weight"] = weight, _["size"] = size, _["min"] = mi, _["max"] = ma);
+  res.attr("compression") = delta;
+  return res;
+}
+
+static std::vector<tdigest> tdigest_from_list(const List& x) {
+  NumericVector mean = x["mean"], weight = x["weight"], mi = x["min"], ma = x["max"];
+  IntegerVector size = x["size"];
+  int ng = size.size();
+  if(mi.size() != ng || ma.size() != ng || mean.size() != weight.size()) stop("invalid t-digest sketch");
+  std::vector<tdigest> d(ng);
+  R_xlen_t k = 0;
+  for(int i = 0; i != ng; ++i) {
+    if(k + size[i] > mean.size()) stop("invalid t-digest sketch");
+    d[i].c.resize(size[i]);
+    for(int j = 0; j != size[i]; ++j, ++k) d[i].c[j] = {mean[k], weight[k]};
+    d[i].nc = size[i];
+    d[i].min = mi[i];
+    d[i].max = ma[i];
+  }
+  return d;
+}
+
+//[[Rcpp::export]]
+NumericVector fnthtdigestCpp(const NumericVector& x, double Q = 0.5, int ng = 0, const IntegerVector& g = 0,
+                             const SEXP& w = R_NilValue, bool narm = true, double delta = 100, int nthreads = 1) {
+  int l = x.size();
+  if(l < 1) return x;
+  if(Q <= 0 || Q == 1) stop("n needs to be between 0 and 1, or between 1 and length(x). Use fmin and fmax for minima and maxima.");
+  if(Q > 1) {
+    int n = ng == 0 ? l : l/ng;
+    if(Q >= n) stop("n needs to be between 0 and 1, or between 1 and the length(x)/ng, with ng the number of groups. Use fmin and fmax for minima and maxima.");
+    Q = (Q-1)/(n-1);
+  }
+  std::vector<tdigest> d = tdigest_build(x, ng, g, w, narm, delta, nthreads);
+  int ngr = d.size();
+  NumericVector out = no_init_vector(ngr);
+  for(int i = 0; i != ngr; ++i) out[i] = d[i].quantile(Q);
+  if(ATTRIB(x) != R_NilValue && !(Rf_isObject(x) && Rf_inherits(x, "ts")))
+    Rf_copyMostAttrib(x, out);
+  return out;
+}
+
+//[[Rcpp::export]]
+List tdigestCpp(const NumericVector& x, int ng = 0, const IntegerVector& g = 0, const SEXP& w = R_NilValue,
+                bool narm = true, double delta = 100, int nthreads = 1) {
+  return tdigest_list(tdigest_build(x, ng, g, w, narm, delta, nthreads), delta);
+}
+
+// Merges groups ia of a with groups ib of b (NA = no group)
+//[[Rcpp::export]]
+List tdigestmergeCpp(const List& a, const List& b, const IntegerVector& ia, const IntegerVector& ib, double delta = 100) {
+  std::vector<tdigest> da = tdigest_from_list(a), db = tdigest_from_list(b), res(ia.size());
+  int na = da.size(), nb = db.size();
+  if(ia.size() != ib.size()) stop("length(ia) must match length(ib)");
+  for(int i = 0; i != ia.size(); ++i) {
+    if(ia[i] != NA_INTEGER) {
+      if(ia[i] < 1 || ia[i] > na) stop("ia out of range");
+      res[i] = da[ia[i]-1];
+    }
+    if(ib[i] != NA_INTEGER) {
+      if(ib[i] < 1 || ib[i] > nb) stop("ib out of range");
+      res[i].merge(db[ib[i]-1], delta);
+    }
+  }
+  return tdigest_list(res, delta);
+}
+
+// Quantiles probs (columns) of each group (rows) of a sketch
+//[[Rcpp::export]]
+NumericMatrix tdigestquantileCpp(const List& x, const NumericVector& probs) {
+  std::vector<tdigest> d = tdigest_from_list(x);
+  int ng = d.size(), np = probs.size();
+  for(int j = 0; j != np; ++j) if(!(probs[j] >= 0 && probs[j] <= 1)) stop("probs need to be between 0 and 1");
+  NumericMatrix out = no_init_matrix(ng, np);
+  for(int j = 0; j != np; ++j)
+    for(int i = 0; i != ng; ++i) out(i, j) = d[i].quantile(probs[j]);
+  return out;
+}
@@ -88,7 +88,7 @@ double fprod_int_impl(int *px, int narm, int l) {
     int j = l-1;
     while(px[j] == NA_INTEGER && j!=0) --j;
     prod = px[j];
-    if(j == 0 && (l > 1 || px[j] == NA_INTEGER)) return NA_REAL;
+    if(j == 0 && px[j] == NA_INTEGER) return NA_REAL;
     for(int i = j; i--; ) if(px[i] != NA_INTEGER) prod *= px[i];
   } else {
     prod = 1;
@@ -113,7 +113,44 @@ void fprod_int_g_impl(double *pout, int *px, int ng, int *pg, int narm, int l) {
   } else {
     for(int i = ng; i--; ) pout[i] = 1.0;
     --pout;
-    for(int i = l; i--; ) pout[pg[i]] *= px[i]; // Used to stop loop when all groups passed with NA, but probably no speed gain since groups are mostly ordered.
+    for(int i = l; i--; ) pout[pg[i]] *= px[i] == NA_INTEGER ? NA_REAL : px[i];
+  }
+}
+
+// Sorted groups (see gseg_starts()): products over the contiguous rows of each group, multiplied in the same (reverse) order
+// as the scatter kernels above. pw (weights) is optional.
+static void fprod_double_seg_impl(double *restrict pout, const double *restrict px, const double *restrict pw, const int ng, const int *restrict starts, const int narm) {
+  for(int gr = 0; gr != ng; ++gr) {
+    const int s = starts[gr];
+    double prod = narm ? NA_REAL : 1.0;
+    if(narm) {
+      for(int i = starts[gr+1]; i-- != s; ) {
+        if(ISNAN(px[i]) || (pw && ISNAN(pw[i]))) continue;
+        const double xi = pw ? px[i] * pw[i] : px[i];
+        prod = ISNAN(prod) ? xi : prod * xi;
+      }
+    } else if(pw) {
+      for(int i = starts[gr+1]; i-- != s; ) prod *= px[i] * pw[i];
+    } else {
+      for(int i = starts[gr+1]; i-- != s; ) prod *= px[i];
+    }
+    pout[gr] = prod;
+  }
+}
+
+static void fprod_int_seg_impl(double *restrict pout, const int *restrict px, const int ng, const int *restrict starts, const int narm) {
+  for(int gr = 0; gr != ng; ++gr) {
+    const int s = starts[gr];
+    double prod = narm ? NA_REAL : 1.0;
+    for(int i = starts[gr+1]; i-- != s; ) {
+      if(px[i] == NA_INTEGER) {
+        if(narm) continue;
+        prod = NA_REAL;
+        break;
+      }
+      prod = ISNAN(prod) ? (double)px[i] : prod * px[i];
+    }
+    pout[gr] = prod;
   }
 }
 
@@ -125,8 +162,13 @@ SEXP fprodC(SEXP x, SEXP Rng, SEXP g, SEXP w, SEXP Rnarm) {
   if(ng && l != length(g)) error("length(g) must match length(x)");
   if(tx == LGLSXP) tx = INTSXP;
   SEXP out = PROTECT(allocVector(REALSXP, ng == 0 ? 1 : ng));
+  int *starts = NULL;
   if(isNull(w)) {
-    switch(tx) {
+    if(ng > 0 && (tx == REALSXP || tx == INTSXP) && (starts = gseg_starts(INTEGER(g), ng, l))) { // Sorted groups: segmented products
+      if(tx == REALSXP) fprod_double_seg_impl(REAL(out), REAL(x), NULL, ng, starts, narm);
+      else fprod_int_seg_impl(REAL(out), INTEGER(x), ng, starts, narm);
+      Free(starts);
+    } else switch(tx) {
       case REALSXP: fprod_double_impl(REAL(out), REAL(x), ng, INTEGER(g), narm, l);
         break;
       case INTSXP: {
@@ -153,7 +195,10 @@ SEXP fprodC(SEXP x, SEXP Rng, SEXP g, SEXP w, SEXP Rnarm) {
       px = REAL(xr);
       ++nprotect;
     } else px = REAL(x);
-    fprod_weights_impl(REAL(out), px, ng, INTEGER(g), pw, narm, l);
+    if(ng > 0 && (starts = gseg_starts(INTEGER(g), ng, l))) {
+      fprod_double_seg_impl(REAL(out), px, pw, ng, starts, narm);
+      Free(starts);
+    } else fprod_weights_impl(REAL(out), px, ng, INTEGER(g), pw, narm, l);
   }
   if(ATTRIB(x) != R_NilValue && !(isObject(x) && inherits(x, "ts")))
     copyMostAttrib(x, out); // For example "Units" objects...
@@ -172,8 +217,18 @@ SEXP fprodmC(SEXP x, SEXP Rng, SEXP g, SEXP w, SEXP Rnarm, SEXP Rdrop) {
   if(tx == LGLSXP) tx = INTSXP;
   SEXP out = PROTECT(allocVector(REALSXP, ng == 0 ? col : col * ng));
   double *pout = REAL(out);
+  int *starts = NULL;
   if(isNull(w)) {
-    switch(tx) {
+    if(ng > 0 && (tx == REALSXP || tx == INTSXP) && (starts = gseg_starts(pg, ng, l))) { // Sorted groups: segmented products
+      if(tx == REALSXP) {
+        double *px = REAL(x);
+        for(int j = 0; j != col; ++j) fprod_double_seg_impl(pout + j*ng, px + j*l, NULL, ng, starts, narm);
+      } else {
+        int *px = INTEGER(x);
+        for(int j = 0; j != col; ++j) fprod_int_seg_impl(pout + j*ng, px + j*l, ng, starts, narm);
+      }
+      Free(starts);
+    } else switch(tx) {
       case REALSXP: {
         double *px = REAL(x);
         for(int j = 0; j != col; ++j) fprod_double_impl(pout + j*ng1, px + j*l, ng, pg, narm, l);
@@ -207,7 +262,12 @@ SEXP fprodmC(SEXP x, SEXP Rng, SEXP g, SEXP w, SEXP Rnarm, SEXP Rdrop) {
       px = REAL(xr);
       ++nprotect;
     } else px = REAL(x);
-    for(int j = 0; j != col; ++j) fprod_weights_impl(pout + j*ng1, px + j*l, ng, pg, pw, narm, l);
+    if(ng > 0 && (starts = gseg_starts(pg, ng, l))) {
+      for(int j = 0; j != col; ++j) fprod_double_seg_impl(pout + j*ng, px + j*l, pw, ng, starts, narm);
+      Free(starts);
+    } else {
+      for(int j = 0; j != col; ++j) fprod_weights_impl(pout + j*ng1, px + j*l, ng, pg, pw, narm, l);
+    }
   }
   matCopyAttr(out, x, Rdrop, ng);
   UNPROTECT(nprotect);
@@ -1,17 +1,102 @@
 #include <Rcpp.h>
 using namespace Rcpp;
+#include "par_cols.h"
 
 // Notes:
 // for mean there are 2 options: "overall.mean" = R_NegInf adds the overall mean. default is centering on 0, or centering on a mean provided, or FALSE = R_PosInf -> no centering, scaling preserves mean
 // for sd there is "within.sd" = R_NegInf, scaling by the frequency weighted within-group sd, default is 1, or scaling by a sd provided.
 // All other comments are in fvar.cpp (in C++ folder, not on Github)
 
+// Multithreaded and in-place scaling ------------------------------------------------------------------------------
+// With nthreads > 1, set = TRUE or set_deterministic(TRUE), the group moments are computed with the multithreaded Welford
+// engine of fvar_fsd.cpp (mergeable partial moments, see there), and x is transformed in a second pass that is
+// parallel over rows (or over columns for matrices and lists with at least nthreads columns). With set = TRUE the result
+// is written into x. The group-level computations are the same as in the serial code below.
+
+void fvarsd_moments(double *pn, double *pmean, double *pM2, const double *px, const double *pw, int ng, const int *pg,
+                    const int *starts, int l, bool narm, int nth); // fvar_fsd.cpp
+extern "C" int *gseg_starts(const int *pg, const int ng, const int l); // small_helper.c
+extern "C" int fsum_deterministic; // set_deterministic(), fsum.c
+
+// Scales px (length l) into pout, which may be px.
+static void fscale_par_impl(double *pout, const double *px, const double *pw, int ng, const int *pg, const int *starts,
+                            int l, bool narm, double set_mean, double set_sd, int nth) {
+  const int nr = ng == 0 ? 1 : ng;
+  std::vector<double> n(nr), mean(nr), M2(nr);
+  fvarsd_moments(n.data(), mean.data(), M2.data(), px, pw, ng, pg, starts, l, narm, nth);
+  if(ng == 0) {
+    const double sc = set_sd/sqrt(M2[0]/(n[0]-1)), mu = mean[0];
+    if(std::isnan(sc)) {
+      std::fill(pout, pout + l, NA_REAL);
+    } else if(set_mean == 0) {
+      #pragma omp parallel for num_threads(nth) if(nth > 1)
+      for(int i = 0; i < l; ++i) pout[i] = (px[i]-mu)*sc;
+    } else {
+      const double add = set_mean == R_PosInf ? mu : set_mean;
+      #pragma omp parallel for num_threads(nth) if(nth > 1)
+      for(int i = 0; i < l; ++i) pout[i] = (px[i]-mu)*sc + add;
+    }
+    return;
+  }
+  double gl_mean = set_mean == R_NegInf ? 0 : set_mean, sum_n = 0, within_sd = 0;
+  for(int i = ng; i--; ) {
+    if(std::isnan(M2[i])) continue;
+    if(set_sd == R_NegInf) {
+      within_sd += M2[i];
+      M2[i] = 1/sqrt(M2[i]/(n[i]-1));
+    } else M2[i] = set_sd/sqrt(M2[i]/(n[i]-1));
+    if(set_mean == R_NegInf) gl_mean += mean[i]*n[i];
+    sum_n += n[i];
+  }
+  if(set_mean == R_NegInf) gl_mean /= sum_n;
+  if(set_sd == R_NegInf) {
+    within_sd = sqrt(within_sd/(sum_n-1));
+    for(int i = ng; i--; ) M2[i] *= within_sd;
+  }
+  const double *pmean = mean.data()-1, *psc = M2.data()-1;
+  if(set_mean == 0) {
+    #pragma omp parallel for num_threads(nth) if(nth > 1)
+    for(int i = 0; i < l; ++i) pout[i] = (px[i]-pmean[pg[i]])*psc[pg[i]];
+  } else if(set_mean == R_PosInf) {
+    #pragma omp parallel for num_threads(nth) if(nth > 1)
+    for(int i = 0; i < l; ++i) pout[i] = (px[i]-pmean[pg[i]])*psc[pg[i]] + pmean[pg[i]];
+  } else {
+    #pragma omp parallel for num_threads(nth) if(nth > 1)
+    for(int i = 0; i < l; ++i) pout[i] = (px[i]-pmean[pg[i]])*psc[pg[i]] + gl_mean;
+  }
+}
+
+// Columns of a matrix or list with the same weights and groups (see par_cols.h). The group starts are shared.
+static void fscale_par_cols(const par_cols& pc, int col, const double *pw, int ng, const int *pg,
+                            bool narm, double set_mean, double set_sd, int nth) {
+  if(ng == 0) {
+    if(set_sd == R_NegInf) stop("within.sd can only be calculated when a grouping vector is supplied");
+    if(set_mean == R_NegInf) stop("without groups, centering on the overall mean amounts to scaling without centering, so use mean = FALSE instead, or supply a grouping vector to subtract out group means.");
+  }
+  int *starts = ng > 0 && col > 0 ? gseg_starts(pg, ng, pc.pl[0]) : NULL;
+  par_cols_apply(col, nth, [&](int j, int nthj) {
+    fscale_par_impl(pc.pouts[j], pc.pxs[j], pw, ng, pg, starts, pc.pl[j], narm, set_mean, set_sd, nthj);
+  });
+  if(starts != NULL) R_Free(starts);
+}
+
 // [[Rcpp::export]]
 NumericVector fscaleCpp(const NumericVector& x, int ng = 0, const IntegerVector& g = 0, const SEXP& w = R_NilValue,
-                        bool narm = true, double set_mean = 0, double set_sd = 1) { // could set mean and sd with SEXP, but complicated...
+                        bool narm = true, double set_mean = 0, double set_sd = 1, int nthreads = 1, bool set = false) { // could set mean and sd with SEXP, but complicated...
   int l = x.size();
   if(l < 1) return x; // Prevents seqfault for numeric(0) #101
 
+  if(nthreads > 1 || set || fsum_deterministic) { // Multithreaded / in-place, see above
+    if(ng > 0 && g.size() != l) stop("length(g) must match nrow(X)");
+    if(!Rf_isNull(w) && Rf_length(w) != l) stop("length(w) must match length(x)");
+    NumericVector wg = Rf_isNull(w) ? NumericVector(0) : NumericVector(w), out = set ? x : NumericVector(no_init_vector(l));
+    par_cols pc;
+    par_cols_matrix(pc, out.begin(), x.begin(), l, 1, l);
+    fscale_par_cols(pc, 1, Rf_isNull(w) ? NULL : wg.begin(), ng, g.begin(), narm, set_mean, set_sd, nthreads);
+    if(!set) SHALLOW_DUPLICATE_ATTRIB(out, x);
+    return out;
+  }
+
   NumericVector out = no_init_vector(l);
   //   SHALLOW_DUPLICATE_ATTRIB(out, x); // Any speed loss or overwriting attributes ?
   if (Rf_isNull(w)) { // No weights
@@ -280,9 +365,22 @@ NumericVector fscaleCpp(const NumericVector& x, int ng = 0, const IntegerVector&
 
 // [[Rcpp::export]]
 NumericMatrix fscalemCpp(const NumericMatrix& x, int ng = 0, const IntegerVector& g = 0, const SEXP& w = R_NilValue,
-                         bool narm = true, double set_mean = 0, double set_sd = 1) {
+                         bool narm = true, double set_mean = 0, double set_sd = 1, int nthreads = 1, bool set = false) {
 
   int l = x.nrow(), col = x.ncol();
+
+  if(nthreads > 1 || set || fsum_deterministic) { // Multithreaded / in-place, see above
+    if(ng > 0 && g.size() != l) stop("length(g) must match nrow(X)");
+    if(!Rf_isNull(w) && Rf_length(w) != l) stop("length(w) must match nrow(X)");
+    NumericVector wg = Rf_isNull(w) ? NumericVector(0) : NumericVector(w);
+    NumericMatrix res = set ? x : NumericMatrix(no_init_matrix(l, col));
+    par_cols pc;
+    par_cols_matrix(pc, res.begin(), x.begin(), l, col, l);
+    fscale_par_cols(pc, col, Rf_isNull(w) ? NULL : wg.begin(), ng, g.begin(), narm, set_mean, set_sd, nthreads);
+    if(!set) SHALLOW_DUPLICATE_ATTRIB(res, x);
+    return res;
+  }
+
   NumericMatrix out = no_init_matrix(l, col);
 
   if (Rf_isNull(w)) { // No weights
@@ -566,9 +664,21 @@ NumericMatrix fscalemCpp(const NumericMatrix& x, int ng = 0, const IntegerVector
 
 // [[Rcpp::export]]
 List fscalelCpp(const List& x, int ng = 0, const IntegerVector& g = 0, const SEXP& w = R_NilValue,
-                bool narm = true, double set_mean = 0, double set_sd = 1) {
+                bool narm = true, double set_mean = 0, double set_sd = 1, int nthreads = 1, bool set = false) {
 
   int l = x.size();
+
+  if(nthreads > 1 || set || fsum_deterministic) { // Multithreaded / in-place, see above
+    par_cols pc;
+    par_cols_list(pc, x, ng, g.size(), w, 0, set);
+    NumericVector wg = Rf_isNull(w) ? NumericVector(0) : NumericVector(w);
+    fscale_par_cols(pc, l, Rf_isNull(w) ? NULL : wg.begin(), ng, g.begin(), narm, set_mean, set_sd, nthreads);
+    if(set) return x;
+    for(int j = l; j--; ) SHALLOW_DUPLICATE_ATTRIB(VECTOR_ELT(pc.res, j), VECTOR_ELT(pc.columns, j));
+    SHALLOW_DUPLICATE_ATTRIB(pc.res, x);
+    return pc.res;
+  }
+
   List out(l);
 
   if (Rf_isNull(w)) { // No weights
@@ -4,47 +4,427 @@
 #include "collapse_c.h"
 // #include <R_ext/Altrep.h>
 
-void fsum_double_impl(double *restrict pout, const double *restrict px, const int narm, const int l) {
-  double sum;
+// Compensated and deterministic summation -------------------------------------
+// With set_sum_accuracy("compensated"), sums and means of doubles use Neumaier's improved Kahan summation: the rounding
+// error of each addition is accumulated in a compensation term c, which is added to the sum at the end. Without groups the
+// data is summed in 4 independent lanes (which can be vectorised), and thread chunks are combined in order, so the
+// result does not depend on the order of a reduction. Missing values (NA/NaN without na.rm) are handled by the standard
+// code, which is also called if the compensated sum is not a number (e.g. Inf - Inf).
+// With set_deterministic(TRUE), the data is instead split into chunks (groups: blocks of rows) whose size does not depend
+// on the number of threads. Threads compute the partial sums of whole chunks, which are combined in a fixed order:
+// pairwise (binary tree) without groups and in row order with groups. Results are thus bit-identical for any nthreads.
+
+int fsum_accurate = 0, fsum_deterministic = 0;
+
+SEXP setsumaccC(SEXP x) {
+  int old = fsum_accurate;
+  fsum_accurate = asInteger(x);
+  return ScalarInteger(old);
+}
+
+SEXP setdetC(SEXP x) {
+  int old = fsum_deterministic;
+  fsum_deterministic = asLogical(x);
+  return ScalarLogical(old);
+}
+
+#define DET_CHUNK 8192 // Rows per chunk without groups
+#define DET_NBLOCK 64  // Maximum number of row blocks with groups
+
+#define KAHAN_ADD(s, c, x) do {                                  \
+  const double x_ = (x), t_ = s + x_;                             \
+  c += fabs(s) >= fabs(x_) ? (s - t_) + x_ : (x_ - t_) + s;       \
+  s = t_;                                                         \
+} while(0)
+
+static inline double kahan_result(const double s, const double c) {
+  const double r = s + c;
+  return ISNAN(r) ? s : r; // Infinite sums
+}
+
+typedef struct { double s, c, sw, cw; int n; } ksum; // sum, compensation, sum of weights, its compensation, count
+
+// Rows start...end-1, in 4 lanes (the remainder goes to the first lane). With na.rm, n counts the non-missing (x, w) pairs.
+// Without compensation (comp = 0) c and cw remain 0.
+#define KSUM_LANE(k, i) {                     \
+  double x = px[i], w = pw ? pw[i] : 1.0;     \
+  if(narm) {                                  \
+    const int ok = NISNAN(x) && NISNAN(w);    \
+    n += ok;                                  \
+    w = ok ? w : 0.0;                         \
+    x = ok ? x * w : 0.0;                     \
+  } else x *= w;                              \
+  if(comp) {                                  \
+    KAHAN_ADD(s[k], c[k], x);                 \
+    if(pw) KAHAN_ADD(sw[k], cw[k], w);        \
+  } else {                                    \
+    s[k] += x;                                \
+    sw[k] += w;                               \
+  }                                           \
+}
+
+static inline void ksum_merge(ksum *restrict a, const ksum b, const int comp) {
+  if(comp) {
+    KAHAN_ADD(a->s, a->c, b.s);
+    a->c += b.c;
+    KAHAN_ADD(a->sw, a->cw, b.sw);
+    a->cw += b.cw;
+  } else {
+    a->s += b.s;
+    a->sw += b.sw;
+  }
+  a->n += b.n;
+}
+
+static ksum ksum_range(const double *restrict px, const double *restrict pw, const int narm, const int comp, const int start, const int end) {
+  double s[4] = {0.0, 0.0, 0.0, 0.0}, c[4] = {0.0, 0.0, 0.0, 0.0}, sw[4] = {0.0, 0.0, 0.0, 0.0}, cw[4] = {0.0, 0.0, 0.0, 0.0};
+  int n = 0, i = start;
+  for(const int end4 = start + ((end - start) & ~3); i < end4; i += 4) {
+    for(int k = 0; k != 4; ++k) KSUM_LANE(k, i+k)
+  }
+  for(; i < end; ++i) KSUM_LANE(0, i)
+  ksum r = {s[0], c[0], sw[0], cw[0], narm ? n : end - start};
+  for(int k = 1; k != 4; ++k) {
+    ksum rk = {s[k], c[k], sw[k], cw[k], 0};
+    ksum_merge(&r, rk, comp);
+  }
+  return r;
+}
+
+// Pairwise combination of chunk results: chunk i is pushed after chunks 0...i-1, and equally sized subtrees are merged
+// immediately, so that the shape of the tree only depends on the number of chunks.
+typedef struct { ksum p[32]; int size[32], k; } ktree;
+
+static void ktree_push(ktree *restrict t, ksum r, const int comp) {
+  int size = 1;
+  while(t->k && t->size[t->k-1] == size) {
+    ksum left = t->p[--t->k];
+    ksum_merge(&left, r, comp);
+    r = left;
+    size *= 2;
+  }
+  t->p[t->k] = r;
+  t->size[t->k++] = size;
+}
+
+static ksum ktree_result(ktree *restrict t, const int comp) {
+  ksum r = t->p[--t->k];
+  while(t->k) {
+    ksum left = t->p[--t->k];
+    ksum_merge(&left, r, comp);
+    r = left;
+  }
+  return r;
+}
+
+// Compensated and/or deterministic (weighted) sum (mean = 0) or mean (mean = 1) of px, computed in nc chunks: with
+// set_deterministic(TRUE) chunks of DET_CHUNK rows, otherwise one chunk per thread. Returns 0 if the standard code should
+// be used instead (not deterministic, and missing values without na.rm or all values missing).
+int fsum_strict_impl(double *restrict pout, const double *restrict px, const double *restrict pw, const int narm, const int l, const int nth, const int mean) {
+  const int comp = fsum_accurate, det = fsum_deterministic, nt = nth > 1 ? nth : 1, nc = det ? (l - 1) / DET_CHUNK + 1 : nt;
+  ktree tree;
+  tree.k = 0;
+  #define CHUNK_START(i) (det ? (i) * DET_CHUNK : (int)((int64_t)l * (i) / nt))
+  #define CHUNK_END(i) (det ? ((i) == nc-1 ? l : ((i)+1) * DET_CHUNK) : (int)((int64_t)l * ((i)+1) / nt))
+  if(nt == 1 || nc == 1) { // Serial: no allocation, as this is also called inside parallel loops over columns
+    for(int i = 0; i != nc; ++i) ktree_push(&tree, ksum_range(px, pw, narm, comp, CHUNK_START(i), CHUNK_END(i)), comp);
+  } else {
+    ksum *restrict part = (ksum *) Calloc(nc, ksum);
+    #pragma omp parallel for num_threads(nth) schedule(static)
+    for(int i = 0; i < nc; ++i) part[i] = ksum_range(px, pw, narm, comp, CHUNK_START(i), CHUNK_END(i));
+    for(int i = 0; i != nc; ++i) ktree_push(&tree, part[i], comp);
+    Free(part);
+  }
+  #undef CHUNK_START
+  #undef CHUNK_END
+  ksum r = ktree_result(&tree, comp);
+  if(r.n == 0) {
+    if(!det) return 0;
+    pout[0] = NA_REAL;
+    return 1;
+  }
+  if(ISNAN(r.s) && !det) return 0;
+  pout[0] = comp ? kahan_result(r.s, r.c) : r.s;
+  if(mean) pout[0] /= pw ? (comp ? kahan_result(r.sw, r.cw) : r.sw) : r.n;
+  return 1;
+}
+
+// Grouped: pout, c and the optional pn (counts) and psw, cw (sums of weights and compensation) are decremented by 1.
+// Without compensation c and cw are NULL.
+static void strict_g_acc(double *restrict pout, double *restrict c, int *restrict pn, double *restrict psw, double *restrict cw, const double *restrict px,
+                         const double *restrict pw, const int *restrict pg, const int narm, const int start, const int end) {
+  for(int i = end, gi; i-- != start; ) {
+    double x = px[i], w = pw ? pw[i] : 1.0;
+    gi = pg[i];
+    if(narm) {
+      if(ISNAN(x) || ISNAN(w)) continue;
+      if(ISNAN(pout[gi])) {
+        pout[gi] = x * w;
+        if(pn) pn[gi] = 1;
+        if(psw) psw[gi] = w;
+        continue;
+      }
+      if(pn) ++pn[gi];
+    }
+    if(c) {
+      KAHAN_ADD(pout[gi], c[gi], x * w);
+      if(psw) KAHAN_ADD(psw[gi], cw[gi], w);
+    } else {
+      pout[gi] += x * w;
+      if(psw) psw[gi] += w;
+    }
+  }
+}
+
+static void strict_g_init(double *restrict pout, int *restrict pn, double *restrict psw, const int ng, const int narm) {
+  if(narm) for(int i = ng; i--; ) pout[i] = NA_REAL;
+  else memset(pout, 0, sizeof(double) * ng);
+  if(pn) memset(pn, 0, sizeof(int) * ng);
+  if(psw) memset(psw, 0, sizeof(double) * ng);
+}
+
+// Sums over nb row blocks (bounds in cuts) computed by nth threads into separate buffers, which are added in block order
+static void strict_g_blocks(double *restrict pout, int *restrict pn, double *restrict psw, const double *restrict px, const double *restrict pw,
+                            const int ng, const int *restrict pg, const int narm, const int nb, const int *restrict cuts, const int nth, const int comp) {
+  const size_t ngt = (size_t)ng * nb;
+  double *restrict buf = (double*)Calloc(ngt, double), *restrict c = comp ? (double*)Calloc(ngt, double) : NULL,
+         *restrict bufw = psw ? (double*)Calloc(ngt, double) : NULL, *restrict cw = psw && comp ? (double*)Calloc(ngt, double) : NULL;
+  int *restrict bufn = pn ? (int*)Calloc(ngt, int) : NULL;
+  #pragma omp parallel for num_threads(nth) schedule(static)
+  for(int t = 0; t < nb; ++t) {
+    const size_t o = (size_t)t * ng;
+    strict_g_init(buf + o, NULL, NULL, ng, narm);
+    strict_g_acc(buf + o - 1, comp ? c + o - 1 : NULL, pn ? bufn + o - 1 : NULL, psw ? bufw + o - 1 : NULL,
+                 cw ? cw + o - 1 : NULL, px, pw, pg, narm, cuts[t], cuts[t+1]);
+  }
+  #pragma omp parallel for num_threads(nth)
+  for(int i = 0; i < ng; ++i) {
+    double s = narm ? NA_REAL : 0.0, cs = 0.0, sw = 0.0, csw = 0.0;
+    int n = 0;
+    for(int t = 0; t != nb; ++t) {
+      const size_t ti = (size_t)t * ng + i;
+      if(narm && ISNAN(s)) {
+        s = buf[ti];
+        if(comp) cs = c[ti];
+      } else if(!(narm && ISNAN(buf[ti]))) {
+        if(comp) {
+          KAHAN_ADD(s, cs, buf[ti]);
+          cs += c[ti];
+        } else s += buf[ti];
+      }
+      if(pn) n += bufn[ti];
+      if(psw) {
+        if(comp) {
+          KAHAN_ADD(sw, csw, bufw[ti]);
+          csw += cw[ti];
+        } else sw += bufw[ti];
+      }
+    }
+    pout[i] = comp ? kahan_result(s, cs) : s;
+    if(pn) pn[i] = n;
+    if(psw) psw[i] = comp ? kahan_result(sw, csw) : sw;
+  }
+  Free(buf);
+  if(c) Free(c);
+  if(bufw) Free(bufw);
+  if(cw) Free(cw);
+  if(bufn) Free(bufn);
+}
+
+// Compensated and/or deterministic grouped (weighted) sums, optionally also computing the number of non-missing values
+// (pn, only with na.rm) and the sums of weights (psw). Without set_deterministic(TRUE), multithreading uses a plan (mode and
+// cuts) from gpar_plan(), as the standard kernels. Otherwise the rows are split into min(DET_NBLOCK, l / ng) blocks
+// independently of nth (with less than 2 rows per group on average the groups are summed in a single pass).
+void fsum_strict_g_impl(double *restrict pout, int *restrict pn, double *restrict psw, const double *restrict px, const double *restrict pw,
+                        const int ng, const int *restrict pg, const int narm, const int l, const int nth, int mode, const int *restrict cuts) {
+  const int comp = fsum_accurate;
+  if(fsum_deterministic) {
+    const int nb = l / ng > DET_NBLOCK ? DET_NBLOCK : l / ng;
+    if(nb >= 2) {
+      int *restrict bcuts = (int*)Calloc(nb+1, int);
+      for(int t = 0; t <= nb; ++t) bcuts[t] = (int)((int64_t)l * t / nb);
+      strict_g_blocks(pout, pn, psw, px, pw, ng, pg, narm, nb, bcuts, nth, comp);
+      Free(bcuts);
+      return;
+    }
+    mode = GPAR_SERIAL;
+  }
+  if(mode == GPAR_BUFFER) {
+    strict_g_blocks(pout, pn, psw, px, pw, ng, pg, narm, nth, cuts, nth, comp);
+    return;
+  }
+  double *restrict c = comp ? (double*)Calloc(ng, double) : NULL, *restrict cw = psw && comp ? (double*)Calloc(ng, double) : NULL;
+  strict_g_init(pout, pn, psw, ng, narm);
+  if(mode == GPAR_SERIAL) strict_g_acc(pout-1, c ? c-1 : NULL, pn ? pn-1 : NULL, psw ? psw-1 : NULL, cw ? cw-1 : NULL, px, pw, pg, narm, 0, l);
+  else {
+    #pragma omp parallel for num_threads(nth)
+    for(int t = 0; t < nth; ++t) strict_g_acc(pout-1, c ? c-1 : NULL, pn ? pn-1 : NULL, psw ? psw-1 : NULL, cw ? cw-1 : NULL, px, pw, pg, narm, cuts[t], cuts[t+1]);
+  }
+  if(comp) {
+    for(int i = ng; i--; ) {
+      pout[i] = kahan_result(pout[i], c[i]);
+      if(psw) psw[i] = kahan_result(psw[i], cw[i]);
+    }
+    Free(c);
+    if(cw) Free(cw);
+  }
+}
+
+// Vectorised ungrouped kernels -------------------------------------------------
+// The loops run forwards without branches on missing values, over VLANES independent accumulators (partial sums of
+// doubles are thus always combined in the same order, whatever the instruction set), and are compiled for several
+// instruction sets (SIMD_DISPATCH, see collapse_c.h). With na.rm, missing values are masked to 0 and counted (pn).
+// Without na.rm, every VBLOCK elements the accumulators are checked for NaN, in which case the block is searched for the
+// first missing value, which is returned (the computation is thus still terminated once a missing value is encountered).
+#define VBLOCK 2048
+
+static inline double vlanes_sum(const double *restrict s) {
+  return ((s[0] + s[1]) + (s[2] + s[3])) + ((s[4] + s[5]) + (s[6] + s[7]));
+}
+
+// Returns the (weighted) sum of px, and in pn the number of non-missing (x, w) pairs with na.rm, otherwise l.
+// With na.rm and all values missing the result is px[0] (* pw[0]). psumw (if not NULL) receives the sum of weights.
+SIMD_DISPATCH
+double vsum_double(const double *restrict px, const double *restrict pw, const int narm, const int l, int *restrict pn, double *restrict psumw) {
+  double s[VLANES] = {0}, sw[VLANES] = {0};
+  int i = 0;
   if(narm) {
-    int j = l-1;
-    sum = px[j];
-    while(ISNAN(sum) && j!=0) sum = px[--j];
-    if(j != 0) for(int i = j; i--; ) {
-      if(NISNAN(px[i])) sum += px[i]; // Fastest ?
+    int n[VLANES] = {0};
+    if(pw) {
+      for(; i <= l - VLANES; i += VLANES) {
+        #pragma omp simd
+        for(int k = 0; k < VLANES; ++k) {
+          const double x = px[i+k], w = pw[i+k];
+          const int ok = NISNAN(x) & NISNAN(w);
+          s[k] += ok ? x * w : 0.0;
+          sw[k] += ok ? w : 0.0;
+          n[k] += ok;
+        }
+      }
+      for(; i < l; ++i) if(NISNAN(px[i]) && NISNAN(pw[i])) {
+        s[0] += px[i] * pw[i];
+        sw[0] += pw[i];
+        ++n[0];
+      }
+    } else {
+      for(; i <= l - VLANES; i += VLANES) {
+        #pragma omp simd
+        for(int k = 0; k < VLANES; ++k) {
+          const double x = px[i+k];
+          const int ok = NISNAN(x);
+          s[k] += ok ? x : 0.0;
+          n[k] += ok;
+        }
+      }
+      for(; i < l; ++i) if(NISNAN(px[i])) {
+        s[0] += px[i];
+        ++n[0];
+      }
     }
-  } else {
-    sum = 0;
-    for(int i = 0; i != l; ++i) {
-      if(ISNAN(px[i])) {
-        sum = px[i];
-        break;
+    int nt = 0;
+    for(int k = 0; k != VLANES; ++k) nt += n[k];
+    *pn = nt;
+    if(psumw) *psumw = vlanes_sum(sw);
+    return nt ? vlanes_sum(s) : pw ? px[0] * pw[0] : px[0];
+  }
+  *pn = l;
+  for(int b = 0, e; b < l; b = e) {
+    e = l - b > VBLOCK ? b + VBLOCK : l;
+    if(pw) {
+      for(; i <= e - VLANES; i += VLANES) {
+        #pragma omp simd
+        for(int k = 0; k < VLANES; ++k) {
+          s[k] += px[i+k] * pw[i+k];
+          sw[k] += pw[i+k];
+        }
+      }
+      for(; i < e; ++i) {
+        s[0] += px[i] * pw[i];
+        sw[0] += pw[i];
+      }
+    } else {
+      for(; i <= e - VLANES; i += VLANES) {
+        #pragma omp simd
+        for(int k = 0; k < VLANES; ++k) s[k] += px[i+k];
+      }
+      for(; i < e; ++i) s[0] += px[i];
+    }
+    if(ISNAN(vlanes_sum(s))) { // Could also be Inf - Inf
+      if(pw) {
+        for(int j = b; j != e; ++j) if(ISNAN(px[j]) || ISNAN(pw[j])) return px[j] + pw[j];
       } else {
-        sum += px[i];
+        for(int j = b; j != e; ++j) if(ISNAN(px[j])) return px[j];
       }
     }
   }
-  pout[0] = sum;
+  if(psumw) *psumw = vlanes_sum(sw);
+  return vlanes_sum(s);
 }
 
-void fsum_double_g_impl(double *restrict pout, const double *restrict px, const int ng, const int *restrict pg, const int narm, const int l) {
+// Integer sum (exact in 64 bits, so the order is irrelevant), NA_REAL if missing values without na.rm or all missing
+SIMD_DISPATCH
+double vsum_int(const int *restrict px, const int narm, const int l, int *restrict pn) {
+  const int na = NA_INTEGER;
+  long long sum = 0;
   if(narm) {
-    for(int i = ng; i--; ) pout[i] = NA_REAL; // Other way ?
-    --pout;
-    for(int i = l; i--; ) {
+    int n = 0;
+    #pragma omp simd reduction(+:sum,n)
+    for(int i = 0; i < l; ++i) {
+      const int ok = px[i] != na;
+      sum += ok ? (long long)px[i] : 0;
+      n += ok;
+    }
+    *pn = n;
+    return n ? (double)sum : NA_REAL;
+  }
+  for(int b = 0, e; b < l; b = e) {
+    e = l - b > VBLOCK ? b + VBLOCK : l;
+    int anyna = 0;
+    #pragma omp simd reduction(+:sum) reduction(|:anyna)
+    for(int i = b; i < e; ++i) {
+      sum += (long long)px[i];
+      anyna |= px[i] == na;
+    }
+    if(anyna) return NA_REAL;
+  }
+  *pn = l;
+  return (double)sum;
+}
+
+void fsum_double_impl(double *restrict pout, const double *restrict px, const int narm, const int l) {
+  if(FSUM_STRICT && fsum_strict_impl(pout, px, NULL, narm, l, 1, 0)) return;
+  int n;
+  pout[0] = vsum_double(px, NULL, narm, l, &n, NULL);
+}
+
+// Accumulates rows start...end-1 into pout, which is decremented by 1 (pout[pg[i]]). The serial and multithreaded
+// grouped kernels below share these loops, so that they give the same results and handle missing values identically.
+static void fsum_double_g_acc(double *restrict pout, const double *restrict px, const int *restrict pg, const int narm, const int start, const int end) {
+  if(narm) {
+    for(int i = end; i-- != start; ) {
       if(NISNAN(px[i])) { // faster way to code this ? -> Not Bad at all
         if(ISNAN(pout[pg[i]])) pout[pg[i]] = px[i];
         else pout[pg[i]] += px[i];
       }
     }
   } else {
-    memset(pout, 0.0, sizeof(double) * ng);
-    --pout;
-    for(int i = l; i--; ) pout[pg[i]] += px[i]; // Used to stop loop when all groups passed with NA, but probably no speed gain since groups are mostly ordered.
+    for(int i = end; i-- != start; ) pout[pg[i]] += px[i]; // Used to stop loop when all groups passed with NA, but probably no speed gain since groups are mostly ordered.
   }
 }
 
+void fsum_double_g_impl(double *restrict pout, const double *restrict px, const int ng, const int *restrict pg, const int narm, const int l) {
+  if(FSUM_STRICT) {
+    fsum_strict_g_impl(pout, NULL, NULL, px, NULL, ng, pg, narm, l, 1, GPAR_SERIAL, NULL);
+    return;
+  }
+  if(narm) {
+    for(int i = ng; i--; ) pout[i] = NA_REAL; // Other way ?
+  } else memset(pout, 0.0, sizeof(double) * ng);
+  fsum_double_g_acc(pout-1, px, pg, narm, 0, l);
+}
+
 void fsum_double_omp_impl(double *restrict pout, const double *restrict px, const int narm, const int l, const int nth) {
+  if(FSUM_STRICT && fsum_strict_impl(pout, px, NULL, narm, l, nth, 0)) return;
   double sum;
   if(narm) {
     int j = 1;
@@ -62,69 +442,63 @@ void fsum_double_omp_impl(double *restrict pout, const double *restrict px, cons
   pout[0] = sum;
 }
 
-// This is unsafe...
-// void fsum_double_g_omp_impl(double *restrict pout, double *restrict px, int ng, int *restrict pg, int narm, int l, int nth) {
-//   if(narm) {
-//     for(int i = ng; i--; ) pout[i] = NA_REAL;
-//     #pragma omp parallel for num_threads(nth) reduction(+:pout[:ng])
-//     for(int i = 0; i < l; ++i) {
-//       if(!ISNAN(px[i])) {
-//         if(ISNAN(pout[pg[i]-1])) pout[pg[i]-1] = px[i];
-//         else pout[pg[i]-1] += px[i];
-//       }
-//     }
-//   } else {
-//     memset(pout, 0.0, sizeof(double) * ng);
-//     #pragma omp parallel for num_threads(nth) reduction(+:pout[:ng]) // shared(pout)
-//     for(int i = 0; i < l; ++i) {
-//       // #pragma omp atomic
-//       pout[pg[i]-1] += px[i]; // Used to stop loop when all groups passed with NA, but probably no speed gain since groups are mostly ordered.
-//     }
-//   }
-// }
-
-void fsum_weights_impl(double *restrict pout, const double *restrict px, const double *restrict pw, const int narm, const int l) {
-  double sum;
-  if(narm) {
-    int j = l-1;
-    while((ISNAN(px[j]) || ISNAN(pw[j])) && j!=0) --j;
-    sum = px[j] * pw[j];
-    if(j != 0) for(int i = j; i--; ) {
-      if(ISNAN(px[i]) || ISNAN(pw[i])) continue;
-      sum += px[i] * pw[i];
-    }
+// Multithreading over rows using a plan (mode and cuts) from gpar_plan(): with sorted groups each thread computes
+// the sums of the groups in its row-range, otherwise threads accumulate into own buffers which are then merged.
+void fsum_double_g_omp_impl(double *restrict pout, const double *restrict px, const int ng, const int *restrict pg, const int narm, const int l, const int nth, const int mode, const int *restrict cuts) {
+  if(FSUM_STRICT) {
+    fsum_strict_g_impl(pout, NULL, NULL, px, NULL, ng, pg, narm, l, nth, mode, cuts);
+    return;
+  }
+  if(mode == GPAR_SORTED) {
+    if(narm) {
+      for(int i = ng; i--; ) pout[i] = NA_REAL;
+    } else memset(pout, 0.0, sizeof(double) * ng);
+    #pragma omp parallel for num_threads(nth)
+    for(int t = 0; t < nth; ++t) fsum_double_g_acc(pout-1, px, pg, narm, cuts[t], cuts[t+1]);
   } else {
-    sum = 0;
-    for(int i = 0; i != l; ++i) {
-      if(ISNAN(px[i]) || ISNAN(pw[i])) {
-        sum = px[i] + pw[i];
-        break;
-      } else {
-        sum += px[i] * pw[i];
-      }
+    double *restrict buf = (double*)Calloc((size_t)ng * nth, double);
+    #pragma omp parallel for num_threads(nth)
+    for(int t = 0; t < nth; ++t) {
+      double *restrict pbt = buf + (size_t)t * ng;
+      if(narm) for(int i = ng; i--; ) pbt[i] = NA_REAL;
+      fsum_double_g_acc(pbt-1, px, pg, narm, cuts[t], cuts[t+1]);
     }
+    gpar_merge_sum(pout, buf, ng, nth, narm);
+    Free(buf);
   }
-  pout[0] = sum;
 }
 
-void fsum_weights_g_impl(double *restrict pout, const double *restrict px, const int ng, const int *restrict pg, const double *restrict pw, const int narm, const int l) {
+void fsum_weights_impl(double *restrict pout, const double *restrict px, const double *restrict pw, const int narm, const int l) {
+  if(FSUM_STRICT && fsum_strict_impl(pout, px, pw, narm, l, 1, 0)) return;
+  int n;
+  pout[0] = vsum_double(px, pw, narm, l, &n, NULL);
+}
+
+static void fsum_weights_g_acc(double *restrict pout, const double *restrict px, const int *restrict pg, const double *restrict pw, const int narm, const int start, const int end) {
   if(narm) {
-    for(int i = ng; i--; ) pout[i] = NA_REAL; // Other way ?
-    --pout;
-    for(int i = l; i--; ) {
+    for(int i = end; i-- != start; ) {
       if(ISNAN(px[i]) || ISNAN(pw[i])) continue;
       if(ISNAN(pout[pg[i]])) pout[pg[i]] = px[i] * pw[i];
       else pout[pg[i]] += px[i] * pw[i];
     }
   } else {
-    memset(pout, 0.0, sizeof(double) * ng);
-    --pout;
-    for(int i = l; i--; ) pout[pg[i]] += px[i] * pw[i]; // Used to stop loop when all groups passed with NA, but probably no speed gain since groups are mostly ordered.
+    for(int i = end; i-- != start; ) pout[pg[i]] += px[i] * pw[i]; // Used to stop loop when all groups passed with NA, but probably no speed gain since groups are mostly ordered.
   }
 }
 
+void fsum_weights_g_impl(double *restrict pout, const double *restrict px, const int ng, const int *restrict pg, const double *restrict pw, const int narm, const int l) {
+  if(FSUM_STRICT) {
+    fsum_strict_g_impl(pout, NULL, NULL, px, pw, ng, pg, narm, l, 1, GPAR_SERIAL, NULL);
+    return;
+  }
+  if(narm) {
+    for(int i = ng; i--; ) pout[i] = NA_REAL; // Other way ?
+  } else memset(pout, 0.0, sizeof(double) * ng);
+  fsum_weights_g_acc(pout-1, px, pg, pw, narm, 0, l);
+}
 
 void fsum_weights_omp_impl(double *restrict pout, const double *restrict px, const double *restrict pw, const int narm, const int l, const int nth) {
+  if(FSUM_STRICT && fsum_strict_impl(pout, px, pw, narm, l, nth, 0)) return;
   double sum;
   if(narm) {
     int j = 0;
@@ -145,63 +519,56 @@ void fsum_weights_omp_impl(double *restrict pout, const double *restrict px, con
   pout[0] = sum;
 }
 
-// This is unsafe...
-// void fsum_weights_g_omp_impl(double *restrict pout, double *restrict px, int ng, int *restrict pg, double *restrict pw, int narm, int l, int nth) {
-//   if(narm) {
-//     for(int i = ng; i--; ) pout[i] = NA_REAL;
-//     #pragma omp parallel for num_threads(nth) reduction(+:pout[:ng])
-//     for(int i = 0; i < l; ++i) {
-//       if(ISNAN(px[i]) || ISNAN(pw[i])) continue;
-//       if(ISNAN(pout[pg[i]-1])) pout[pg[i]-1] = px[i] * pw[i];
-//       else pout[pg[i]-1] += px[i] * pw[i];
-//     }
-//   } else {
-//     memset(pout, 0.0, sizeof(double) * ng);
-//     #pragma omp parallel for num_threads(nth) reduction(+:pout[:ng])
-//     for(int i = 0; i < l; ++i) pout[pg[i]-1] += px[i] * pw[i]; // Used to stop loop when all groups passed with NA, but probably no speed gain since groups are mostly ordered.
-//   }
-// }
+void fsum_weights_g_omp_impl(double *restrict pout, const double *restrict px, const int ng, const int *restrict pg, const double *restrict pw, const int narm, const int l, const int nth, const int mode, const int *restrict cuts) {
+  if(FSUM_STRICT) {
+    fsum_strict_g_impl(pout, NULL, NULL, px, pw, ng, pg, narm, l, nth, mode, cuts);
+    return;
+  }
+  if(mode == GPAR_SORTED) {
+    if(narm) {
+      for(int i = ng; i--; ) pout[i] = NA_REAL;
+    } else memset(pout, 0.0, sizeof(double) * ng);
+    #pragma omp parallel for num_threads(nth)
+    for(int t = 0; t < nth; ++t) fsum_weights_g_acc(pout-1, px, pg, pw, narm, cuts[t], cuts[t+1]);
+  } else {
+    double *restrict buf = (double*)Calloc((size_t)ng * nth, double);
+    #pragma omp parallel for num_threads(nth)
+    for(int t = 0; t < nth; ++t) {
+      double *restrict pbt = buf + (size_t)t * ng;
+      if(narm) for(int i = ng; i--; ) pbt[i] = NA_REAL;
+      fsum_weights_g_acc(pbt-1, px, pg, pw, narm, cuts[t], cuts[t+1]);
+    }
+    gpar_merge_sum(pout, buf, ng, nth, narm);
+    Free(buf);
+  }
+}
 
 
 // using long long internally is substantially faster than using doubles !!
 double fsum_int_impl(const int *restrict px, const int narm, const int l) {
-  long long sum;
-  if(narm) {
-    int j = l-1;
-    while(px[j] == NA_INTEGER && j!=0) --j;
-    sum = (long long)px[j];
-    if(j == 0 && (l > 1 || px[j] == NA_INTEGER)) return NA_REAL;
-    for(int i = j; i--; ) if(px[i] != NA_INTEGER) sum += (long long)px[i];
-  } else {
-    sum = 0;
-    for(int i = 0; i != l; ++i) {
-      if(px[i] == NA_INTEGER) return NA_REAL;
-      sum += (long long)px[i];
-    }
-  }
-  return (double)sum;
+  int n;
+  return vsum_int(px, narm, l, &n);
 }
 
-void fsum_int_g_impl(int *restrict pout, const int *restrict px, const int ng, const int *restrict pg, const int narm, const int l) {
+const char *fsum_int_overflow_msg = "Integer overflow in one or more groups. Integers in R are bounded between 2,147,483,647 and -2,147,483,647. The sum within each group should be in that range.";
+
+// Returns 1 if an integer overflow occurred (the caller raises the error, which must not happen inside a parallel region)
+static int fsum_int_g_acc(int *restrict pout, const int *restrict px, const int *restrict pg, const int narm, const int start, const int end) {
   long long ckof;
   if(narm) {
-    for(int i = ng; i--; ) pout[i] = NA_INTEGER;
-    --pout;
-    for(int i = l, lsi; i--; ) {
+    for(int i = end, lsi; i-- != start; ) {
       if(px[i] != NA_INTEGER) {
         lsi = pout[pg[i]];
         if(lsi == NA_INTEGER) pout[pg[i]] = px[i];
         else {
           ckof = (long long)lsi + px[i];
-          if(ckof > INT_MAX || ckof <= INT_MIN) error("Integer overflow in one or more groups. Integers in R are bounded between 2,147,483,647 and -2,147,483,647. The sum within each group should be in that range.");
+          if(ckof > INT_MAX || ckof <= INT_MIN) return 1;
           pout[pg[i]] = (int)ckof;
         }
       }
     }
   } else {
-    memset(pout, 0, sizeof(int) * ng);
-    --pout;
-    for(int i = l, lsi; i--; ) {
+    for(int i = end, lsi; i-- != start; ) {
       if(px[i] == NA_INTEGER) {
         pout[pg[i]] = NA_INTEGER;
         continue;
@@ -209,11 +576,19 @@ void fsum_int_g_impl(int *restrict pout, const int *restrict px, const int ng, c
       lsi = pout[pg[i]];
       if(lsi != NA_INTEGER) { // Used to stop loop when all groups passed with NA, but probably no speed gain since groups are mostly ordered.
         ckof = (long long)lsi + px[i];
-        if(ckof > INT_MAX || ckof <= INT_MIN) error("Integer overflow in one or more groups. Integers in R are bounded between 2,147,483,647 and -2,147,483,647. The sum within each group should be in that range.");
+        if(ckof > INT_MAX || ckof <= INT_MIN) return 1;
         pout[pg[i]] = (int)ckof;
       }
     }
   }
+  return 0;
+}
+
+void fsum_int_g_impl(int *restrict pout, const int *restrict px, const int ng, const int *restrict pg, const int narm, const int l) {
+  if(narm) {
+    for(int i = ng; i--; ) pout[i] = NA_INTEGER;
+  } else memset(pout, 0, sizeof(int) * ng);
+  if(fsum_int_g_acc(pout-1, px, pg, narm, 0, l)) error(fsum_int_overflow_msg);
 }
 
 double fsum_int_omp_impl(const int *restrict px, const int narm, const int l, const int nth) {
@@ -233,44 +608,81 @@ double fsum_int_omp_impl(const int *restrict px, const int narm, const int l, co
   return (double)sum;
 }
 
-// This is unsafe...
-// void fsum_int_g_omp_impl(int *restrict pout, int *restrict px, int ng, int *restrict pg, int narm, int l, int nth) {
-//   long long ckof;
-//   if(narm) {
-//     for(int i = ng; i--; ) pout[i] = NA_INTEGER;
-//     int lsi;
-//     #pragma omp parallel for num_threads(nth) reduction(+:pout[:ng])
-//     for(int i = 0; i < l; ++i) {
-//       if(px[i] != NA_INTEGER) {
-//         lsi = pout[pg[i]-1];
-//         if(lsi == NA_INTEGER) pout[pg[i]-1] = px[i];
-//         else {
-//           ckof = (long long)lsi + px[i];
-//           if(ckof > INT_MAX || ckof <= INT_MIN) error("Integer overflow in one or more groups. Integers in R are bounded between 2,147,483,647 and -2,147,483,647. The sum within each group should be in that range.");
-//           pout[pg[i]-1] = (int)ckof;
-//         }
-//       }
-//     }
-//   } else {
-//     memset(pout, 0, sizeof(int) * ng);
-//     int lsi;
-//     #pragma omp parallel for num_threads(nth) reduction(+:pout[:ng])
-//     for(int i = 0; i < l; ++i) {
-//       if(px[i] == NA_INTEGER) {
-//         pout[pg[i]-1] = NA_INTEGER;
-//         continue;
-//       }
-//       lsi = pout[pg[i]-1];
-//       if(lsi != NA_INTEGER) { // Used to stop loop when all groups passed with NA, but probably no speed gain since groups are mostly ordered.
-//         ckof = (long long)lsi + px[i];
-//         if(ckof > INT_MAX || ckof <= INT_MIN) error("Integer overflow in one or more groups. Integers in R are bounded between 2,147,483,647 and -2,147,483,647. The sum within each group should be in that range.");
-//         pout[pg[i]-1] = (int)ckof;
-//       }
-//     }
-//   }
-// }
+// Integer sums are only computed in parallel with sorted groups (GPAR_SORTED), where each group is summed by one thread in
+// the serial order. With thread-local buffers (GPAR_BUFFER) the partial sums would overflow in different places than the
+// running sums of the serial code, so whether an error is raised would depend on the number of threads.
+void fsum_int_g_omp_impl(int *restrict pout, const int *restrict px, const int ng, const int *restrict pg, const int narm, const int l, const int nth, const int mode, const int *restrict cuts) {
+  if(mode != GPAR_SORTED) {
+    fsum_int_g_impl(pout, px, ng, pg, narm, l);
+    return;
+  }
+  int overflow = 0;
+  if(narm) {
+    for(int i = ng; i--; ) pout[i] = NA_INTEGER;
+  } else memset(pout, 0, sizeof(int) * ng);
+  #pragma omp parallel for num_threads(nth) reduction(|:overflow)
+  for(int t = 0; t < nth; ++t) overflow |= fsum_int_g_acc(pout-1, px, pg, narm, cuts[t], cuts[t+1]);
+  if(overflow) error(fsum_int_overflow_msg);
+}
 
 
+// Partitioned aggregation over many groups (see gpart_init()): px (and pw) are moved into the bucket order of gp, and the
+// scatter kernels above accumulate each bucket, whose writes then stay within a cache-sized range of groups. Threads
+// process different buckets. Since rows stay in order within groups, the results are the same as those of the serial code.
+// px is double or integer (tx), pw is optional (double px). Returns 1 if an integer overflow occurred.
+int fsum_g_part_impl(void *pout, const void *px, const double *pw, const int tx, const int ng, const int *pg, const int narm, const gpart *gp) {
+  const int nb = gp->nb, nth = gp->nth < nb ? gp->nth : nb, *starts = gp->starts, *gs = gp->g;
+  int overflow = 0;
+  void *xs = tx == REALSXP ? (void*)Calloc(gp->l, double) : (void*)Calloc(gp->l, int);
+  double *ws = pw ? (double*)Calloc(gp->l, double) : NULL;
+  gpart_scatter(xs, px, tx, pg, gp);
+  if(pw) gpart_scatter(ws, pw, REALSXP, pg, gp);
+  if(tx == REALSXP) {
+    double *po = (double *)pout;
+    if(narm) for(int i = ng; i--; ) po[i] = NA_REAL;
+    else memset(po, 0.0, sizeof(double) * ng);
+  } else {
+    int *po = (int *)pout;
+    if(narm) for(int i = ng; i--; ) po[i] = NA_INTEGER;
+    else memset(po, 0, sizeof(int) * ng);
+  }
+  #pragma omp parallel for num_threads(nth) schedule(dynamic) reduction(|:overflow)
+  for(int b = 0; b < nb; ++b) {
+    if(tx != REALSXP) overflow |= fsum_int_g_acc((int *)pout - 1, (const int *)xs, gs, narm, starts[b], starts[b+1]);
+    else if(pw) fsum_weights_g_acc((double *)pout - 1, (const double *)xs, gs, ws, narm, starts[b], starts[b+1]);
+    else fsum_double_g_acc((double *)pout - 1, (const double *)xs, gs, narm, starts[b], starts[b+1]);
+  }
+  Free(xs);
+  if(pw) Free(ws);
+  return overflow;
+}
+
+// Segmented kernels for sorted groups (see gseg_starts()): each group is a contiguous run of rows summed by the
+// vectorised ungrouped kernels, in parallel over groups if nth > 1. With na.rm groups without observations are NA.
+void fsum_double_seg_impl(double *restrict pout, const double *restrict px, const double *restrict pw, const int ng, const int *restrict starts, const int narm, const int nth) {
+  #pragma omp parallel for num_threads(nth) schedule(dynamic, GSEG_CHUNK) if(nth > 1)
+  for(int gr = 0; gr < ng; ++gr) {
+    const int st = starts[gr];
+    int n;
+    pout[gr] = vsum_double(px + st, pw ? pw + st : NULL, narm, starts[gr+1] - st, &n, NULL);
+    if(n == 0) pout[gr] = NA_REAL;
+  }
+}
+
+// Returns 1 if an integer overflow occurred
+int fsum_int_seg_impl(int *restrict pout, const int *restrict px, const int ng, const int *restrict starts, const int narm, const int nth) {
+  int overflow = 0;
+  #pragma omp parallel for num_threads(nth) schedule(dynamic, GSEG_CHUNK) if(nth > 1) reduction(|:overflow)
+  for(int gr = 0; gr < ng; ++gr) {
+    int n;
+    const double sum = vsum_int(px + starts[gr], narm, starts[gr+1] - starts[gr], &n);
+    if(ISNAN(sum)) pout[gr] = NA_INTEGER;
+    else if(sum > INT_MAX || sum <= INT_MIN) overflow = 1;
+    else pout[gr] = (int)sum;
+  }
+  return overflow;
+}
+
 SEXP fsumC(SEXP x, SEXP Rng, SEXP g, SEXP w, SEXP Rnarm, SEXP Rnth) {
   int l = length(x), tx = TYPEOF(x), ng = asInteger(Rng),
     narm = asLogical(Rnarm), nth = asInteger(Rnth), nprotect = 0, nwl = isNull(w);
@@ -287,6 +699,12 @@ SEXP fsumC(SEXP x, SEXP Rng, SEXP g, SEXP w, SEXP Rnarm, SEXP Rnth) {
   if(ng && l != length(g)) error("length(g) must match length(x)");
   if(l < 100000) nth = 1; // No improvements from multithreading on small data.
   if(tx == LGLSXP) tx = INTSXP;
+  int gmode = GPAR_SERIAL, *cuts = NULL, *starts;
+  gpart gp;
+  if(ng && nth > 1) {
+    cuts = (int*)R_alloc(nth+1, sizeof(int));
+    gmode = gpar_plan(cuts, INTEGER(g), ng, l, nth);
+  }
   SEXP out;
   if(!(ng == 0 && nwl && tx == INTSXP)) {
     out = PROTECT(allocVector(nwl ? tx : REALSXP, ng == 0 ? 1 : ng));
@@ -298,22 +716,27 @@ SEXP fsumC(SEXP x, SEXP Rng, SEXP g, SEXP w, SEXP Rnarm, SEXP Rnth) {
         if(ng == 0) {
           if(nth <= 1) fsum_double_impl(REAL(out), REAL(x), narm, l);
           else fsum_double_omp_impl(REAL(out), REAL(x), narm, l, nth);
-        } else fsum_double_g_impl(REAL(out), REAL(x), ng, INTEGER(g), narm, l);
-        // If safe sub-column-level mutithreading can be developed...
-        // if(nth <= 1) {
-        //   if(ng == 0) fsum_double_impl(REAL(out), REAL(x), narm, l);
-        //   else fsum_double_g_impl(REAL(out), REAL(x), ng, INTEGER(g), narm, l);
-        // } else {
-        //   if(ng == 0) fsum_double_omp_impl(REAL(out), REAL(x), narm, l, nth);
-        //   else fsum_double_g_omp_impl(REAL(out), REAL(x), ng, INTEGER(g), narm, l, nth);
-        // }
+        } else if(!FSUM_STRICT && (starts = gseg_starts(INTEGER(g), ng, l))) { // Sorted groups: segmented kernels
+          fsum_double_seg_impl(REAL(out), REAL(x), NULL, ng, starts, narm, nth);
+          Free(starts);
+        } else if(!FSUM_STRICT && gpart_init(&gp, INTEGER(g), ng, l, nth)) { // Many groups: partitioned aggregation
+          fsum_g_part_impl(REAL(out), REAL(x), NULL, REALSXP, ng, INTEGER(g), narm, &gp);
+          gpart_free(&gp);
+        } else if(gmode == GPAR_SERIAL) fsum_double_g_impl(REAL(out), REAL(x), ng, INTEGER(g), narm, l);
+        else fsum_double_g_omp_impl(REAL(out), REAL(x), ng, INTEGER(g), narm, l, nth, gmode, cuts);
         break;
       case INTSXP: {
         if(ng > 0) {
-          fsum_int_g_impl(INTEGER(out), INTEGER(x), ng, INTEGER(g), narm, l);
-          // If safe sub-column-level mutithreading can be developed...
-          // if(nth <= 1) fsum_int_g_impl(INTEGER(out), INTEGER(x), ng, INTEGER(g), narm, l);
-          // else fsum_int_g_omp_impl(INTEGER(out), INTEGER(x), ng, INTEGER(g), narm, l, nth);
+          if((starts = gseg_starts(INTEGER(g), ng, l))) {
+            int overflow = fsum_int_seg_impl(INTEGER(out), INTEGER(x), ng, starts, narm, nth);
+            Free(starts);
+            if(overflow) error(fsum_int_overflow_msg);
+          } else if(gpart_init(&gp, INTEGER(g), ng, l, nth)) {
+            int overflow = fsum_g_part_impl(INTEGER(out), INTEGER(x), NULL, INTSXP, ng, INTEGER(g), narm, &gp);
+            gpart_free(&gp);
+            if(overflow) error(fsum_int_overflow_msg);
+          } else if(gmode == GPAR_SERIAL) fsum_int_g_impl(INTEGER(out), INTEGER(x), ng, INTEGER(g), narm, l);
+          else fsum_int_g_omp_impl(INTEGER(out), INTEGER(x), ng, INTEGER(g), narm, l, nth, gmode, cuts);
         } else {
           double sum = nth <= 1 ? fsum_int_impl(INTEGER(x), narm, l) : fsum_int_omp_impl(INTEGER(x), narm, l, nth);
           if(sum > INT_MAX || sum <= INT_MIN) return ScalarReal(sum); // INT_MIN is NA_INTEGER
@@ -343,7 +766,14 @@ SEXP fsumC(SEXP x, SEXP Rng, SEXP g, SEXP w, SEXP Rnarm, SEXP Rnth) {
     if(ng == 0) {
       if(nth <= 1) fsum_weights_impl(REAL(out), px, pw, narm, l);
       else fsum_weights_omp_impl(REAL(out), px, pw, narm, l, nth);
-    } else fsum_weights_g_impl(REAL(out), px, ng, INTEGER(g), pw, narm, l);
+    } else if(!FSUM_STRICT && (starts = gseg_starts(INTEGER(g), ng, l))) {
+      fsum_double_seg_impl(REAL(out), px, pw, ng, starts, narm, nth);
+      Free(starts);
+    } else if(!FSUM_STRICT && gpart_init(&gp, INTEGER(g), ng, l, nth)) {
+      fsum_g_part_impl(REAL(out), px, pw, REALSXP, ng, INTEGER(g), narm, &gp);
+      gpart_free(&gp);
+    } else if(gmode == GPAR_SERIAL) fsum_weights_g_impl(REAL(out), px, ng, INTEGER(g), pw, narm, l);
+    else fsum_weights_g_omp_impl(REAL(out), px, ng, INTEGER(g), pw, narm, l, nth, gmode, cuts);
   }
   if(ATTRIB(x) != R_NilValue && !(isObject(x) && inherits(x, "ts")))
     copyMostAttrib(x, out); // For example "Units" objects...
@@ -362,6 +792,12 @@ SEXP fsummC(SEXP x, SEXP Rng, SEXP g, SEXP w, SEXP Rnarm, SEXP Rdrop, SEXP Rnth)
   if(l*col < 100000) nth = 1; // No gains from multithreading on small data
   if(ng && l != length(g)) error("length(g) must match nrow(x)");
   if(tx == LGLSXP) tx = INTSXP;
+  int gmode = GPAR_SERIAL, *cuts = NULL, *starts;
+  gpart gp;
+  if(ng > 0 && nth > 1 && col < nth) { // Too few columns for column-level parallelism: parallelize over rows
+    cuts = (int*)R_alloc(nth+1, sizeof(int));
+    gmode = gpar_plan(cuts, pg, ng, l, nth);
+  }
   SEXP out = PROTECT(allocVector((nwl && ng > 0) ? tx : REALSXP, ng == 0 ? col : col * ng));
   if(nwl) {
     switch(tx) {
@@ -377,7 +813,18 @@ SEXP fsummC(SEXP x, SEXP Rng, SEXP g, SEXP w, SEXP Rnarm, SEXP Rdrop, SEXP Rnth)
             for(int j = 0; j != col; ++j) fsum_double_omp_impl(pout + j, px + j*l, narm, l, nth);
           }
         } else {
-          if(nth <= 1 || col == 1) {
+          if(!FSUM_STRICT && (starts = gseg_starts(pg, ng, l))) { // Sorted groups: segmented kernels
+            if(nth > 1 && col >= nth) {
+              #pragma omp parallel for num_threads(nth)
+              for(int j = 0; j < col; ++j) fsum_double_seg_impl(pout + j*ng, px + j*l, NULL, ng, starts, narm, 1);
+            } else for(int j = 0; j != col; ++j) fsum_double_seg_impl(pout + j*ng, px + j*l, NULL, ng, starts, narm, nth);
+            Free(starts);
+          } else if(!FSUM_STRICT && gpart_init(&gp, pg, ng, l, nth)) { // Many groups: one partition for all columns
+            for(int j = 0; j != col; ++j) fsum_g_part_impl(pout + j*ng, px + j*l, NULL, REALSXP, ng, pg, narm, &gp);
+            gpart_free(&gp);
+          } else if(gmode != GPAR_SERIAL) {
+            for(int j = 0; j != col; ++j) fsum_double_g_omp_impl(pout + j*ng, px + j*l, ng, pg, narm, l, nth, gmode, cuts);
+          } else if(nth <= 1 || col == 1) {
             for(int j = 0; j != col; ++j) fsum_double_g_impl(pout + j*ng, px + j*l, ng, pg, narm, l);
           } else {
             if(nth > col) nth = col;
@@ -391,7 +838,22 @@ SEXP fsummC(SEXP x, SEXP Rng, SEXP g, SEXP w, SEXP Rnarm, SEXP Rdrop, SEXP Rnth)
         int *px = INTEGER(x);
         if(ng > 0) {
           int *pout = INTEGER(out);
-          if(nth <= 1 || col == 1) {
+          if((starts = gseg_starts(pg, ng, l))) {
+            int overflow = 0;
+            if(nth > 1 && col >= nth) {
+              #pragma omp parallel for num_threads(nth) reduction(|:overflow)
+              for(int j = 0; j < col; ++j) overflow |= fsum_int_seg_impl(pout + j*ng, px + j*l, ng, starts, narm, 1);
+            } else for(int j = 0; j != col; ++j) overflow |= fsum_int_seg_impl(pout + j*ng, px + j*l, ng, starts, narm, nth);
+            Free(starts);
+            if(overflow) error(fsum_int_overflow_msg);
+          } else if(gpart_init(&gp, pg, ng, l, nth)) {
+            int overflow = 0;
+            for(int j = 0; j != col && !overflow; ++j) overflow = fsum_g_part_impl(pout + j*ng, px + j*l, NULL, INTSXP, ng, pg, narm, &gp);
+            gpart_free(&gp);
+            if(overflow) error(fsum_int_overflow_msg);
+          } else if(gmode != GPAR_SERIAL) {
+            for(int j = 0; j != col; ++j) fsum_int_g_omp_impl(pout + j*ng, px + j*l, ng, pg, narm, l, nth, gmode, cuts);
+          } else if(nth <= 1 || col == 1) {
             for(int j = 0; j != col; ++j) fsum_int_g_impl(pout + j*ng, px + j*l, ng, pg, narm, l);
           } else {
             if(nth > col) nth = col;
@@ -459,7 +921,18 @@ SEXP fsummC(SEXP x, SEXP Rng, SEXP g, SEXP w, SEXP Rnarm, SEXP Rdrop, SEXP Rnth)
         for(int j = 0; j != col; ++j) fsum_weights_omp_impl(pout + j, px + j*l, pw, narm, l, nth);
       }
     } else {
-      if(nth <= 1 || col == 1) {
+      if(!FSUM_STRICT && (starts = gseg_starts(pg, ng, l))) {
+        if(nth > 1 && col >= nth) {
+          #pragma omp parallel for num_threads(nth)
+          for(int j = 0; j < col; ++j) fsum_double_seg_impl(pout + j*ng, px + j*l, pw, ng, starts, narm, 1);
+        } else for(int j = 0; j != col; ++j) fsum_double_seg_impl(pout + j*ng, px + j*l, pw, ng, starts, narm, nth);
+        Free(starts);
+      } else if(!FSUM_STRICT && gpart_init(&gp, pg, ng, l, nth)) {
+        for(int j = 0; j != col; ++j) fsum_g_part_impl(pout + j*ng, px + j*l, pw, REALSXP, ng, pg, narm, &gp);
+        gpart_free(&gp);
+      } else if(gmode != GPAR_SERIAL) {
+        for(int j = 0; j != col; ++j) fsum_weights_g_omp_impl(pout + j*ng, px + j*l, ng, pg, pw, narm, l, nth, gmode, cuts);
+      } else if(nth <= 1 || col == 1) {
         for(int j = 0; j != col; ++j) fsum_weights_g_impl(pout + j*ng, px + j*l, ng, pg, pw, narm, l);
       } else {
         if(nth > col) nth = col;
@@ -492,9 +965,10 @@ SEXP fsumlC(SEXP x, SEXP Rng, SEXP g, SEXP w, SEXP Rnarm, SEXP Rdrop, SEXP Rnth)
     return out;
   }
   SEXP out = PROTECT(allocVector(VECSXP, l)), *restrict pout = SEXPPTR(out), *restrict px = SEXPPTR(x);
-  if((ng > 0 && nth > 1 && l > 1) || (ng == 0 && nth > 1 && nth >= l)) {
+  // With groups and fewer columns than threads, fsumC() parallelizes over the rows of long columns
+  if((ng > 0 && nth > 1 && l > 1 && (l >= nth || length(px[0]) < 100000)) || (ng == 0 && nth > 1 && nth >= l)) {
     if(nth > l) nth = l;
-    SEXP Rnth1 = PROTECT(ScalarInteger(1)); ++nprotect; // Needed if ng == 0, otherwise double multithreading
+    SEXP Rnth1 = PROTECT(ScalarInteger(1)); ++nprotect; // Needed to avoid double multithreading
     #pragma omp parallel for num_threads(nth)
     for(int j = 0; j < l; ++j) pout[j] = fsumC(px[j], Rng, g, w, Rnarm, Rnth1);
   } else {
@@ -505,156 +979,3 @@ SEXP fsumlC(SEXP x, SEXP Rng, SEXP g, SEXP w, SEXP Rnarm, SEXP Rdrop, SEXP Rnth)
   UNPROTECT(nprotect);
   return out;
 }
-
-// If effective sub-column-level multithreading can be developed...
-// SEXP fsummC(SEXP x, SEXP Rng, SEXP g, SEXP w, SEXP Rnarm, SEXP Rdrop, SEXP Rnth) {
-//   SEXP dim = getAttrib(x, R_DimSymbol);
-//   if(isNull(dim)) error("x is not a matrix");
-//   int tx = TYPEOF(x), l = INTEGER(dim)[0], col = INTEGER(dim)[1], *restrict pg = INTEGER(g),
-//     ng = asInteger(Rng), // ng1 = ng == 0 ? 1 : ng,
-//     narm = asLogical(Rnarm), nprotect = 1, nwl = isNull(w),
-//     nth = asInteger(Rnth), cmth = nth > 1 && col >= nth;
-//   if (l < 1) return x; // Prevents seqfault for numeric(0) #101
-//   if(nth < 100000) nth = 1; // No gains from multithreading on small data
-//   if(ng && l != length(g)) error("length(g) must match nrow(x)");
-//   if(tx == LGLSXP) tx = INTSXP;
-//   SEXP out = PROTECT(allocVector((nwl && ng > 0) ? tx : REALSXP, ng == 0 ? col : col * ng));
-//   if(nwl) {
-//     switch(tx) {
-//     case REALSXP: {
-//       double *px = REAL(x), *pout = REAL(out);
-//       if(nth <= 1) { // No multithreading
-//         if(ng == 0) for(int j = 0; j != col; ++j) fsum_double_impl(pout + j, px + j*l, narm, l);
-//         else for(int j = 0; j != col; ++j) fsum_double_g_impl(pout + j*ng, px + j*l, ng, pg, narm, l);
-//       } else { // Multithreading
-//         if(ng == 0) {
-//           if(cmth) { // If high-dimensional: column-level parallelism
-// #pragma omp parallel for num_threads(nth)
-//             for(int j = 0; j < col; ++j) fsum_double_impl(pout + j, px + j*l, narm, l);
-//           } else {
-//             for(int j = 0; j != col; ++j) fsum_double_omp_impl(pout + j, px + j*l, narm, l, nth);
-//           }
-//         } else {
-//           if(cmth) { // If high-dimensional: column-level parallelism
-// #pragma omp parallel for num_threads(nth)
-//             for(int j = 0; j < col; ++j) fsum_double_g_impl(pout + j*ng, px + j*l, ng, pg, narm, l);
-//           } else {
-//             for(int j = 0; j != col; ++j) fsum_double_g_omp_impl(pout + j*ng, px + j*l, ng, pg, narm, l, nth);
-//           }
-//         }
-//       }
-//       break;
-//     }
-//     case INTSXP: {
-//       int *px = INTEGER(x);
-//       if(ng > 0) {
-//         int *pout = INTEGER(out);
-//         if(nth <= 1) {
-//           for(int j = 0; j != col; ++j) fsum_int_g_impl(pout + j*ng, px + j*l, ng, pg, narm, l);
-//         } else if(cmth) { // If high-dimensional: column-level parallelism
-// #pragma omp parallel for num_threads(nth)
-//           for(int j = 0; j < col; ++j) fsum_int_g_impl(pout + j*ng, px + j*l, ng, pg, narm, l);
-//         } else {
-//           for(int j = 0; j != col; ++j) fsum_int_g_omp_impl(pout + j*ng, px + j*l, ng, pg, narm, l, nth);
-//         }
-//       } else {
-//         double *pout = REAL(out);
-//         int anyoutl = 0;
-//         if(nth <= 1) {
-//           for(int j = 0; j != col; ++j) {
-//             double sumj = fsum_int_impl(px + j*l, narm, l);
-//             if(sumj > INT_MAX || sumj <= INT_MIN) anyoutl = 1;
-//             pout[j] = sumj;
-//           }
-//         } else if(cmth) { // If high-dimensional: column-level parallelism
-// #pragma omp parallel for num_threads(nth)
-//           for(int j = 0; j < col; ++j) {
-//             double sumj = fsum_int_impl(px + j*l, narm, l);
-//             if(sumj > INT_MAX || sumj <= INT_MIN) anyoutl = 1;
-//             pout[j] = sumj;
-//           }
-//         } else {
-//           for(int j = 0; j != col; ++j) {
-//             double sumj = fsum_int_omp_impl(px + j*l, narm, l, nth);
-//             if(sumj > INT_MAX || sumj <= INT_MIN) anyoutl = 1;
-//             pout[j] = sumj;
-//           }
-//         }
-//         if(anyoutl == 0) {
-//           SEXP iout = PROTECT(coerceVector(out, INTSXP));
-//           matCopyAttr(iout, x, Rdrop, ng);
-//           UNPROTECT(2);
-//           return iout;
-//         }
-//       }
-//       break;
-//     }
-//     default: error("Unsupported SEXP type");
-//     }
-//   } else {
-//     if(l != length(w)) error("length(w) must match nrow(x)");
-//     int tw = TYPEOF(w);
-//     SEXP xr, wr;
-//     double *px, *pw, *pout = REAL(out);
-//     if(tw != REALSXP) {
-//       if(tw != INTSXP && tw != LGLSXP) error("weigths must be double or integer");
-//       wr = PROTECT(coerceVector(w, REALSXP));
-//       pw = REAL(wr);
-//       ++nprotect;
-//     } else pw = REAL(w);
-//     if(tx != REALSXP) {
-//       if(tx != INTSXP) error("x must be double or integer");
-//       xr = PROTECT(coerceVector(x, REALSXP));
-//       px = REAL(xr);
-//       ++nprotect;
-//     } else px = REAL(x);
-//     if(nth <= 1) {
-//       for(int j = 0; j != col; ++j) fsum_weights_impl(pout + j*ng, px + j*l, ng, pg, pw, narm, l);
-//     } else if(cmth) {
-// #pragma omp parallel for num_threads(nth)
-//       for(int j = 0; j < col; ++j) fsum_weights_impl(pout + j*ng, px + j*l, ng, pg, pw, narm, l);
-//     } else {
-//       for(int j = 0; j != col; ++j) fsum_weights_omp_impl(pout + j*ng, px + j*l, ng, pg, pw, narm, l, nth);
-//     }
-//   }
-//   matCopyAttr(out, x, Rdrop, ng);
-//   UNPROTECT(nprotect);
-//   return out;
-// }
-
-// If effective sub-column-level multithreading can be developed...
-// SEXP fsumlC(SEXP x, SEXP Rng, SEXP g, SEXP w, SEXP Rnarm, SEXP Rdrop, SEXP Rnth) {
-//   int l = length(x), ng = asInteger(Rng), nth = asInteger(Rnth),
-//     nprotect = 1, cmth = nth > 1 && l >= nth;
-//   // TODO: Disable multithreading if overall data size is small?
-//   if(l < 1) return x; // needed ??
-//   SEXP Rnth1;
-//   if(cmth) {
-//     Rnth1 = PROTECT(ScalarInteger(1));
-//     ++nprotect;
-//   }
-//   if(ng == 0 && asLogical(Rdrop)) {
-//     SEXP out = PROTECT(allocVector(REALSXP, l)), *px = SEXPPTR(x);
-//     double *pout = REAL(out);
-//     if(cmth) { // If high-dimensional: column-level parallelism
-//       #pragma omp parallel for num_threads(nth)
-//       for(int j = 0; j < l; ++j) pout[j] = asReal(fsumC(px[j], Rng, g, w, Rnarm, Rnth1));
-//     } else {
-//       for(int j = 0; j != l; ++j) pout[j] = asReal(fsumC(px[j], Rng, g, w, Rnarm, Rnth));
-//     }
-//     setAttrib(out, R_NamesSymbol, getAttrib(x, R_NamesSymbol));
-//     UNPROTECT(nprotect);
-//     return out;
-//   }
-//   SEXP out = PROTECT(allocVector(VECSXP, l)), *pout = SEXPPTR(out), *px = SEXPPTR(x);
-//   if(cmth) {
-//     #pragma omp parallel for num_threads(nth)
-//     for(int j = 0; j < l; ++j) pout[j] = fsumC(px[j], Rng, g, w, Rnarm, Rnth1);
-//   } else {
-//     for(int j = 0; j != l; ++j) pout[j] = fsumC(px[j], Rng, g, w, Rnarm, Rnth);
-//   }
-//   // if(ng == 0) for(int j = 0; j != l; ++j) copyMostAttrib(px[j], pout[j]);
-//   DFcopyAttr(out, x, ng);
-//   UNPROTECT(nprotect);
-//   return out;
-// }
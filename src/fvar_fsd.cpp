@@ -1,14 +1,314 @@
 #include <Rcpp.h>
 using namespace Rcpp;
+#include "par_cols.h"
 
 // Note: More comments are in fvar.cpp (C++ folder, not on Github)
 
+extern "C" int *gseg_starts(const int *pg, const int ng, const int l); // small_helper.c
+
+// Multithreaded Welford ------------------------------------------------------------------------------------------
+// Partial moments (sum of weights n, mean and sum of squared deviations M2) of blocks of rows are computed with Welford's
+// algorithm and combined with the pairwise update of Chan, Golub and LeVeque (1979), which is equally stable. Without
+// groups, the rows are split into one chunk per thread or, with set_deterministic(TRUE), into chunks of VDET_CHUNK rows,
+// which are combined pairwise (binary tree), so that the result does not depend on nthreads. Each chunk runs WLANES
+// independent Welford recurrences, which are vectorised (the division in each update is the bottleneck of the serial loop).
+// With groups, sorted groups (gseg_starts()) are distributed across threads, giving the same result as the serial code.
+// Otherwise the rows are split as for fsum() (gpar_plan(), or with set_deterministic(TRUE) min(VDET_NBLOCK, l / ng) blocks),
+// and the group moments of the blocks are combined in block order. Matrices and lists are multithreaded across columns
+// if they have at least nthreads columns.
+
+extern "C" int fsum_deterministic; // set_deterministic(), fsum.c
+extern "C" int gpar_plan(int *cuts, const int *pg, const int ng, const int l, const int nth); // small_helper.c
+#define GPAR_SERIAL 0 // Modes returned by gpar_plan(), see collapse_c.h
+#define GPAR_SORTED 1
+#define GSEG_CHUNK 64
+#define VDET_CHUNK 8192 // As DET_CHUNK and DET_NBLOCK in fsum.c
+#define VDET_NBLOCK 64
+#define WLANES 8
+
+struct wmom { double n, mean, M2; };
+
+// With na.rm, n = 0 indicates that there were no (non-zero weighted) observations. Without na.rm, a missing M2 is propagated.
+static inline void wmom_merge(wmom &a, const wmom &b, bool narm) {
+  if(!narm && (std::isnan(a.M2) || std::isnan(b.M2))) {
+    a.M2 = NA_REAL;
+    return;
+  }
+  if(b.n == 0) return;
+  if(a.n == 0) {
+    a = b;
+    return;
+  }
+  const double n = a.n + b.n, d = b.mean - a.mean;
+  a.mean += d * (b.n / n);
+  a.M2 += b.M2 + d * d * (a.n * b.n / n);
+  a.n = n;
+}
+
+static inline double wmom_result(const wmom &m, bool narm, bool sd) {
+  if(std::isnan(m.M2) || (narm && m.n == 0)) return NA_REAL;
+  double res = m.M2 / (m.n - 1);
+  if(sd) res = sqrt(res);
+  return std::isnan(res) ? NA_REAL : res;
+}
+
+// Welford's algorithm over rows s...e-1, visiting them in the same order as the grouped loops below (backwards with na.rm,
+// forwards otherwise). pw (weights) is optional. M2 is missing if the result is NA.
+static wmom wmom_seg(const double *px, const double *pw, int s, int e, bool narm) {
+  double n = 0, mean = 0, M2 = 0, d1 = 0, wi = 1.0;
+  if(narm) {
+    M2 = NA_REAL;
+    for(int i = e; i-- != s; ) {
+      if(pw) wi = pw[i];
+      if(std::isnan(px[i]) || std::isnan(wi) || wi == 0) continue;
+      if(std::isnan(M2)) {
+        n = wi;
+        mean = px[i];
+        M2 = 0;
+      } else {
+        n += wi;
+        d1 = px[i]-mean;
+        mean += d1 * (wi / n);
+        M2 += wi * d1 * (px[i]-mean);
+      }
+    }
+  } else {
+    for(int i = s; i != e; ++i) {
+      if(pw) wi = pw[i];
+      if(std::isnan(px[i]) || std::isnan(wi)) {
+        M2 = NA_REAL;
+        break;
+      }
+      if(wi == 0) continue;
+      n += wi;
+      d1 = px[i]-mean;
+      mean += d1 * (wi / n);
+      M2 += wi * d1 * (px[i]-mean);
+    }
+  }
+  const wmom r = {n, mean, M2};
+  return r;
+}
+
+// Sorted groups (see gseg_starts()): Welford's algorithm over the contiguous rows of each group.
+static void fvarsd_seg_impl(double *pout, const double *px, const double *pw, int ng, const int *starts, bool narm, bool sd) {
+  for(int gr = 0; gr != ng; ++gr) pout[gr] = wmom_result(wmom_seg(px, pw, starts[gr], starts[gr+1], narm), narm, sd);
+}
+
+#define WLANE_UPDATE(k, i) {                                                   \
+  const double x = px[i], w = pw ? pw[i] : 1.0;                                \
+  const bool ok = narm ? (x == x && w == w && w != 0) : w != 0;                \
+  const double nk = n[k] + (ok ? w : 0.0), d = x - mean[k];                    \
+  const double mk = mean[k] + (ok ? d * (w / nk) : 0.0);                       \
+  M2[k] += ok ? w * d * (x - mk) : 0.0;                                         \
+  mean[k] = mk;                                                                \
+  n[k] = nk;                                                                   \
+}
+
+// Moments of rows start...end-1. Without na.rm missing values are not skipped but propagate to M2.
+static wmom wmom_range(const double *px, const double *pw, int start, int end, bool narm) {
+  double n[WLANES] = {0}, mean[WLANES] = {0}, M2[WLANES] = {0};
+  int i = start;
+  for(const int endl = start + (end - start) / WLANES * WLANES; i < endl; i += WLANES) {
+    #pragma omp simd
+    for(int k = 0; k < WLANES; ++k) WLANE_UPDATE(k, i+k)
+  }
+  for( ; i < end; ++i) WLANE_UPDATE(0, i)
+  wmom r = {n[0], mean[0], M2[0]};
+  for(int k = 1; k != WLANES; ++k) {
+    const wmom rk = {n[k], mean[k], M2[k]};
+    wmom_merge(r, rk, narm);
+  }
+  return r;
+}
+
+#undef WLANE_UPDATE
+
+static wmom wmom_pairwise(const wmom *p, int n, bool narm) {
+  if(n == 1) return p[0];
+  wmom a = wmom_pairwise(p, n / 2, narm);
+  const wmom b = wmom_pairwise(p + n / 2, n - n / 2, narm);
+  wmom_merge(a, b, narm);
+  return a;
+}
+
+// Grouped Welford over rows start...end-1, with the same updates as the grouped loops of fvarsdCpp() below. pn, pmean and
+// pM2 are decremented by 1, and initialized with n = 0, mean = 0 and M2 = NA (na.rm) or 0.
+static void wmom_g_acc(double *pn, double *pmean, double *pM2, const double *px, const double *pw, const int *pg,
+                       bool narm, int start, int end) {
+  double d1 = 0, wi = 1.0;
+  if(narm) {
+    for(int i = end; i-- != start; ) {
+      if(pw) wi = pw[i];
+      if(std::isnan(px[i]) || std::isnan(wi) || wi == 0) continue;
+      const int gi = pg[i];
+      if(std::isnan(pM2[gi])) {
+        pn[gi] = wi;
+        pmean[gi] = px[i];
+        pM2[gi] = 0;
+      } else {
+        pn[gi] += wi;
+        d1 = px[i]-pmean[gi];
+        pmean[gi] += d1 * (wi / pn[gi]);
+        pM2[gi] += wi * d1 * (px[i]-pmean[gi]);
+      }
+    }
+  } else {
+    for(int i = start; i != end; ++i) {
+      const int gi = pg[i];
+      if(std::isnan(pM2[gi])) continue;
+      if(pw) wi = pw[i];
+      if(std::isnan(px[i]) || std::isnan(wi)) {
+        pM2[gi] = NA_REAL;
+        continue;
+      }
+      if(wi == 0) continue;
+      pn[gi] += wi;
+      d1 = px[i]-pmean[gi];
+      pmean[gi] += d1 * (wi / pn[gi]);
+      pM2[gi] += wi * d1 * (px[i]-pmean[gi]);
+    }
+  }
+}
+
+static inline void wmom_g_init(double *pn, double *pmean, double *pM2, int ng, bool narm) {
+  std::fill(pn, pn + ng, 0.0);
+  std::fill(pmean, pmean + ng, 0.0);
+  std::fill(pM2, pM2 + ng, narm ? NA_REAL : 0.0);
+}
+
+// Moments of px (length l) without groups (ng = 0), or by groups pg (1-based), where starts are the group starts if g is
+// sorted (gseg_starts()) or NULL. pn, pmean and pM2 have length max(ng, 1), and pM2 is missing where the result is NA.
+// Also used by fscale.cpp.
+void fvarsd_moments(double *pn, double *pmean, double *pM2, const double *px, const double *pw, int ng, const int *pg,
+                    const int *starts, int l, bool narm, int nth) {
+  const bool det = fsum_deterministic;
+  if(nth < 1) nth = 1;
+  if(ng == 0) {
+    wmom m;
+    if(!det && (nth == 1 || l < nth * VDET_CHUNK)) m = wmom_seg(px, pw, 0, l, narm);
+    else {
+      const int nc = det ? (l - 1) / VDET_CHUNK + 1 : nth;
+      #define CHUNK_START(i) (det ? (i) * VDET_CHUNK : (int)((size_t)l * (i) / nc))
+      #define CHUNK_END(i) (det ? ((i) == nc-1 ? l : ((i)+1) * VDET_CHUNK) : (int)((size_t)l * ((i)+1) / nc))
+      std::vector<wmom> part(nc);
+      #pragma omp parallel for num_threads(nth) schedule(static) if(nth > 1 && nc > 1)
+      for(int i = 0; i < nc; ++i) part[i] = wmom_range(px, pw, CHUNK_START(i), CHUNK_END(i), narm);
+      #undef CHUNK_START
+      #undef CHUNK_END
+      m = wmom_pairwise(part.data(), nc, narm);
+      if(narm && m.n == 0) m.M2 = NA_REAL;
+    }
+    pn[0] = m.n;
+    pmean[0] = m.mean;
+    pM2[0] = m.M2;
+    return;
+  }
+  if(starts != NULL) { // Groups are independent: same result as serial
+    #pragma omp parallel for num_threads(nth) schedule(dynamic, GSEG_CHUNK) if(nth > 1)
+    for(int gr = 0; gr < ng; ++gr) {
+      const wmom m = wmom_seg(px, pw, starts[gr], starts[gr+1], narm);
+      pn[gr] = m.n;
+      pmean[gr] = m.mean;
+      pM2[gr] = m.M2;
+    }
+    return;
+  }
+  std::vector<int> cuts(nth+1);
+  int nb = 1, mode = GPAR_SERIAL;
+  if(det) {
+    nb = l / ng > VDET_NBLOCK ? VDET_NBLOCK : l / ng;
+    if(nb >= 2) {
+      cuts.resize(nb+1);
+      for(int t = 0; t <= nb; ++t) cuts[t] = (int)((size_t)l * t / nb);
+    } else nb = 1;
+  } else {
+    mode = gpar_plan(cuts.data(), pg, ng, l, nth);
+    if(mode != GPAR_SERIAL && mode != GPAR_SORTED) nb = nth; // GPAR_BUFFER: thread-local moments
+  }
+  if(nb == 1) {
+    wmom_g_init(pn, pmean, pM2, ng, narm);
+    if(mode == GPAR_SORTED) { // Each group falls into one thread's range of rows
+      #pragma omp parallel for num_threads(nth)
+      for(int t = 0; t < nth; ++t) wmom_g_acc(pn-1, pmean-1, pM2-1, px, pw, pg, narm, cuts[t], cuts[t+1]);
+    } else wmom_g_acc(pn-1, pmean-1, pM2-1, px, pw, pg, narm, 0, l);
+    return;
+  }
+  const size_t ngt = (size_t)ng * nb;
+  std::vector<double> n(ngt), mean(ngt), M2(ngt);
+  #pragma omp parallel for num_threads(nth) schedule(static)
+  for(int t = 0; t < nb; ++t) {
+    const size_t o = (size_t)t * ng;
+    wmom_g_init(n.data() + o, mean.data() + o, M2.data() + o, ng, narm);
+    wmom_g_acc(n.data() + o - 1, mean.data() + o - 1, M2.data() + o - 1, px, pw, pg, narm, cuts[t], cuts[t+1]);
+  }
+  #pragma omp parallel for num_threads(nth)
+  for(int i = 0; i < ng; ++i) {
+    wmom m = {n[i], mean[i], M2[i]};
+    if(narm && std::isnan(m.M2)) m.n = 0;
+    for(int t = 1; t < nb; ++t) {
+      const size_t ti = (size_t)t * ng + i;
+      wmom b = {n[ti], mean[ti], M2[ti]};
+      if(narm && std::isnan(b.M2)) b.n = 0;
+      wmom_merge(m, b, narm);
+    }
+    if(narm && m.n == 0) m.M2 = NA_REAL;
+    pn[i] = m.n;
+    pmean[i] = m.mean;
+    pM2[i] = m.M2;
+  }
+}
+
+// Variance / sd of px: pout has length max(ng, 1), arguments as for fvarsd_moments().
+static void fvarsd_par_impl(double *pout, const double *px, const double *pw, int ng, const int *pg, const int *starts,
+                            int l, bool narm, bool sd, int nth) {
+  const int nr = ng == 0 ? 1 : ng;
+  std::vector<double> n(nr), mean(nr), M2(nr);
+  fvarsd_moments(n.data(), mean.data(), M2.data(), px, pw, ng, pg, starts, l, narm, nth);
+  for(int i = 0; i != nr; ++i) {
+    const wmom m = {n[i], mean[i], M2[i]};
+    pout[i] = wmom_result(m, narm, sd);
+  }
+}
+
+// Columns of a matrix or list with the same weights and groups (see par_cols.h)
+static void fvarsd_par_cols(const par_cols& pc, int col, const double *pw, int ng, const int *pg, const int *starts,
+                            bool narm, bool sd, int nth) {
+  par_cols_apply(col, nth, [&](int j, int nthj) {
+    fvarsd_par_impl(pc.pouts[j], pc.pxs[j], pw, ng, pg, starts, pc.pl[j], narm, sd, nthj);
+  });
+}
+
 // [[Rcpp::export]]
 NumericVector fvarsdCpp(const NumericVector& x, int ng = 0, const IntegerVector& g = 0, const SEXP& gs = R_NilValue,
-                        const SEXP& w = R_NilValue, bool narm = true, bool stable_algo = true, bool sd = true) {
+                        const SEXP& w = R_NilValue, bool narm = true, bool stable_algo = true, bool sd = true, int nthreads = 1) {
   int l = x.size();
   if(l < 2) return Rf_ScalarReal(NA_REAL); // Prevents seqfault for numeric(0) #101
 
+  if(stable_algo && (nthreads > 1 || fsum_deterministic)) { // Multithreaded / deterministic Welford
+    if(ng > 0 && g.size() != l) stop("length(g) must match nrow(X)");
+    if(!Rf_isNull(w) && Rf_length(w) != l) stop("length(w) must match length(x)");
+    NumericVector out = no_init_vector(ng == 0 ? 1 : ng), wg = Rf_isNull(w) ? NumericVector(0) : NumericVector(w);
+    int *starts = ng > 0 ? gseg_starts(g.begin(), ng, l) : NULL;
+    fvarsd_par_impl(out.begin(), x.begin(), Rf_isNull(w) ? NULL : wg.begin(), ng, g.begin(), starts, l, narm, sd, nthreads);
+    if(starts != NULL) R_Free(starts);
+    if(ATTRIB(x) != R_NilValue && !(Rf_isObject(x) && Rf_inherits(x, "ts")))
+      Rf_copyMostAttrib(x, out);
+    return out;
+  }
+
+  if(stable_algo && ng > 0 && g.size() == l && (Rf_isNull(w) || Rf_length(w) == l)) { // Sorted groups: segmented kernel
+    NumericVector out = no_init_vector(ng), wg = Rf_isNull(w) ? NumericVector(0) : NumericVector(w);
+    int *starts = gseg_starts(g.begin(), ng, l);
+    if(starts != NULL) {
+      fvarsd_seg_impl(out.begin(), x.begin(), Rf_isNull(w) ? NULL : wg.begin(), ng, starts, narm, sd);
+      R_Free(starts);
+      if(ATTRIB(x) != R_NilValue && !(Rf_isObject(x) && Rf_inherits(x, "ts")))
+        Rf_copyMostAttrib(x, out);
+      return out;
+    }
+  }
+
   if(stable_algo) { // WELFORDS ONLINE METHOD ---------------------------------------------------------
     if(Rf_isNull(w)) { // No weights
       if(ng == 0) {
@@ -490,9 +790,43 @@ NumericVector fvarsdCpp(const NumericVector& x, int ng = 0, const IntegerVector&
 SEXP fvarsdmCpp(const NumericMatrix& x, int ng = 0, const IntegerVector& g = 0,
                 const SEXP& gs = R_NilValue, const SEXP& w = R_NilValue,
                 bool narm = true, bool stable_algo = true,
-                bool sd = true, bool drop = true) {
+                bool sd = true, bool drop = true, int nthreads = 1) {
   int l = x.nrow(), col = x.ncol();
 
+  if(stable_algo && (nthreads > 1 || fsum_deterministic)) { // Multithreaded / deterministic Welford
+    if(ng > 0 && g.size() != l) stop("length(g) must match nrow(X)");
+    if(!Rf_isNull(w) && Rf_length(w) != l) stop("length(w) must match nrow(X)");
+    NumericVector wg = Rf_isNull(w) ? NumericVector(0) : NumericVector(w);
+    const int nrg = ng == 0 ? 1 : ng;
+    NumericVector out = no_init_vector((size_t)nrg * col);
+    int *starts = ng > 0 ? gseg_starts(g.begin(), ng, l) : NULL;
+    par_cols pc;
+    par_cols_matrix(pc, out.begin(), x.begin(), l, col, nrg);
+    fvarsd_par_cols(pc, col, Rf_isNull(w) ? NULL : wg.begin(), ng, g.begin(), starts, narm, sd, nthreads);
+    if(starts != NULL) R_Free(starts);
+    if(ng == 0 && drop) Rf_setAttrib(out, R_NamesSymbol, colnames(x));
+    else {
+      Rf_dimgets(out, Dimension(nrg, col));
+      colnames(out) = colnames(x);
+      if(!Rf_isObject(x)) Rf_copyMostAttrib(x, out);
+    }
+    return out;
+  }
+
+  if(stable_algo && ng > 0 && g.size() == l && (Rf_isNull(w) || Rf_length(w) == l)) { // Sorted groups: segmented kernel
+    NumericMatrix out = no_init_matrix(ng, col);
+    NumericVector wg = Rf_isNull(w) ? NumericVector(0) : NumericVector(w);
+    int *starts = gseg_starts(g.begin(), ng, l);
+    if(starts != NULL) {
+      for(int j = 0; j != col; ++j)
+        fvarsd_seg_impl(out.begin() + (size_t)j * ng, x.begin() + (size_t)j * l, Rf_isNull(w) ? NULL : wg.begin(), ng, starts, narm, sd);
+      R_Free(starts);
+      colnames(out) = colnames(x);
+      if(!Rf_isObject(x)) Rf_copyMostAttrib(x, out);
+      return out;
+    }
+  }
+
   if(stable_algo) { // WELFORDS ONLINE METHOD -------------------------------------
     if(Rf_isNull(w)) { // No weights
       if(ng == 0) {
@@ -1058,9 +1392,60 @@ SEXP fvarsdmCpp(const NumericMatrix& x, int ng = 0, const IntegerVector& g = 0,
 SEXP fvarsdlCpp(const List& x, int ng = 0, const IntegerVector& g = 0,
                 const SEXP& gs = R_NilValue, const SEXP& w = R_NilValue,
                 bool narm = true, bool stable_algo = true,
-                bool sd = true, bool drop = true) {
+                bool sd = true, bool drop = true, int nthreads = 1) {
   int l = x.size();
 
+  if(stable_algo && (nthreads > 1 || fsum_deterministic)) { // Multithreaded / deterministic Welford
+    const int gss = g.size(), nrg = ng == 0 ? 1 : ng;
+    par_cols pc;
+    par_cols_list(pc, x, ng, gss, w, nrg, false);
+    NumericVector wg = Rf_isNull(w) ? NumericVector(0) : NumericVector(w);
+    List columns = pc.columns, out = pc.res;
+    int *starts = ng > 0 ? gseg_starts(g.begin(), ng, gss) : NULL;
+    fvarsd_par_cols(pc, l, Rf_isNull(w) ? NULL : wg.begin(), ng, g.begin(), starts, narm, sd, nthreads);
+    if(starts != NULL) R_Free(starts);
+    if(ng == 0) {
+      if(drop) {
+        NumericVector res = no_init_vector(l);
+        for(int j = l; j--; ) res[j] = pc.pouts[j][0];
+        Rf_setAttrib(res, R_NamesSymbol, Rf_getAttrib(x, R_NamesSymbol));
+        return res;
+      }
+      for(int j = l; j--; ) SHALLOW_DUPLICATE_ATTRIB(out[j], x[j]);
+      SHALLOW_DUPLICATE_ATTRIB(out, x);
+      Rf_setAttrib(out, R_RowNamesSymbol, Rf_ScalarInteger(1));
+      return out;
+    }
+    for(int j = l; j--; ) SHALLOW_DUPLICATE_ATTRIB(out[j], columns[j]);
+    SHALLOW_DUPLICATE_ATTRIB(out, x);
+    Rf_setAttrib(out, R_RowNamesSymbol, IntegerVector::create(NA_INTEGER, -ng));
+    return out;
+  }
+
+  if(stable_algo && ng > 0 && l > 0 && (Rf_isNull(w) || Rf_length(w) == g.size())) { // Sorted groups: segmented kernel
+    int gss = g.size();
+    bool ok = true;
+    for(int j = 0; j != l; ++j) { // Columns that would fail below are left to the general code
+      SEXP xj = VECTOR_ELT(x, j);
+      if(Rf_length(xj) != gss || !(TYPEOF(xj) == REALSXP || TYPEOF(xj) == INTSXP || TYPEOF(xj) == LGLSXP)) ok = false;
+    }
+    int *starts = ok ? gseg_starts(g.begin(), ng, gss) : NULL;
+    if(starts != NULL) {
+      List out(l);
+      NumericVector wg = Rf_isNull(w) ? NumericVector(0) : NumericVector(w);
+      for(int j = 0; j != l; ++j) {
+        NumericVector column = x[j], M2j = no_init_vector(ng);
+        fvarsd_seg_impl(M2j.begin(), column.begin(), Rf_isNull(w) ? NULL : wg.begin(), ng, starts, narm, sd);
+        SHALLOW_DUPLICATE_ATTRIB(M2j, column);
+        out[j] = M2j;
+      }
+      R_Free(starts);
+      SHALLOW_DUPLICATE_ATTRIB(out, x);
+      Rf_setAttrib(out, R_RowNamesSymbol, IntegerVector::create(NA_INTEGER, -ng));
+      return out;
+    }
+  }
+
   if(stable_algo) { // WELFORDS ONLINE METHOD -------------------------------------
     if(Rf_isNull(w)) { // No weights
       if(ng == 0) {
@@ -99,5 +99,6 @@
 // extern SEXP vswitchR(SEXP x, SEXP values, SEXP outputs, SEXP na, SEXP nthreads, SEXP chkenc);
 
 union uno { double d; unsigned int u[2]; };
+extern int group_nthreads; // set_group_threads(), defined in base_radixsort.c
 // bool isMixEnc(SEXP x);
 // SEXP enc2UTF8(SEXP x);
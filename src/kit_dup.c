@@ -6,6 +6,288 @@
 #include "kit.h"
 
 
+// ****************************************************************
+// Combined keys of multiple columns, used by dupVecIndexMulti()
+// ****************************************************************
+
+typedef struct { int tx; const void *p; } hcol;
+
+// Checks the columns of a list and fills cols with their types and data pointers
+static void getHashCols(hcol *restrict cols, SEXP X, const int l, const int n) {
+  for (int j = 0; j != l; ++j) {
+    SEXP col = VECTOR_ELT(X, j);
+    if(length(col) != n) error("Unequal length columns");
+    cols[j].tx = TYPEOF(col);
+    switch(cols[j].tx) {
+    case LGLSXP:
+    case INTSXP: cols[j].p = INTEGER(col); break;
+    case REALSXP: cols[j].p = REAL(col); break;
+    case CPLXSXP: cols[j].p = COMPLEX(col); break;
+    case STRSXP: cols[j].p = STRING_PTR(col); break;
+    default: error("Type %s is not supported.", type2char(cols[j].tx));
+    }
+  }
+}
+
+// Hashes the rows of the columns column by column: hv[i] = (hv[i] ^ key) * C, with the keys hashed as in dupVecIndex()
+#define HCOMB(h, key) (((h) ^ (unsigned int)(key)) * 2654435769U)
+
+static void hashCols(unsigned int *restrict hv, const hcol *restrict cols, const int l, const int n, const int K, const int nth) {
+  memset(hv, 0, sizeof(unsigned int) * n);
+  for (int j = 0; j != l; ++j) {
+    switch(cols[j].tx) {
+    case LGLSXP:
+    case INTSXP: {
+      const int *restrict px = cols[j].p;
+      #pragma omp parallel for num_threads(nth)
+      for (int i = 0; i < n; ++i) hv[i] = HCOMB(hv[i], px[i]);
+    } break;
+    case REALSXP: {
+      const double *restrict px = cols[j].p;
+      #pragma omp parallel for num_threads(nth)
+      for (int i = 0; i < n; ++i) {
+        union uno tpv;
+        tpv.d = px[i] + 0.0;
+        hv[i] = HCOMB(hv[i], tpv.u[0] + tpv.u[1]);
+      }
+    } break;
+    case CPLXSXP: {
+      const Rcomplex *restrict px = cols[j].p;
+      #pragma omp parallel for num_threads(nth)
+      for (int i = 0; i < n; ++i) {
+        union uno tpv;
+        Rcomplex tmp = px[i];
+        if(C_IsNA(tmp)) {
+          tmp.r = tmp.i = NA_REAL;
+        } else if (C_IsNaN(tmp)) {
+          tmp.r = tmp.i = R_NaN;
+        }
+        tpv.d = tmp.r + 0.0;
+        unsigned int u = tpv.u[0] ^ tpv.u[1];
+        tpv.d = tmp.i + 0.0;
+        u ^= tpv.u[0] ^ tpv.u[1];
+        hv[i] = HCOMB(hv[i], u);
+      }
+    } break;
+    case STRSXP: {
+      const SEXP *restrict px = cols[j].p;
+      #pragma omp parallel for num_threads(nth)
+      for (int i = 0; i < n; ++i) hv[i] = HCOMB(hv[i], (intptr_t) px[i] & 0xffffffff);
+    } break;
+    }
+  }
+  #pragma omp parallel for num_threads(nth)
+  for (int i = 0; i < n; ++i) hv[i] = HASH(hv[i], K);
+}
+
+#undef HCOMB
+
+// Compares rows a and b column by column, returning at the first difference
+static inline int rowsEqual(const hcol *restrict cols, const int l, const int a, const int b) {
+  for (int j = 0; j != l; ++j) {
+    switch(cols[j].tx) {
+    case LGLSXP:
+    case INTSXP:
+      if(((const int *)cols[j].p)[a] != ((const int *)cols[j].p)[b]) return 0;
+      break;
+    case REALSXP: {
+      const double *restrict px = cols[j].p;
+      if(!REQUAL(px[a], px[b])) return 0;
+    } break;
+    case CPLXSXP: {
+      const Rcomplex *restrict px = cols[j].p;
+      if(!CEQUAL(px[a], px[b])) return 0;
+    } break;
+    case STRSXP:
+      if(((const SEXP *)cols[j].p)[a] != ((const SEXP *)cols[j].p)[b]) return 0;
+      break;
+    }
+  }
+  return 1;
+}
+
+// ****************************************************************
+// Parallel hash grouping, used by dupVecIndex() and dupVecSecond()
+// ****************************************************************
+
+// With set_group_threads(nthreads > 1) and at least N_PAR_HASH elements, the hashed types (integers with a large range,
+// doubles, complex numbers and strings) are grouped in parallel. The table of size 2^K is split into 2^P partitions by the
+// top P bits of the hash value, and the rows are stably distributed to the partitions (a counting sort over chunks of x, as
+// in the parallel radix sort). Equal keys have equal hash values, thus each partition can be grouped by a different thread,
+// which only probes its own slice of the table. As the rows of a partition are visited in increasing order, each row is either
+// the first occurrence of its key (pans_i[i] = 0) or points to it (pans_i[i] = -(first + 1)). Group id's are then assigned
+// to the first occurrences in order of appearance, and copied to the other rows, which gives the same result as the serial
+// algorithm. If pidx is not NULL, the keys are the combinations of pidx (previous group id's) and x. If x is a list (tx = VECSXP),
+// the keys are its rows, described by the l columns in cols (pidx must then be NULL). The function returns
+// the number of groups, or -1 if a slice of the table ran full (heavily unequal partitions), in which case the caller
+// proceeds with the serial algorithm.
+
+#define N_PAR_HASH 100000
+#define CHUNK_START(t) (int)((int64_t)n * (t) / nth)
+
+// Probe the slice of the table of partition p for all rows of the partition.
+#define PROBE_PART(EQUAL)                                        \
+for (int k = pstart[p], end = pstart[p+1], i, j; k != end; ++k) { \
+  i = po[k];                                                     \
+  id = phv[i] & mask;                                            \
+  while((j = ph[id])) {                                          \
+    --j;                                                         \
+    if(EQUAL && (pidx == NULL || pidx[j] == pidx[i])) break;     \
+    id = (id + 1) & mask;                                        \
+  }                                                              \
+  if(ph[id]) pans_i[i] = -ph[id];                                \
+  else {                                                         \
+    if(++occ == S) { /* keep at least one empty slot */          \
+      _Pragma("omp atomic write")                                \
+      overflow = 1;                                              \
+      break;                                                     \
+    }                                                            \
+    ph[id] = i + 1;                                              \
+    pans_i[i] = 0;                                               \
+  }                                                              \
+}
+
+static int dupVecIndexPar(const int *restrict pidx, int *restrict pans_i, SEXP x, const int tx, const int n, const int K, const int nth,
+                          const hcol *restrict cols, const int l) {
+
+  int P = 0, overflow = 0;
+  while((1 << P) < 8 * nth && P < K - 6) ++P; // at least 8 partitions per thread, slices of at least 64 slots
+  const int np = 1 << P, shift = K - P;
+  const unsigned int S = 1U << shift, mask = S - 1;
+  unsigned int *restrict hv = (unsigned int*)Calloc(n, unsigned int);
+  int *restrict po = (int*)Calloc(n, int), *restrict pstart = (int*)Calloc(np + 1, int),
+      *restrict tcounts = (int*)Calloc(nth * np, int), *restrict h = (int*)Calloc((size_t)S * np, int);
+
+  // Hash values, as in the serial code (where adding 0.0 maps -0 to 0, so that 0 and -0 are hashed alike)
+  switch(tx) {
+  case INTSXP: {
+    const int *restrict px = INTEGER(x);
+    #pragma omp parallel for num_threads(nth)
+    for (int i = 0; i < n; ++i) hv[i] = pidx == NULL ? HASH(px[i], K) : HASH((unsigned)px[i] * (unsigned)pidx[i], K);
+  } break;
+  case REALSXP: {
+    const double *restrict px = REAL(x);
+    #pragma omp parallel for num_threads(nth)
+    for (int i = 0; i < n; ++i) {
+      union uno tpv;
+      tpv.d = px[i] + 0.0;
+      unsigned int u = tpv.u[0] + tpv.u[1];
+      hv[i] = pidx == NULL ? HASH(u, K) : HASH(u ^ pidx[i], K);
+    }
+  } break;
+  case CPLXSXP: {
+    const Rcomplex *restrict px = COMPLEX(x);
+    #pragma omp parallel for num_threads(nth)
+    for (int i = 0; i < n; ++i) {
+      union uno tpv;
+      Rcomplex tmp = px[i];
+      if(C_IsNA(tmp)) {
+        tmp.r = tmp.i = NA_REAL;
+      } else if (C_IsNaN(tmp)) {
+        tmp.r = tmp.i = R_NaN;
+      }
+      tpv.d = tmp.r + 0.0;
+      unsigned int u = tpv.u[0] ^ tpv.u[1];
+      tpv.d = tmp.i + 0.0;
+      u ^= tpv.u[0] ^ tpv.u[1];
+      hv[i] = pidx == NULL ? HASH(u, K) : HASH(u ^ pidx[i], K);
+    }
+  } break;
+  case STRSXP: {
+    const SEXP *restrict px = STRING_PTR(x);
+    #pragma omp parallel for num_threads(nth)
+    for (int i = 0; i < n; ++i) {
+      unsigned int u = (intptr_t) px[i] & 0xffffffff;
+      hv[i] = pidx == NULL ? HASH(u, K) : HASH(u ^ pidx[i], K);
+    }
+  } break;
+  case VECSXP: hashCols(hv, cols, l, n, K, nth); break;
+  default: error("Type %s is not supported.", type2char(tx)); // # nocov
+  }
+
+  // Stable distribution of the rows to the partitions
+  #pragma omp parallel for num_threads(nth)
+  for (int t = 0; t < nth; ++t) {
+    int *restrict cnt = tcounts + t * np;
+    for (int i = CHUNK_START(t), end = CHUNK_START(t+1); i < end; ++i) ++cnt[hv[i] >> shift];
+  }
+  for (int p = 0, pos = 0, c; p != np; ++p) {
+    pstart[p] = pos;
+    for (int t = 0; t != nth; ++t) {
+      c = tcounts[t * np + p];
+      tcounts[t * np + p] = pos;
+      pos += c;
+    }
+  }
+  pstart[np] = n;
+  #pragma omp parallel for num_threads(nth)
+  for (int t = 0; t < nth; ++t) {
+    int *restrict off = tcounts + t * np;
+    for (int i = CHUNK_START(t), end = CHUNK_START(t+1); i < end; ++i) po[off[hv[i] >> shift]++] = i;
+  }
+
+  // Grouping the partitions
+  #pragma omp parallel for num_threads(nth) schedule(dynamic)
+  for (int p = 0; p < np; ++p) {
+    int ovf;
+    #pragma omp atomic read
+    ovf = overflow;
+    if(ovf) continue; // another partition overflowed: the serial code is used instead
+    int *restrict ph = h + (size_t)p * S;
+    const unsigned int *restrict phv = hv;
+    unsigned int id, occ = 0;
+    switch(tx) {
+    case INTSXP: {
+      const int *restrict px = INTEGER(x);
+      PROBE_PART(px[j] == px[i])
+    } break;
+    case REALSXP: {
+      const double *restrict px = REAL(x);
+      PROBE_PART(REQUAL(px[j], px[i]))
+    } break;
+    case CPLXSXP: {
+      const Rcomplex *restrict px = COMPLEX(x);
+      PROBE_PART(CEQUAL(px[j], px[i]))
+    } break;
+    case STRSXP: {
+      const SEXP *restrict px = STRING_PTR(x);
+      PROBE_PART(px[j] == px[i])
+    } break;
+    case VECSXP: {
+      PROBE_PART(rowsEqual(cols, l, j, i))
+    } break;
+    }
+  }
+  Free(h); Free(po); Free(hv);
+  if(overflow) {
+    Free(pstart); Free(tcounts);
+    return -1;
+  }
+
+  // Numbering the first occurrences in order of appearance, and copying the id's to the other rows
+  int *restrict gstart = tcounts; // nth * np >= nth + 1 elements
+  #pragma omp parallel for num_threads(nth)
+  for (int t = 0; t < nth; ++t) {
+    int c = 0;
+    for (int i = CHUNK_START(t), end = CHUNK_START(t+1); i < end; ++i) c += pans_i[i] == 0;
+    gstart[t+1] = c;
+  }
+  gstart[0] = 0;
+  for (int t = 0; t != nth; ++t) gstart[t+1] += gstart[t];
+  #pragma omp parallel for num_threads(nth)
+  for (int t = 0; t < nth; ++t) {
+    int g = gstart[t];
+    for (int i = CHUNK_START(t), end = CHUNK_START(t+1); i < end; ++i) if(pans_i[i] == 0) pans_i[i] = ++g;
+  }
+  #pragma omp parallel for num_threads(nth)
+  for (int i = 0; i < n; ++i) if(pans_i[i] < 0) pans_i[i] = pans_i[-pans_i[i]-1];
+  int ng = gstart[nth];
+  Free(pstart); Free(tcounts);
+  return ng;
+}
+
+#undef PROBE_PART
+
 // ****************************************
 // This function groups a single vector
 // ****************************************
@@ -48,14 +330,20 @@ SEXP dupVecIndex(SEXP x) {
         M = (size_t)(x_max + 2);
         if(x_min == 0 || x_min == 1) tx = 1000;
         else x_max = NA_INTEGER;
-      } else M = (size_t)n;
+      } else if(group_nthreads > 1 && n >= N_PAR_HASH) goto bigint; // The division hash is serial
+      else M = (size_t)n;
     }
   } else if (tx == LGLSXP) {
     M = 3;
   } else error("Type %s is not supported.", type2char(tx)); // # nocov
-  int *restrict h = (int*)Calloc(M, int); // Table to save the hash values, table has size M
   SEXP ans_i = PROTECT(allocVector(INTSXP, n));
   int *restrict pans_i = INTEGER(ans_i), g = 0;
+  if(K && group_nthreads > 1 && n >= N_PAR_HASH) {
+    g = dupVecIndexPar(NULL, pans_i, x, tx, n, K, group_nthreads, NULL, 0);
+    if(g >= 0) goto done;
+    g = 0;
+  }
+  int *restrict h = (int*)Calloc(M, int); // Table to save the hash values, table has size M
   size_t id = 0;
   switch (tx) {
   case LGLSXP:
@@ -130,7 +418,7 @@ SEXP dupVecIndex(SEXP x) {
     const double *restrict px = REAL(x);
     union uno tpv;
     for (int i = 0; i != n; ++i) {
-      tpv.d = px[i]; // R_IsNA(px[i]) ? NA_REAL : (R_IsNaN(px[i]) ? R_NaN : px[i]);
+      tpv.d = px[i] + 0.0; // R_IsNA(px[i]) ? NA_REAL : (R_IsNaN(px[i]) ? R_NaN : px[i]);
       id = HASH(tpv.u[0] + tpv.u[1], K);
       while(h[id]) {
         if(REQUAL(px[h[id]-1], px[i])) {
@@ -156,9 +444,9 @@ SEXP dupVecIndex(SEXP x) {
       } else if (C_IsNaN(tmp)) {
         tmp.r = tmp.i = R_NaN;
       }
-      tpv.d = tmp.r;
+      tpv.d = tmp.r + 0.0;
       u = tpv.u[0] ^ tpv.u[1];
-      tpv.d = tmp.i;
+      tpv.d = tmp.i + 0.0;
       u ^= tpv.u[0] ^ tpv.u[1];
       id = HASH(u, K);
       while(h[id]) {
@@ -191,6 +479,7 @@ SEXP dupVecIndex(SEXP x) {
   } break;
   }
   Free(h);
+  done:;
   SEXP ngroups_sym = install("N.groups");
   setAttrib(ans_i, ngroups_sym, ScalarInteger(g));
   UNPROTECT(1);
@@ -294,7 +583,7 @@ SEXP dupVecIndexKeepNA(SEXP x) {
         pans_i[i] = NA_INTEGER;
         continue;
       }
-      tpv.d = px[i];
+      tpv.d = px[i] + 0.0;
       id = HASH(tpv.u[0] + tpv.u[1], K);
       while(h[id]) {
         if(REQUAL(px[h[id]-1], px[i])) {
@@ -319,9 +608,9 @@ SEXP dupVecIndexKeepNA(SEXP x) {
         pans_i[i] = NA_INTEGER;
         continue;
       }
-      tpv.d = tmp.r;
+      tpv.d = tmp.r + 0.0;
       u = tpv.u[0] ^ tpv.u[1];
-      tpv.d = tmp.i;
+      tpv.d = tmp.i + 0.0;
       u ^= tpv.u[0] ^ tpv.u[1];
       id = HASH(u, K);
       while(h[id]) {
@@ -397,6 +686,10 @@ int dupVecSecond(int *restrict pidx, int *restrict pans_i, SEXP x, const int n,
   } else if (tx == LGLSXP) {
     M = (size_t)ng * 3 + 1;
   } else error("Type %s is not supported.", type2char(tx)); // # nocov
+  if(tx != 1000 && tx != LGLSXP && group_nthreads > 1 && n >= N_PAR_HASH) {
+    int gp = dupVecIndexPar(pidx, pans_i, x, tx, n, K, group_nthreads, NULL, 0);
+    if(gp >= 0) return gp;
+  }
   int *restrict h = (int*)Calloc(M, int), g = 0, hid = 0; // Table to save the hash values, table has size M
   size_t id = 0;
   switch (tx) {
@@ -451,7 +744,7 @@ int dupVecSecond(int *restrict pidx, int *restrict pans_i, SEXP x, const int n,
     const double *restrict px = REAL(x);
     union uno tpv;
     for (int i = 0; i != n; ++i) {
-      tpv.d = px[i]; // R_IsNA(px[i]) ? NA_REAL : (R_IsNaN(px[i]) ? R_NaN :px[i]);
+      tpv.d = px[i] + 0.0; // R_IsNA(px[i]) ? NA_REAL : (R_IsNaN(px[i]) ? R_NaN :px[i]);
       id = HASH((tpv.u[0] + tpv.u[1]) ^ pidx[i], K) + pidx[i]; // Note: This is much faster than just adding pidx[i] to the hash value...
       while(h[id]) { // Problem: This value might be seen before, but not in combination with that pidx value...
         hid = h[id]-1; // The issue here is that REQUAL(px[hid], px[i]) could be true but pidx[hid] == pidx[i] fails, although the same combination of px and pidx could be seen earlier before...
@@ -478,9 +771,9 @@ int dupVecSecond(int *restrict pidx, int *restrict pans_i, SEXP x, const int n,
       } else if (C_IsNaN(tmp)) {
         tmp.r = tmp.i = R_NaN;
       }
-      tpv.d = tmp.r;
+      tpv.d = tmp.r + 0.0;
       u = tpv.u[0] ^ tpv.u[1];
-      tpv.d = tmp.i;
+      tpv.d = tmp.i + 0.0;
       u ^= tpv.u[0] ^ tpv.u[1];
       id = HASH(u ^ pidx[i], K) + pidx[i];
       while(h[id]) {
@@ -518,21 +811,269 @@ int dupVecSecond(int *restrict pidx, int *restrict pans_i, SEXP x, const int n,
   return g;
 }
 
+// ******************************************************************
+// This function groups multiple vectors (the columns of a list) at once
+// ******************************************************************
+
+// The rows are hashed column by column into a single table of size M >= 2n, and compared column by column
+// (rowsEqual()), stopping at the first column that differs. This needs one pass over each column plus one pass over
+// the table, instead of a full rehash for each additional column as with dupVecSecond().
+SEXP dupVecIndexMulti(SEXP X) {
+  const int l = length(X), n = length(VECTOR_ELT(X, 0));
+  hcol *restrict cols = (hcol*)R_alloc(l, sizeof(hcol));
+  getHashCols(cols, X, l, n);
+  int K = 8, g = 0;
+  size_t M = 256, id = 0;
+  const size_t n2 = 2U * (size_t) n;
+  while (M < n2) {
+    M *= 2;
+    K++;
+  }
+  SEXP ans_i = PROTECT(allocVector(INTSXP, n));
+  int *restrict pans_i = INTEGER(ans_i);
+  if(group_nthreads > 1 && n >= N_PAR_HASH) {
+    g = dupVecIndexPar(NULL, pans_i, X, VECSXP, n, K, group_nthreads, cols, l);
+    if(g >= 0) goto done;
+    g = 0;
+  }
+  unsigned int *restrict hv = (unsigned int*)Calloc(n, unsigned int);
+  hashCols(hv, cols, l, n, K, 1);
+  int *restrict h = (int*)Calloc(M, int); // Table to save the hash values, table has size M
+  for (int i = 0; i != n; ++i) {
+    id = hv[i];
+    while(h[id]) {
+      if(rowsEqual(cols, l, h[id]-1, i)) {
+        pans_i[i] = pans_i[h[id]-1];
+        goto mbl;
+      }
+      if(++id >= M) id %= M; // # nocov
+    }
+    h[id] = i + 1;
+    pans_i[i] = ++g;
+    mbl:;
+  }
+  Free(h); Free(hv);
+  done:;
+  setAttrib(ans_i, install("N.groups"), ScalarInteger(g));
+  UNPROTECT(1);
+  return ans_i;
+}
+
+// ****************************************************************
+// Grouping cache for single vectors, used by groupVec() and groupAtVec()
+// ****************************************************************
+
+// With set_group_cache(size > 0), the group id's (and starts and sizes) of atomic vectors with at least N_CACHE elements
+// are saved in a cache of 'size' entries, which are replaced in turn. Entries are weak references keyed on the vector
+// itself, thus they disappear with the vector. An entry is only used if the data pointer, length and type of the vector
+// are unchanged and a checksum of the data (over all elements) still matches, so that modifications by reference (e.g.
+// with setv() or data.table::set()) invalidate it. On a hit, the cached id's are copied into a new vector (the result is
+// often modified by reference, e.g. when creating a factor), which is much faster than grouping again.
+// Slots of the cache list: 0: id's (with "N.groups" attribute), 1: starts, 2: group sizes (if !keepna), 3: gcache_meta.
+
+#define N_CACHE 100000
+
+typedef struct {
+  const void *ptr;
+  R_xlen_t n;
+  int tx, keepna;
+  uint64_t checksum;
+} gcache_meta;
+
+static SEXP gcache = NULL, gstats = NULL; // preserved lists of weak references
+static int gcache_size = 0, gcache_next = 0, gstats_next = 0;
+
+SEXP setgroupcacheC(SEXP x) {
+  int old = gcache_size, size = asInteger(x);
+  if(size == NA_INTEGER || size < 0) error("size must be a non-negative integer");
+  if(gcache != NULL) {
+    R_ReleaseObject(gcache);
+    R_ReleaseObject(gstats);
+    gcache = gstats = NULL;
+  }
+  if(size > 0) {
+    gcache = allocVector(VECSXP, size);
+    R_PreserveObject(gcache);
+    gstats = allocVector(VECSXP, size);
+    R_PreserveObject(gstats);
+  }
+  gcache_size = size;
+  gcache_next = gstats_next = 0;
+  return ScalarInteger(old);
+}
+
+static const void *gcache_dataptr(SEXP x) {
+  switch(TYPEOF(x)) {
+  case LGLSXP: return LOGICAL(x);
+  case INTSXP: return INTEGER(x);
+  case REALSXP: return REAL(x);
+  case CPLXSXP: return COMPLEX(x);
+  case STRSXP: return STRING_PTR(x);
+  default: error("Type %s is not supported.", type2char(TYPEOF(x))); // # nocov
+  }
+  return NULL; // # nocov
+}
+
+// Position-dependent checksum over the 32-bit words of the data, summed (thus computable in any order)
+static uint64_t gcache_checksum(SEXP x) {
+  const uint32_t *restrict pw = gcache_dataptr(x);
+  const int64_t nw = (int64_t)length(x) * (TYPEOF(x) == STRSXP ? sizeof(SEXP) : TYPEOF(x) == CPLXSXP ? sizeof(Rcomplex) :
+                     TYPEOF(x) == REALSXP ? sizeof(double) : sizeof(int)) / sizeof(uint32_t);
+  uint64_t s = 0;
+  #pragma omp parallel for num_threads(group_nthreads) reduction(+:s)
+  for (int64_t k = 0; k < nw; ++k) {
+    uint64_t h = ((uint64_t)k << 32 | pw[k]) * 0x9E3779B97F4A7C15ULL;
+    s += h ^ (h >> 29);
+  }
+  return s;
+}
+
+// Looks up x in the cache, returning the cache entry or R_NilValue
+static SEXP gcache_get(SEXP x, const int keepna) {
+  for (int s = 0; s != gcache_size; ++s) {
+    SEXP wr = VECTOR_ELT(gcache, s);
+    if(wr == R_NilValue || R_WeakRefKey(wr) != x) continue;
+    SEXP val = R_WeakRefValue(wr);
+    const gcache_meta *m = (const gcache_meta *) RAW(VECTOR_ELT(val, 3));
+    if(m->keepna != keepna) continue;
+    if(m->ptr == gcache_dataptr(x) && m->n == xlength(x) && m->tx == TYPEOF(x) && m->checksum == gcache_checksum(x)) return val;
+    SET_VECTOR_ELT(gcache, s, R_NilValue); // x was modified
+    return R_NilValue;
+  }
+  return R_NilValue;
+}
+
+// Groups a vector using the cache: keepna = 0 uses dupVecIndex(), keepna = 1 dupVecIndexKeepNA()
+static SEXP gcache_group(SEXP x, const int keepna, const int start, const int size) {
+  SEXP sym_ng = install("N.groups"), val = gcache_get(x, keepna), ids;
+  const int n = length(x);
+  if(val == R_NilValue) {
+    SEXP idx = PROTECT(keepna ? dupVecIndexKeepNA(x) : dupVecIndex(x));
+    const int ng = asInteger(getAttrib(idx, sym_ng)), *pidx = INTEGER(idx);
+    val = PROTECT(allocVector(VECSXP, 4));
+    SET_VECTOR_ELT(val, 0, ids = allocVector(INTSXP, n));
+    memcpy(INTEGER(ids), pidx, sizeof(int) * n);
+    setAttrib(ids, sym_ng, ScalarInteger(ng));
+    SEXP st, gs = R_NilValue;
+    SET_VECTOR_ELT(val, 1, st = allocVector(INTSXP, ng));
+    int *pst = INTEGER(st);
+    memset(pst, 0, sizeof(int) * ng); --pst;
+    if(keepna) {
+      for(int i = 0, k = 0; i != n; ++i) {
+        if(pidx[i] != NA_INTEGER && pst[pidx[i]] == 0) {
+          pst[pidx[i]] = i + 1;
+          if(++k == ng) break;
+        }
+      }
+    } else {
+      SET_VECTOR_ELT(val, 2, gs = allocVector(INTSXP, ng));
+      int *pgs = INTEGER(gs);
+      memset(pgs, 0, sizeof(int) * ng); --pgs;
+      for(int i = 0; i != n; ++i) {
+        ++pgs[pidx[i]];
+        if(pst[pidx[i]] == 0) pst[pidx[i]] = i + 1;
+      }
+    }
+    SEXP meta;
+    SET_VECTOR_ELT(val, 3, meta = allocVector(RAWSXP, sizeof(gcache_meta)));
+    gcache_meta *m = (gcache_meta *) RAW(meta);
+    m->ptr = gcache_dataptr(x);
+    m->n = xlength(x);
+    m->tx = TYPEOF(x);
+    m->keepna = keepna;
+    m->checksum = gcache_checksum(x);
+    SET_VECTOR_ELT(gcache, gcache_next, R_MakeWeakRef(x, val, R_NilValue, FALSE));
+    if(++gcache_next == gcache_size) gcache_next = 0;
+    if(start) setAttrib(idx, install("starts"), duplicate(st));
+    if(size && !keepna) setAttrib(idx, install("group.sizes"), duplicate(gs));
+    UNPROTECT(2);
+    return idx;
+  }
+  PROTECT(val);
+  ids = VECTOR_ELT(val, 0);
+  SEXP res = PROTECT(allocVector(INTSXP, n));
+  memcpy(INTEGER(res), INTEGER(ids), sizeof(int) * n);
+  setAttrib(res, sym_ng, ScalarInteger(asInteger(getAttrib(ids, sym_ng))));
+  if(start) setAttrib(res, install("starts"), duplicate(VECTOR_ELT(val, 1)));
+  if(size && !keepna) setAttrib(res, install("group.sizes"), duplicate(VECTOR_ELT(val, 2)));
+  UNPROTECT(2);
+  return res;
+}
+
+// Per-group statistics cache
+// With set_group_cache(size > 0), the group sizes of integer group id's (the 'group.id' of a 'GRP' object or a factor)
+// are also kept, in another 'size' entries. They are saved by the first computation that obtains them over the complete
+// data (see BW_par_cols() in fbetween_fwithin.cpp), and spare later calls with the same groups the counting of the group
+// sizes, which writes to an ng-sized array at random positions. Entries are weak references keyed on the group id's.
+// As group id's can be modified by reference (e.g. with setv()), they are validated like cached grouping vectors above,
+// by data pointer, length and checksum, whose (sequential and multithreaded) pass is cheaper than counting with many groups.
+// Slots of the entries: 0: group sizes (double, length ng), 1: gstats_meta.
+
+typedef struct {
+  const void *gptr;
+  R_xlen_t n;
+  int ng;
+  uint64_t checksum;
+} gstats_meta;
+
+int gstats_active(void) {
+  return gcache_size > 0;
+}
+
+// Returns the cached group sizes for group id's g (ng groups), or R_NilValue
+SEXP gstats_get(SEXP g, const int ng) {
+  if(gcache_size == 0 || TYPEOF(g) != INTSXP) return R_NilValue;
+  for (int s = 0; s != gcache_size; ++s) {
+    SEXP wr = VECTOR_ELT(gstats, s);
+    if(wr == R_NilValue || R_WeakRefKey(wr) != g) continue;
+    SEXP val = R_WeakRefValue(wr);
+    const gstats_meta *m = (const gstats_meta *) RAW(VECTOR_ELT(val, 1));
+    if(m->gptr == INTEGER(g) && m->n == xlength(g) && m->ng == ng && m->checksum == gcache_checksum(g)) return VECTOR_ELT(val, 0);
+    SET_VECTOR_ELT(gstats, s, R_NilValue); // g was modified
+  }
+  return R_NilValue;
+}
+
+// Saves the group sizes pstat (length ng) for group id's g
+void gstats_put(SEXP g, const int ng, const double *pstat) {
+  if(gcache_size == 0 || TYPEOF(g) != INTSXP) return;
+  SEXP val = PROTECT(allocVector(VECSXP, 2)), stat, meta;
+  SET_VECTOR_ELT(val, 0, stat = allocVector(REALSXP, ng));
+  memcpy(REAL(stat), pstat, sizeof(double) * ng);
+  SET_VECTOR_ELT(val, 1, meta = allocVector(RAWSXP, sizeof(gstats_meta)));
+  gstats_meta *m = (gstats_meta *) RAW(meta);
+  m->gptr = INTEGER(g);
+  m->n = xlength(g);
+  m->ng = ng;
+  m->checksum = gcache_checksum(g);
+  SET_VECTOR_ELT(gstats, gstats_next, R_MakeWeakRef(g, val, R_NilValue, FALSE));
+  if(++gstats_next == gcache_size) gstats_next = 0;
+  UNPROTECT(1);
+}
+
+#define GCACHE_USE(x) (gcache_size > 0 && TYPEOF(x) != VECSXP && length(x) >= N_CACHE)
+
 // ************************************************************************
 // This function brings everything together for vectors or lists of vectors
 // ************************************************************************
 SEXP groupVec(SEXP X, SEXP starts, SEXP sizes) {
 
-  int l = length(X), islist = TYPEOF(X) == VECSXP,
+  int l = length(X), islist = TYPEOF(X) == VECSXP, iter = islist && l > 1,
     start = asLogical(starts), size = asLogical(sizes), nprotect = 0;
+  if(!(islist && l > 1) && GCACHE_USE(islist ? VECTOR_ELT(X, 0) : X)) return gcache_group(islist ? VECTOR_ELT(X, 0) : X, 0, start, size);
   // Better not exceptions to fundamental algorithms, when a couple of user-level functions return qG objects...
   // if(islist == 0 && OBJECT(X) != 0 && inherits(X, "qG") && inherits(X, "na.included")) return X; // return "qG" objects
-  SEXP idx = islist ? dupVecIndex(VECTOR_ELT(X, 0)) : dupVecIndex(X);
-  if(!(islist && l > 1) && start == 0 && size == 0) return idx; // l == 1 &&
+  // Multiple columns are hashed together, unless all are factors / qG / logical, which dupVecSecond() combines by direct indexing
+  for (int j = 0; iter && j < l; ++j) {
+    SEXP col = VECTOR_ELT(X, j);
+    if(!(TYPEOF(col) == LGLSXP || isFactor(col) || (TYPEOF(col) == INTSXP && inherits(col, "qG")))) iter = 0;
+  }
+  SEXP idx = (islist && l > 1 && !iter) ? dupVecIndexMulti(X) : islist ? dupVecIndex(VECTOR_ELT(X, 0)) : dupVecIndex(X);
+  if(!iter && start == 0 && size == 0) return idx; // l == 1 &&
   PROTECT(idx); ++nprotect;
   SEXP sym_ng = install("N.groups"), res;
   int ng = asInteger(getAttrib(idx, sym_ng)), n = length(idx);
-  if(islist && l > 1) {
+  if(iter) {
     SEXP ans = PROTECT(allocVector(INTSXP, n)); ++nprotect;
     int i = 1, *pidx = INTEGER(idx), *pans = INTEGER(ans);
     for( ; i < l; ++i) {
@@ -589,6 +1130,7 @@ SEXP groupVec(SEXP X, SEXP starts, SEXP sizes) {
 SEXP groupAtVec(SEXP X, SEXP starts, SEXP naincl) {
 
   int start = asLogical(starts), nain = asLogical(naincl);
+  if(GCACHE_USE(X)) return gcache_group(X, !nain, start, 0);
   // Note: These functions will give errors for unsupported types...
   SEXP idx = nain ? dupVecIndex(X) : dupVecIndexKeepNA(X);
   if(start == 0) return idx;
@@ -716,7 +1258,7 @@ SEXP funiqueC(SEXP x) {
     const double *restrict px = REAL(x);
     union uno tpv;
     for (int i = 0; i != n; ++i) {
-      tpv.d = px[i];
+      tpv.d = px[i] + 0.0;
       id = HASH(tpv.u[0] + tpv.u[1], K);
       while(h[id]) {
         if(REQUAL(px[h[id]-1], px[i])) goto rbl;
@@ -744,9 +1286,9 @@ SEXP funiqueC(SEXP x) {
       } else if (C_IsNaN(tmp)) {
         tmp.r = tmp.i = R_NaN;
       }
-      tpv.d = tmp.r;
+      tpv.d = tmp.r + 0.0;
       u = tpv.u[0] ^ tpv.u[1];
-      tpv.d = tmp.i;
+      tpv.d = tmp.i + 0.0;
       u ^= tpv.u[0] ^ tpv.u[1];
       id = HASH(u, K);
       while(h[id]) {
@@ -0,0 +1,63 @@
+#ifndef COLLAPSE_PAR_COLS_H
+#define COLLAPSE_PAR_COLS_H
+
+#include <Rcpp.h>
+#include <vector>
+
+// Column dispatch of the multithreaded engines of fvar_fsd.cpp, fscale.cpp and fbetween_fwithin.cpp: matrix columns
+// and list elements are described by pointers to their data (pxs), their lengths (pl) and pointers to their results
+// (pouts). par_cols_apply() computes them in parallel across columns if there are at least nth, and otherwise one
+// after another with nth threads each (for row-level parallelism within the column).
+struct par_cols {
+  std::vector<double *> pouts;
+  std::vector<const double *> pxs;
+  std::vector<int> pl;
+  Rcpp::List columns, res; // Lists: the columns coerced to double, and the results (protected while computing)
+};
+
+template <typename F>
+inline void par_cols_apply(const int col, int nth, F fun) {
+  if(nth < 1) nth = 1;
+  if(col >= nth) {
+    #pragma omp parallel for num_threads(nth) schedule(dynamic) if(nth > 1)
+    for(int j = 0; j < col; ++j) fun(j, 1);
+  } else {
+    for(int j = 0; j != col; ++j) fun(j, nth);
+  }
+}
+
+// Columns of a matrix px with l rows, with results of nro rows in pout
+inline void par_cols_matrix(par_cols& pc, double *pout, const double *px, const int l, const int col, const int nro) {
+  pc.pouts.resize(col);
+  pc.pxs.resize(col);
+  pc.pl.assign(col, l);
+  for(int j = 0; j != col; ++j) {
+    pc.pouts[j] = pout + (size_t)j * nro;
+    pc.pxs[j] = px + (size_t)j * l;
+  }
+}
+
+// Columns of a list x, coerced to double, with results of length nro (0 for the length of the column) or, with set = TRUE,
+// written into the columns. The lengths are checked against the grouping vector (ng > 0, of length gss) or the weights.
+inline void par_cols_list(par_cols& pc, const Rcpp::List& x, const int ng, const int gss, const SEXP& w, const int nro, const bool set) {
+  const int l = x.size(), wgs = Rf_length(w);
+  if(ng > 0 && !Rf_isNull(w) && wgs != gss) Rcpp::stop("length(w) must match length(g)");
+  pc.columns = Rcpp::List(l);
+  pc.res = Rcpp::List(l);
+  pc.pouts.resize(l);
+  pc.pxs.resize(l);
+  pc.pl.resize(l);
+  for(int j = 0; j != l; ++j) {
+    if(set && TYPEOF(VECTOR_ELT(x, j)) != REALSXP) Rcpp::stop("set = TRUE requires all columns to be of type double");
+    Rcpp::NumericVector column = x[j], outj = set ? column : Rcpp::NumericVector(Rcpp::no_init_vector(nro > 0 ? nro : column.size()));
+    if(ng > 0 && column.size() != gss) Rcpp::stop("length(g) must match nrow(X)");
+    if(ng == 0 && !Rf_isNull(w) && column.size() != wgs) Rcpp::stop("length(w) must match nrow(X)");
+    pc.columns[j] = column;
+    pc.res[j] = outj;
+    pc.pxs[j] = column.begin();
+    pc.pouts[j] = outj.begin();
+    pc.pl[j] = column.size();
+  }
+}
+
+#endif